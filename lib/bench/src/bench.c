@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "bench.h"
+#include "metrics.h"
+#include "task_plan.h"
+#include "webserver.h"
+#include "mongoose.h"
+
+typedef struct
+{
+  const char *name;
+  BenchKernel_t kernel;
+  void *arg;
+  uint8_t flags;
+} BenchEntry_t;
+
+#define BENCH_IDLE 0
+#define BENCH_RUNNING 1
+#define BENCH_DONE 2
+
+// One run in flight: the web thread fills it in, the bench task runs it and
+// the web thread sends the report when it polls the waiting connection
+typedef struct
+{
+  struct mg_connection *nc;
+  mg_event_handler_t handler;
+  char only[32];
+  volatile uint8_t state;
+  int length;
+  char report[BENCH_REPORT_SIZE];
+} BenchRequest_t;
+
+static BenchConfig_t *config;
+static BenchEntry_t entries[BENCH_MAX_KERNELS];
+static int entryCount;
+static portMUX_TYPE registryLock = portMUX_INITIALIZER_UNLOCKED;
+static WebRequestHandler_t benchHandler;
+static BenchRequest_t request;
+static TaskHandle_t benchTaskHandle;
+
+static void benchCallback(struct mg_connection *nc, struct http_message *hm);
+static void benchTask(void *arg);
+
+void benchInit(BenchConfig_t *info)
+{
+  config = info;
+  memset(&request, 0, sizeof(request));
+
+  benchTaskHandle = taskPlanCreate(TASK_ROLE_TELEMETRY, benchTask, "benchTask", NULL);
+
+  benchHandler.callback = &benchCallback;
+  benchHandler.path = "/bench";
+  benchHandler.request = HTTP_GET;
+  webserverRegister(&benchHandler);
+}
+
+void benchRegister(const char *name, BenchKernel_t kernel, void *arg, uint8_t flags)
+{
+  portENTER_CRITICAL(&registryLock);
+  assert(entryCount < BENCH_MAX_KERNELS);
+  entries[entryCount++] = (BenchEntry_t){name, kernel, arg, flags};
+  portEXIT_CRITICAL(&registryLock);
+}
+
+static void benchEmpty(void *arg, uint32_t i)
+{
+}
+
+static inline uint32_t benchTime(const BenchEntry_t *entry, uint32_t i)
+{
+  uint32_t start, end;
+
+  if (entry->flags & BENCH_IRQ_OFF)
+  {
+    portDISABLE_INTERRUPTS();
+    start = metricsCycles();
+    entry->kernel(entry->arg, i);
+    end = metricsCycles();
+    portENABLE_INTERRUPTS();
+  }
+  else
+  {
+    start = metricsCycles();
+    entry->kernel(entry->arg, i);
+    end = metricsCycles();
+  }
+
+  return end - start;
+}
+
+static void benchMeasure(const BenchEntry_t *entry, uint32_t overhead, BenchResult_t *result)
+{
+  for (uint32_t i = 0; i < config->warmup; ++i)
+    entry->kernel(entry->arg, i);
+
+  uint64_t sum = 0;
+  uint64_t squares = 0;
+  uint32_t min = UINT32_MAX;
+  uint32_t max = 0;
+
+  for (uint32_t i = 0; i < config->iterations; ++i)
+  {
+    uint32_t cycles = benchTime(entry, i);
+    cycles = cycles > overhead ? cycles - overhead : 0;
+
+    sum += cycles;
+    squares += (uint64_t)cycles * cycles;
+    min = cycles < min ? cycles : min;
+    max = cycles > max ? cycles : max;
+  }
+
+  uint32_t n = config->iterations;
+  double mean = (double)sum / n;
+  double variance = (double)squares / n - mean * mean;
+
+  result->name = entry->name;
+  result->iterations = n;
+  result->mean = (uint32_t)(mean + 0.5);
+  result->sd = variance > 0 ? (uint32_t)(sqrt(variance) + 0.5) : 0;
+  result->min = min;
+  result->max = max;
+}
+
+// Cycles an empty iteration costs, the least seen since anything above it is noise
+static uint32_t benchOverhead(uint8_t flags)
+{
+  BenchEntry_t empty = {"empty", benchEmpty, NULL, flags};
+  uint32_t least = UINT32_MAX;
+
+  for (int i = 0; i < 64; ++i)
+  {
+    uint32_t cycles = benchTime(&empty, i);
+    least = cycles < least ? cycles : least;
+  }
+  return least;
+}
+
+int benchFormat(char *out, size_t size, const BenchResult_t *result, int core)
+{
+  return snprintf(
+      out, size, "%s %d %u %u %u %u %u %u\n",
+      result->name, core, result->iterations, result->mean, result->sd, result->min, result->max,
+      result->mean * 1000 / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+}
+
+int benchRun(const char *name, BenchResult_t *result)
+{
+  for (int e = 0; e < entryCount; ++e)
+  {
+    if (strcmp(entries[e].name, name) != 0)
+      continue;
+
+    benchMeasure(&entries[e], benchOverhead(entries[e].flags), result);
+    return 1;
+  }
+  return 0;
+}
+
+static void benchTask(void *arg)
+{
+  while (1)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    int length = snprintf(request.report, sizeof(request.report), BENCH_COLUMNS);
+
+    for (int e = 0; e < entryCount; ++e)
+    {
+      if (request.only[0] != 0 && strcmp(entries[e].name, request.only) != 0)
+        continue;
+
+      BenchResult_t result;
+      benchMeasure(&entries[e], benchOverhead(entries[e].flags), &result);
+
+      // a full report keeps its whole lines, BENCH_REPORT_SIZE holds every kernel
+      int line = benchFormat(request.report + length, sizeof(request.report) - length, &result, xPortGetCoreID());
+      if (line >= (int)sizeof(request.report) - length)
+        break;
+      length += line;
+    }
+
+    request.length = length;
+    __atomic_store_n(&request.state, BENCH_DONE, __ATOMIC_RELEASE);
+  }
+}
+
+static void benchEndRequest(BenchRequest_t *r)
+{
+  r->nc->handler = r->handler;
+  r->nc = NULL;
+}
+
+static void benchRequestHandler(struct mg_connection *nc, int ev, void *ev_data MG_UD_ARG(void *user_data))
+{
+  mg_event_handler_t handler = request.handler;
+
+  if (request.nc == nc)
+  {
+    if (ev == MG_EV_POLL && __atomic_load_n(&request.state, __ATOMIC_ACQUIRE) == BENCH_DONE)
+    {
+      mg_send_head(nc, 200, request.length, "Content-Type: text/plain");
+      mg_send(nc, request.report, request.length);
+      request.state = BENCH_IDLE;
+      benchEndRequest(&request);
+    }
+    else if (ev == MG_EV_CLOSE)
+    {
+      // the run goes on, its report is dropped when the next request comes in
+      benchEndRequest(&request);
+    }
+  }
+
+  handler(nc, ev, ev_data MG_UD_ARG(user_data));
+}
+
+static void benchCallback(struct mg_connection *nc, struct http_message *hm)
+{
+  if (request.nc != NULL || request.state == BENCH_RUNNING)
+  {
+    mg_send_head(nc, 409, -1, "Content-Type: text/plain");
+    mg_printf_http_chunk(nc, "busy\n");
+    mg_send_http_chunk(nc, "", 0);
+    return;
+  }
+
+  memset(request.only, 0, sizeof(request.only));
+  mg_get_http_var(&hm->query_string, "kernel", request.only, sizeof(request.only));
+
+  request.nc = nc;
+  request.handler = nc->handler;
+  nc->handler = benchRequestHandler;
+  request.state = BENCH_RUNNING;
+  xTaskNotifyGive(benchTaskHandle);
+}
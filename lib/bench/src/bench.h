@@ -0,0 +1,66 @@
+//
+// Kernel benchmarks
+//
+// Modules register their hot kernels here and /bench runs them in
+// isolation: a warmup, then iterations timed one by one with the cycle
+// counter. Kernels flagged BENCH_IRQ_OFF run each iteration with
+// interrupts masked on the measuring core, so ticks and WiFi do not land
+// in the numbers; kernels that block (SPI, locks) must leave it off. The
+// cost of an empty iteration is measured first and taken off every result.
+//
+// Output is one line per kernel in a fixed column order, so runs from two
+// commits can be diffed directly:
+//
+//   name core iterations mean_cycles sd_cycles min_cycles max_cycles mean_ns
+//
+// test/bench_kernels.c runs the plain C kernels the same way on a PC, with
+// make -C test bench, and prints the same columns.
+//
+// /bench?kernel=name runs just that kernel. Runs happen on a bench task
+// of the telemetry role, the web server keeps serving meanwhile and the
+// request is answered once the last kernel is done. One run at a time,
+// another request gets a 409 until then.
+//
+
+#ifndef __bench_INCLUDED__
+#define __bench_INCLUDED__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define BENCH_MAX_KERNELS 16
+#define BENCH_IRQ_OFF 0x01
+#define BENCH_REPORT_SIZE 2048
+#define BENCH_COLUMNS "# name core iterations mean_cycles sd_cycles min_cycles max_cycles mean_ns\n"
+
+// i counts iterations from 0 so a kernel can vary its input
+typedef void (*BenchKernel_t)(void *arg, uint32_t i);
+
+typedef struct
+{
+  uint16_t iterations;
+  uint16_t warmup;
+} BenchConfig_t;
+
+typedef struct
+{
+  const char *name;
+  uint32_t iterations;
+  uint32_t mean;
+  uint32_t sd;
+  uint32_t min;
+  uint32_t max;
+} BenchResult_t;
+
+void benchInit(BenchConfig_t *info);
+
+// Cheap, keeps the pointer, call once from module init
+void benchRegister(const char *name, BenchKernel_t kernel, void *arg, uint8_t flags);
+
+// Runs one registered kernel on the calling core, 0 when it is not registered
+int benchRun(const char *name, BenchResult_t *result);
+
+// Formats a result as a report line in the BENCH_COLUMNS order, returns what snprintf does
+int benchFormat(char *out, size_t size, const BenchResult_t *result, int core);
+
+#endif
@@ -0,0 +1,334 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "driver/uart.h"
+#include "lwip/sockets.h"
+
+#include "chorus_controller.h"
+#include "chorus_proto.h"
+#include "lap_timer.h"
+#include "rssi_reader.h"
+#include "rx_controller.h"
+#include "task_plan.h"
+
+#define CHORUS_LAP_QUEUE 16
+#define CHORUS_BAND_COUNT 6 // R, A, B, E, F, D, in the order Chorus numbers them
+
+static ChorusControllerConfig_t chorusConfig;
+static const ChorusControllerConfig_t *config = &chorusConfig;
+
+static QueueHandle_t laps;
+static SemaphoreHandle_t lock;      // the send and the peer
+static SemaphoreHandle_t stateLock; // the chain and race state below, taken before lock
+static int sock = -1;
+static struct sockaddr_in peer;
+static bool hasPeer;
+
+static uint8_t firstNode;
+static bool racing;
+static uint16_t lapBase[MAX_RX_COUNT];
+
+static void chorusLapTask(void *arg);
+static void chorusUdpTask(void *arg);
+static void chorusUartTask(void *arg);
+
+void chorusControllerInit(ChorusControllerConfig_t *info)
+{
+  memcpy(&chorusConfig, info, sizeof(chorusConfig));
+  lock = xSemaphoreCreateMutex();
+  stateLock = xSemaphoreCreateMutex();
+
+  if (config->uart >= 0)
+  {
+    uart_config_t uartConfig = {
+        .baud_rate = config->baudRate,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE};
+
+    uart_param_config(config->uart, &uartConfig);
+    uart_set_pin(config->uart, config->uartTxPin, config->uartRxPin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    uart_driver_install(config->uart, 256, 256, 0, NULL, 0);
+    taskPlanCreate(TASK_ROLE_NETWORK, chorusUartTask, "chorusUartTask", NULL);
+  }
+
+  if (config->udpPort != 0)
+  {
+    sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0)
+    {
+      printf("chorus: no socket\n");
+    }
+    else
+    {
+      struct sockaddr_in local;
+      memset(&local, 0, sizeof(local));
+      local.sin_family = AF_INET;
+      local.sin_port = htons(config->udpPort);
+      local.sin_addr.s_addr = htonl(INADDR_ANY);
+      bind(sock, (struct sockaddr *)&local, sizeof(local));
+      taskPlanCreate(TASK_ROLE_NETWORK, chorusUdpTask, "chorusUdpTask", NULL);
+    }
+  }
+
+  laps = xQueueCreate(CHORUS_LAP_QUEUE, sizeof(LapEvent_t));
+  taskPlanCreate(TASK_ROLE_NETWORK, chorusLapTask, "chorusLapTask", NULL);
+
+  printf("chorus: udp %u, uart %d\n", config->udpPort, config->uart);
+}
+
+void chorusControllerLap(const LapEvent_t *event)
+{
+  if (laps != NULL)
+    xQueueSend(laps, event, 0);
+}
+
+static void chorusSend(const char *line, int len)
+{
+  xSemaphoreTake(lock, portMAX_DELAY);
+
+  if (config->uart >= 0)
+    uart_write_bytes(config->uart, line, len);
+
+  if (sock >= 0 && hasPeer)
+    sendto(sock, line, len, 0, (struct sockaddr *)&peer, sizeof(peer));
+
+  xSemaphoreGive(lock);
+}
+
+static void chorusReply(uint8_t node, char field, uint32_t value)
+{
+  char line[CHORUS_LINE_MAX];
+  chorusSend(line, chorusFormat(line, node, field, value));
+}
+
+static uint16_t chorusRssi(int pilot)
+{
+  float level = rssiReadings()[pilot].filtered * 0.5f + 0.5f;
+  level = level < 0 ? 0 : level > 1 ? 1 : level;
+  return (uint16_t)(level * 4095.0f);
+}
+
+static void chorusReport(const LapTimerConfig_t *timer, int p, uint8_t node, char field)
+{
+  const PilotConfig_t *pilot = &timer->pilots[p];
+
+  switch (field)
+  {
+  case CHORUS_BAND:
+    chorusReply(node, field, pilot->band);
+    break;
+  case CHORUS_CHANNEL:
+    chorusReply(node, field, pilot->channel - 1);
+    break;
+  case CHORUS_FREQUENCY:
+    chorusReply(node, field, rxGetFrequency(pilot->band, pilot->channel));
+    break;
+  case CHORUS_THRESHOLD:
+    chorusReply(node, field, pilot->threshold);
+    break;
+  case CHORUS_MIN_LAP:
+    chorusReply(node, field, timer->minLapTime / 1000);
+    break;
+  case CHORUS_RACE:
+    chorusReply(node, field, racing);
+    break;
+  case CHORUS_RSSI:
+    chorusReply(node, field, chorusRssi(p));
+    break;
+  case CHORUS_VERSION:
+    chorusReply(node, field, CHORUS_API_VERSION);
+    break;
+  }
+}
+
+// Band and channel of a frequency in MHz, false when no channel is on it
+static bool chorusFindFrequency(uint32_t mhz, uint8_t *band, uint8_t *channel)
+{
+  for (int b = 0; b < CHORUS_BAND_COUNT; ++b)
+  {
+    for (int c = 1; c <= 8; ++c)
+    {
+      if ((uint32_t)rxGetFrequency(b, c) != mhz)
+        continue;
+      *band = b;
+      *channel = c;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void chorusSetPilot(const LapTimerConfig_t *timer, int p, const ChorusCommand_t *command)
+{
+  PilotConfig_t pilot = timer->pilots[p];
+
+  switch (command->command)
+  {
+  case CHORUS_BAND:
+    if (command->value < CHORUS_BAND_COUNT)
+      pilot.band = command->value;
+    break;
+  case CHORUS_CHANNEL:
+    if (command->value < 8)
+      pilot.channel = command->value + 1;
+    break;
+  case CHORUS_FREQUENCY:
+    chorusFindFrequency(command->value, &pilot.band, &pilot.channel);
+    break;
+  case CHORUS_THRESHOLD:
+    pilot.threshold = command->value;
+    break;
+  }
+
+  lapTimerUpdatePilotConfig(&pilot);
+}
+
+static void chorusHandleNode(int p, uint8_t node, const ChorusCommand_t *command)
+{
+  const char fields[] = {CHORUS_BAND, CHORUS_CHANNEL, CHORUS_FREQUENCY, CHORUS_THRESHOLD, CHORUS_MIN_LAP, CHORUS_RACE};
+  char field = command->command;
+
+  if (command->hasValue)
+  {
+    switch (field)
+    {
+    case CHORUS_BAND:
+    case CHORUS_CHANNEL:
+    case CHORUS_FREQUENCY:
+    case CHORUS_THRESHOLD:
+    {
+      const LapTimerConfig_t *timer = lapTimerConfigAcquire();
+      chorusSetPilot(timer, p, command);
+      lapTimerConfigRelease(timer);
+      break;
+    }
+
+    case CHORUS_MIN_LAP:
+      // the config holds milliseconds in 16 bits, about 65 s
+      lapTimerUpdateMinLapTime(command->value > UINT16_MAX / 1000 ? UINT16_MAX : command->value * 1000);
+      break;
+
+    case CHORUS_RACE:
+    {
+      // lap numbers restart with every race
+      const PilotLapData_t *lapData = lapTimerPilotLapData(p);
+      lapBase[p] = lapData->timesCount > 0 ? lapData->timesCount - 1 : 0;
+      racing = command->value != 0;
+      break;
+    }
+    }
+  }
+
+  // a setter answers with the value now in effect
+  const LapTimerConfig_t *timer = lapTimerConfigAcquire();
+
+  if (field == CHORUS_REPORT_ALL)
+  {
+    for (int f = 0; f < (int)sizeof(fields); ++f)
+      chorusReport(timer, p, node, fields[f]);
+  }
+  else
+  {
+    chorusReport(timer, p, node, field);
+  }
+
+  lapTimerConfigRelease(timer);
+}
+
+// Runs on the UDP and the UART task, one command at a time
+static void chorusHandle(const char *line)
+{
+  ChorusCommand_t command;
+  if (!chorusParse(line, &command))
+    return;
+
+  const LapTimerConfig_t *timer = lapTimerConfigAcquire();
+  int pilotCount = timer->pilotCount;
+  lapTimerConfigRelease(timer);
+
+  xSemaphoreTake(stateLock, portMAX_DELAY);
+
+  if (command.command == CHORUS_ENUMERATE)
+  {
+    // our pilots take the next ids in the chain
+    firstNode = command.value;
+    char reply[CHORUS_LINE_MAX];
+    chorusSend(reply, chorusFormatEnumerate(reply, firstNode + pilotCount));
+  }
+  else
+  {
+    for (int p = 0; p < pilotCount; ++p)
+    {
+      uint8_t node = firstNode + p;
+      if (command.node == CHORUS_ALL_NODES || command.node == node)
+        chorusHandleNode(p, node, &command);
+    }
+  }
+
+  xSemaphoreGive(stateLock);
+}
+
+static void chorusLapTask(void *arg)
+{
+  LapEvent_t event;
+
+  while (1)
+  {
+    xQueueReceive(laps, &event, portMAX_DELAY);
+
+    // a lap either goes out before a race stop or renumber is answered, or not at all
+    xSemaphoreTake(stateLock, portMAX_DELAY);
+    if (racing && event.pilot < MAX_RX_COUNT && event.lap > lapBase[event.pilot])
+    {
+      char line[CHORUS_LINE_MAX];
+      int len = chorusFormatLap(line, firstNode + event.pilot, event.lap - lapBase[event.pilot], event.time);
+      chorusSend(line, len);
+    }
+    xSemaphoreGive(stateLock);
+  }
+}
+
+static void chorusUdpTask(void *arg)
+{
+  ChorusLineBuffer_t buffer = {0};
+  char datagram[128];
+
+  while (1)
+  {
+    struct sockaddr_in from;
+    socklen_t fromLen = sizeof(from);
+    int len = recvfrom(sock, datagram, sizeof(datagram), 0, (struct sockaddr *)&from, &fromLen);
+    if (len <= 0)
+      continue;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    peer = from;
+    hasPeer = true;
+    xSemaphoreGive(lock);
+
+    // a datagram always ends whatever line it carries
+    for (int i = 0; i <= len; ++i)
+    {
+      if (chorusLineFeed(&buffer, i < len ? datagram[i] : '\n'))
+        chorusHandle(buffer.line);
+    }
+  }
+}
+
+static void chorusUartTask(void *arg)
+{
+  ChorusLineBuffer_t buffer = {0};
+  uint8_t c;
+
+  while (1)
+  {
+    if (uart_read_bytes(config->uart, &c, 1, portMAX_DELAY) == 1 && chorusLineFeed(&buffer, c))
+      chorusHandle(buffer.line);
+  }
+}
@@ -0,0 +1,34 @@
+//
+// Chorus controller
+//
+// Lets race software that speaks the Chorus RF Laptimer protocol drive this
+// timer, over UDP and over a UART. Each pilot shows up as one Chorus node,
+// numbered from the id the chain enumeration hands us. Band, channel,
+// frequency and threshold go through the same pilot config updates as the
+// web UI; laps are pushed as soon as the lap timer hands them over, while a
+// race is running.
+//
+// Replies go to the UART and to whichever UDP client spoke last.
+//
+
+#ifndef __chorus_controller_INCLUDED__
+#define __chorus_controller_INCLUDED__
+
+#include <stdint.h>
+#include "lap_log.h"
+
+typedef struct
+{
+  uint16_t udpPort; // 0 disables UDP, Chorus32 clients default to 9000
+  int8_t uart;      // UART number, -1 disables serial
+  int8_t uartTxPin;
+  int8_t uartRxPin;
+  uint32_t baudRate; // Chorus hardware runs at 115200
+} ChorusControllerConfig_t;
+
+void chorusControllerInit(ChorusControllerConfig_t *info);
+
+// Called by the lap timer for every lap, never blocks
+void chorusControllerLap(const LapEvent_t *event);
+
+#endif
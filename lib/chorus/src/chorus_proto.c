@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "chorus_proto.h"
+
+static int chorusHexDigit(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+bool chorusLineFeed(ChorusLineBuffer_t *buffer, char c)
+{
+  if (c == '\r')
+    return false;
+
+  if (c == '\n')
+  {
+    bool complete = !buffer->overflow && buffer->length > 0;
+    buffer->line[buffer->length] = 0;
+    buffer->length = 0;
+    buffer->overflow = false;
+    return complete;
+  }
+
+  if (buffer->length + 1 >= CHORUS_LINE_MAX)
+  {
+    buffer->overflow = true;
+    return false;
+  }
+
+  buffer->line[buffer->length++] = c;
+  return false;
+}
+
+bool chorusParse(const char *line, ChorusCommand_t *command)
+{
+  const char *value;
+
+  if (line[0] == CHORUS_ENUMERATE)
+  {
+    command->node = CHORUS_ALL_NODES;
+    command->command = CHORUS_ENUMERATE;
+    value = line + 1;
+  }
+  else if (line[0] == 'R' && line[1] != 0 && line[2] != 0)
+  {
+    int node = chorusHexDigit(line[1]);
+    if (line[1] != '*' && node < 0)
+      return false;
+
+    command->node = line[1] == '*' ? CHORUS_ALL_NODES : node;
+    command->command = line[2];
+    value = line + 3;
+  }
+  else
+  {
+    return false;
+  }
+
+  command->hasValue = *value != 0;
+  command->value = 0;
+
+  for (; *value != 0; ++value)
+  {
+    int digit = chorusHexDigit(*value);
+    if (digit < 0)
+      return false;
+    command->value = (command->value << 4) | digit;
+  }
+
+  return true;
+}
+
+int chorusFieldDigits(char field)
+{
+  switch (field)
+  {
+  case CHORUS_FREQUENCY:
+  case CHORUS_THRESHOLD:
+  case CHORUS_RSSI:
+  case CHORUS_VERSION:
+    return 4;
+  case CHORUS_MIN_LAP:
+    return 2;
+  default:
+    return 1;
+  }
+}
+
+int chorusFormat(char *out, uint8_t node, char field, uint32_t value)
+{
+  return sprintf(out, "S%X%c%0*X\n", node & 0x0f, field, chorusFieldDigits(field), (unsigned)value);
+}
+
+int chorusFormatLap(char *out, uint8_t node, uint8_t lap, uint32_t ms)
+{
+  return sprintf(out, "S%X%c%02X%08X\n", node & 0x0f, CHORUS_LAP, lap, (unsigned)ms);
+}
+
+int chorusFormatEnumerate(char *out, uint8_t next)
+{
+  return sprintf(out, "%c%X\n", CHORUS_ENUMERATE, next & 0x0f);
+}
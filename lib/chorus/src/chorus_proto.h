@@ -0,0 +1,77 @@
+//
+// Chorus RF Laptimer protocol
+//
+// The line based text protocol race software such as LiveTime uses to talk
+// to Chorus timers. A command is 'R', a target node as one hex digit or '*'
+// for every node, a command letter and an optional hex value, ending in a
+// newline. Nodes answer with 'S', their node digit, a field letter and the
+// value as a fixed number of hex digits. "N<n>" enumerates a chain: a node
+// takes ids from n and passes on n plus the ids it took.
+//
+//   R*a      report every field of every node
+//   R1B3     band 3 on node 1          S1B3
+//   R1C5     channel 5 (0 based)       S1C5
+//   R1F16A8  frequency in MHz          S1F16A8
+//   R1T0320  threshold                 S1T0320
+//   R*M05    minimum lap seconds       S0M05
+//   R*R1     race start, R0 stops      S0R1
+//   R1r      current RSSI              S1r0412
+//   R*#      protocol version          S0#0004
+//            lap report                S1L03000049F2  (lap 3, 18930 ms)
+//
+// Plain C with no platform calls, so it builds unchanged on a PC.
+//
+
+#ifndef __chorus_proto_INCLUDED__
+#define __chorus_proto_INCLUDED__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CHORUS_LINE_MAX 24
+#define CHORUS_ALL_NODES 0xff
+#define CHORUS_API_VERSION 4
+
+#define CHORUS_BAND 'B'
+#define CHORUS_CHANNEL 'C'
+#define CHORUS_FREQUENCY 'F'
+#define CHORUS_THRESHOLD 'T'
+#define CHORUS_MIN_LAP 'M'
+#define CHORUS_RACE 'R'
+#define CHORUS_RSSI 'r'
+#define CHORUS_VERSION '#'
+#define CHORUS_REPORT_ALL 'a'
+#define CHORUS_LAP 'L'
+#define CHORUS_ENUMERATE 'N'
+
+typedef struct
+{
+  uint8_t node; // CHORUS_ALL_NODES for '*'
+  char command;
+  bool hasValue;
+  uint32_t value;
+} ChorusCommand_t;
+
+// Collects a byte stream into lines
+typedef struct
+{
+  char line[CHORUS_LINE_MAX];
+  int length;
+  bool overflow; // the line in progress is too long and will be dropped
+} ChorusLineBuffer_t;
+
+// True once c completes a line, which is then in buffer->line
+bool chorusLineFeed(ChorusLineBuffer_t *buffer, char c);
+
+// Parses one line without its newline, false for anything that is not a command
+bool chorusParse(const char *line, ChorusCommand_t *command);
+
+// Hex digits a field's value is written with
+int chorusFieldDigits(char field);
+
+// Formats a reply line with its newline, returns its length
+int chorusFormat(char *out, uint8_t node, char field, uint32_t value);
+int chorusFormatLap(char *out, uint8_t node, uint8_t lap, uint32_t ms);
+int chorusFormatEnumerate(char *out, uint8_t next);
+
+#endif
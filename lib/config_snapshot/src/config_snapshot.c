@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "config_snapshot.h"
+
+void configSnapshotInit(ConfigSnapshot_t *snap, void *slots, size_t size, const void *initial)
+{
+  memset(snap, 0, sizeof(ConfigSnapshot_t));
+  snap->size = size;
+
+  for (int s = 0; s < CONFIG_SNAPSHOT_SLOTS; ++s)
+  {
+    snap->slots[s].data = (uint8_t *)slots + s * size;
+  }
+
+  memcpy(snap->slots[0].data, initial, size);
+  snap->slots[0].version = 1;
+  snap->current = &snap->slots[0];
+
+  snap->writeLock = xSemaphoreCreateMutex();
+  assert(snap->writeLock != NULL);
+}
+
+const void *configSnapshotAcquire(ConfigSnapshot_t *snap, uint32_t *version)
+{
+  while (1)
+  {
+    ConfigSnapshotSlot_t *slot = __atomic_load_n(&snap->current, __ATOMIC_ACQUIRE);
+    __atomic_add_fetch(&slot->readers, 1, __ATOMIC_ACQ_REL);
+
+    // the writer may have swapped between the load and the pin, retry on the new slot
+    if (slot == __atomic_load_n(&snap->current, __ATOMIC_ACQUIRE))
+    {
+      if (version != NULL)
+        *version = slot->version;
+
+      return slot->data;
+    }
+
+    __atomic_sub_fetch(&slot->readers, 1, __ATOMIC_RELEASE);
+  }
+}
+
+void configSnapshotRelease(ConfigSnapshot_t *snap, const void *data)
+{
+  for (int s = 0; s < CONFIG_SNAPSHOT_SLOTS; ++s)
+  {
+    if (snap->slots[s].data == data)
+    {
+      __atomic_sub_fetch(&snap->slots[s].readers, 1, __ATOMIC_RELEASE);
+      return;
+    }
+  }
+
+  assert(false);
+}
+
+uint32_t configSnapshotCopy(ConfigSnapshot_t *snap, void *out)
+{
+  uint32_t version = 0;
+  const void *data = configSnapshotAcquire(snap, &version);
+  memcpy(out, data, snap->size);
+  configSnapshotRelease(snap, data);
+  return version;
+}
+
+uint32_t configSnapshotPublish(ConfigSnapshot_t *snap, const void *next)
+{
+  xSemaphoreTake(snap->writeLock, portMAX_DELAY);
+
+  ConfigSnapshotSlot_t *current = snap->current;
+  ConfigSnapshotSlot_t *spare = current == &snap->slots[0] ? &snap->slots[1] : &snap->slots[0];
+
+  // readers only hold a slot for one batch, so this wait is bounded by the slowest loop period
+  while (__atomic_load_n(&spare->readers, __ATOMIC_ACQUIRE) != 0)
+    vTaskDelay(1);
+
+  memcpy(spare->data, next, snap->size);
+  spare->version = current->version + 1;
+  __atomic_store_n(&snap->current, spare, __ATOMIC_RELEASE);
+
+  uint32_t version = spare->version;
+  xSemaphoreGive(snap->writeLock);
+  return version;
+}
+
+uint32_t configSnapshotVersion(ConfigSnapshot_t *snap)
+{
+  ConfigSnapshotSlot_t *slot = __atomic_load_n(&snap->current, __ATOMIC_ACQUIRE);
+  return slot->version;
+}
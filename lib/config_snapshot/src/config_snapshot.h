@@ -0,0 +1,48 @@
+//
+// Versioned configuration snapshots
+//
+// Writers build a complete copy and publish it with a single pointer swap.
+// Readers pin the current copy once per batch of work and release it when
+// done, so a hot loop never sees fields change underneath it and never
+// takes a lock.
+//
+
+#ifndef __config_snapshot_INCLUDED__
+#define __config_snapshot_INCLUDED__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define CONFIG_SNAPSHOT_SLOTS 2
+
+typedef struct
+{
+  void *data;
+  uint32_t version;
+  volatile uint32_t readers;
+} ConfigSnapshotSlot_t;
+
+typedef struct
+{
+  size_t size;
+  ConfigSnapshotSlot_t slots[CONFIG_SNAPSHOT_SLOTS];
+  ConfigSnapshotSlot_t *volatile current;
+  SemaphoreHandle_t writeLock;
+} ConfigSnapshot_t;
+
+// slots must point at CONFIG_SNAPSHOT_SLOTS buffers of size bytes each
+void configSnapshotInit(ConfigSnapshot_t *snap, void *slots, size_t size, const void *initial);
+
+const void *configSnapshotAcquire(ConfigSnapshot_t *snap, uint32_t *version);
+void configSnapshotRelease(ConfigSnapshot_t *snap, const void *data);
+
+// Copies the current snapshot into out, for read-modify-publish writers
+uint32_t configSnapshotCopy(ConfigSnapshot_t *snap, void *out);
+
+// Blocks until no reader holds the spare slot, returns the new version
+uint32_t configSnapshotPublish(ConfigSnapshot_t *snap, const void *next);
+uint32_t configSnapshotVersion(ConfigSnapshot_t *snap);
+
+#endif
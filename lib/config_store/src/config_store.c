@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "rom/crc.h"
+#include "config_store.h"
+#include "task_plan.h"
+#include "metrics.h"
+#include "timers.h"
+
+typedef struct
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t reserved;
+  uint32_t size;
+  uint32_t crc;
+} ConfigStoreHeader_t;
+
+typedef struct
+{
+  const char *key;
+  uint16_t version;
+  uint32_t size;
+  bool dirty;
+  uint8_t *pending; // header followed by the blob, as written to flash
+} ConfigStoreEntry_t;
+
+static ConfigStoreConfig_t storeConfig;
+static const ConfigStoreConfig_t *config = &storeConfig;
+
+static ConfigStoreEntry_t entries[CONFIG_STORE_MAX_BLOBS];
+static SemaphoreHandle_t lock;
+static TaskHandle_t storeTask;
+static MetricsCounter_t *writes;
+static MetricsCounter_t *failures;
+
+static void configStoreTask(void *arg);
+
+void configStoreInit(ConfigStoreConfig_t *info)
+{
+  memcpy(&storeConfig, info, sizeof(storeConfig));
+  memset(entries, 0, sizeof(entries));
+  lock = xSemaphoreCreateMutex();
+
+  esp_err_t ret = nvs_flash_init();
+  if (ret == ESP_ERR_NVS_NO_FREE_PAGES)
+  {
+    // a partition left by another layout, nothing in it is ours to keep
+    printf("config-store: erasing nvs\n");
+    nvs_flash_erase();
+    ret = nvs_flash_init();
+  }
+  assert(ret == ESP_OK);
+
+  writes = metricsCounter("config_writes");
+  failures = metricsCounter("config_write_failures");
+}
+
+bool configStoreLoad(const char *key, uint16_t version, void *blob, size_t size)
+{
+  nvs_handle handle;
+  if (nvs_open(config->ns, NVS_READONLY, &handle) != ESP_OK)
+    return false;
+
+  size_t stored = 0;
+  bool loaded = false;
+
+  if (nvs_get_blob(handle, key, NULL, &stored) == ESP_OK && stored == sizeof(ConfigStoreHeader_t) + size)
+  {
+    uint8_t *buffer = malloc(stored);
+    assert(buffer != NULL);
+
+    ConfigStoreHeader_t *header = (ConfigStoreHeader_t *)buffer;
+    uint8_t *data = buffer + sizeof(ConfigStoreHeader_t);
+
+    loaded = nvs_get_blob(handle, key, buffer, &stored) == ESP_OK &&
+             header->magic == CONFIG_STORE_MAGIC &&
+             header->version == version &&
+             header->size == size &&
+             header->crc == crc32_le(0, data, size);
+
+    if (loaded)
+      memcpy(blob, data, size);
+
+    free(buffer);
+  }
+
+  nvs_close(handle);
+  printf("config-store: %s v%u %s\n", key, version, loaded ? "loaded" : "defaults");
+  return loaded;
+}
+
+static ConfigStoreEntry_t *configStoreEntry(const char *key, uint32_t size)
+{
+  ConfigStoreEntry_t *slot = NULL;
+
+  for (int e = 0; e < CONFIG_STORE_MAX_BLOBS; ++e)
+  {
+    if (entries[e].key != NULL && strcmp(entries[e].key, key) == 0)
+      return &entries[e];
+
+    if (entries[e].key == NULL && slot == NULL)
+      slot = &entries[e];
+  }
+
+  assert(slot != NULL);
+  slot->key = key;
+  slot->size = size;
+  slot->pending = malloc(sizeof(ConfigStoreHeader_t) + size);
+  assert(slot->pending != NULL);
+  return slot;
+}
+
+void configStoreSave(const char *key, uint16_t version, const void *blob, size_t size)
+{
+  xSemaphoreTake(lock, portMAX_DELAY);
+
+  ConfigStoreEntry_t *entry = configStoreEntry(key, size);
+  assert(entry->size == size);
+
+  ConfigStoreHeader_t *header = (ConfigStoreHeader_t *)entry->pending;
+  header->magic = CONFIG_STORE_MAGIC;
+  header->version = version;
+  header->reserved = 0;
+  header->size = size;
+  header->crc = crc32_le(0, blob, size);
+  memcpy(entry->pending + sizeof(ConfigStoreHeader_t), blob, size);
+  entry->version = version;
+  entry->dirty = true;
+
+  // started on first use, boot only loads and has no need for it
+  if (storeTask == NULL)
+    storeTask = taskPlanCreate(TASK_ROLE_STORAGE, configStoreTask, "configStoreTask", NULL);
+
+  xSemaphoreGive(lock);
+  xTaskNotifyGive(storeTask);
+}
+
+void configStoreErase(const char *key)
+{
+  nvs_handle handle;
+  if (nvs_open(config->ns, NVS_READWRITE, &handle) != ESP_OK)
+    return;
+
+  nvs_erase_key(handle, key);
+  nvs_commit(handle);
+  nvs_close(handle);
+}
+
+static void configStoreWrite(ConfigStoreEntry_t *entry, uint8_t *buffer)
+{
+  nvs_handle handle;
+  esp_err_t ret = nvs_open(config->ns, NVS_READWRITE, &handle);
+
+  if (ret == ESP_OK)
+  {
+    ret = nvs_set_blob(handle, entry->key, buffer, sizeof(ConfigStoreHeader_t) + entry->size);
+    if (ret == ESP_OK)
+      ret = nvs_commit(handle);
+    nvs_close(handle);
+  }
+
+  if (ret != ESP_OK)
+  {
+    printf("config-store: %s write failed %d\n", entry->key, ret);
+    metricsCount(failures, 1);
+    return;
+  }
+
+  metricsCount(writes, 1);
+}
+
+static void configStoreTask(void *arg)
+{
+  uint8_t *buffer = NULL;
+  uint32_t bufferSize = 0;
+
+  while (1)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    // every edit restarts the quiet period, up to maxDelayMs after the first
+    uint32_t first = millis();
+    while (ulTaskNotifyTake(pdTRUE, config->debounceMs / portTICK_PERIOD_MS) != 0 &&
+           millis() - first < config->maxDelayMs)
+    {
+    }
+
+    for (int e = 0; e < CONFIG_STORE_MAX_BLOBS; ++e)
+    {
+      xSemaphoreTake(lock, portMAX_DELAY);
+      ConfigStoreEntry_t *entry = &entries[e];
+      bool dirty = entry->dirty;
+
+      if (dirty)
+      {
+        uint32_t size = sizeof(ConfigStoreHeader_t) + entry->size;
+        if (size > bufferSize)
+        {
+          buffer = realloc(buffer, size);
+          assert(buffer != NULL);
+          bufferSize = size;
+        }
+
+        // written from a copy so saves never wait on flash
+        memcpy(buffer, entry->pending, size);
+        entry->dirty = false;
+      }
+      xSemaphoreGive(lock);
+
+      if (dirty)
+        configStoreWrite(entry, buffer);
+    }
+  }
+}
@@ -0,0 +1,41 @@
+//
+// Persisted config
+//
+// Keeps config structs in NVS so a node comes back from a reboot with the
+// pilots, thresholds and tuning it had. Each blob carries a magic, a layout
+// version, its size and a CRC; a blob that fails any of them is ignored and
+// the caller keeps its defaults. Loads are synchronous and meant for boot,
+// before any task reads the config. Saves only copy the struct, a storage
+// task writes it once edits have been quiet for debounceMs, or after
+// maxDelayMs of constant edits, so a burst of web changes is one flash write.
+//
+
+#ifndef __config_store_INCLUDED__
+#define __config_store_INCLUDED__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define CONFIG_STORE_MAX_BLOBS 4
+#define CONFIG_STORE_MAGIC 0x46435443 // "CTCF"
+
+typedef struct
+{
+  const char *ns; // NVS namespace
+  uint16_t debounceMs;
+  uint16_t maxDelayMs;
+} ConfigStoreConfig_t;
+
+void configStoreInit(ConfigStoreConfig_t *info);
+
+// Fills blob and returns true only when a stored copy with this version and size checks out
+bool configStoreLoad(const char *key, uint16_t version, void *blob, size_t size);
+
+// Queues a write, safe to call from any task, key must outlive the store
+void configStoreSave(const char *key, uint16_t version, const void *blob, size_t size);
+
+// Drops the stored copy, the next boot starts from defaults
+void configStoreErase(const char *key);
+
+#endif
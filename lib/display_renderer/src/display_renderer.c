@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include <string.h>
+#include "esp_timer.h"
+
+#include "display_renderer.h"
+#include "font_5x7.h"
+
+static RendererConfig_t *config;
+
+static uint8_t frames[2][RENDER_PAGES * RENDER_WIDTH];
+static uint8_t *front = frames[0];
+static uint8_t *back = frames[1];
+
+static RendererStats_t stats;
+static int64_t frameStart = 0;
+
+// Fallback when no span flush is configured: replay the changed pixels into
+// the display controller's buffer and let it push the frame
+static void rendererControllerFlushSpan(int page, int x0, int x1, const uint8_t *columns)
+{
+  for (int x = x0; x <= x1; ++x)
+  {
+    uint8_t bits = columns[x - x0];
+    for (int b = 0; b < 8; ++b)
+      displayDraw(x, page * 8 + b, (bits >> b) & 1);
+  }
+}
+
+static void rendererControllerPresent()
+{
+  displayUpdate();
+}
+
+void rendererInit(RendererConfig_t *info)
+{
+  config = info;
+
+  if (config->flushSpan == NULL)
+  {
+    config->flushSpan = &rendererControllerFlushSpan;
+    config->present = &rendererControllerPresent;
+  }
+
+  memset(frames, 0, sizeof(frames));
+  memset(&stats, 0, sizeof(stats));
+
+  displayClear();
+  if (config->present != NULL)
+    config->present();
+}
+
+void rendererBeginFrame()
+{
+  frameStart = esp_timer_get_time();
+  memset(back, 0, RENDER_PAGES * RENDER_WIDTH);
+}
+
+void rendererEndFrame()
+{
+  int64_t flushStart = esp_timer_get_time();
+  uint32_t dirty = 0;
+
+  for (int page = 0; page < RENDER_PAGES; ++page)
+  {
+    const uint8_t *b = &back[page * RENDER_WIDTH];
+    const uint8_t *f = &front[page * RENDER_WIDTH];
+
+    int x0 = 0;
+    while (x0 < RENDER_WIDTH && b[x0] == f[x0])
+      ++x0;
+
+    if (x0 == RENDER_WIDTH)
+      continue;
+
+    int x1 = RENDER_WIDTH - 1;
+    while (b[x1] == f[x1])
+      --x1;
+
+    config->flushSpan(page, x0, x1, &b[x0]);
+    dirty += x1 - x0 + 1;
+  }
+
+  if (dirty > 0 && config->present != NULL)
+    config->present();
+
+  int64_t flushEnd = esp_timer_get_time();
+
+  // swap, the buffer just sent is now what the panel shows
+  uint8_t *shown = back;
+  back = front;
+  front = shown;
+
+  ++stats.frames;
+  if (dirty == 0)
+    ++stats.unchangedFrames;
+
+  stats.dirtyBytes = dirty;
+  stats.renderUs = flushStart - frameStart;
+  stats.flushUs = flushEnd - flushStart;
+
+  if (stats.renderUs > stats.maxRenderUs)
+    stats.maxRenderUs = stats.renderUs;
+
+  if (stats.flushUs > stats.maxFlushUs)
+    stats.maxFlushUs = stats.flushUs;
+}
+
+void rendererDraw(int x, int y, uint8_t color)
+{
+  if (x < 0 || x >= RENDER_WIDTH || y < 0 || y >= RENDER_HEIGHT)
+    return;
+
+  uint8_t *column = &back[(y >> 3) * RENDER_WIDTH + x];
+  uint8_t bit = 1 << (y & 7);
+
+  if (color)
+    *column |= bit;
+  else
+    *column &= ~bit;
+}
+
+// Applies one page mask to a run of columns, four columns per word where aligned
+static void rendererMaskColumns(uint8_t *column, int w, uint8_t mask, uint8_t color)
+{
+  uint32_t wide = mask * 0x01010101u;
+
+  while (w > 0 && ((uintptr_t)column & 3) != 0)
+  {
+    *column = color ? (*column | mask) : (*column & ~mask);
+    ++column;
+    --w;
+  }
+
+  uint32_t *words = (uint32_t *)column;
+  for (; w >= 4; w -= 4, ++words)
+    *words = color ? (*words | wide) : (*words & ~wide);
+
+  column = (uint8_t *)words;
+  for (; w > 0; --w, ++column)
+    *column = color ? (*column | mask) : (*column & ~mask);
+}
+
+// Clips to the frame, returns false when nothing is left
+static bool rendererClip(int *x, int *y, int *w, int *h)
+{
+  if (*x < 0)
+  {
+    *w += *x;
+    *x = 0;
+  }
+
+  if (*y < 0)
+  {
+    *h += *y;
+    *y = 0;
+  }
+
+  if (*x + *w > RENDER_WIDTH)
+    *w = RENDER_WIDTH - *x;
+
+  if (*y + *h > RENDER_HEIGHT)
+    *h = RENDER_HEIGHT - *y;
+
+  return *w > 0 && *h > 0;
+}
+
+void rendererFillSpan(int x0, int x1, int y, uint8_t color)
+{
+  rendererFillRect(x0, y, x1 - x0 + 1, 1, color);
+}
+
+void rendererFillRect(int x, int y, int w, int h, uint8_t color)
+{
+  if (!rendererClip(&x, &y, &w, &h))
+    return;
+
+  int yEnd = y + h;
+  for (int page = y >> 3; page <= (yEnd - 1) >> 3; ++page)
+  {
+    int top = page * 8;
+    int from = y > top ? y - top : 0;
+    int to = yEnd < top + 8 ? yEnd - top : 8;
+
+    uint8_t mask = (uint8_t)((0xFF << from) & (0xFF >> (8 - to)));
+    rendererMaskColumns(&back[page * RENDER_WIDTH + x], w, mask, color);
+  }
+}
+
+void rendererBlitGlyph(int x, int y, const uint8_t *glyph, int width, uint8_t color)
+{
+  if (y <= -8 || y >= RENDER_HEIGHT)
+    return;
+
+  // a glyph column straddles at most two pages
+  int page = y >= 0 ? y >> 3 : -1;
+  int shift = y & 7;
+
+  for (int col = 0; col < width; ++col)
+  {
+    int px = x + col;
+    if (px < 0 || px >= RENDER_WIDTH)
+      continue;
+
+    uint16_t bits = (uint16_t)glyph[col] << shift;
+    uint8_t lo = bits & 0xFF;
+    uint8_t hi = bits >> 8;
+
+    if (page >= 0 && lo)
+    {
+      uint8_t *column = &back[page * RENDER_WIDTH + px];
+      *column = color ? (*column | lo) : (*column & ~lo);
+    }
+
+    if (page + 1 < RENDER_PAGES && hi)
+    {
+      uint8_t *column = &back[(page + 1) * RENDER_WIDTH + px];
+      *column = color ? (*column | hi) : (*column & ~hi);
+    }
+  }
+}
+
+static int rendererDrawText(int x, int y, const char *text, uint8_t color)
+{
+  for (; *text; ++text)
+  {
+    char c = *text;
+    if (c < FONT_5X7_FIRST || c > FONT_5X7_LAST)
+      c = '?';
+
+    rendererBlitGlyph(x, y, &font5x7[(c - FONT_5X7_FIRST) * FONT_5X7_WIDTH], FONT_5X7_WIDTH, color);
+    x += FONT_5X7_ADVANCE;
+  }
+
+  return x;
+}
+
+int rendererDrawString(int x, int y, const char *text)
+{
+  return rendererDrawText(x, y, text, 1);
+}
+
+int rendererDrawLapTime(int x, int y, uint16_t lap, uint32_t ms)
+{
+  char buf[16];
+
+  // lap number in an inverted box, then m:ss.cc
+  sprintf(buf, "%u", lap);
+  int labelWidth = strlen(buf) * FONT_5X7_ADVANCE + 1;
+  rendererFillRect(x, y - 1, labelWidth, FONT_5X7_HEIGHT + 2, 1);
+  rendererDrawText(x + 1, y, buf, 0);
+
+  uint32_t minutes = ms / 60000;
+  uint32_t seconds = (ms / 1000) % 60;
+  uint32_t hundredths = (ms / 10) % 100;
+
+  if (minutes > 0)
+    sprintf(buf, "%u:%02u.%02u", minutes, seconds, hundredths);
+  else
+    sprintf(buf, "%u.%02u", seconds, hundredths);
+
+  return rendererDrawText(x + labelWidth + 2, y, buf, 1);
+}
+
+const RendererStats_t *rendererStats()
+{
+  return &stats;
+}
@@ -0,0 +1,60 @@
+//
+// Display renderer
+//
+// Frames are drawn into a page organised back buffer (one byte covers 8
+// vertical pixels, like the panel's own memory). At the end of a frame it
+// is compared with the last frame sent, and only the changed column span of
+// each page is handed to the display. Unchanged frames cost no bus time.
+//
+
+#ifndef __display_renderer_INCLUDED__
+#define __display_renderer_INCLUDED__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "display_controller.h"
+
+#define RENDER_WIDTH DISPLAY_WIDTH
+#define RENDER_HEIGHT DISPLAY_HEIGHT
+#define RENDER_PAGES (DISPLAY_HEIGHT / 8)
+
+// Pushes columns [x0, x1] of one page, columns points at column x0
+typedef void (*RenderFlushSpan_t)(int page, int x0, int x1, const uint8_t *columns);
+typedef void (*RenderPresent_t)();
+
+typedef struct
+{
+  RenderFlushSpan_t flushSpan; // NULL uses the display controller
+  RenderPresent_t present;
+} RendererConfig_t;
+
+typedef struct
+{
+  uint32_t frames;
+  uint32_t unchangedFrames;
+  uint32_t dirtyBytes;
+  uint32_t renderUs;
+  uint32_t flushUs;
+  uint32_t maxRenderUs;
+  uint32_t maxFlushUs;
+} RendererStats_t;
+
+void rendererInit(RendererConfig_t *info);
+
+void rendererBeginFrame();
+void rendererEndFrame();
+
+void rendererDraw(int x, int y, uint8_t color);
+void rendererFillSpan(int x0, int x1, int y, uint8_t color);
+void rendererFillRect(int x, int y, int w, int h, uint8_t color);
+
+// glyph is width column bytes, bit 0 at the top
+void rendererBlitGlyph(int x, int y, const uint8_t *glyph, int width, uint8_t color);
+
+// Return the x after the last character drawn
+int rendererDrawString(int x, int y, const char *text);
+int rendererDrawLapTime(int x, int y, uint16_t lap, uint32_t ms);
+
+const RendererStats_t *rendererStats();
+
+#endif
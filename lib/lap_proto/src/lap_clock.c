@@ -0,0 +1,122 @@
+#include <string.h>
+#include <math.h>
+
+#include "lap_clock.h"
+
+// exchanges slower than the best one by more than this are not trusted
+#define LAP_CLOCK_DELAY_SLACK_US 2000
+
+// crystals are good to a few tens of ppm, a steeper fit is noise
+#define LAP_CLOCK_MAX_DRIFT 100e-6
+
+void lapClockInit(LapClock_t *clock)
+{
+  memset(clock, 0, sizeof(LapClock_t));
+}
+
+static void lapClockFit(LapClock_t *clock)
+{
+  uint32_t best = UINT32_MAX;
+  for (int s = 0; s < clock->count; ++s)
+  {
+    if (clock->samples[s].delay < best)
+      best = clock->samples[s].delay;
+  }
+
+  uint32_t cutoff = best + (best < LAP_CLOCK_DELAY_SLACK_US ? best : LAP_CLOCK_DELAY_SLACK_US);
+  int64_t reference = clock->samples[(clock->next + LAP_CLOCK_SAMPLES - 1) % LAP_CLOCK_SAMPLES].local;
+
+  // least squares in doubles, relative to the newest sample so the numbers stay small
+  double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (int s = 0; s < clock->count; ++s)
+  {
+    const LapClockSample_t *sample = &clock->samples[s];
+    if (sample->delay > cutoff)
+      continue;
+
+    double x = (double)(sample->local - reference);
+    double y = (double)sample->offset;
+    n += 1;
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+
+  double drift = 0;
+  double denominator = n * sxx - sx * sx;
+  if (n >= 3 && denominator > 0)
+    drift = (n * sxy - sx * sy) / denominator;
+
+  if (drift > LAP_CLOCK_MAX_DRIFT)
+    drift = LAP_CLOCK_MAX_DRIFT;
+  else if (drift < -LAP_CLOCK_MAX_DRIFT)
+    drift = -LAP_CLOCK_MAX_DRIFT;
+
+  double offset = (sy - drift * sx) / n;
+
+  double residual = 0;
+  for (int s = 0; s < clock->count; ++s)
+  {
+    const LapClockSample_t *sample = &clock->samples[s];
+    if (sample->delay > cutoff)
+      continue;
+
+    double error = (double)sample->offset - (offset + drift * (double)(sample->local - reference));
+    residual += error * error;
+  }
+
+  clock->reference = reference;
+  clock->offset = offset;
+  clock->drift = drift;
+  clock->errorUs = best / 2 + (uint32_t)sqrt(residual / n);
+  clock->synced = true;
+}
+
+void lapClockSample(LapClock_t *clock, int64_t t1, int64_t t2, int64_t t3, int64_t t4)
+{
+  int64_t roundTrip = (t4 - t1) - (t3 - t2);
+  if (roundTrip < 0)
+    roundTrip = 0;
+
+  LapClockSample_t *sample = &clock->samples[clock->next];
+  sample->local = t1 + (t4 - t1) / 2;
+  sample->offset = ((t2 - t1) + (t3 - t4)) / 2;
+  sample->delay = roundTrip > UINT32_MAX ? UINT32_MAX : (uint32_t)roundTrip;
+
+  clock->next = (clock->next + 1) % LAP_CLOCK_SAMPLES;
+  if (clock->count < LAP_CLOCK_SAMPLES)
+    ++clock->count;
+
+  lapClockFit(clock);
+}
+
+int64_t lapClockToRemote(const LapClock_t *clock, int64_t local)
+{
+  return local + (int64_t)(clock->offset + clock->drift * (double)(local - clock->reference));
+}
+
+int64_t lapClockToLocal(const LapClock_t *clock, int64_t remote)
+{
+  // the offset barely moves within one offset's distance, one step is plenty
+  int64_t local = remote - (int64_t)clock->offset;
+  return remote - (int64_t)(clock->offset + clock->drift * (double)(local - clock->reference));
+}
+
+double lapClockScale(const LapClock_t *clock, double remoteDuration)
+{
+  return remoteDuration / (1.0 + clock->drift);
+}
+
+int64_t lapClockUnwrap(uint32_t low, int64_t near)
+{
+  int64_t value = (near & ~(int64_t)0xffffffff) | low;
+  int64_t half = (int64_t)1 << 31;
+
+  if (value - near > half)
+    value -= (int64_t)1 << 32;
+  else if (near - value > half)
+    value += (int64_t)1 << 32;
+
+  return value;
+}
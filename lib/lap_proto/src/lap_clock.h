@@ -0,0 +1,54 @@
+//
+// Remote clock estimate
+//
+// Fits one remote node's microsecond clock against ours from NTP style
+// four-timestamp exchanges. Only exchanges whose round trip is close to the
+// shortest seen are trusted, since a slow exchange is usually slow one way.
+// A line through their offsets gives offset and drift, and the error is
+// half the best round trip plus the scatter around the line. Plain C, time
+// is passed in.
+//
+
+#ifndef __lap_clock_INCLUDED__
+#define __lap_clock_INCLUDED__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define LAP_CLOCK_SAMPLES 16
+
+typedef struct
+{
+  int64_t local;  // midpoint of the exchange on our clock
+  int64_t offset; // remote minus local
+  uint32_t delay; // round trip less the remote's turnaround
+} LapClockSample_t;
+
+typedef struct
+{
+  LapClockSample_t samples[LAP_CLOCK_SAMPLES];
+  int count;
+  int next;
+
+  bool synced;
+  int64_t reference; // local time the fit is anchored at
+  double offset;     // remote minus local at reference
+  double drift;      // remote us gained per local us
+  uint32_t errorUs;
+} LapClock_t;
+
+void lapClockInit(LapClock_t *clock);
+
+// t1 request sent and t4 reply received on our clock, t2 and t3 on the remote's
+void lapClockSample(LapClock_t *clock, int64_t t1, int64_t t2, int64_t t3, int64_t t4);
+
+int64_t lapClockToLocal(const LapClock_t *clock, int64_t remote);
+int64_t lapClockToRemote(const LapClock_t *clock, int64_t local);
+
+// Durations measured on the remote clock, in local units
+double lapClockScale(const LapClock_t *clock, double remoteDuration);
+
+// Widens the low 32 bits of a timestamp to the 64 bit value nearest to near
+int64_t lapClockUnwrap(uint32_t low, int64_t near);
+
+#endif
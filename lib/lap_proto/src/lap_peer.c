@@ -0,0 +1,44 @@
+#include <string.h>
+
+#include "lap_peer.h"
+
+void lapPeerInit(LapPeer_t *peer, uint16_t nackMs)
+{
+  lapClockInit(&peer->clock);
+  lapReliableInit(&peer->rx, nackMs);
+}
+
+int lapPeerLap(LapPeer_t *peer, const LapProtoLap_t *lap, int64_t nowUs)
+{
+  return lapReliableOnLap(&peer->rx, lap->seq, nowUs / 1000);
+}
+
+bool lapPeerHeartbeat(LapPeer_t *peer, const LapProtoHeartbeat_t *heartbeat, int64_t nowUs)
+{
+  uint32_t reboots = peer->rx.reboots;
+  lapReliableOnHeartbeat(&peer->rx, heartbeat->head, heartbeat->oldest, heartbeat->uptime, heartbeat->boot, nowUs / 1000);
+
+  if (peer->rx.reboots == reboots)
+    return false;
+
+  lapClockInit(&peer->clock);
+  return true;
+}
+
+void lapPeerSync(LapPeer_t *peer, const LapProtoSync_t *sync, int64_t nowUs)
+{
+  lapClockSample(&peer->clock, sync->origin, sync->receive, sync->transmit, nowUs);
+}
+
+bool lapPeerLocal(const LapPeer_t *peer, const LapProtoLap_t *lap, int64_t nowUs, int64_t *localUs, uint32_t *time)
+{
+  if (!peer->clock.synced || lap->detectedUs == 0)
+    return false;
+
+  // the lap may be a replay from a while back, widen it around the node's clock now
+  int64_t remoteNow = lapClockToRemote(&peer->clock, nowUs);
+  int64_t remoteUs = lapClockUnwrap(lap->detectedUs, remoteNow);
+  *localUs = lapClockToLocal(&peer->clock, remoteUs);
+  *time = (uint32_t)lapClockScale(&peer->clock, lap->time);
+  return true;
+}
@@ -0,0 +1,41 @@
+//
+// Remote lap node
+//
+// What a receiver keeps about one other node: which of its laps have been
+// handed on, and how its clock maps onto ours. A node that restarts begins
+// both a new seq run and a new clock, so a restart seen in its heartbeat
+// drops the clock fit along with the lap window, and its laps go out
+// unsynced until fresh exchanges come back. Plain C, time is passed in.
+//
+
+#ifndef __lap_peer_INCLUDED__
+#define __lap_peer_INCLUDED__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lap_proto.h"
+#include "lap_clock.h"
+#include "lap_reliable.h"
+
+typedef struct
+{
+  LapClock_t clock;
+  LapReliableRx_t rx;
+} LapPeer_t;
+
+void lapPeerInit(LapPeer_t *peer, uint16_t nackMs);
+
+// Returns LAP_RELIABLE_NEW for a lap to hand on, LAP_RELIABLE_DUPLICATE otherwise
+int lapPeerLap(LapPeer_t *peer, const LapProtoLap_t *lap, int64_t nowUs);
+
+// True when the heartbeat shows the node restarted
+bool lapPeerHeartbeat(LapPeer_t *peer, const LapProtoHeartbeat_t *heartbeat, int64_t nowUs);
+
+void lapPeerSync(LapPeer_t *peer, const LapProtoSync_t *sync, int64_t nowUs);
+
+// The lap's detection on our clock and its time in our units. False while
+// the clock is unsynced or for senders without detectedUs.
+bool lapPeerLocal(const LapPeer_t *peer, const LapProtoLap_t *lap, int64_t nowUs, int64_t *localUs, uint32_t *time);
+
+#endif
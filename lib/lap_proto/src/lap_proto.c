@@ -0,0 +1,276 @@
+#include <string.h>
+
+#include "lap_proto.h"
+
+#define LAP_PROTO_LAP_SIZE 20
+#define LAP_PROTO_LAP_MIN_SIZE 16
+#define LAP_PROTO_PILOT_SIZE 12
+#define LAP_PROTO_RSSI_SIZE 8
+#define LAP_PROTO_HEARTBEAT_SIZE 16
+#define LAP_PROTO_HEARTBEAT_MIN_SIZE 12
+#define LAP_PROTO_NACK_SIZE 8
+#define LAP_PROTO_SYNC_SIZE 24
+
+static uint8_t *lapProtoPut8(uint8_t *p, uint8_t value)
+{
+  *p++ = value;
+  return p;
+}
+
+static uint8_t *lapProtoPut16(uint8_t *p, uint16_t value)
+{
+  *p++ = value & 0xff;
+  *p++ = value >> 8;
+  return p;
+}
+
+static uint8_t *lapProtoPut32(uint8_t *p, uint32_t value)
+{
+  p = lapProtoPut16(p, value & 0xffff);
+  return lapProtoPut16(p, value >> 16);
+}
+
+static uint8_t *lapProtoPut64(uint8_t *p, uint64_t value)
+{
+  p = lapProtoPut32(p, value & 0xffffffff);
+  return lapProtoPut32(p, value >> 32);
+}
+
+static uint16_t lapProtoGet16(const uint8_t *p)
+{
+  return p[0] | (uint16_t)p[1] << 8;
+}
+
+static uint32_t lapProtoGet32(const uint8_t *p)
+{
+  return lapProtoGet16(p) | (uint32_t)lapProtoGet16(p + 2) << 16;
+}
+
+static uint64_t lapProtoGet64(const uint8_t *p)
+{
+  return lapProtoGet32(p) | (uint64_t)lapProtoGet32(p + 4) << 32;
+}
+
+static uint8_t *lapProtoPutHeader(uint8_t *p, uint8_t type, uint8_t node, uint16_t length, uint32_t seq)
+{
+  p = lapProtoPut8(p, LAP_PROTO_MAGIC0);
+  p = lapProtoPut8(p, LAP_PROTO_MAGIC1);
+  p = lapProtoPut8(p, LAP_PROTO_VERSION);
+  p = lapProtoPut8(p, type);
+  p = lapProtoPut8(p, node);
+  p = lapProtoPut8(p, 0);
+  p = lapProtoPut16(p, length);
+  return lapProtoPut32(p, seq);
+}
+
+size_t lapProtoEncodeLap(uint8_t *buf, size_t size, uint8_t node, uint32_t seq, const LapProtoLap_t *lap)
+{
+  if (size < LAP_PROTO_HEADER_SIZE + LAP_PROTO_LAP_SIZE)
+    return 0;
+
+  uint8_t *p = lapProtoPutHeader(buf, LAP_PROTO_LAP, node, LAP_PROTO_LAP_SIZE, seq);
+  p = lapProtoPut32(p, lap->seq);
+  p = lapProtoPut8(p, lap->pilot);
+  p = lapProtoPut8(p, 0);
+  p = lapProtoPut16(p, lap->lap);
+  p = lapProtoPut32(p, lap->time);
+  p = lapProtoPut32(p, lap->timestamp);
+  p = lapProtoPut32(p, lap->detectedUs);
+  return p - buf;
+}
+
+size_t lapProtoEncodePilot(uint8_t *buf, size_t size, uint8_t node, uint32_t seq, const LapProtoPilot_t *pilot)
+{
+  if (size < LAP_PROTO_HEADER_SIZE + LAP_PROTO_PILOT_SIZE)
+    return 0;
+
+  uint8_t *p = lapProtoPutHeader(buf, LAP_PROTO_PILOT, node, LAP_PROTO_PILOT_SIZE, seq);
+  p = lapProtoPut8(p, pilot->pilot);
+  p = lapProtoPut8(p, pilot->band);
+  p = lapProtoPut8(p, pilot->channel);
+  p = lapProtoPut8(p, pilot->state);
+  p = lapProtoPut16(p, pilot->threshold);
+  p = lapProtoPut16(p, pilot->laps);
+  p = lapProtoPut32(p, pilot->lastLap);
+  return p - buf;
+}
+
+size_t lapProtoEncodeRssi(uint8_t *buf, size_t size, uint8_t node, uint32_t seq, const LapProtoRssi_t *rssi)
+{
+  uint8_t count = rssi->count < LAP_PROTO_MAX_RSSI ? rssi->count : LAP_PROTO_MAX_RSSI;
+  uint16_t length = LAP_PROTO_RSSI_SIZE + count * 2;
+
+  if (size < LAP_PROTO_HEADER_SIZE + (size_t)length)
+    return 0;
+
+  uint8_t *p = lapProtoPutHeader(buf, LAP_PROTO_RSSI, node, length, seq);
+  p = lapProtoPut32(p, rssi->timestamp);
+  p = lapProtoPut8(p, count);
+  p = lapProtoPut8(p, 0);
+  p = lapProtoPut16(p, rssi->decimation);
+
+  for (int c = 0; c < count; ++c)
+    p = lapProtoPut16(p, (uint16_t)rssi->filtered[c]);
+
+  return p - buf;
+}
+
+size_t lapProtoEncodeHeartbeat(uint8_t *buf, size_t size, uint8_t node, uint32_t seq, const LapProtoHeartbeat_t *heartbeat)
+{
+  if (size < LAP_PROTO_HEADER_SIZE + LAP_PROTO_HEARTBEAT_SIZE)
+    return 0;
+
+  uint8_t *p = lapProtoPutHeader(buf, LAP_PROTO_HEARTBEAT, node, LAP_PROTO_HEARTBEAT_SIZE, seq);
+  p = lapProtoPut32(p, heartbeat->head);
+  p = lapProtoPut32(p, heartbeat->oldest);
+  p = lapProtoPut32(p, heartbeat->uptime);
+  p = lapProtoPut32(p, heartbeat->boot);
+  return p - buf;
+}
+
+size_t lapProtoEncodeNack(uint8_t *buf, size_t size, uint8_t node, uint32_t seq, const LapProtoNack_t *nack)
+{
+  if (size < LAP_PROTO_HEADER_SIZE + LAP_PROTO_NACK_SIZE)
+    return 0;
+
+  uint8_t *p = lapProtoPutHeader(buf, LAP_PROTO_NACK, node, LAP_PROTO_NACK_SIZE, seq);
+  p = lapProtoPut32(p, nack->from);
+  p = lapProtoPut16(p, nack->count);
+  p = lapProtoPut16(p, 0);
+  return p - buf;
+}
+
+size_t lapProtoEncodeSync(uint8_t *buf, size_t size, uint8_t type, uint8_t node, uint32_t seq, const LapProtoSync_t *sync)
+{
+  if (size < LAP_PROTO_HEADER_SIZE + LAP_PROTO_SYNC_SIZE)
+    return 0;
+
+  uint8_t *p = lapProtoPutHeader(buf, type, node, LAP_PROTO_SYNC_SIZE, seq);
+  p = lapProtoPut64(p, sync->origin);
+  p = lapProtoPut64(p, sync->receive);
+  p = lapProtoPut64(p, sync->transmit);
+  return p - buf;
+}
+
+void lapProtoSetFlags(uint8_t *buf, uint8_t flags)
+{
+  buf[5] = flags;
+}
+
+int lapProtoDecode(const uint8_t *buf, size_t len, LapProtoPacket_t *packet)
+{
+  if (len < LAP_PROTO_HEADER_SIZE)
+    return LAP_PROTO_ERR_SHORT;
+
+  if (buf[0] != LAP_PROTO_MAGIC0 || buf[1] != LAP_PROTO_MAGIC1)
+    return LAP_PROTO_ERR_MAGIC;
+
+  // a newer major layout is not ours to guess at
+  if (buf[2] != LAP_PROTO_VERSION)
+    return LAP_PROTO_ERR_VERSION;
+
+  memset(packet, 0, sizeof(LapProtoPacket_t));
+
+  LapProtoHeader_t *header = &packet->header;
+  header->version = buf[2];
+  header->type = buf[3];
+  header->node = buf[4];
+  header->flags = buf[5];
+  header->length = lapProtoGet16(&buf[6]);
+  header->seq = lapProtoGet32(&buf[8]);
+
+  if (len < LAP_PROTO_HEADER_SIZE + (size_t)header->length)
+    return LAP_PROTO_ERR_SHORT;
+
+  const uint8_t *p = buf + LAP_PROTO_HEADER_SIZE;
+
+  switch (header->type)
+  {
+  case LAP_PROTO_LAP:
+    if (header->length < LAP_PROTO_LAP_MIN_SIZE)
+      return LAP_PROTO_ERR_LENGTH;
+
+    packet->lap.seq = lapProtoGet32(p);
+    packet->lap.pilot = p[4];
+    packet->lap.lap = lapProtoGet16(p + 6);
+    packet->lap.time = lapProtoGet32(p + 8);
+    packet->lap.timestamp = lapProtoGet32(p + 12);
+    if (header->length >= LAP_PROTO_LAP_SIZE)
+      packet->lap.detectedUs = lapProtoGet32(p + 16);
+    return LAP_PROTO_OK;
+
+  case LAP_PROTO_PILOT:
+    if (header->length < LAP_PROTO_PILOT_SIZE)
+      return LAP_PROTO_ERR_LENGTH;
+
+    packet->pilot.pilot = p[0];
+    packet->pilot.band = p[1];
+    packet->pilot.channel = p[2];
+    packet->pilot.state = p[3];
+    packet->pilot.threshold = lapProtoGet16(p + 4);
+    packet->pilot.laps = lapProtoGet16(p + 6);
+    packet->pilot.lastLap = lapProtoGet32(p + 8);
+    return LAP_PROTO_OK;
+
+  case LAP_PROTO_RSSI:
+    if (header->length < LAP_PROTO_RSSI_SIZE)
+      return LAP_PROTO_ERR_LENGTH;
+
+    packet->rssi.timestamp = lapProtoGet32(p);
+    packet->rssi.count = p[4];
+    packet->rssi.decimation = lapProtoGet16(p + 6);
+
+    if (packet->rssi.count > LAP_PROTO_MAX_RSSI || header->length < LAP_PROTO_RSSI_SIZE + packet->rssi.count * 2)
+      return LAP_PROTO_ERR_LENGTH;
+
+    for (int c = 0; c < packet->rssi.count; ++c)
+      packet->rssi.filtered[c] = (int16_t)lapProtoGet16(p + LAP_PROTO_RSSI_SIZE + c * 2);
+    return LAP_PROTO_OK;
+
+  case LAP_PROTO_HEARTBEAT:
+    if (header->length < LAP_PROTO_HEARTBEAT_MIN_SIZE)
+      return LAP_PROTO_ERR_LENGTH;
+
+    packet->heartbeat.head = lapProtoGet32(p);
+    packet->heartbeat.oldest = lapProtoGet32(p + 4);
+    packet->heartbeat.uptime = lapProtoGet32(p + 8);
+    if (header->length >= LAP_PROTO_HEARTBEAT_SIZE)
+      packet->heartbeat.boot = lapProtoGet32(p + 12);
+    return LAP_PROTO_OK;
+
+  case LAP_PROTO_NACK:
+    if (header->length < LAP_PROTO_NACK_SIZE)
+      return LAP_PROTO_ERR_LENGTH;
+
+    packet->nack.from = lapProtoGet32(p);
+    packet->nack.count = lapProtoGet16(p + 4);
+    return LAP_PROTO_OK;
+
+  case LAP_PROTO_SYNC_REQUEST:
+  case LAP_PROTO_SYNC_REPLY:
+    if (header->length < LAP_PROTO_SYNC_SIZE)
+      return LAP_PROTO_ERR_LENGTH;
+
+    packet->sync.origin = lapProtoGet64(p);
+    packet->sync.receive = lapProtoGet64(p + 8);
+    packet->sync.transmit = lapProtoGet64(p + 16);
+    return LAP_PROTO_OK;
+  }
+
+  return LAP_PROTO_ERR_TYPE;
+}
+
+int16_t lapProtoScaleRssi(float filtered)
+{
+  if (filtered > 1.0f)
+    filtered = 1.0f;
+  else if (filtered < -1.0f)
+    filtered = -1.0f;
+
+  return (int16_t)(filtered * 32767.0f);
+}
+
+float lapProtoUnscaleRssi(int16_t value)
+{
+  return value / 32767.0f;
+}
@@ -0,0 +1,146 @@
+//
+// Lap wire protocol
+//
+// Fixed layout binary packets for LAN consumers. Every field is written
+// byte by byte in little endian order, so the encoding does not depend on
+// compiler packing or host byte order and this file builds unchanged on a
+// PC. Receivers check magic and version, and ignore types they do not know.
+// Fields are only ever appended to a payload, so receivers also ignore
+// trailing bytes they do not know.
+//
+//   header   magic "LT", version, type, node, flags, payload length u16, packet seq u32
+//   lap      lap log seq u32, pilot u8, reserved u8, lap u16, time ms u32, timestamp ms u32,
+//            detected us u32 (low bits of the sync clock)
+//   pilot    pilot u8, band u8, channel u8, state u8, threshold u16, laps u16, last lap ms u32
+//   rssi     timestamp ms u32, count u8, reserved u8, decimation u16, count x filtered i16
+//   beat     newest lap seq u32, oldest replayable lap seq u32, uptime ms u32,
+//            first lap seq of this boot u32
+//   nack     first missing lap seq u32, count u16, reserved u16 (receiver to node)
+//   sync     origin us u64, receive us u64, transmit us u64 (request and reply)
+//
+// Lap packets carry the node's lap log seq, which has no gaps, so a
+// receiver can spot a missing lap and ask for it again with a nack.
+//
+
+#ifndef __lap_proto_INCLUDED__
+#define __lap_proto_INCLUDED__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define LAP_PROTO_VERSION 1
+#define LAP_PROTO_MAGIC0 'L'
+#define LAP_PROTO_MAGIC1 'T'
+
+#define LAP_PROTO_HEADER_SIZE 12
+#define LAP_PROTO_MAX_PACKET 256
+#define LAP_PROTO_MAX_RSSI 16
+
+#define LAP_PROTO_LAP 1
+#define LAP_PROTO_PILOT 2
+#define LAP_PROTO_RSSI 3
+#define LAP_PROTO_HEARTBEAT 4
+#define LAP_PROTO_NACK 5
+#define LAP_PROTO_SYNC_REQUEST 6
+#define LAP_PROTO_SYNC_REPLY 7
+
+#define LAP_PROTO_FLAG_RETRANSMIT 0x01
+
+#define LAP_PROTO_OK 0
+#define LAP_PROTO_ERR_SHORT -1
+#define LAP_PROTO_ERR_MAGIC -2
+#define LAP_PROTO_ERR_VERSION -3
+#define LAP_PROTO_ERR_LENGTH -4
+#define LAP_PROTO_ERR_TYPE -5
+
+typedef struct
+{
+  uint8_t version;
+  uint8_t type;
+  uint8_t node;
+  uint8_t flags;
+  uint16_t length;
+  uint32_t seq;
+} LapProtoHeader_t;
+
+typedef struct
+{
+  uint32_t seq;
+  uint8_t pilot;
+  uint16_t lap;
+  uint32_t time;
+  uint32_t timestamp;
+  uint32_t detectedUs; // 0 from senders that predate it
+} LapProtoLap_t;
+
+typedef struct
+{
+  uint8_t pilot;
+  uint8_t band;
+  uint8_t channel;
+  uint8_t state;
+  uint16_t threshold;
+  uint16_t laps;
+  uint32_t lastLap;
+} LapProtoPilot_t;
+
+typedef struct
+{
+  uint32_t timestamp;
+  uint8_t count;
+  uint16_t decimation; // sampler ticks per packet
+  int16_t filtered[LAP_PROTO_MAX_RSSI]; // -1.0 .. 1.0 scaled to -32767 .. 32767
+} LapProtoRssi_t;
+
+typedef struct
+{
+  uint32_t head;
+  uint32_t oldest;
+  uint32_t uptime;
+  uint32_t boot; // first lap seq logged since boot, 0 from senders that predate it
+} LapProtoHeartbeat_t;
+
+typedef struct
+{
+  uint32_t from;
+  uint16_t count;
+} LapProtoNack_t;
+
+// NTP style exchange, origin is set by the requester, receive and transmit by the replier
+typedef struct
+{
+  uint64_t origin;
+  uint64_t receive;
+  uint64_t transmit;
+} LapProtoSync_t;
+
+typedef struct
+{
+  LapProtoHeader_t header;
+  union {
+    LapProtoLap_t lap;
+    LapProtoPilot_t pilot;
+    LapProtoRssi_t rssi;
+    LapProtoHeartbeat_t heartbeat;
+    LapProtoNack_t nack;
+    LapProtoSync_t sync;
+  };
+} LapProtoPacket_t;
+
+// Each returns the packet size, or 0 when it does not fit in size bytes
+size_t lapProtoEncodeLap(uint8_t *buf, size_t size, uint8_t node, uint32_t seq, const LapProtoLap_t *lap);
+size_t lapProtoEncodePilot(uint8_t *buf, size_t size, uint8_t node, uint32_t seq, const LapProtoPilot_t *pilot);
+size_t lapProtoEncodeRssi(uint8_t *buf, size_t size, uint8_t node, uint32_t seq, const LapProtoRssi_t *rssi);
+size_t lapProtoEncodeHeartbeat(uint8_t *buf, size_t size, uint8_t node, uint32_t seq, const LapProtoHeartbeat_t *heartbeat);
+size_t lapProtoEncodeNack(uint8_t *buf, size_t size, uint8_t node, uint32_t seq, const LapProtoNack_t *nack);
+size_t lapProtoEncodeSync(uint8_t *buf, size_t size, uint8_t type, uint8_t node, uint32_t seq, const LapProtoSync_t *sync);
+
+void lapProtoSetFlags(uint8_t *buf, uint8_t flags);
+
+// Returns LAP_PROTO_OK or one of the LAP_PROTO_ERR codes
+int lapProtoDecode(const uint8_t *buf, size_t len, LapProtoPacket_t *packet);
+
+int16_t lapProtoScaleRssi(float filtered);
+float lapProtoUnscaleRssi(int16_t value);
+
+#endif
@@ -0,0 +1,139 @@
+#include <string.h>
+
+#include "lap_reliable.h"
+
+void lapReliableInit(LapReliableRx_t *rx, uint16_t nackMs)
+{
+  memset(rx, 0, sizeof(LapReliableRx_t));
+  rx->nackMs = nackMs;
+}
+
+// Moves delivered forward by one, counting the seq as lost if it never came
+static void lapReliableAdvance(LapReliableRx_t *rx)
+{
+  if ((rx->received & 1) == 0)
+    ++rx->lost;
+
+  rx->received >>= 1;
+  ++rx->delivered;
+}
+
+static void lapReliableSettle(LapReliableRx_t *rx)
+{
+  while (rx->received & 1)
+  {
+    rx->received >>= 1;
+    ++rx->delivered;
+  }
+}
+
+static void lapReliableStart(LapReliableRx_t *rx, uint32_t seq)
+{
+  // a late joiner starts from what it sees first, history is on /laps
+  rx->started = true;
+  rx->delivered = seq - 1;
+  rx->head = seq - 1;
+  rx->received = 0;
+}
+
+int lapReliableOnLap(LapReliableRx_t *rx, uint32_t seq, uint32_t nowMs)
+{
+  rx->lastHeardMs = nowMs;
+
+  if (!rx->started)
+    lapReliableStart(rx, seq);
+
+  if (seq <= rx->delivered)
+  {
+    ++rx->duplicates;
+    return LAP_RELIABLE_DUPLICATE;
+  }
+
+  // too far ahead, give up on the oldest gaps to make room
+  while (seq - rx->delivered > LAP_RELIABLE_WINDOW)
+    lapReliableAdvance(rx);
+
+  uint64_t bit = 1ull << (seq - rx->delivered - 1);
+  if (rx->received & bit)
+  {
+    ++rx->duplicates;
+    return LAP_RELIABLE_DUPLICATE;
+  }
+
+  rx->received |= bit;
+  if (seq > rx->head)
+    rx->head = seq;
+
+  ++rx->laps;
+  lapReliableSettle(rx);
+  return LAP_RELIABLE_NEW;
+}
+
+void lapReliableOnHeartbeat(LapReliableRx_t *rx, uint32_t head, uint32_t oldest, uint32_t uptime, uint32_t boot, uint32_t nowMs)
+{
+  rx->lastHeardMs = nowMs;
+
+  if (!rx->started)
+  {
+    // nothing owed from before we joined
+    lapReliableStart(rx, head + 1);
+    rx->uptime = uptime;
+    rx->uptimeAtMs = nowMs;
+    return;
+  }
+
+  // the node restarted and counts seqs again from the laps its journal
+  // replayed, which we already had. Everything from boot on is new, laps
+  // that arrived before this heartbeat were taken as duplicates and get
+  // nacked again.
+  uint32_t expected = rx->uptime + (nowMs - rx->uptimeAtMs);
+  if ((int32_t)(expected - uptime) > LAP_RELIABLE_REBOOT_MS)
+  {
+    lapReliableStart(rx, boot > 0 && boot <= head + 1 ? boot : head + 1);
+    ++rx->reboots;
+  }
+  else if ((int32_t)(uptime - rx->uptime) < 0)
+  {
+    // a heartbeat that was overtaken, the newer one already told us more
+    return;
+  }
+
+  rx->uptime = uptime;
+  rx->uptimeAtMs = nowMs;
+
+  if (head > rx->head)
+    rx->head = head;
+
+  // the node overwrote these, asking again is pointless
+  while (oldest > 0 && rx->delivered + 1 < oldest)
+  {
+    lapReliableAdvance(rx);
+    lapReliableSettle(rx);
+  }
+}
+
+bool lapReliableNack(LapReliableRx_t *rx, uint32_t nowMs, uint32_t *from, uint16_t *count)
+{
+  if (!rx->started || rx->head <= rx->delivered)
+    return false;
+
+  if (rx->nacks > 0 && nowMs - rx->lastNackMs < rx->nackMs)
+    return false;
+
+  // delivered + 1 is missing by definition, extend over the rest of the run
+  uint32_t run = 1;
+  while (rx->delivered + run < rx->head && run < LAP_RELIABLE_WINDOW && (rx->received & (1ull << run)) == 0)
+    ++run;
+
+  *from = rx->delivered + 1;
+  *count = run;
+
+  rx->lastNackMs = nowMs;
+  ++rx->nacks;
+  return true;
+}
+
+bool lapReliableSilent(const LapReliableRx_t *rx, uint32_t nowMs, uint32_t timeoutMs)
+{
+  return rx->started && nowMs - rx->lastHeardMs > timeoutMs;
+}
@@ -0,0 +1,57 @@
+//
+// Lap stream receiver
+//
+// Tracks one node's lap seqs on the receiving side: drops duplicates,
+// accepts reordering inside a 64 lap window, and works out which laps to
+// nack. Heartbeats tell it about laps it never saw at all, and which ones
+// the node can no longer replay, and when the node restarted and began its
+// seqs again from its journal. Plain C with no platform calls, time is
+// passed in, so it runs the same in a PC consumer as on a node.
+//
+
+#ifndef __lap_reliable_INCLUDED__
+#define __lap_reliable_INCLUDED__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define LAP_RELIABLE_WINDOW 64
+#define LAP_RELIABLE_REBOOT_MS 500 // uptime shortfall taken as a restart, a late heartbeat falls short by its delay only
+
+#define LAP_RELIABLE_NEW 0
+#define LAP_RELIABLE_DUPLICATE 1
+
+typedef struct
+{
+  bool started;
+  uint32_t delivered; // every seq up to here has been seen or given up
+  uint64_t received;  // bit n set when delivered + 1 + n has been seen
+  uint32_t head;      // newest seq known to exist
+  uint32_t uptime;    // node uptime at the last heartbeat
+  uint32_t uptimeAtMs;
+  uint32_t lastNackMs;
+  uint32_t lastHeardMs;
+  uint16_t nackMs; // minimum time between nacks
+
+  uint32_t laps;
+  uint32_t duplicates;
+  uint32_t lost; // fell out of the window or the node's replay log
+  uint32_t nacks;
+  uint32_t reboots;
+} LapReliableRx_t;
+
+void lapReliableInit(LapReliableRx_t *rx, uint16_t nackMs);
+
+// Returns LAP_RELIABLE_NEW for a lap to hand on, LAP_RELIABLE_DUPLICATE otherwise
+int lapReliableOnLap(LapReliableRx_t *rx, uint32_t seq, uint32_t nowMs);
+
+// boot is the first seq the node logged since it started, or 0 when it does not say
+void lapReliableOnHeartbeat(LapReliableRx_t *rx, uint32_t head, uint32_t oldest, uint32_t uptime, uint32_t boot, uint32_t nowMs);
+
+// The first run of missing laps, when one is due to be requested
+bool lapReliableNack(LapReliableRx_t *rx, uint32_t nowMs, uint32_t *from, uint16_t *count);
+
+// True when nothing, not even a heartbeat, arrived for timeoutMs
+bool lapReliableSilent(const LapReliableRx_t *rx, uint32_t nowMs, uint32_t timeoutMs);
+
+#endif
@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <string.h>
+#include "esp_timer.h"
+
+#include "lap_aggregator.h"
+#include "lap_timer.h"
+#include "lap_sectors.h"
+#include "ws_outbox.h"
+#include "cJSON.h"
+
+// a nack costs the node a replay, don't ask more often than this
+#define LAP_AGGREGATOR_NACK_MS 200
+
+static LapUdpConfig_t *config;
+
+static LapAggregatorNode_t nodes[LAP_AGGREGATOR_MAX_NODES];
+static uint32_t requestSeq = 0;
+static uint8_t packet[LAP_PROTO_MAX_PACKET];
+
+void lapAggregatorInit(LapUdpConfig_t *info)
+{
+  config = info;
+  memset(nodes, 0, sizeof(nodes));
+
+  printf("lap-aggregator: merging laps, sync every %u ms\n", config->syncMs);
+}
+
+static LapAggregatorNode_t *lapAggregatorNode(uint8_t node, struct sockaddr_in *from)
+{
+  LapAggregatorNode_t *slot = NULL;
+
+  for (int n = 0; n < LAP_AGGREGATOR_MAX_NODES; ++n)
+  {
+    if (nodes[n].active && nodes[n].node == node)
+    {
+      // nodes may change address after a DHCP renew
+      nodes[n].addr = *from;
+      return &nodes[n];
+    }
+
+    if (!nodes[n].active && slot == NULL)
+      slot = &nodes[n];
+  }
+
+  if (slot == NULL)
+    return NULL;
+
+  memset(slot, 0, sizeof(LapAggregatorNode_t));
+  slot->active = true;
+  slot->node = node;
+  slot->addr = *from;
+  lapPeerInit(&slot->peer, LAP_AGGREGATOR_NACK_MS);
+
+  printf("lap-aggregator: node %u joined from %s\n", node, inet_ntoa(from->sin_addr));
+  return slot;
+}
+
+static void lapAggregatorPublish(uint8_t node, const LapProtoLap_t *lap, int64_t localUs, uint32_t time, int32_t errorUs)
+{
+  cJSON *msg = cJSON_CreateObject();
+  cJSON_AddStringToObject(msg, "type", "aggregate");
+  cJSON_AddNumberToObject(msg, "node", node);
+  cJSON_AddNumberToObject(msg, "seq", lap->seq);
+  cJSON_AddNumberToObject(msg, "pilot", lap->pilot);
+  cJSON_AddNumberToObject(msg, "count", lap->lap);
+  cJSON_AddNumberToObject(msg, "time", time);
+
+  // unsynced laps still carry a usable lap time, just not a comparable moment
+  if (errorUs >= 0)
+  {
+    cJSON_AddNumberToObject(msg, "timestamp", (double)(localUs / 1000));
+    cJSON_AddNumberToObject(msg, "syncError", errorUs);
+  }
+
+  wsOutboxPublishJson(WS_OUTBOX_LAP, msg);
+  cJSON_Delete(msg);
+}
+
+static void lapAggregatorLap(LapAggregatorNode_t *node, const LapProtoLap_t *lap, int64_t nowUs)
+{
+  if (lapPeerLap(&node->peer, lap, nowUs) != LAP_RELIABLE_NEW)
+    return;
+
+  ++node->laps;
+
+  int64_t localUs;
+  uint32_t time;
+  if (!lapPeerLocal(&node->peer, lap, nowUs, &localUs, &time))
+  {
+    lapAggregatorPublish(node->node, lap, 0, lap->time, -1);
+    return;
+  }
+
+  lapAggregatorPublish(node->node, lap, localUs, time, node->peer.clock.errorUs);
+
+  // a remote node's pass may close a sector
+  const LapTimerConfig_t *timer = lapTimerConfigAcquire();
+  SectorConfig_t sectors = timer->sectors;
+  lapTimerConfigRelease(timer);
+
+  SectorSplit_t split;
+  lapSectorsPass(&sectors, node->node, lap->pilot, localUs, &split);
+}
+
+void lapAggregatorReceive(const LapProtoPacket_t *packet, struct sockaddr_in *from, int64_t nowUs)
+{
+  // requests between other nodes name the target, not the sender
+  if (packet->header.type != LAP_PROTO_LAP && packet->header.type != LAP_PROTO_HEARTBEAT && packet->header.type != LAP_PROTO_SYNC_REPLY)
+    return;
+
+  LapAggregatorNode_t *node = lapAggregatorNode(packet->header.node, from);
+  if (node == NULL)
+    return;
+
+  switch (packet->header.type)
+  {
+  case LAP_PROTO_LAP:
+    lapAggregatorLap(node, &packet->lap, nowUs);
+    break;
+
+  case LAP_PROTO_HEARTBEAT:
+    if (lapPeerHeartbeat(&node->peer, &packet->heartbeat, nowUs))
+    {
+      // its clock started over too, sync fast again
+      node->lastSyncUs = 0;
+      printf("lap-aggregator: node %u restarted, laps from seq %u\n", node->node, node->peer.rx.delivered + 1);
+    }
+    break;
+
+  case LAP_PROTO_SYNC_REPLY:
+    lapPeerSync(&node->peer, &packet->sync, nowUs);
+    ++node->syncs;
+    break;
+  }
+}
+
+void lapAggregatorPoll(int64_t nowUs)
+{
+  for (int n = 0; n < LAP_AGGREGATOR_MAX_NODES; ++n)
+  {
+    LapAggregatorNode_t *node = &nodes[n];
+    if (!node->active)
+      continue;
+
+    // sync fast until the fit has a few points, then settle to the configured rate
+    int64_t interval = (node->peer.clock.count < 4 ? 100 : config->syncMs) * 1000ll;
+    if (nowUs - node->lastSyncUs >= interval)
+    {
+      LapProtoSync_t request = {.origin = esp_timer_get_time()};
+      size_t len = lapProtoEncodeSync(packet, sizeof(packet), LAP_PROTO_SYNC_REQUEST, node->node, ++requestSeq, &request);
+      lapUdpSendPacket(packet, len, &node->addr);
+      node->lastSyncUs = nowUs;
+    }
+
+    uint32_t from;
+    uint16_t count;
+    if (lapReliableNack(&node->peer.rx, nowUs / 1000, &from, &count))
+    {
+      LapProtoNack_t nack = {.from = from, .count = count};
+      size_t len = lapProtoEncodeNack(packet, sizeof(packet), node->node, ++requestSeq, &nack);
+      lapUdpSendPacket(packet, len, &node->addr);
+    }
+  }
+}
+
+void lapAggregatorLocalLap(const LapEvent_t *event)
+{
+  LapProtoLap_t lap = {
+      .seq = event->seq,
+      .pilot = event->pilot,
+      .lap = event->lap,
+      .time = event->time,
+      .timestamp = event->timestamp,
+      .detectedUs = event->detectedUs};
+
+  // our own clock is the timebase, no error to add
+  int64_t localUs = lapClockUnwrap(event->detectedUs, esp_timer_get_time());
+  lapAggregatorPublish(config->node, &lap, localUs, event->time, 0);
+}
+
+int lapAggregatorNodes(const LapAggregatorNode_t **out, int maxNodes)
+{
+  int count = 0;
+  for (int n = 0; n < LAP_AGGREGATOR_MAX_NODES && count < maxNodes; ++n)
+  {
+    if (nodes[n].active)
+      out[count++] = &nodes[n];
+  }
+
+  return count;
+}
@@ -0,0 +1,46 @@
+//
+// Lap aggregator
+//
+// Runs on one node when several timers cover a race. It listens to every
+// other node's lap stream, keeps each node's clock synced with NTP style
+// exchanges and nacks lost laps. Each lap is mapped onto this node's clock
+// and published to WebSocket clients as an "aggregate" message. The
+// message carries the sync error bound, so a close finish between nodes
+// can be judged against it.
+//
+
+#ifndef __lap_aggregator_INCLUDED__
+#define __lap_aggregator_INCLUDED__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lwip/sockets.h"
+
+#include "lap_udp.h"
+#include "lap_log.h"
+#include "lap_proto.h"
+#include "lap_peer.h"
+
+#define LAP_AGGREGATOR_MAX_NODES 8
+
+typedef struct
+{
+  bool active;
+  uint8_t node;
+  struct sockaddr_in addr;
+  LapPeer_t peer;
+  int64_t lastSyncUs;
+  uint32_t syncs;
+  uint32_t laps;
+} LapAggregatorNode_t;
+
+void lapAggregatorInit(LapUdpConfig_t *info);
+
+// Called from the UDP task only
+void lapAggregatorReceive(const LapProtoPacket_t *packet, struct sockaddr_in *from, int64_t nowUs);
+void lapAggregatorPoll(int64_t nowUs);
+void lapAggregatorLocalLap(const LapEvent_t *event);
+
+int lapAggregatorNodes(const LapAggregatorNode_t **nodes, int maxNodes);
+
+#endif
@@ -0,0 +1,49 @@
+#include "lap_detect.h"
+
+bool lapDetectUpdate(const PilotConfig_t *pilot, PilotLapData_t *lapData, float rssi, uint32_t now, uint32_t minLapMs)
+{
+  // potential passing
+  uint32_t last = lapData->timesCount ? lapData->timestamps[lapData->timesCount - 1] : 0;
+  uint32_t lapTime = now - last;
+
+  bool lap = false;
+  float threshold = pilot->threshold / 4095.0f;
+
+  switch (lapData->state)
+  {
+  case LAP_STATE_LOW:
+    if (rssi >= threshold && lapData->resumed)
+    {
+      // the clock restarted with the node, the lap in progress cannot be timed
+      lapData->timestamps[lapData->timesCount - 1] = now;
+      lapData->state = LAP_STATE_DROP_WAIT;
+      lapData->resumed = 0;
+    }
+    else if (rssi >= threshold && lapData->timesCount > 0 && lapTime < minLapMs)
+    {
+      // too soon after the last pass to be a lap, wait for the signal to drop again
+      lapData->state = LAP_STATE_DROP_WAIT;
+    }
+    else if (rssi >= threshold)
+    {
+      lapData->timestamps[lapData->timesCount++] = now;
+      lapData->state = LAP_STATE_HIGH;
+
+      if (lapData->timesCount > 1)
+      {
+        // A lap occurred
+        lap = true;
+        lapData->times[lapData->timesCount - 2] = lapTime;
+      }
+    }
+    break;
+
+  case LAP_STATE_DROP_WAIT:
+  case LAP_STATE_HIGH:
+    if (rssi < threshold * 0.75f)
+      lapData->state = LAP_STATE_LOW;
+    break;
+  }
+
+  return lap;
+}
@@ -0,0 +1,48 @@
+//
+// Lap detection
+//
+// The per pilot threshold detector the lap timer runs on every filtered
+// sample. A pilot goes high when its RSSI reaches the threshold and is
+// rearmed once it falls below three quarters of it; each rising crossing
+// is a pass, and every pass after the first ends a lap. A crossing sooner
+// than the minimum lap time after the last pass is swallowed, and so is the
+// first one after a reboot resumed a lap whose start the clock lost.
+//
+// Plain C with no platform calls, so it runs the same on a PC.
+//
+
+#ifndef __lap_detect_INCLUDED__
+#define __lap_detect_INCLUDED__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAX_LAPS 32
+
+#define LAP_STATE_LOW 0
+#define LAP_STATE_HIGH 1
+#define LAP_STATE_UPDATE 2
+#define LAP_STATE_DROP_WAIT 3
+
+typedef struct
+{
+  uint8_t id;
+  uint8_t band;
+  uint8_t channel;
+  uint16_t threshold;
+} PilotConfig_t;
+
+typedef struct
+{
+  uint8_t state;
+  uint8_t resumed; // restored from the journal, the next crossing restarts timing
+  uint16_t timesCount;
+  uint32_t times[MAX_LAPS];
+  uint32_t timestamps[MAX_LAPS];
+} PilotLapData_t;
+
+// Feeds one sample taken at now (ms), true when it completed a lap. The caller
+// keeps timesCount below MAX_LAPS.
+bool lapDetectUpdate(const PilotConfig_t *pilot, PilotLapData_t *lapData, float rssi, uint32_t now, uint32_t minLapMs);
+
+#endif
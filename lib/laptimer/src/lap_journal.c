@@ -0,0 +1,377 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "rom/crc.h"
+#include "lap_journal.h"
+#include "task_plan.h"
+#include "metrics.h"
+#include "timers.h"
+
+#define JOURNAL_MAGIC 0x4a4c
+#define JOURNAL_VERSION 1
+
+#define JOURNAL_FILE 0
+#define JOURNAL_LAP 1
+#define JOURNAL_PILOT 2 // no longer written, older journals are read past them
+#define JOURNAL_RESET 3 // queued only, never written
+#define JOURNAL_HEAD 4  // newest lap seq seen, written after the file record by every compaction
+
+typedef struct
+{
+  uint16_t magic;
+  uint8_t type;
+  uint8_t length; // payload bytes that follow
+  uint32_t crc;   // over type, length and payload
+} JournalRecord_t;
+
+typedef struct
+{
+  uint8_t index;
+  uint8_t id;
+  uint8_t band;
+  uint8_t channel;
+  uint16_t threshold;
+} JournalPilot_t;
+
+typedef struct
+{
+  uint8_t type;
+  union {
+    uint32_t version;
+    uint32_t seq;
+    LapEvent_t lap;
+    JournalPilot_t pilot;
+  };
+} JournalItem_t;
+
+#define JOURNAL_MAX_RECORD (sizeof(JournalRecord_t) + sizeof(((JournalItem_t *)0)->lap))
+
+// what a compacted journal holds, rebuilt from every record written or replayed
+typedef struct
+{
+  LapEvent_t laps[LAP_JOURNAL_PILOT_LAPS];
+  uint32_t order[LAP_JOURNAL_PILOT_LAPS]; // journal wide arrival order, to interleave pilots again
+  uint32_t lapCount;
+} JournalShadow_t;
+
+static LapJournalConfig_t journalConfig;
+static const LapJournalConfig_t *config = &journalConfig;
+
+static JournalShadow_t shadow[LAP_JOURNAL_PILOTS];
+static uint32_t arrivals;
+static uint32_t newestSeq; // kept through resets, the lap log carries on counting
+static QueueHandle_t queue;
+static FILE *file;
+static uint32_t fileBytes;
+static char sidePath[sizeof(journalConfig.path) + 1];
+
+static MetricsCounter_t *commits;
+static MetricsCounter_t *dropped;
+static MetricsCounter_t *compactions;
+static MetricsCounter_t *resets;
+
+static void lapJournalTask(void *arg);
+
+static uint8_t journalPayloadLength(uint8_t type)
+{
+  switch (type)
+  {
+  case JOURNAL_FILE:
+  case JOURNAL_HEAD:
+    return sizeof(uint32_t);
+  case JOURNAL_LAP:
+    return sizeof(LapEvent_t);
+  case JOURNAL_PILOT:
+    return sizeof(JournalPilot_t);
+  }
+  return 0;
+}
+
+static uint32_t journalCrc(uint8_t type, uint8_t length, const void *payload)
+{
+  uint8_t head[2] = {type, length};
+  return crc32_le(crc32_le(0, head, sizeof(head)), payload, length);
+}
+
+// Writes item as a record at out, returns its size
+static size_t journalEncode(const JournalItem_t *item, uint8_t *out)
+{
+  JournalRecord_t record;
+  record.magic = JOURNAL_MAGIC;
+  record.type = item->type;
+  record.length = journalPayloadLength(item->type);
+  record.crc = journalCrc(record.type, record.length, &item->version);
+
+  memcpy(out, &record, sizeof(record));
+  memcpy(out + sizeof(record), &item->version, record.length);
+  return sizeof(record) + record.length;
+}
+
+// Reads the next record, false at the end of the file or at the first damaged record
+static bool journalDecode(FILE *in, JournalItem_t *item)
+{
+  JournalRecord_t record;
+  if (fread(&record, sizeof(record), 1, in) != 1)
+    return false;
+
+  if (record.magic != JOURNAL_MAGIC || record.length != journalPayloadLength(record.type))
+    return false;
+
+  if (fread(&item->version, record.length, 1, in) != 1)
+    return false;
+
+  item->type = record.type;
+  return record.crc == journalCrc(record.type, record.length, &item->version);
+}
+
+static void journalApply(const JournalItem_t *item)
+{
+  if (item->type == JOURNAL_HEAD && item->seq > newestSeq)
+    newestSeq = item->seq;
+
+  if (item->type == JOURNAL_LAP && item->lap.seq > newestSeq)
+    newestSeq = item->lap.seq;
+
+  if (item->type == JOURNAL_LAP && item->lap.pilot < LAP_JOURNAL_PILOTS)
+  {
+    JournalShadow_t *pilot = &shadow[item->lap.pilot];
+    int slot = pilot->lapCount++ % LAP_JOURNAL_PILOT_LAPS;
+    pilot->laps[slot] = item->lap;
+    pilot->order[slot] = arrivals++;
+  }
+}
+
+static bool journalWrite(FILE *out, const JournalItem_t *item)
+{
+  uint8_t buffer[JOURNAL_MAX_RECORD];
+  size_t len = journalEncode(item, buffer);
+  fileBytes += len;
+  return fwrite(buffer, 1, len, out) == len;
+}
+
+static void journalSync(FILE *out)
+{
+  fflush(out);
+  fsync(fileno(out));
+}
+
+// Rewrites the journal from the shadow and leaves it open for appending
+static void journalCompact()
+{
+  if (file != NULL)
+    fclose(file);
+
+  FILE *out = fopen(sidePath, "wb");
+  assert(out != NULL);
+  fileBytes = 0;
+
+  JournalItem_t item = {.type = JOURNAL_FILE, .version = JOURNAL_VERSION};
+  bool ok = journalWrite(out, &item);
+
+  item.type = JOURNAL_HEAD;
+  item.seq = newestSeq;
+  ok &= journalWrite(out, &item);
+
+  // merge the pilots' rings back into arrival order
+  uint32_t next[LAP_JOURNAL_PILOTS];
+  for (int p = 0; p < LAP_JOURNAL_PILOTS; ++p)
+    next[p] = shadow[p].lapCount > LAP_JOURNAL_PILOT_LAPS ? shadow[p].lapCount - LAP_JOURNAL_PILOT_LAPS : 0;
+
+  item.type = JOURNAL_LAP;
+  while (1)
+  {
+    int pick = -1;
+    for (int p = 0; p < LAP_JOURNAL_PILOTS; ++p)
+    {
+      if (next[p] == shadow[p].lapCount)
+        continue;
+      if (pick < 0 || shadow[p].order[next[p] % LAP_JOURNAL_PILOT_LAPS] < shadow[pick].order[next[pick] % LAP_JOURNAL_PILOT_LAPS])
+        pick = p;
+    }
+
+    if (pick < 0)
+      break;
+
+    item.lap = shadow[pick].laps[next[pick]++ % LAP_JOURNAL_PILOT_LAPS];
+    ok &= journalWrite(out, &item);
+  }
+
+  journalSync(out);
+  fclose(out);
+
+  // the side file is complete before the old journal goes, a crash in between leaves one of them
+  if (ok)
+  {
+    remove(config->path);
+    rename(sidePath, config->path);
+  }
+  else
+  {
+    printf("lap-journal: compaction failed, keeping the old journal\n");
+    remove(sidePath);
+  }
+
+  file = fopen(config->path, "ab");
+  assert(file != NULL);
+  if (!ok)
+    fileBytes = ftell(file);
+
+  metricsCount(compactions, 1);
+}
+
+static void journalReplay(LapJournalLapFn onLap)
+{
+  FILE *in = fopen(config->path, "rb");
+  if (in == NULL)
+  {
+    // died between removing the journal and renaming its replacement
+    in = fopen(sidePath, "rb");
+    if (in == NULL)
+      return;
+    fclose(in);
+    rename(sidePath, config->path);
+    in = fopen(config->path, "rb");
+  }
+  else
+  {
+    // an unfinished compaction, the journal itself is intact
+    remove(sidePath);
+  }
+
+  JournalItem_t item;
+  if (!journalDecode(in, &item) || item.type != JOURNAL_FILE || item.version != JOURNAL_VERSION)
+  {
+    printf("lap-journal: %s is not a v%d journal, starting empty\n", config->path, JOURNAL_VERSION);
+    fclose(in);
+    return;
+  }
+
+  int records = 0;
+  uint32_t start = millis();
+
+  while (journalDecode(in, &item))
+  {
+    journalApply(&item);
+    ++records;
+
+    if (item.type == JOURNAL_LAP)
+      onLap(&item.lap);
+  }
+
+  bool torn = !feof(in);
+  fclose(in);
+
+  printf("lap-journal: replayed %d records in %u ms%s\n", records, millis() - start, torn ? ", torn tail dropped" : "");
+}
+
+uint32_t lapJournalInit(const LapJournalConfig_t *info, LapJournalLapFn onLap)
+{
+  memcpy(&journalConfig, info, sizeof(journalConfig));
+  memset(shadow, 0, sizeof(shadow));
+  arrivals = 0;
+  newestSeq = 0;
+
+  if (config->path[0] == 0)
+    return 0;
+
+  sprintf(sidePath, "%s~", config->path);
+
+  commits = metricsCounter("journal_commits");
+  dropped = metricsCounter("journal_dropped");
+  compactions = metricsCounter("journal_compactions");
+  resets = metricsCounter("journal_resets");
+
+  journalReplay(onLap);
+  journalCompact();
+
+  queue = xQueueCreate(config->queueLength, sizeof(JournalItem_t));
+  assert(queue != NULL);
+
+  taskPlanCreate(TASK_ROLE_STORAGE, lapJournalTask, "lapJournalTask", NULL);
+  return newestSeq;
+}
+
+static void lapJournalQueue(const JournalItem_t *item)
+{
+  if (queue == NULL)
+    return;
+
+  if (xQueueSend(queue, item, 0) != pdTRUE)
+    metricsCount(dropped, 1);
+}
+
+void lapJournalLap(const LapEvent_t *event)
+{
+  JournalItem_t item = {.type = JOURNAL_LAP, .lap = *event};
+  lapJournalQueue(&item);
+}
+
+void lapJournalReset()
+{
+  JournalItem_t item = {.type = JOURNAL_RESET};
+  lapJournalQueue(&item);
+}
+
+static void lapJournalTask(void *arg)
+{
+  uint8_t *buffer = malloc(config->batch * JOURNAL_MAX_RECORD);
+  assert(buffer != NULL);
+
+  JournalItem_t item;
+
+  while (1)
+  {
+    xQueueReceive(queue, &item, portMAX_DELAY);
+
+    // the first record opens the batch, the commit waits at most commitMs for more
+    uint32_t first = millis();
+    size_t used = 0;
+    int count = 0;
+    bool reset = false;
+
+    while (1)
+    {
+      if (item.type == JOURNAL_RESET)
+      {
+        // laps batched ahead of it belong to the session that just ended
+        memset(shadow, 0, sizeof(shadow));
+        arrivals = 0;
+        used = 0;
+        reset = true;
+      }
+      else
+      {
+        used += journalEncode(&item, buffer + used);
+        journalApply(&item);
+      }
+
+      int32_t left = config->commitMs - (millis() - first);
+      if (++count >= config->batch || left <= 0 || xQueueReceive(queue, &item, left / portTICK_PERIOD_MS) != pdTRUE)
+        break;
+    }
+
+    if (reset)
+    {
+      // the shadow holds exactly the laps since the reset, rewriting from it truncates
+      printf("lap-journal: session reset\n");
+      metricsCount(resets, 1);
+      journalCompact();
+      continue;
+    }
+
+    if (fwrite(buffer, 1, used, file) != used)
+      printf("lap-journal: write failed\n");
+
+    journalSync(file);
+    fileBytes += used;
+    metricsCount(commits, 1);
+
+    if (fileBytes > config->compactBytes)
+      journalCompact();
+  }
+}
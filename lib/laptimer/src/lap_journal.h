@@ -0,0 +1,53 @@
+//
+// Lap journal
+//
+// Keeps the session on flash so a brown out mid heat loses at most the
+// last batch. Lap events are queued by the timing task and appended by a
+// storage task as checksummed records, group committed
+// every commitMs or batch records. At boot the journal is read back before
+// the timer starts; reading stops at the first record that is short or
+// fails its CRC, so a torn tail is dropped. Pilot settings are not
+// journaled, the stored config already has the newest ones. Laps keep
+// their lap log seq, and the journal remembers the newest seq it has seen
+// even across compactions and resets, so seqs are never handed out twice.
+//
+// Once the file passes compactBytes it is rewritten to hold only what the
+// session still needs, the newest laps of each pilot, so recovery time is
+// bounded however long the session runs. The
+// rewrite goes to a side file that replaces the journal by rename. Boot
+// always compacts, which also removes a torn tail.
+//
+
+#ifndef __lap_journal_INCLUDED__
+#define __lap_journal_INCLUDED__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lap_log.h"
+
+#define LAP_JOURNAL_PILOTS 8
+#define LAP_JOURNAL_PILOT_LAPS 32 // newest laps per pilot a compacted journal keeps
+
+typedef struct
+{
+  char path[32];         // e.g. /spiffs/session.jnl, empty disables the journal
+  uint16_t batch;        // records per commit at most
+  uint16_t commitMs;     // longest a queued record waits for its commit
+  uint16_t queueLength;  // records the timing task can queue ahead of the writer
+  uint32_t compactBytes; // journal size that triggers a compaction
+} LapJournalConfig_t;
+
+typedef void (*LapJournalLapFn)(const LapEvent_t *event);
+
+// Replays the journal through the callback, oldest first, then starts the writer.
+// Returns the newest lap log seq ever journaled, the log resumes after it
+uint32_t lapJournalInit(const LapJournalConfig_t *info, LapJournalLapFn onLap);
+
+// Queue without waiting, a full queue drops the record and counts it
+void lapJournalLap(const LapEvent_t *event);
+
+// Ends the session: laps queued before it are dropped and the journal is
+// truncated. Queued like a lap, so call it from the task that queues laps.
+void lapJournalReset();
+
+#endif
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "lap_log.h"
+
+static LapEvent_t events[LAP_LOG_SIZE];
+static volatile uint32_t head = 0;
+
+void lapLogInit()
+{
+  memset(events, 0, sizeof(events));
+  head = 0;
+}
+
+uint32_t lapLogAppend(LapEvent_t *event)
+{
+  uint32_t seq = head + 1;
+  LapEvent_t *slot = &events[seq % LAP_LOG_SIZE];
+
+  // readers see seq 0 while the slot is being rewritten and retry or skip it
+  __atomic_store_n(&slot->seq, 0, __ATOMIC_RELEASE);
+  event->seq = seq;
+  slot->pilot = event->pilot;
+  slot->lap = event->lap;
+  slot->time = event->time;
+  slot->timestamp = event->timestamp;
+  slot->detectedUs = event->detectedUs;
+  __atomic_store_n(&slot->seq, seq, __ATOMIC_RELEASE);
+
+  __atomic_store_n(&head, seq, __ATOMIC_RELEASE);
+  return seq;
+}
+
+void lapLogRestore(const LapEvent_t *event)
+{
+  if (event->seq == 0)
+    return;
+
+  events[event->seq % LAP_LOG_SIZE] = *event;
+  lapLogResume(event->seq);
+}
+
+void lapLogResume(uint32_t seq)
+{
+  if (seq > head)
+    __atomic_store_n(&head, seq, __ATOMIC_RELEASE);
+}
+
+uint32_t lapLogHead()
+{
+  return __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+}
+
+uint32_t lapLogOldest()
+{
+  uint32_t newest = lapLogHead();
+  return newest > LAP_LOG_SIZE ? newest - LAP_LOG_SIZE + 1 : 1;
+}
+
+int lapLogRead(uint32_t since, LapEvent_t *out, int maxEvents)
+{
+  uint32_t newest = lapLogHead();
+  uint32_t seq = since + 1;
+  uint32_t oldest = lapLogOldest();
+
+  if (seq < oldest)
+    seq = oldest;
+
+  int count = 0;
+  for (; seq <= newest && count < maxEvents; ++seq)
+  {
+    LapEvent_t *slot = &events[seq % LAP_LOG_SIZE];
+
+    uint32_t before = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    out[count] = *slot;
+    uint32_t after = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+    if (before != seq || after != seq)
+    {
+      // overwritten by a newer lap while copying, everything from here on is newer too
+      if (lapLogHead() + 1 >= seq + LAP_LOG_SIZE)
+        break;
+
+      // a lap from before a reboot the journal did not keep, there is nothing to send for it
+      continue;
+    }
+
+    out[count].seq = seq;
+    ++count;
+  }
+
+  return count;
+}
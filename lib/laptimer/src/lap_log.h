@@ -0,0 +1,47 @@
+//
+// Lap event log
+//
+// Every lap gets a sequence number and lands in a fixed ring, so clients
+// that reconnect can ask for just the events after the last one they saw.
+// Seqs survive a reboot: journaled laps come back under their own seq and
+// the log resumes after the newest seq the journal has seen. Laps the
+// journal did not keep leave gaps, which readers step over.
+//
+
+#ifndef __lap_log_INCLUDED__
+#define __lap_log_INCLUDED__
+
+#include <stdint.h>
+
+#define LAP_LOG_SIZE 256
+
+typedef struct
+{
+  uint32_t seq;
+  uint8_t pilot;
+  uint16_t lap;
+  uint32_t time;
+  uint32_t timestamp;
+  uint32_t detectedUs; // low bits of esp_timer, the clock nodes sync on
+} LapEvent_t;
+
+void lapLogInit();
+
+// Single writer (the lap timer task), assigns and returns the event's seq
+uint32_t lapLogAppend(LapEvent_t *event);
+
+// At boot only, before the lap timer task starts: puts a journaled event
+// back under its own seq, and moves the head to at least seq
+void lapLogRestore(const LapEvent_t *event);
+void lapLogResume(uint32_t seq);
+
+// Newest seq written, 0 when the log is empty
+uint32_t lapLogHead();
+
+// Oldest seq still held, events before it have been overwritten
+uint32_t lapLogOldest();
+
+// Copies up to maxEvents events with seq > since, oldest first
+int lapLogRead(uint32_t since, LapEvent_t *events, int maxEvents);
+
+#endif
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "lap_quality.h"
+#include "lap_timer.h"
+#include "ws_outbox.h"
+#include "task_plan.h"
+
+// room kept for the closing brackets
+#define LAP_QUALITY_RESERVE 8
+
+static LapQuality_t qualities[LAP_QUALITY_PILOTS];
+static WsOutboxWriter_t writer;
+
+static void lapQualityTask(void *arg);
+
+void lapQualityInit()
+{
+  memset(qualities, 0, sizeof(qualities));
+
+  taskPlanCreate(TASK_ROLE_TELEMETRY, lapQualityTask, "lapQualityTask", NULL);
+}
+
+const LapQuality_t *lapQuality(int pilot)
+{
+  return &qualities[pilot];
+}
+
+void lapQualityUpdate(int pilot, float rssi, float threshold, bool inPass, uint32_t now)
+{
+  LapQuality_t *q = &qualities[pilot];
+  float near = threshold * LAP_QUALITY_NEAR;
+  float rearm = threshold * LAP_QUALITY_REARM;
+
+  if (inPass)
+  {
+    if (!q->inPass)
+    {
+      q->inPass = true;
+      q->inNear = false;
+      q->runningPeak = rssi;
+      q->passStart = now;
+    }
+    q->runningPeak = rssi > q->runningPeak ? rssi : q->runningPeak;
+    return;
+  }
+
+  if (q->inPass)
+  {
+    // the pass ended, a sqrt per pass is all the SNR costs
+    q->inPass = false;
+    q->peak = q->runningPeak;
+    q->margin = q->peak - threshold;
+    q->passMs = now - q->passStart;
+    q->snr = q->variance > 0 ? (q->peak - q->floor) / sqrtf(q->variance) : 0;
+    ++q->passes;
+  }
+
+  if (rssi >= near || (q->inNear && rssi >= rearm))
+  {
+    if (!q->inNear)
+    {
+      q->inNear = true;
+      q->runningPeak = rssi;
+    }
+    q->runningPeak = rssi > q->runningPeak ? rssi : q->runningPeak;
+    return;
+  }
+
+  if (q->inNear)
+  {
+    q->inNear = false;
+    q->nearPeak = q->runningPeak;
+    ++q->nearMisses;
+  }
+
+  // only quiet samples feed the floor, so passes do not lift it
+  float delta = rssi - q->floor;
+  q->floor += LAP_QUALITY_ALPHA * delta;
+  q->variance += LAP_QUALITY_ALPHA * (delta * delta - q->variance);
+}
+
+static bool lapQualityAppend(int p, bool first)
+{
+  const LapQuality_t *q = &qualities[p];
+  return wsOutboxAppend(
+      &writer,
+      "%s{\"pilot\":%d,\"floor\":%.3f,\"noise\":%.4f,\"peak\":%.3f,\"margin\":%.3f,\"snr\":%.1f,\"passMs\":%u,\"passes\":%u,\"nearMisses\":%u,\"nearPeak\":%.3f}",
+      first ? "" : ",", p, q->floor, sqrtf(q->variance), q->peak, q->margin, q->snr, q->passMs, q->passes, q->nearMisses, q->nearPeak);
+}
+
+static void lapQualityPush()
+{
+  const LapTimerConfig_t *config = lapTimerConfigAcquire();
+  int pilotCount = config->pilotCount < LAP_QUALITY_PILOTS ? config->pilotCount : LAP_QUALITY_PILOTS;
+  lapTimerConfigRelease(config);
+
+  int p = 0;
+  while (p < pilotCount)
+  {
+    if (p > 0)
+      vTaskDelay(pdMS_TO_TICKS(LAP_QUALITY_SPLIT_MS));
+
+    int first = p;
+    wsOutboxWriterInit(&writer, LAP_QUALITY_RESERVE);
+    wsOutboxClose(&writer, "{\"type\":\"quality\",\"first\":%d,\"pilots\":[", first);
+
+    while (p < pilotCount && lapQualityAppend(p, p == first))
+      ++p;
+
+    // a pilot that cannot fit a frame on its own is left out rather than stalling the push
+    if (p == first)
+    {
+      printf("quality: pilot %d does not fit a frame\n", p);
+      ++p;
+      continue;
+    }
+
+    wsOutboxClose(&writer, "]}");
+    wsOutboxPublishWriter(WS_OUTBOX_QUALITY, &writer);
+  }
+}
+
+static void lapQualityTask(void *arg)
+{
+  TickType_t lastWake = xTaskGetTickCount();
+  while (1)
+  {
+    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(LAP_QUALITY_PUSH_MS));
+    lapQualityPush();
+  }
+}
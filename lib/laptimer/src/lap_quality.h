@@ -0,0 +1,59 @@
+//
+// Signal quality
+//
+// Rolling per pilot statistics for telling a weak transmitter or a bad
+// threshold from a detector fault. Every detector tick costs a handful of
+// multiply-adds per pilot: the noise floor and its variance are EWMAs taken
+// while the pilot is away from the gate, a pass tracks its peak and length,
+// and a rise that gets within LAP_QUALITY_NEAR of the threshold and falls
+// back below LAP_QUALITY_REARM without crossing it counts as a near miss,
+// so a signal hovering at the near level counts once.
+//
+// Pushed as quality telemetry frames of as many whole pilots as fit, each
+// carrying the index of its first pilot.
+//
+// Written by the lap timer task only; status and telemetry read it racily,
+// which is fine for what they show. Values are in the detector's normalized
+// RSSI units, the same as the threshold.
+//
+
+#ifndef __lap_quality_INCLUDED__
+#define __lap_quality_INCLUDED__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define LAP_QUALITY_PILOTS 8
+#define LAP_QUALITY_NEAR 0.8f       // fraction of threshold a near miss has to reach
+#define LAP_QUALITY_REARM 0.7f      // fraction of threshold a near miss has to fall back below
+#define LAP_QUALITY_ALPHA 0.001f    // floor and variance EWMA weight per tick
+#define LAP_QUALITY_PUSH_MS 1000
+#define LAP_QUALITY_SPLIT_MS 100    // between the frames of one push, quality frames coalesce
+
+typedef struct
+{
+  float floor;    // signal level away from the gate
+  float variance; // of the signal around floor
+  float peak;     // highest level of the last pass
+  float margin;   // that peak above threshold
+  float snr;      // that peak above floor, in noise standard deviations
+  uint32_t passMs;
+  uint32_t passes;
+  uint32_t nearMisses;
+  float nearPeak; // highest level of the last near miss
+
+  // in progress
+  bool inPass;
+  bool inNear;
+  float runningPeak;
+  uint32_t passStart;
+} LapQuality_t;
+
+void lapQualityInit();
+
+// One detector tick for pilot; inPass is the detector's own view of the pass
+void lapQualityUpdate(int pilot, float rssi, float threshold, bool inPass, uint32_t now);
+
+const LapQuality_t *lapQuality(int pilot);
+
+#endif
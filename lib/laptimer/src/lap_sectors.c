@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+#include "lap_sectors.h"
+#include "ws_outbox.h"
+#include "cJSON.h"
+
+static PilotSectors_t pilots[MAX_SECTOR_PILOTS];
+
+// passes arrive from the lap timer task and the udp task
+static portMUX_TYPE sectorLock = portMUX_INITIALIZER_UNLOCKED;
+
+void lapSectorsInit(const SectorConfig_t *config)
+{
+  memset(pilots, 0, sizeof(pilots));
+  for (int p = 0; p < MAX_SECTOR_PILOTS; ++p)
+    pilots[p].lastGate = -1;
+
+  if (config->gateCount > 1)
+    printf("lap-sectors: %u gates\n", config->gateCount);
+}
+
+static int lapSectorsGate(const SectorConfig_t *config, uint8_t node)
+{
+  for (int g = 0; g < config->gateCount; ++g)
+  {
+    if (config->gates[g].node == node)
+      return g;
+  }
+
+  return -1;
+}
+
+static void lapSectorsPublish(const SectorSplit_t *split)
+{
+  cJSON *msg = cJSON_CreateObject();
+  cJSON_AddStringToObject(msg, "type", "sector");
+  cJSON_AddNumberToObject(msg, "pilot", split->pilot);
+  cJSON_AddNumberToObject(msg, "sector", split->sector);
+  cJSON_AddNumberToObject(msg, "split", split->split);
+  cJSON_AddNumberToObject(msg, "delta", split->delta);
+  cJSON_AddNumberToObject(msg, "best", split->best);
+  cJSON_AddNumberToObject(msg, "theoreticalBest", split->theoreticalBest);
+
+  wsOutboxPublishJson(WS_OUTBOX_LAP, msg);
+  cJSON_Delete(msg);
+}
+
+bool lapSectorsPass(const SectorConfig_t *config, uint8_t node, uint8_t pilot, int64_t us, SectorSplit_t *split)
+{
+  if (config->gateCount < 2 || pilot >= MAX_SECTOR_PILOTS)
+    return false;
+
+  int gate = lapSectorsGate(config, node);
+  if (gate < 0)
+    return false;
+
+  bool completed = false;
+
+  portENTER_CRITICAL(&sectorLock);
+  PilotSectors_t *sectors = &pilots[pilot];
+
+  // a replayed pass can arrive after a later one, it can't form a split
+  if (sectors->lastGate >= 0 && us <= sectors->lastUs)
+  {
+    portEXIT_CRITICAL(&sectorLock);
+    return false;
+  }
+
+  if (sectors->lastGate >= 0 && gate == (sectors->lastGate + 1) % config->gateCount)
+  {
+    int sector = sectors->lastGate;
+    uint32_t time = (uint32_t)((us - sectors->lastUs) / 1000);
+    uint32_t best = sectors->best[sector];
+
+    split->pilot = pilot;
+    split->sector = sector;
+    split->split = time;
+    split->delta = best ? (int32_t)(time - best) : 0;
+
+    sectors->splits[sector] = time;
+    if (best == 0)
+    {
+      ++sectors->bestKnown;
+      sectors->best[sector] = time;
+      sectors->bestSum += time;
+    }
+    else if (time < best)
+    {
+      sectors->best[sector] = time;
+      sectors->bestSum -= best - time;
+    }
+
+    split->best = sectors->best[sector];
+    split->theoreticalBest = sectors->bestKnown == config->gateCount ? sectors->bestSum : 0;
+    completed = true;
+  }
+
+  sectors->lastGate = gate;
+  sectors->lastUs = us;
+  portEXIT_CRITICAL(&sectorLock);
+
+  if (completed)
+    lapSectorsPublish(split);
+
+  return completed;
+}
+
+const PilotSectors_t *lapSectorsPilot(uint8_t pilot)
+{
+  return &pilots[pilot];
+}
@@ -0,0 +1,71 @@
+//
+// Sector timing
+//
+// A track can have several gates, each watched by one node. Gate 0 is the
+// start/finish line and sector n runs from gate n to gate n + 1. Every
+// node runs the same pilot table, so a pass is just (gate, pilot, time on
+// this node's clock). Local passes come from the lap timer; remote ones
+// come from the aggregator once that node's clock is synced.
+//
+// Each pass updates the pilot's state in O(1): the split of the sector
+// just finished, its delta to the best, the best itself, and a running sum
+// of bests that gives the theoretical best lap. A pass out of gate order
+// (a missed gate) starts a fresh chain instead of producing a bogus split.
+//
+// Nodes only report passes that complete a lap, so a gate's first crossing
+// is not seen and splits start from the second lap.
+//
+// Gates are keyed by node alone: every pass a node reports belongs to its
+// one gate, so a node cannot time several gates for the same pilot, and
+// the lap model is untouched, each node still counts laps at its own gate.
+// Timing more points means adding nodes, one per gate.
+//
+
+#ifndef __lap_sectors_INCLUDED__
+#define __lap_sectors_INCLUDED__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAX_GATES 4
+#define MAX_SECTOR_PILOTS 8
+
+typedef struct
+{
+  uint8_t node; // node whose passes count for this gate, one gate per node
+} GateConfig_t;
+
+typedef struct
+{
+  uint8_t gateCount; // 0 or 1 disables sector timing
+  GateConfig_t gates[MAX_GATES];
+} SectorConfig_t;
+
+typedef struct
+{
+  int8_t lastGate;
+  int64_t lastUs;
+  uint32_t splits[MAX_GATES]; // latest split per sector, ms
+  uint32_t best[MAX_GATES];   // 0 until the sector has been timed
+  uint8_t bestKnown;          // how many sectors have a best
+  uint32_t bestSum;           // theoretical best once every sector is known
+} PilotSectors_t;
+
+typedef struct
+{
+  uint8_t pilot;
+  uint8_t sector;
+  uint32_t split;
+  int32_t delta; // split minus the previous best, 0 for the first time
+  uint32_t best;
+  uint32_t theoreticalBest; // 0 until every sector has a time
+} SectorSplit_t;
+
+void lapSectorsInit(const SectorConfig_t *config);
+
+// Records a pass of the gate watched by node, publishes the split when a sector completes
+bool lapSectorsPass(const SectorConfig_t *config, uint8_t node, uint8_t pilot, int64_t us, SectorSplit_t *split);
+
+const PilotSectors_t *lapSectorsPilot(uint8_t pilot);
+
+#endif
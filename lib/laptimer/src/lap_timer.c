@@ -9,36 +9,66 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
+#include <assert.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "freertos/semphr.h"
+#include "esp_timer.h"
 
 #include "display_controller.h"
+#include "display_renderer.h"
 #include "lap_timer.h"
+#include "lap_log.h"
+#include "lap_journal.h"
+#include "lap_quality.h"
+#include "lap_trace.h"
+#include "lap_aggregator.h"
+#include "lap_sectors.h"
+#include "lap_clock.h"
 #include "timers.h"
 #include "signal_detect.h"
 #include "filters.h"
-#include "udp_send.h"
 #include "webserver.h"
+#include "ws_outbox.h"
 #include "rx_controller.h"
 #include "mongoose.h"
 #include "cJSON.h"
+#include "config_snapshot.h"
+#include "tick_scheduler.h"
+#include "metrics.h"
+#include "trace_capture.h"
+#include "pool_alloc.h"
+#include "config_store.h"
+#include "chorus_controller.h"
+#include "bench.h"
+#include "lap_proto.h"
+
+#define LAP_SYNC_PAGE 32
+
+// pilots above this fraction of their threshold are sampled at the full rate
+#define LAP_APPROACH_FRACTION 0.6f
 
 typedef struct
 {
-  QueueHandle_t readTimerLock;
+  SemaphoreHandle_t configWriteLock;
+  volatile bool resetRequested; // taken up by the lap timer task, which owns the lap data
 } TimerState_t;
 
-static LapTimerConfig_t *config;
+static ConfigSnapshot_t configSnapshot;
+static LapTimerConfig_t configSlots[CONFIG_SNAPSHOT_SLOTS];
 static TimerState_t state;
 static PilotLapData_t allPilotLapData[MAX_RX_COUNT];
 static signal_data_t signal;
-static NetMessage_t *udpMsg = NULL;
 
 static WebRequestHandler_t statusHandler;
 static WebRequestHandler_t commandHandler;
+static WebRequestHandler_t lapsHandler;
 static WebSocketDataHandler_t pilotsCommandHandler;
+static WebSocketDataHandler_t lapsCommandHandler;
+static WebSocketDataHandler_t resetCommandHandler;
+static RendererConfig_t rendererConfig;
 
 static void rx_task();
 static char web_buffer[8192];
@@ -46,9 +76,12 @@ static char web_buffer[8192];
 void lapTimerTask(void *arg);
 void lapTimerDisplayTask(void *arg);
 
-void statusCallback(struct mg_connection *nc, struct http_message *hm)
+// Writes the status page into page, returns its length. Client stats come
+// from the caller, they can only be read on the mongoose thread
+static int lapTimerStatusPage(char *page, const WsOutboxClientStats_t *clients, int clientCount)
 {
-  char *start = &web_buffer[0];
+  const LapTimerConfig_t *config = lapTimerConfigAcquire();
+  char *start = page;
   start += sprintf(start, "<html><body><h1>Devices</h1><p>%d</p>", config->pilotCount);
   start += sprintf(start, "<table>");
   start += sprintf(start, "<th>Id</th>");
@@ -56,11 +89,18 @@ void statusCallback(struct mg_connection *nc, struct http_message *hm)
   start += sprintf(start, "<th>Channel</th>");
   start += sprintf(start, "<th>Threshold</th>");
   start += sprintf(start, "<th>RSSI</th>");
+  start += sprintf(start, "<th>Floor</th>");
+  start += sprintf(start, "<th>Noise</th>");
+  start += sprintf(start, "<th>Peak</th>");
+  start += sprintf(start, "<th>Margin</th>");
+  start += sprintf(start, "<th>SNR</th>");
+  start += sprintf(start, "<th>Pass ms</th>");
+  start += sprintf(start, "<th>Near misses</th>");
 
   RssiReading_t *rssi_readings = rssiReadings();
   for (int c = 0; c < config->pilotCount; ++c)
   {
-    PilotConfig_t *pilot = &config->pilots[c];
+    const PilotConfig_t *pilot = &config->pilots[c];
     PilotLapData_t *device = &allPilotLapData[c];
     start += sprintf(start, "<tr>");
     start += sprintf(start, "<td>%d</td>", c);
@@ -69,15 +109,216 @@ void statusCallback(struct mg_connection *nc, struct http_message *hm)
     start += sprintf(start, "<td>%d</td>", pilot->threshold);
     start += sprintf(start, "<td>%f</td>", rssi_readings[c].filtered);
 
+    const LapQuality_t *quality = lapQuality(c);
+    start += sprintf(start, "<td>%.3f</td>", quality->floor);
+    start += sprintf(start, "<td>%.4f</td>", sqrtf(quality->variance));
+    start += sprintf(start, "<td>%.3f</td>", quality->peak);
+    start += sprintf(start, "<td>%.3f</td>", quality->margin);
+    start += sprintf(start, "<td>%.1f</td>", quality->snr);
+    start += sprintf(start, "<td>%u</td>", quality->passMs);
+    start += sprintf(start, "<td>%u (%.3f)</td>", quality->nearMisses, quality->nearPeak);
+
     start += sprintf(start, "</tr>");
   }
 
+  lapTimerConfigRelease(config);
+
   start += sprintf(start, "</table>");
-  sprintf(start, "</body></html>");
-  int len = strlen(&web_buffer[0]);
+
+  const RendererStats_t *render = rendererStats();
+  start += sprintf(
+      start, "<h1>Display</h1><p>frames: %u, unchanged: %u, dirty bytes: %u, render: %u us (max %u), flush: %u us (max %u)</p>",
+      render->frames,
+      render->unchangedFrames,
+      render->dirtyBytes,
+      render->renderUs,
+      render->maxRenderUs,
+      render->flushUs,
+      render->maxFlushUs);
+
+  const TickConsumer_t *consumers[TICK_MAX_CONSUMERS];
+  int consumerCount = tickSchedulerConsumers(consumers, TICK_MAX_CONSUMERS);
+
+  start += sprintf(start, "<h1>Ticks</h1><p>%u Hz, %u ticks</p>", tickSchedulerBaseHz(), tickSchedulerTicks());
+  start += sprintf(start, "<table>");
+  start += sprintf(start, "<th>Task</th>");
+  start += sprintf(start, "<th>Divisor</th>");
+  start += sprintf(start, "<th>Wakes</th>");
+  start += sprintf(start, "<th>Coalesced</th>");
+  start += sprintf(start, "<th>Missed</th>");
+
+  for (int c = 0; c < consumerCount; ++c)
+  {
+    start += sprintf(start, "<tr>");
+    start += sprintf(start, "<td>%s</td>", consumers[c]->name);
+    start += sprintf(start, "<td>%u</td>", consumers[c]->divisor);
+    start += sprintf(start, "<td>%u</td>", consumers[c]->wakes);
+    start += sprintf(start, "<td>%u</td>", consumers[c]->coalesced);
+    start += sprintf(start, "<td>%u</td>", consumers[c]->missed);
+    start += sprintf(start, "</tr>");
+  }
+
+  start += sprintf(start, "</table>");
+
+  const LapTimerConfig_t *timer = lapTimerConfigAcquire();
+  if (timer->sectors.gateCount > 1)
+  {
+    start += sprintf(start, "<h1>Sectors</h1>");
+    start += sprintf(start, "<table>");
+    start += sprintf(start, "<th>Pilot</th>");
+    for (int g = 0; g < timer->sectors.gateCount; ++g)
+      start += sprintf(start, "<th>S%d Last / Best</th>", g + 1);
+    start += sprintf(start, "<th>Theoretical Best</th>");
+
+    for (int p = 0; p < timer->pilotCount && p < MAX_SECTOR_PILOTS; ++p)
+    {
+      const PilotSectors_t *sectors = lapSectorsPilot(p);
+      start += sprintf(start, "<tr>");
+      start += sprintf(start, "<td>%d</td>", p);
+      for (int g = 0; g < timer->sectors.gateCount; ++g)
+        start += sprintf(start, "<td>%u / %u</td>", sectors->splits[g], sectors->best[g]);
+      start += sprintf(start, "<td>%u</td>", sectors->bestKnown == timer->sectors.gateCount ? sectors->bestSum : 0);
+      start += sprintf(start, "</tr>");
+    }
+
+    start += sprintf(start, "</table>");
+  }
+  lapTimerConfigRelease(timer);
+
+  const LapAggregatorNode_t *nodes[LAP_AGGREGATOR_MAX_NODES];
+  int nodeCount = lapAggregatorNodes(nodes, LAP_AGGREGATOR_MAX_NODES);
+
+  if (nodeCount > 0)
+  {
+    start += sprintf(start, "<h1>Nodes</h1>");
+    start += sprintf(start, "<table>");
+    start += sprintf(start, "<th>Node</th>");
+    start += sprintf(start, "<th>Sync Error us</th>");
+    start += sprintf(start, "<th>Drift ppm</th>");
+    start += sprintf(start, "<th>Syncs</th>");
+    start += sprintf(start, "<th>Laps</th>");
+    start += sprintf(start, "<th>Lost</th>");
+    start += sprintf(start, "<th>Restarts</th>");
+
+    for (int n = 0; n < nodeCount; ++n)
+    {
+      start += sprintf(start, "<tr>");
+      start += sprintf(start, "<td>%u</td>", nodes[n]->node);
+      start += sprintf(start, "<td>%u</td>", nodes[n]->peer.clock.errorUs);
+      start += sprintf(start, "<td>%.1f</td>", nodes[n]->peer.clock.drift * 1e6);
+      start += sprintf(start, "<td>%u</td>", nodes[n]->syncs);
+      start += sprintf(start, "<td>%u</td>", nodes[n]->laps);
+      start += sprintf(start, "<td>%u</td>", nodes[n]->peer.rx.lost);
+      start += sprintf(start, "<td>%u</td>", nodes[n]->peer.rx.reboots);
+      start += sprintf(start, "</tr>");
+    }
+
+    start += sprintf(start, "</table>");
+  }
+
+  start += sprintf(start, "<h1>Clients</h1><p>evicted: %u</p>", wsOutboxEvictions());
+  start += sprintf(start, "<table>");
+  start += sprintf(start, "<th>Id</th>");
+  start += sprintf(start, "<th>Lap Queue</th>");
+  start += sprintf(start, "<th>Laps Sent</th>");
+  start += sprintf(start, "<th>Telemetry Sent</th>");
+  start += sprintf(start, "<th>Telemetry Dropped</th>");
+  start += sprintf(start, "<th>Buffered</th>");
+
+  for (int c = 0; c < clientCount; ++c)
+  {
+    start += sprintf(start, "<tr>");
+    start += sprintf(start, "<td>%u</td>", clients[c].id);
+    start += sprintf(start, "<td>%u</td>", clients[c].lapDepth);
+    start += sprintf(start, "<td>%u</td>", clients[c].lapsSent);
+    start += sprintf(start, "<td>%u</td>", clients[c].telemetrySent);
+    start += sprintf(start, "<td>%u</td>", clients[c].telemetryDropped);
+    start += sprintf(start, "<td>%u</td>", clients[c].bufferedBytes);
+    start += sprintf(start, "</tr>");
+  }
+
+  start += sprintf(start, "</table>");
+  start += sprintf(start, "</body></html>");
+  return start - page;
+}
+
+void statusCallback(struct mg_connection *nc, struct http_message *hm)
+{
+  WsOutboxClientStats_t clients[WS_OUTBOX_MAX_CLIENTS];
+  int clientCount = wsOutboxClientStats(clients, WS_OUTBOX_MAX_CLIENTS);
+
+  int len = lapTimerStatusPage(web_buffer, clients, clientCount);
   mg_printf(nc, "HTTP/1.1 200 OK\r\nContent-Type: application/html\r\nContent-Length: %d\r\n\r\n%.*s", len, len, &web_buffer[0]);
 }
 
+// Writes the laps after since into web_buffer, a page at a time
+static int lapTimerLapsPage(uint32_t since, int limit)
+{
+  static LapEvent_t page[LAP_SYNC_PAGE];
+
+  if (limit <= 0 || limit > LAP_SYNC_PAGE)
+    limit = LAP_SYNC_PAGE;
+
+  uint32_t head = lapLogHead();
+  uint32_t oldest = lapLogOldest();
+  int count = lapLogRead(since, page, limit);
+  uint32_t next = count ? page[count - 1].seq : since;
+
+  char *start = &web_buffer[0];
+  start += sprintf(start, "{\"type\":\"laps\",\"head\":%u,\"oldest\":%u,\"next\":%u", head, oldest, next);
+  start += sprintf(start, ",\"more\":%s", next < head ? "true" : "false");
+  start += sprintf(start, ",\"truncated\":%s", since + 1 < oldest ? "true" : "false");
+  start += sprintf(start, ",\"laps\":[");
+
+  for (int e = 0; e < count; ++e)
+  {
+    LapEvent_t *event = &page[e];
+    start += sprintf(
+        start, "%s{\"seq\":%u,\"pilot\":%u,\"count\":%u,\"time\":%u,\"timestamp\":%u}",
+        e ? "," : "",
+        event->seq,
+        event->pilot,
+        event->lap,
+        event->time,
+        event->timestamp);
+  }
+
+  start += sprintf(start, "]}");
+  return start - &web_buffer[0];
+}
+
+void lapsCallback(struct mg_connection *nc, struct http_message *hm)
+{
+  char value[16];
+  uint32_t since = 0;
+  int limit = LAP_SYNC_PAGE;
+
+  if (mg_get_http_var(&hm->query_string, "since", value, sizeof(value)) > 0)
+    since = strtoul(value, NULL, 10);
+
+  if (mg_get_http_var(&hm->query_string, "limit", value, sizeof(value)) > 0)
+    limit = atoi(value);
+
+  int len = lapTimerLapsPage(since, limit);
+  mg_printf(nc, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %d\r\n\r\n%.*s", len, len, &web_buffer[0]);
+}
+
+void lapTimerLapsCommandHandler(struct mg_connection *nc, cJSON *data)
+{
+  cJSON *value = NULL;
+  uint32_t since = 0;
+  int limit = LAP_SYNC_PAGE;
+
+  if ((value = cJSON_GetObjectItemCaseSensitive(data, "since")) != NULL)
+    since = (uint32_t)value->valuedouble;
+
+  if ((value = cJSON_GetObjectItemCaseSensitive(data, "limit")) != NULL)
+    limit = value->valueint;
+
+  int len = lapTimerLapsPage(since, limit);
+  mg_send_websocket_frame(nc, WEBSOCKET_OP_TEXT, &web_buffer[0], len);
+}
+
 bool lapTimerPilotCommand(cJSON *command_json, cJSON *resp)
 {
   cJSON *value = cJSON_GetObjectItemCaseSensitive(command_json, "id");
@@ -89,14 +330,20 @@ bool lapTimerPilotCommand(cJSON *command_json, cJSON *resp)
 
   int id = value->valueint;
 
-  if (id < 0 || id >= config->pilotCount)
+  // static to keep the copy off the web task stack
+  static LapTimerConfig_t next;
+  xSemaphoreTakeRecursive(state.configWriteLock, portMAX_DELAY);
+  configSnapshotCopy(&configSnapshot, &next);
+
+  if (id < 0 || id >= next.pilotCount)
   {
+    xSemaphoreGiveRecursive(state.configWriteLock);
     cJSON_AddNumberToObject(resp, "result", -1);
     return true;
   }
 
   printf("pilot.id: %d\n", id);
-  PilotConfig_t *pilot = &config->pilots[id];
+  PilotConfig_t *pilot = &next.pilots[id];
   if ((value = cJSON_GetObjectItemCaseSensitive(command_json, "band")) != NULL)
     pilot->band = value->valueint;
 
@@ -108,14 +355,23 @@ bool lapTimerPilotCommand(cJSON *command_json, cJSON *resp)
   if ((value = cJSON_GetObjectItemCaseSensitive(command_json, "threshold")) != NULL)
     pilot->threshold = value->valueint;
 
-  printf("rx set state: %d, %d, %d\n", id, pilot->band, pilot->channel);
-  rxSetState(id, pilot->band, pilot->channel);
+  // a config that fails validation is refused, the running one stays
+  bool updated = lapTimerConfigUpdate(&next);
+  xSemaphoreGiveRecursive(state.configWriteLock);
+  if (!updated)
+  {
+    cJSON_AddNumberToObject(resp, "result", -1);
+    return true;
+  }
+
   cJSON_AddNumberToObject(resp, "pilot", pilot->threshold);
   return true;
 }
 
 void commandCallback(struct mg_connection *nc, struct http_message *hm)
 {
+  // everything cJSON allocates below goes when the arena ends
+  poolArenaBegin();
   cJSON *resp = cJSON_CreateObject();
 
   cJSON *command_json = cJSON_Parse(hm->body.p);
@@ -126,6 +382,7 @@ void commandCallback(struct mg_connection *nc, struct http_message *hm)
     {
       printf(stderr, "Error before: %s\n", error_ptr);
       mg_http_send_error(nc, 404, error_ptr);
+      poolArenaEnd();
       return;
     }
   }
@@ -139,6 +396,13 @@ void commandCallback(struct mg_connection *nc, struct http_message *hm)
 
       lapTimerPilotCommand(command_json, resp);
     }
+    else if (strcmp(command->valuestring, "reset") == 0)
+    {
+      printf("command: reset\n");
+
+      lapTimerResetSession();
+      cJSON_AddNumberToObject(resp, "result", 0);
+    }
   }
 
   cJSON_PrintPreallocated(resp, web_buffer, sizeof(web_buffer), true);
@@ -147,8 +411,9 @@ void commandCallback(struct mg_connection *nc, struct http_message *hm)
   printf("write response\n");
   mg_printf(nc, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %d\r\n\r\n%.*s", len, len, &web_buffer[0]);
 
-  cJSON_Delete(command);
+  cJSON_Delete(command_json);
   cJSON_Delete(resp);
+  poolArenaEnd();
 }
 
 void lapTimerCommandHandler(struct mg_connection *nc, cJSON *data)
@@ -160,6 +425,7 @@ void lapTimerCommandHandler(struct mg_connection *nc, cJSON *data)
     return;
   }
 
+  poolArenaBegin();
   cJSON *resp = cJSON_CreateObject();
 
   if (strcmp(type->valuestring, "pilot") == 0)
@@ -173,15 +439,123 @@ void lapTimerCommandHandler(struct mg_connection *nc, cJSON *data)
   mg_send_websocket_frame(nc, WEBSOCKET_OP_TEXT, &web_buffer[0], len);
 
   cJSON_Delete(resp);
+  poolArenaEnd();
+}
+
+void lapTimerResetCommandHandler(struct mg_connection *nc, cJSON *data)
+{
+  lapTimerResetSession();
+}
+
+static void lapTimerBenchUpdatePilot(void *arg, uint32_t i)
+{
+  static PilotLapData_t lapData;
+  static const PilotConfig_t pilot = {.threshold = 2048};
+
+  // a slow sawtooth through the threshold, so every state gets its share
+  float rssi = (float)(i & 0x3ff) / 1024.0f;
+  if (lapData.timesCount >= MAX_LAPS - 1)
+    lapData.timesCount = 0;
+  lapDetectUpdate(&pilot, &lapData, rssi, i, 0);
+}
+
+// The bench task renders into a page of its own, web_buffer belongs to the mongoose thread,
+// with a full table of idle clients standing in for the live ones
+static void lapTimerBenchStatusPage(void *arg, uint32_t i)
+{
+  static char page[sizeof(web_buffer)];
+  static const WsOutboxClientStats_t clients[WS_OUTBOX_MAX_CLIENTS];
+  lapTimerStatusPage(page, clients, WS_OUTBOX_MAX_CLIENTS);
+}
+
+static void lapTimerBenchLapJson(void *arg, uint32_t i)
+{
+  char frame[256];
+
+  cJSON *msg = cJSON_CreateObject();
+  cJSON_AddStringToObject(msg, "type", "lap");
+  cJSON *pilots = cJSON_CreateArray();
+  cJSON_AddItemToObject(msg, "pilots", pilots);
+
+  cJSON *data = cJSON_CreateObject();
+  cJSON_AddItemToArray(pilots, data);
+  cJSON_AddNumberToObject(data, "seq", i);
+  cJSON_AddNumberToObject(data, "pilot", 0);
+  cJSON_AddNumberToObject(data, "count", 3);
+  cJSON_AddNumberToObject(data, "time", 18930);
+  cJSON_AddNumberToObject(data, "latency", 412);
+
+  cJSON_PrintPreallocated(msg, frame, sizeof(frame), false);
+  cJSON_Delete(msg);
+}
+
+static void lapTimerBenchLapProto(void *arg, uint32_t i)
+{
+  uint8_t packet[64];
+  LapProtoLap_t lap = {
+      .seq = i,
+      .pilot = 0,
+      .lap = 3,
+      .time = 18930,
+      .timestamp = 120000,
+      .detectedUs = 120000412};
+
+  volatile size_t len = lapProtoEncodeLap(packet, sizeof(packet), 0, i, &lap);
+  (void)len;
+}
+
+static void lapTimerBenchRegister()
+{
+  benchRegister("lap_update_pilot", lapTimerBenchUpdatePilot, NULL, BENCH_IRQ_OFF);
+  benchRegister("lap_status_page", lapTimerBenchStatusPage, NULL, 0);
+  benchRegister("lap_message_json", lapTimerBenchLapJson, NULL, 0);
+  benchRegister("lap_message_proto", lapTimerBenchLapProto, NULL, BENCH_IRQ_OFF);
+}
+
+static uint32_t replaySkipped;
+
+static void lapTimerReplayLap(const LapEvent_t *event)
+{
+  // clients resuming with /laps?since= see the lap under the seq it had before the reboot
+  lapLogRestore(event);
+
+  if (event->pilot >= MAX_RX_COUNT || event->lap == 0 || event->lap >= MAX_LAPS)
+  {
+    ++replaySkipped;
+    return;
+  }
+
+  PilotLapData_t *lapData = &allPilotLapData[event->pilot];
+  lapData->times[event->lap - 1] = event->time;
+  lapData->timestamps[event->lap - 1] = event->timestamp - event->time;
+  lapData->timestamps[event->lap] = event->timestamp;
+  lapData->timesCount = event->lap + 1;
+  lapData->resumed = 1;
 }
 
 void lapTimerInit(LapTimerConfig_t *info)
 {
-  config = info;
+  // the journal holds the laps of the session the node went down in
+  lapLogInit();
+  memset(&allPilotLapData, 0, sizeof(allPilotLapData));
+  replaySkipped = 0;
+  lapLogResume(lapJournalInit(&info->journal, &lapTimerReplayLap));
+  if (replaySkipped > 0)
+    printf("lap-timer: %u journaled laps are outside the lap table, restored to the log only\n", replaySkipped);
+
+  // the app only hands over a checked config, receivers are tuned straight from it
+  assert(lapTimerConfigValid(info));
+
+  // ticks are raised on the core that consumes them
+  info->scheduler.core = taskPlanPlacement(TASK_ROLE_SAMPLING)->core;
+
+  configSnapshotInit(&configSnapshot, configSlots, sizeof(LapTimerConfig_t), info);
+  state.configWriteLock = xSemaphoreCreateRecursiveMutex();
 
   // init sub modules
-  rssiInit(&config->rssiReader);
-  rxInit(&config->rxController);
+  tickSchedulerInit(&info->scheduler);
+  rssiInit(&info->rssiReader);
+  rxInit(&info->rxController);
 
   statusHandler.callback = &statusCallback;
   statusHandler.path = "/status";
@@ -191,84 +565,201 @@ void lapTimerInit(LapTimerConfig_t *info)
   commandHandler.path = "/command";
   commandHandler.request = HTTP_GET;
 
+  lapsHandler.callback = &lapsCallback;
+  lapsHandler.path = "/laps";
+  lapsHandler.request = HTTP_GET;
+
   webserverRegister(&commandHandler);
   webserverRegister(&statusHandler);
+  webserverRegister(&lapsHandler);
 
   pilotsCommandHandler.callback = &lapTimerCommandHandler;
   pilotsCommandHandler.command = "pilot";
   webserverWSRegister(&pilotsCommandHandler);
 
-  state.readTimerLock = xSemaphoreCreateBinary();
+  lapsCommandHandler.callback = &lapTimerLapsCommandHandler;
+  lapsCommandHandler.command = "laps";
+  webserverWSRegister(&lapsCommandHandler);
+
+  resetCommandHandler.callback = &lapTimerResetCommandHandler;
+  resetCommandHandler.command = "reset";
+  webserverWSRegister(&resetCommandHandler);
+
+  lapTraceInit();
+  lapQualityInit();
+  lapTimerBenchRegister();
+  wsOutboxSetTrace(&lapTraceNow, &lapTraceSent);
+  lapSectorsInit(&info->sectors);
+  lapUdpInit(&info->udp);
 
   memset(&signal, 0, sizeof(signal));
-  signal.alpha = lpfAlpha(50, 1.0f / config->updateHz);
+  signal.alpha = lpfAlpha(50, 1.0f / info->updateHz);
   signal.threshold = 5;
   signal.influence = 0;
 
-  timerInit(TIMER_1, TIMER_GROUP_0, state.readTimerLock, true, 1.0f / config->updateHz);
+  taskPlanCreate(TASK_ROLE_DETECTION, lapTimerTask, "lapTimerTask", NULL);
+  rendererInit(&rendererConfig);
 
-  xTaskCreate(lapTimerTask, "lapTimerTask", 1024 * 3, NULL, 10, NULL);
-  xTaskCreate(lapTimerDisplayTask, "lapTimerDisplayTask", 1024 * 3, NULL, 10, NULL);
+  // drawing runs off the timing core so it can never preempt them
+  taskPlanCreate(TASK_ROLE_DISPLAY, lapTimerDisplayTask, "lapTimerDisplayTask", NULL);
 }
 
-void lapTimerSetupPilotRx()
+const PilotLapData_t *lapTimerPilotLapData(int pilot)
 {
-  for (int p = 0; p < config->pilotCount; ++p)
+  return &allPilotLapData[pilot];
+}
+
+const LapTimerConfig_t *lapTimerConfigAcquire()
+{
+  return configSnapshotAcquire(&configSnapshot, NULL);
+}
+
+void lapTimerConfigRelease(const LapTimerConfig_t *snapshot)
+{
+  configSnapshotRelease(&configSnapshot, snapshot);
+}
+
+// Receiver c feeds RSSI channel c, with antenna diversity several of them serve one pilot
+static int lapTimerReceiverPilot(const RssiReaderConfig_t *rssi, int c)
+{
+  return rssi->outputCount ? rssi->outputs[c] : c;
+}
+
+static void lapTimerTunePilot(const LapTimerConfig_t *config, int p)
+{
+  const PilotConfig_t *pilot = &config->pilots[p];
+  for (int c = 0; c < config->rssiReader.channelCount; ++c)
   {
-    PilotConfig_t *pilot = &config->pilots[p];
-    rxSetState(
-        pilot->id,
-        pilot->band,
-        pilot->channel);
+    if (lapTimerReceiverPilot(&config->rssiReader, c) != p)
+      continue;
+
+    printf("rx set state: %d, %d, %d (pilot %d)\n", c, pilot->band, pilot->channel, pilot->id);
+    rxSetState(c, pilot->band, pilot->channel);
   }
 }
 
-void lapTimerSetup()
+bool lapTimerConfigValid(const LapTimerConfig_t *config)
 {
-  //assert(config->pilotCount == config->rssiReader.channelCount);
-  memset(&allPilotLapData, 0, sizeof(allPilotLapData));
+  const RssiReaderConfig_t *rssi = &config->rssiReader;
 
-  lapTimerSetupPilotRx();
+  if (config->pilotCount == 0 || config->pilotCount > MAX_RX_COUNT || rssi->channelCount > MAX_RSSI_CHANNEL_COUNT)
+  {
+    printf("lap-timer: %d pilots on %d channels is out of range\n", config->pilotCount, rssi->channelCount);
+    return false;
+  }
+
+  if (!rssiConfigValid(rssi))
+    return false;
+
+  if (rssi->channelCount > config->rxController.rxCount)
+  {
+    printf("lap-timer: %d rssi channels but only %d receivers\n", rssi->channelCount, config->rxController.rxCount);
+    return false;
+  }
+
+  if (rssiReadingCount(rssi) != config->pilotCount)
+  {
+    printf("lap-timer: %d rssi readings for %d pilots\n", rssiReadingCount(rssi), config->pilotCount);
+    return false;
+  }
+
+  uint32_t served = 0;
+  for (int c = 0; c < rssi->channelCount; ++c)
+  {
+    int p = lapTimerReceiverPilot(rssi, c);
+    if (p >= config->pilotCount)
+    {
+      printf("lap-timer: channel %d feeds pilot %d of %d\n", c, p, config->pilotCount);
+      return false;
+    }
+    served |= 1u << p;
+  }
+
+  if (served != (1u << config->pilotCount) - 1)
+  {
+    printf("lap-timer: pilots %x have no receiver\n", ~served & ((1u << config->pilotCount) - 1));
+    return false;
+  }
+
+  return true;
 }
 
-bool lapTimerUpdatePilot(PilotConfig_t *pilot, PilotLapData_t *lapData, float rssi, uint32_t now)
+bool lapTimerConfigUpdate(const LapTimerConfig_t *next)
 {
-  // potential passing
-  uint32_t last = lapData->timesCount ? lapData->timestamps[lapData->timesCount - 1] : 0;
-  uint32_t lapTime = now - last;
+  if (!lapTimerConfigValid(next))
+    return false;
 
-  bool lap = false;
-  float threshold = pilot->threshold / 4095.0f;
-  //float s = signal_detect(&signal, rssi);
+  // static to keep the copy off the caller's stack, guarded by the write lock
+  static LapTimerConfig_t prev;
+  xSemaphoreTakeRecursive(state.configWriteLock, portMAX_DELAY);
+  configSnapshotCopy(&configSnapshot, &prev);
+  configSnapshotPublish(&configSnapshot, next);
+  configStoreSave(LAP_TIMER_CONFIG_KEY, LAP_TIMER_CONFIG_VERSION, next, sizeof(*next));
 
-  switch (pilot->state)
+  bool remapped = memcmp(&prev.rssiReader, &next->rssiReader, sizeof(RssiReaderConfig_t)) != 0;
+  if (remapped)
+    rssiConfigUpdate(&next->rssiReader);
+
+  for (int p = 0; p < next->pilotCount; ++p)
   {
-  case LAP_STATE_LOW:
-    if (rssi >= threshold)
-    {
-      lapData->timestamps[lapData->timesCount++] = now;
-      pilot->state = LAP_STATE_HIGH;
+    const PilotConfig_t *pilot = &next->pilots[p];
+    const PilotConfig_t *old = &prev.pilots[p];
 
-      if (lapData->timesCount > 1)
-      {
-        // A lap occurred
-        float seconds = (float)lapTime / 1000;
-        lap = true;
-        //printf("Pilot: %u, lap: %f, signal: %f\n", pilot->id, seconds, s);
+    if (!remapped && p < prev.pilotCount && pilot->band == old->band && pilot->channel == old->channel)
+      continue;
 
-        lapData->times[lapData->timesCount - 2] = lapTime;
-      }
-    }
-    break;
+    lapTimerTunePilot(next, p);
+  }
+
+  xSemaphoreGiveRecursive(state.configWriteLock);
+  return true;
+}
+
+void lapTimerUpdatePilotConfig(const PilotConfig_t *pilot)
+{
+  static LapTimerConfig_t next;
+  xSemaphoreTakeRecursive(state.configWriteLock, portMAX_DELAY);
+  configSnapshotCopy(&configSnapshot, &next);
 
-  case LAP_STATE_DROP_WAIT:
-  case LAP_STATE_HIGH:
-    if (rssi < threshold * 0.75f)
-      pilot->state = LAP_STATE_LOW;
+  for (int p = 0; p < next.pilotCount; ++p)
+  {
+    if (next.pilots[p].id != pilot->id)
+      continue;
+
+    next.pilots[p] = *pilot;
+    lapTimerConfigUpdate(&next);
     break;
   }
 
-  return lap;
+  xSemaphoreGiveRecursive(state.configWriteLock);
+}
+
+void lapTimerResetSession()
+{
+  state.resetRequested = true;
+}
+
+void lapTimerUpdateMinLapTime(uint16_t ms)
+{
+  static LapTimerConfig_t next;
+  xSemaphoreTakeRecursive(state.configWriteLock, portMAX_DELAY);
+  configSnapshotCopy(&configSnapshot, &next);
+  next.minLapTime = ms;
+  lapTimerConfigUpdate(&next);
+  xSemaphoreGiveRecursive(state.configWriteLock);
+}
+
+void lapTimerSetupPilotRx()
+{
+  const LapTimerConfig_t *config = lapTimerConfigAcquire();
+  for (int p = 0; p < config->pilotCount; ++p)
+    lapTimerTunePilot(config, p);
+  lapTimerConfigRelease(config);
+}
+
+void lapTimerSetup()
+{
+  lapTimerSetupPilotRx();
 }
 
 void lapTimerTask(void *arg)
@@ -276,30 +767,112 @@ void lapTimerTask(void *arg)
   lapTimerSetup();
 
   uint32_t updateCount = 0;
+  uint32_t appliedVersion = 0;
+  uint32_t appliedHz = 0;
+
+  // the detector shares the sampler's timebase, so it always wakes right after a sample tick
+  const LapTimerConfig_t *initial = lapTimerConfigAcquire();
+  TickConsumer_t *ticks = tickSchedulerAdd("lapTimer", initial->updateHz);
+  lapTimerConfigRelease(initial);
+
+  MetricsLoop_t *loop = metricsLoop("lapTimer");
+  uint16_t span = traceCaptureName("lapTimer");
+  MetricsCounter_t *sampleGaps = metricsCounter("rssi_sample_gaps");
+  MetricsCounter_t *samplesLost = metricsCounter("rssi_samples_lost");
+  uint32_t lastSampleCount = 0;
+  int32_t samplesOwed = 0;
+
   while (1)
   {
-    if (xSemaphoreTake(state.readTimerLock, portMAX_DELAY) != pdTRUE)
-      continue;
-    //assert(config->pilotCount == config->rssiReader.channelCount);
+    uint32_t elapsed = tickSchedulerWait(ticks);
+    metricsLoopBegin(loop);
+    traceCaptureBegin(span);
+
+    uint32_t version = 0;
+    const LapTimerConfig_t *config = configSnapshotAcquire(&configSnapshot, &version);
+    if (version != appliedVersion)
+    {
+      if (appliedHz != 0 && appliedHz != config->updateHz)
+        tickSchedulerSetRate(ticks, config->updateHz);
+
+      signal.alpha = lpfAlpha(50, 1.0f / config->updateHz);
+      metricsLoopExpect(loop, config->updateHz);
+      traceCaptureRate(span, config->updateHz);
+      appliedHz = config->updateHz;
+      appliedVersion = version;
+    }
+
+    // laps are queued to the journal from here too, so the reset lands in order
+    if (state.resetRequested)
+    {
+      state.resetRequested = false;
+      memset(allPilotLapData, 0, sizeof(allPilotLapData));
+      lapJournalReset();
+      printf("lap-timer: session reset\n");
+    }
 
     RssiReading_t *rssi_readings = rssiReadings();
     uint32_t now = millis();
 
+    // the sampler should have run updateHz ratio times per detector tick, one
+    // sample may still be in flight on the other core, anything beyond that never happened
+    uint32_t sampleCount = rssi_readings[0].sampleCount;
+    if (lastSampleCount != 0)
+    {
+      samplesOwed += elapsed * (config->rssiReader.updateHz / config->updateHz);
+      samplesOwed -= sampleCount - lastSampleCount;
+
+      if (samplesOwed > 1)
+      {
+        metricsCount(sampleGaps, 1);
+        metricsCount(samplesLost, samplesOwed - 1);
+        samplesOwed = 1;
+      }
+      else if (samplesOwed < 0)
+      {
+        samplesOwed = 0;
+      }
+    }
+    lastSampleCount = sampleCount;
+
     bool update = false;
+    uint32_t passAt[MAX_RX_COUNT];
+    uint32_t hot = 0;
 
     for (int i = 0; i < config->pilotCount; ++i)
     {
-      PilotConfig_t *pilot = &config->pilots[i];
+      const PilotConfig_t *pilot = &config->pilots[i];
       float rssi = rssi_readings[i].filtered;
 
+      // the filtered signal lags the antenna, the pass happened that much earlier
+      passAt[i] = now - (rssi_readings[i].delayUs + 500) / 1000;
+
       PilotLapData_t *lapData = &allPilotLapData[i];
-      update |= lapTimerUpdatePilot(pilot, lapData, rssi, now);
+      update |= lapDetectUpdate(pilot, lapData, rssi, passAt[i], config->minLapTime);
+      lapQualityUpdate(i, rssi, pilot->threshold / 4095.0f, lapData->state != LAP_STATE_LOW, passAt[i]);
+
+      if (lapData->state != LAP_STATE_LOW || rssi >= pilot->threshold / 4095.0f * LAP_APPROACH_FRACTION)
+        hot |= 1 << i;
     }
 
+    rssiSetHot(hot);
+
     if (!update)
+    {
+      lapTimerConfigRelease(config);
+      traceCaptureEnd(span);
+      metricsLoopEnd(loop);
       continue;
+    }
 
     update = false;
+    uint32_t detectedUs = lapTraceNow();
+    LapTrace_t traces[MAX_RX_COUNT];
+    uint8_t passed[MAX_RX_COUNT];
+    uint32_t passedUs[MAX_RX_COUNT];
+    int traceCount = 0;
+    uint32_t originUs = 0;
+
     cJSON *msg = cJSON_CreateObject();
     cJSON_AddStringToObject(msg, "type", "lap");
     cJSON *pilots = cJSON_CreateArray();
@@ -307,113 +880,125 @@ void lapTimerTask(void *arg)
 
     for (int i = 0; i < config->pilotCount; ++i)
     {
-      PilotConfig_t *pilot = &config->pilots[i];
       PilotLapData_t *lapData = &allPilotLapData[i];
 
-      if (pilot->state != LAP_STATE_HIGH || lapData->timestamps[lapData->timesCount - 1] != now || lapData->timesCount < 2)
+      if (lapData->state != LAP_STATE_HIGH || lapData->timestamps[lapData->timesCount - 1] != passAt[i] || lapData->timesCount < 2)
         continue;
 
       update = true;
-      pilot->state = LAP_STATE_DROP_WAIT;
+      lapData->state = LAP_STATE_DROP_WAIT;
       uint32_t lapTime = lapData->times[lapData->timesCount - 2];
       printf("LapTime: %d:%u: %u, %f\n", i, lapData->timesCount - 1, lapTime, (float)lapTime / 1000.0f);
 
+      LapEvent_t event = {
+          .pilot = i,
+          .lap = lapData->timesCount - 1,
+          .time = lapTime,
+          .timestamp = passAt[i],
+          .detectedUs = detectedUs - rssi_readings[i].delayUs};
+      lapLogAppend(&event);
+      lapJournalLap(&event);
+      chorusControllerLap(&event);
+
+      passed[traceCount] = i;
+      passedUs[traceCount] = event.detectedUs;
+      LapTrace_t *trace = &traces[traceCount++];
+      trace->us[LAP_STAGE_SAMPLED] = rssi_readings[i].sampleUs;
+      trace->us[LAP_STAGE_FILTERED] = rssi_readings[i].filteredUs;
+      trace->us[LAP_STAGE_DETECTED] = detectedUs;
+      if (traceCount == 1 || (int32_t)(trace->us[LAP_STAGE_SAMPLED] - originUs) < 0)
+        originUs = trace->us[LAP_STAGE_SAMPLED];
+
       cJSON *data = cJSON_CreateObject();
       cJSON_AddItemToArray(pilots, data);
 
+      cJSON_AddNumberToObject(data, "seq", event.seq);
       cJSON_AddNumberToObject(data, "pilot", i);
       cJSON_AddNumberToObject(data, "count", lapData->timesCount - 1);
       cJSON_AddNumberToObject(data, "time", lapTime);
+      cJSON_AddNumberToObject(data, "latency", detectedUs - trace->us[LAP_STAGE_SAMPLED]);
     }
 
+    SectorConfig_t sectors = config->sectors;
+    uint8_t node = config->udp.node;
+    lapTimerConfigRelease(config);
+
     if (update)
     {
-      webServerBroadcastJson(msg);
+      // the frame leaves once for all laps in it, sent time is tracked from the oldest sample
+      uint32_t readyUs = 0;
+      if (wsOutboxPublishJsonTraced(WS_OUTBOX_LAP, msg, originUs, &readyUs))
+      {
+        for (int t = 0; t < traceCount; ++t)
+        {
+          traces[t].us[LAP_STAGE_SERIALIZED] = readyUs;
+          lapTraceRecord(&traces[t], LAP_STAGE_SAMPLED, LAP_STAGE_SERIALIZED);
+        }
+      }
     }
 
     cJSON_Delete(msg);
+
+    // splits follow the lap they belong to
+    if (sectors.gateCount > 1)
+    {
+      int64_t nowUs = esp_timer_get_time();
+      for (int t = 0; t < traceCount; ++t)
+      {
+        SectorSplit_t split;
+        lapSectorsPass(&sectors, node, passed[t], lapClockUnwrap(passedUs[t], nowUs), &split);
+      }
+    }
+
+    traceCaptureEnd(span);
+    metricsLoopEnd(loop);
     // TODO: queue readings
   }
 }
 
 void lapTimerDisplayTask(void *arg)
 {
-  int tri[3][2] = {
-      {16, 16},
-      {16, 0},
-      {0, 0},
-
-  };
-  //memset(tri, 0, sizeof(tri));
-
-  //    render_initialize(DISPLAY_WIDTH, DISPLAY_HEIGHT);
-
-  int y = 5;
   char buf[128 / 8];
+  TickType_t lastWake = xTaskGetTickCount();
+  uint16_t span = traceCaptureName("display");
 
   while (1)
   {
-    //render_begin_frame();
-
-    //render_draw();
-
-    // displayDrawLine(
-    //     DISPLAY_WIDTH-1, DISPLAY_HEIGHT-1,
-    //     0, 0,
-    //     1
-    // );
-
-    uint32_t now = millis();
-
+    const LapTimerConfig_t *config = lapTimerConfigAcquire();
+    TickType_t frameTicks = pdMS_TO_TICKS(config->displayFrameMs);
     RssiReading_t *rssi_readings = rssiReadings();
 
-    int s = 0;
-    int x = 10;
-    for(int r=0; r < config->rssiReader.channelCount; ++r)
-    {
+    traceCaptureBegin(span);
+    rendererBeginFrame();
 
+    int s = 1;
+    int x = 14;
+    for (int r = 0; r < rssiReadingCount(&config->rssiReader); ++r)
+    {
       int percent = (int)((rssi_readings[r].filtered) * 50);
+      rendererFillRect(x, s, percent, 5, 1);
 
-      for (int p = 0; p < percent; ++p)
-      {
-        for(int h=0; h < 5; ++h)
-        {
-          displayDraw(x+p, s + h, 1);
-        }
-      }
-
-      PilotConfig_t *pilot = &config->pilots[r];
+      const PilotConfig_t *pilot = &config->pilots[r];
       PilotLapData_t *lapData = &allPilotLapData[r];
 
       sprintf(
           buf, "%c%u",
           rxGetBandShortName(pilot->band),
           pilot->channel);
-      displayDrawString(0, s, buf); 
+      rendererDrawString(0, s, buf);
 
-      s += 12;
+      uint16_t timesCount = lapData->timesCount;
+      if (timesCount > 1)
+        rendererDrawLapTime(x + 52, s, timesCount - 1, lapData->times[timesCount - 2]);
 
-      // sprintf(
-      //     buf, "%c%u:%d:%.2f",
-      //     rxGetBandShortName(pilot->band),
-      //     pilot->channel,
-      //     rxGetFrequency(pilot->band, pilot->channel),
-      //     (now - lapData->timestamps[lapData->timesCount - 1]) / 1000.0f);
-      // displayDrawString(8, s, buf); 
-
-      // if (lapData->timesCount > 1)
-      // {
-      //   s += 10;
-      //   int lapCount = lapData->timesCount - 1;
-      //   int lapTime = lapData->times[lapData->timesCount - 2];
-      //   sprintf(buf, "%d:%0.2f", lapCount, lapTime / 1000.0f);
-      //   displayDrawString(1, s, buf); 
-      // }
+      s += 12;
     }
 
-    displayUpdate();
+    lapTimerConfigRelease(config);
+    rendererEndFrame();
+    traceCaptureEnd(span);
 
-    vTaskDelay(0);
-    displayClear();
+    // fixed frame rate, and always yield so drawing never starves anything below us
+    vTaskDelayUntil(&lastWake, frameTicks > 0 ? frameTicks : 1);
   }
 }
@@ -6,42 +6,55 @@
 #include "driver/adc.h"
 #include "rssi_reader.h"
 #include "rx_controller.h"
+#include "tick_scheduler.h"
+#include "task_plan.h"
+#include "lap_udp.h"
+#include "lap_sectors.h"
+#include "lap_journal.h"
+#include "lap_detect.h"
 
-#define MAX_LAPS 32
-
-#define LAP_STATE_LOW 0
-#define LAP_STATE_HIGH 1
-#define LAP_STATE_UPDATE 2
-#define LAP_STATE_DROP_WAIT 3
-
-typedef struct
-{
-  uint8_t id;
-  uint8_t band;
-  uint8_t channel;
-  uint16_t threshold;
-  uint8_t state;
-} PilotConfig_t;
+// Bump whenever LapTimerConfig_t or anything in it changes layout, stored copies are then ignored
+#define LAP_TIMER_CONFIG_VERSION 3
+#define LAP_TIMER_CONFIG_KEY "laptimer"
 
 typedef struct
 {
   uint32_t updateHz;
   uint8_t pilotCount;
   uint16_t minLapTime;
+  uint16_t displayFrameMs;
 
   PilotConfig_t pilots[MAX_RX_COUNT];
+  TaskPlanConfig_t tasks; // started by the app before any module, everything else creates tasks through it
+  TickSchedulerConfig_t scheduler;
+  LapUdpConfig_t udp;
+  SectorConfig_t sectors;
+  LapJournalConfig_t journal;
   RssiReaderConfig_t rssiReader;
   RxControllerConfig_t rxController;
 } LapTimerConfig_t;
 
-typedef struct
-{
-  uint16_t timesCount;
-  uint32_t times[MAX_LAPS];
-  uint32_t timestamps[MAX_LAPS];
-} PilotLapData_t;
-
 void lapTimerInit(LapTimerConfig_t *info);
-void lapTimerUpdatePilotConfig(PilotConfig_t *pilot);
+
+// Pin the current config for one batch of work, release when the batch is done
+const LapTimerConfig_t *lapTimerConfigAcquire();
+void lapTimerConfigRelease(const LapTimerConfig_t *snapshot);
+
+// Every pilot needs one RSSI reading, and every RSSI channel a receiver to tune:
+// receiver c feeds channel c, which feeds the pilot rssiReader.outputs maps it to
+bool lapTimerConfigValid(const LapTimerConfig_t *config);
+
+// Publishes a new config, running tasks pick it up on their next pass. A config
+// that is not valid is refused and false returned.
+bool lapTimerConfigUpdate(const LapTimerConfig_t *next);
+void lapTimerUpdatePilotConfig(const PilotConfig_t *pilot);
+void lapTimerUpdateMinLapTime(uint16_t ms);
+
+// Clears every pilot's laps and truncates the journal on the lap timer's next tick.
+// The lap log keeps its seqs, so clients that sync by seq carry on.
+void lapTimerResetSession();
+
+// Live lap state, written by the lap timer task only
+const PilotLapData_t *lapTimerPilotLapData(int pilot);
 
 #endif
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <string.h>
+#include "esp_timer.h"
+
+#include "lap_trace.h"
+#include "webserver.h"
+#include "mongoose.h"
+
+static const char *stageNames[LAP_STAGE_COUNT] = {
+    "sampled",
+    "filtered",
+    "detected",
+    "serialized",
+    "sent"};
+
+// stages up to serialized are written by the lap timer task, sent and total by the web thread
+static MetricsHistogram_t stages[LAP_STAGE_COUNT];
+static MetricsHistogram_t total;
+
+static WebRequestHandler_t latencyHandler;
+
+static uint32_t lapTraceEspClock()
+{
+  return (uint32_t)esp_timer_get_time();
+}
+
+static LapTraceClock_t traceClock = &lapTraceEspClock;
+
+static void lapTracePrint(struct mg_connection *nc, const char *stage, const MetricsHistogram_t *histogram)
+{
+  uint32_t cumulative = 0;
+
+  // every finite bucket is emitted so the series set is stable between scrapes
+  for (int b = 0; b < METRICS_BUCKETS - 1; ++b)
+  {
+    cumulative += histogram->buckets[b];
+    mg_printf_http_chunk(nc, "laptimer_lap_latency_us_bucket{stage=\"%s\",le=\"%u\"} %u\n", stage, (2u << b) - 1, cumulative);
+  }
+
+  mg_printf_http_chunk(nc, "laptimer_lap_latency_us_bucket{stage=\"%s\",le=\"+Inf\"} %u\n", stage, histogram->count);
+  mg_printf_http_chunk(nc, "laptimer_lap_latency_us_sum{stage=\"%s\"} %llu\n", stage, histogram->sum);
+  mg_printf_http_chunk(nc, "laptimer_lap_latency_us_count{stage=\"%s\"} %u\n", stage, histogram->count);
+  mg_printf_http_chunk(nc, "laptimer_lap_latency_us_max{stage=\"%s\"} %u\n", stage, histogram->max);
+}
+
+void latencyCallback(struct mg_connection *nc, struct http_message *hm)
+{
+  mg_send_head(nc, 200, -1, "Content-Type: text/plain; version=0.0.4");
+  mg_printf_http_chunk(nc, "# TYPE laptimer_lap_latency_us histogram\n");
+
+  // the first stage is the reference point, it has no latency of its own
+  for (int s = LAP_STAGE_FILTERED; s < LAP_STAGE_COUNT; ++s)
+    lapTracePrint(nc, stageNames[s], &stages[s]);
+
+  lapTracePrint(nc, "total", &total);
+  mg_send_http_chunk(nc, "", 0);
+}
+
+void lapTraceInit()
+{
+  memset(stages, 0, sizeof(stages));
+  memset(&total, 0, sizeof(total));
+
+  latencyHandler.callback = &latencyCallback;
+  latencyHandler.path = "/latency";
+  latencyHandler.request = HTTP_GET;
+  webserverRegister(&latencyHandler);
+}
+
+void lapTraceSetClock(LapTraceClock_t next)
+{
+  traceClock = next;
+}
+
+uint32_t lapTraceNow()
+{
+  return traceClock();
+}
+
+void lapTraceRecord(const LapTrace_t *trace, int fromStage, int toStage)
+{
+  for (int s = fromStage + 1; s <= toStage; ++s)
+    metricsRecord(&stages[s], trace->us[s] - trace->us[s - 1]);
+}
+
+void lapTraceSent(uint32_t originUs, uint32_t readyUs)
+{
+  uint32_t now = traceClock();
+  metricsRecord(&stages[LAP_STAGE_SENT], now - readyUs);
+  metricsRecord(&total, now - originUs);
+}
+
+const MetricsHistogram_t *lapTraceStage(int stage)
+{
+  return &stages[stage];
+}
+
+const MetricsHistogram_t *lapTraceTotal()
+{
+  return &total;
+}
@@ -0,0 +1,44 @@
+//
+// Lap latency tracing
+//
+// Each lap carries a timestamp per pipeline stage, from the ADC sample that
+// crossed the threshold to the frame being handed to the network stack.
+// The time spent in each stage goes into a histogram, read at /latency.
+// The clock can be swapped, so the same instrumentation runs against a
+// simulated clock off target.
+//
+
+#ifndef __lap_trace_INCLUDED__
+#define __lap_trace_INCLUDED__
+
+#include <stdint.h>
+#include "metrics.h"
+
+#define LAP_STAGE_SAMPLED 0
+#define LAP_STAGE_FILTERED 1
+#define LAP_STAGE_DETECTED 2
+#define LAP_STAGE_SERIALIZED 3
+#define LAP_STAGE_SENT 4
+#define LAP_STAGE_COUNT 5
+
+typedef uint32_t (*LapTraceClock_t)();
+
+typedef struct
+{
+  uint32_t us[LAP_STAGE_COUNT];
+} LapTrace_t;
+
+void lapTraceInit();
+void lapTraceSetClock(LapTraceClock_t clock);
+uint32_t lapTraceNow();
+
+// Records the time spent reaching each stage in (fromStage, toStage]
+void lapTraceRecord(const LapTrace_t *trace, int fromStage, int toStage);
+
+// Hooked into the outbox, records the last stage when a lap frame first leaves
+void lapTraceSent(uint32_t originUs, uint32_t readyUs);
+
+const MetricsHistogram_t *lapTraceStage(int stage);
+const MetricsHistogram_t *lapTraceTotal();
+
+#endif
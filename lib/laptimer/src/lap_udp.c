@@ -0,0 +1,321 @@
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "esp_timer.h"
+
+#include "lap_udp.h"
+#include "lap_proto.h"
+#include "lap_aggregator.h"
+#include "lap_log.h"
+#include "lap_timer.h"
+#include "task_plan.h"
+#include "timers.h"
+#include "metrics.h"
+
+#define LAP_UDP_POLL_MS 10
+#define LAP_UDP_BATCH 8
+
+static LapUdpConfig_t *config;
+
+static int sock = -1;
+static struct sockaddr_in groupAddr;
+static uint32_t packetSeq = 0;
+static uint32_t bootSeq = 0;
+static uint8_t packet[LAP_PROTO_MAX_PACKET];
+
+void lapUdpTask(void *arg);
+
+static MetricsCounter_t *nacks;
+static MetricsCounter_t *replayed;
+
+void lapUdpSendPacket(const uint8_t *data, size_t len, const struct sockaddr_in *to)
+{
+  if (len == 0 || sock < 0)
+    return;
+
+  if (to == NULL)
+    to = &groupAddr;
+
+  // wifi may be down or out of buffers, the next poll carries on regardless
+  sendto(sock, data, len, 0, (const struct sockaddr *)to, sizeof(struct sockaddr_in));
+}
+
+static void lapUdpSendTo(size_t len, struct sockaddr_in *addr)
+{
+  lapUdpSendPacket(packet, len, addr);
+}
+
+static void lapUdpSend(size_t len)
+{
+  lapUdpSendTo(len, &groupAddr);
+}
+
+static size_t lapUdpEncodeLap(const LapEvent_t *event)
+{
+  LapProtoLap_t lap = {
+      .seq = event->seq,
+      .pilot = event->pilot,
+      .lap = event->lap,
+      .time = event->time,
+      .timestamp = event->timestamp,
+      .detectedUs = event->detectedUs};
+
+  return lapProtoEncodeLap(packet, sizeof(packet), config->node, ++packetSeq, &lap);
+}
+
+static void lapUdpSendLaps(uint32_t *lastSeq)
+{
+  LapEvent_t events[LAP_UDP_BATCH];
+  int count;
+
+  while ((count = lapLogRead(*lastSeq, events, LAP_UDP_BATCH)) > 0)
+  {
+    for (int e = 0; e < count; ++e)
+    {
+      lapUdpSend(lapUdpEncodeLap(&events[e]));
+      *lastSeq = events[e].seq;
+
+      if (config->aggregate)
+        lapAggregatorLocalLap(&events[e]);
+    }
+  }
+}
+
+static void lapUdpSendPilots(const LapTimerConfig_t *timer)
+{
+  for (int p = 0; p < timer->pilotCount; ++p)
+  {
+    const PilotConfig_t *pilot = &timer->pilots[p];
+    const PilotLapData_t *lapData = lapTimerPilotLapData(p);
+    uint16_t timesCount = lapData->timesCount;
+
+    LapProtoPilot_t state = {
+        .pilot = p,
+        .band = pilot->band,
+        .channel = pilot->channel,
+        .state = lapData->state,
+        .threshold = pilot->threshold,
+        .laps = timesCount > 0 ? timesCount - 1 : 0,
+        .lastLap = timesCount > 1 ? lapData->times[timesCount - 2] : 0};
+
+    lapUdpSend(lapProtoEncodePilot(packet, sizeof(packet), config->node, ++packetSeq, &state));
+  }
+}
+
+static void lapUdpSendRssi(const LapTimerConfig_t *timer)
+{
+  RssiReading_t *readings = rssiReadings();
+  LapProtoRssi_t rssi;
+
+  rssi.timestamp = millis();
+  rssi.count = rssiReadingCount(&timer->rssiReader);
+  rssi.decimation = timer->rssiReader.updateHz / config->rssiHz;
+
+  for (int c = 0; c < rssi.count && c < LAP_PROTO_MAX_RSSI; ++c)
+    rssi.filtered[c] = lapProtoScaleRssi(readings[c].filtered);
+
+  lapUdpSend(lapProtoEncodeRssi(packet, sizeof(packet), config->node, ++packetSeq, &rssi));
+}
+
+static void lapUdpSendHeartbeat()
+{
+  LapProtoHeartbeat_t heartbeat = {
+      .head = lapLogHead(),
+      .oldest = lapLogOldest(),
+      .uptime = millis(),
+      .boot = bootSeq};
+
+  lapUdpSend(lapProtoEncodeHeartbeat(packet, sizeof(packet), config->node, ++packetSeq, &heartbeat));
+}
+
+// Replays what the log still holds of the requested range to whoever asked
+static void lapUdpReplay(const LapProtoNack_t *nack, struct sockaddr_in *from)
+{
+  LapEvent_t events[LAP_UDP_BATCH];
+  uint32_t since = nack->from - 1;
+  uint32_t last = nack->from + nack->count - 1;
+  int budget = nack->count < config->replayLimit ? nack->count : config->replayLimit;
+  int count;
+
+  metricsCount(nacks, 1);
+
+  while (budget > 0 && (count = lapLogRead(since, events, budget < LAP_UDP_BATCH ? budget : LAP_UDP_BATCH)) > 0)
+  {
+    for (int e = 0; e < count && events[e].seq <= last; ++e)
+    {
+      size_t len = lapUdpEncodeLap(&events[e]);
+      if (len == 0)
+        continue;
+
+      lapProtoSetFlags(packet, LAP_PROTO_FLAG_RETRANSMIT);
+      lapUdpSendTo(len, from);
+      metricsCount(replayed, 1);
+    }
+
+    since = events[count - 1].seq;
+    budget -= count;
+    if (since >= last)
+      break;
+  }
+}
+
+// Turned around as soon as it is read, the time it sat in the socket counts as network delay
+static void lapUdpSyncReply(const LapProtoSync_t *request, int64_t receivedUs, struct sockaddr_in *from)
+{
+  LapProtoSync_t reply = {
+      .origin = request->origin,
+      .receive = receivedUs};
+
+  reply.transmit = esp_timer_get_time();
+  lapUdpSendTo(lapProtoEncodeSync(packet, sizeof(packet), LAP_PROTO_SYNC_REPLY, config->node, ++packetSeq, &reply), from);
+}
+
+static void lapUdpReceive()
+{
+  uint8_t request[LAP_PROTO_MAX_PACKET];
+  struct sockaddr_in from;
+  socklen_t fromLen = sizeof(from);
+  int len;
+
+  while ((len = recvfrom(sock, request, sizeof(request), MSG_DONTWAIT, (struct sockaddr *)&from, &fromLen)) > 0)
+  {
+    int64_t receivedUs = esp_timer_get_time();
+    fromLen = sizeof(from);
+
+    LapProtoPacket_t decoded;
+    if (lapProtoDecode(request, len, &decoded) != LAP_PROTO_OK)
+      continue;
+
+    bool toUs = decoded.header.node == config->node;
+
+    if (decoded.header.type == LAP_PROTO_SYNC_REQUEST && toUs)
+      lapUdpSyncReply(&decoded.sync, receivedUs, &from);
+    else if (decoded.header.type == LAP_PROTO_NACK && toUs && config->reliable)
+      lapUdpReplay(&decoded.nack, &from);
+    else if (config->aggregate && !toUs)
+      lapAggregatorReceive(&decoded, &from, receivedUs);
+  }
+}
+
+// Sleeps until the next poll, waking early for anything on the socket
+static void lapUdpWait(TickType_t lastWake)
+{
+  TickType_t next = lastWake + pdMS_TO_TICKS(LAP_UDP_POLL_MS);
+  TickType_t now = xTaskGetTickCount();
+  TickType_t left = (int32_t)(next - now) > 0 ? next - now : 0;
+
+  fd_set readable;
+  FD_ZERO(&readable);
+  FD_SET(sock, &readable);
+
+  struct timeval timeout = {
+      .tv_sec = 0,
+      .tv_usec = left * portTICK_PERIOD_MS * 1000};
+
+  if (select(sock + 1, &readable, NULL, NULL, &timeout) > 0)
+    lapUdpReceive();
+}
+
+void lapUdpInit(LapUdpConfig_t *info)
+{
+  config = info;
+  if (config->port == 0)
+    return;
+
+  sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock < 0)
+  {
+    printf("lap-udp: no socket\n");
+    return;
+  }
+
+  int enable = 1;
+  setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable));
+
+  // stay on the local segment
+  uint8_t ttl = 1;
+  setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+
+  memset(&groupAddr, 0, sizeof(groupAddr));
+  groupAddr.sin_family = AF_INET;
+  groupAddr.sin_port = htons(config->port);
+  groupAddr.sin_addr.s_addr = inet_addr(config->group);
+
+  nacks = metricsCounter("lap_udp_nacks");
+  replayed = metricsCounter("lap_udp_replayed");
+
+  // nacks and sync requests come back unicast to the port we send from
+  struct sockaddr_in local;
+  memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_port = htons(config->port);
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  bind(sock, (struct sockaddr *)&local, sizeof(local));
+
+  if (config->aggregate)
+  {
+    // other nodes send to the group, so join it
+    struct ip_mreq membership;
+    membership.imr_multiaddr.s_addr = groupAddr.sin_addr.s_addr;
+    membership.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (IN_MULTICAST(ntohl(groupAddr.sin_addr.s_addr)))
+      setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership));
+
+    lapAggregatorInit(config);
+  }
+
+  printf("lap-udp: node %u sending to %s:%u\n", config->node, config->group, config->port);
+  taskPlanCreate(TASK_ROLE_NETWORK, lapUdpTask, "lapUdpTask", NULL);
+}
+
+void lapUdpTask(void *arg)
+{
+  // only laps after boot, older ones are on /laps
+  uint32_t lastSeq = lapLogHead();
+  bootSeq = lastSeq + 1;
+  uint32_t lastPilots = 0;
+  uint32_t lastRssi = 0;
+  uint32_t lastHeartbeat = 0;
+  TickType_t lastWake = xTaskGetTickCount();
+
+  while (1)
+  {
+    lapUdpWait(lastWake);
+
+    TickType_t tick = xTaskGetTickCount();
+    if ((int32_t)(tick - lastWake) < pdMS_TO_TICKS(LAP_UDP_POLL_MS))
+      continue;
+    lastWake = tick;
+
+    lapUdpSendLaps(&lastSeq);
+
+    uint32_t now = millis();
+
+    if (config->heartbeatMs > 0 && now - lastHeartbeat >= config->heartbeatMs)
+    {
+      lapUdpSendHeartbeat();
+      lastHeartbeat = now;
+    }
+
+    if (config->aggregate)
+      lapAggregatorPoll(esp_timer_get_time());
+
+    const LapTimerConfig_t *timer = lapTimerConfigAcquire();
+
+    if (config->pilotMs > 0 && now - lastPilots >= config->pilotMs)
+    {
+      lapUdpSendPilots(timer);
+      lastPilots = now;
+    }
+
+    if (config->rssiHz > 0 && now - lastRssi >= 1000 / config->rssiHz)
+    {
+      lapUdpSendRssi(timer);
+      lastRssi = now;
+    }
+
+    lapTimerConfigRelease(timer);
+  }
+}
@@ -0,0 +1,47 @@
+//
+// Lap UDP broadcast
+//
+// Sends lap events, pilot state and decimated RSSI as lap_proto packets to
+// a multicast group (or the broadcast address). One datagram reaches every
+// consumer on the LAN, so adding an overlay or logger costs the timer
+// nothing. Laps are read back from the lap log, so the timing path never
+// waits on the network.
+//
+// Laps can be made reliable: heartbeats announce the newest and oldest lap
+// the node still holds, and receivers nack gaps to the node's address.
+// Missing laps are replayed from the lap log straight to the receiver that
+// asked, so the replay window is the lap log.
+//
+// Every node answers clock sync requests. A node with aggregate set also
+// listens to the other nodes, keeps their clocks synced and merges their
+// laps onto its own timebase, see lap_aggregator.h.
+//
+
+#ifndef __lap_udp_INCLUDED__
+#define __lap_udp_INCLUDED__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "lwip/sockets.h"
+
+typedef struct
+{
+  char group[16];   // e.g. 239.255.76.84, or 255.255.255.255 for broadcast
+  uint16_t port;    // 0 disables the sender
+  uint8_t node;     // identifies this timer when several share a LAN
+  uint16_t rssiHz;  // decimated RSSI rate, 0 disables RSSI packets
+  uint16_t pilotMs; // pilot state interval
+  uint16_t heartbeatMs; // 0 disables heartbeats
+  bool reliable;        // answer nacks from receivers
+  uint8_t replayLimit;  // most laps replayed per nack
+  bool aggregate;       // merge laps from every node on the LAN
+  uint16_t syncMs;      // clock sync interval per node when aggregating
+} LapUdpConfig_t;
+
+void lapUdpInit(LapUdpConfig_t *info);
+
+// Sends a ready encoded packet, NULL sends to the group
+void lapUdpSendPacket(const uint8_t *data, size_t len, const struct sockaddr_in *to);
+
+#endif
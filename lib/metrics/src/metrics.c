@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include "metrics.h"
+#include "tick_scheduler.h"
+#include "webserver.h"
+#include "ws_outbox.h"
+#include "task_plan.h"
+#include "mongoose.h"
+
+#define METRICS_MAX_TASKS 24
+
+static MetricsConfig_t *config;
+
+static MetricsLoop_t loops[METRICS_MAX_LOOPS];
+static MetricsCounter_t counters[METRICS_MAX_COUNTERS];
+static volatile int loopCount = 0;
+static volatile int counterCount = 0;
+static portMUX_TYPE registryLock = portMUX_INITIALIZER_UNLOCKED;
+
+// room kept for the section brackets and the truncated marker
+#define METRICS_PUSH_RESERVE 64
+
+static TaskStatus_t taskStatus[METRICS_MAX_TASKS];
+static WebRequestHandler_t metricsHandler;
+
+void metricsTask(void *arg);
+
+MetricsLoop_t *metricsLoop(const char *name)
+{
+  MetricsLoop_t *loop = NULL;
+
+  portENTER_CRITICAL(&registryLock);
+  if (loopCount < METRICS_MAX_LOOPS)
+  {
+    loop = &loops[loopCount];
+    memset(loop, 0, sizeof(MetricsLoop_t));
+    loop->name = name;
+    ++loopCount;
+  }
+  portEXIT_CRITICAL(&registryLock);
+
+  assert(loop != NULL);
+  return loop;
+}
+
+MetricsCounter_t *metricsCounter(const char *name)
+{
+  MetricsCounter_t *counter = NULL;
+
+  portENTER_CRITICAL(&registryLock);
+  if (counterCount < METRICS_MAX_COUNTERS)
+  {
+    counter = &counters[counterCount];
+    counter->name = name;
+    counter->value = 0;
+    ++counterCount;
+  }
+  portEXIT_CRITICAL(&registryLock);
+
+  assert(counter != NULL);
+  return counter;
+}
+
+MetricsLoop_t *metricsFindLoop(const char *name)
+{
+  for (int l = 0; l < loopCount; ++l)
+  {
+    if (strcmp(loops[l].name, name) == 0)
+      return &loops[l];
+  }
+
+  return NULL;
+}
+
+void metricsLoopExpect(MetricsLoop_t *loop, uint32_t hz)
+{
+  loop->expected = hz ? CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ * 1000000 / hz : 0;
+}
+
+uint32_t metricsCyclesToUs(uint32_t cycles)
+{
+  return cycles / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+}
+
+uint32_t metricsPercentile(const MetricsHistogram_t *histogram, float fraction)
+{
+  uint32_t count = histogram->count;
+  uint32_t target = (uint32_t)(count * fraction);
+  uint32_t seen = 0;
+
+  for (int b = 0; b < METRICS_BUCKETS; ++b)
+  {
+    seen += histogram->buckets[b];
+    if (seen > target)
+      return b == METRICS_BUCKETS - 1 ? UINT32_MAX : (2u << b) - 1;
+  }
+
+  return histogram->max;
+}
+
+static void metricsPrintHistogram(struct mg_connection *nc, const char *metric, const char *loop, const MetricsHistogram_t *histogram)
+{
+  uint32_t cumulative = 0;
+
+  // every bucket is emitted so the series set is stable between scrapes. The
+  // bounds stay fractional, rounding cycles to whole microseconds would give
+  // the low buckets the same le. The last bucket ends at UINT32_MAX and is +Inf.
+  for (int b = 0; b < METRICS_BUCKETS - 1; ++b)
+  {
+    cumulative += histogram->buckets[b];
+
+    mg_printf_http_chunk(
+        nc, "laptimer_%s_us_bucket{loop=\"%s\",le=\"%.6g\"} %u\n",
+        metric, loop, ((2ull << b) - 1) / (double)CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ, cumulative);
+  }
+
+  mg_printf_http_chunk(nc, "laptimer_%s_us_bucket{loop=\"%s\",le=\"+Inf\"} %u\n", metric, loop, histogram->count);
+  mg_printf_http_chunk(nc, "laptimer_%s_us_sum{loop=\"%s\"} %llu\n", metric, loop, histogram->sum / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+  mg_printf_http_chunk(nc, "laptimer_%s_us_count{loop=\"%s\"} %u\n", metric, loop, histogram->count);
+  mg_printf_http_chunk(nc, "laptimer_%s_us_max{loop=\"%s\"} %u\n", metric, loop, metricsCyclesToUs(histogram->max));
+}
+
+void metricsCallback(struct mg_connection *nc, struct http_message *hm)
+{
+  mg_send_head(nc, 200, -1, "Content-Type: text/plain; version=0.0.4");
+
+  mg_printf_http_chunk(nc, "# TYPE laptimer_loop_period_us histogram\n");
+  for (int l = 0; l < loopCount; ++l)
+    metricsPrintHistogram(nc, "loop_period", loops[l].name, &loops[l].period);
+
+  mg_printf_http_chunk(nc, "# TYPE laptimer_loop_duration_us histogram\n");
+  for (int l = 0; l < loopCount; ++l)
+    metricsPrintHistogram(nc, "loop_duration", loops[l].name, &loops[l].duration);
+
+  mg_printf_http_chunk(nc, "# TYPE laptimer_loop_jitter_us histogram\n");
+  for (int l = 0; l < loopCount; ++l)
+  {
+    if (loops[l].expected != 0)
+      metricsPrintHistogram(nc, "loop_jitter", loops[l].name, &loops[l].jitter);
+  }
+
+  const TickConsumer_t *consumers[TICK_MAX_CONSUMERS];
+  int consumerCount = tickSchedulerConsumers(consumers, TICK_MAX_CONSUMERS);
+
+  mg_printf_http_chunk(nc, "# TYPE laptimer_tick_missed_total counter\n");
+  for (int c = 0; c < consumerCount; ++c)
+  {
+    mg_printf_http_chunk(nc, "laptimer_tick_missed_total{consumer=\"%s\"} %u\n", consumers[c]->name, consumers[c]->missed);
+    mg_printf_http_chunk(nc, "laptimer_tick_coalesced_total{consumer=\"%s\"} %u\n", consumers[c]->name, consumers[c]->coalesced);
+  }
+
+  mg_printf_http_chunk(nc, "# TYPE laptimer_counter_total counter\n");
+  for (int c = 0; c < counterCount; ++c)
+    mg_printf_http_chunk(nc, "laptimer_%s_total %u\n", counters[c].name, counters[c].value);
+
+  uint32_t totalRunTime = 0;
+  int taskCount = uxTaskGetSystemState(taskStatus, METRICS_MAX_TASKS, &totalRunTime);
+
+  // run time counters are cumulative since boot, scrapers diff them for a windowed share
+  mg_printf_http_chunk(nc, "# TYPE laptimer_task_runtime_total counter\n");
+  for (int t = 0; t < taskCount; ++t)
+  {
+    TaskStatus_t *task = &taskStatus[t];
+    mg_printf_http_chunk(nc, "laptimer_task_runtime_total{task=\"%s\"} %u\n", task->pcTaskName, task->ulRunTimeCounter);
+    mg_printf_http_chunk(
+        nc, "laptimer_task_cpu_percent{task=\"%s\"} %.2f\n",
+        task->pcTaskName,
+        totalRunTime ? 100.0f * task->ulRunTimeCounter / totalRunTime : 0.0f);
+    mg_printf_http_chunk(nc, "laptimer_task_stack_free_bytes{task=\"%s\"} %u\n", task->pcTaskName, task->usStackHighWaterMark);
+    mg_printf_http_chunk(nc, "laptimer_task_priority{task=\"%s\"} %u\n", task->pcTaskName, task->uxCurrentPriority);
+  }
+
+  mg_send_http_chunk(nc, "", 0);
+}
+
+// Compact summary for spectator screens, the full detail stays on /metrics
+static void metricsPush()
+{
+  static WsOutboxWriter_t writer;
+  static bool warned = false;
+
+  wsOutboxWriterInit(&writer, METRICS_PUSH_RESERVE);
+
+  wsOutboxClose(&writer, "{\"type\":\"metrics\",\"loops\":[");
+  for (int l = 0; l < loopCount; ++l)
+  {
+    MetricsLoop_t *loop = &loops[l];
+    wsOutboxAppend(
+        &writer, "%s{\"name\":\"%s\",\"period99\":%u,\"duration99\":%u,\"durationMax\":%u,\"jitter99\":%u}",
+        l ? "," : "",
+        loop->name,
+        metricsCyclesToUs(metricsPercentile(&loop->period, 0.99f)),
+        metricsCyclesToUs(metricsPercentile(&loop->duration, 0.99f)),
+        metricsCyclesToUs(loop->duration.max),
+        metricsCyclesToUs(metricsPercentile(&loop->jitter, 0.99f)));
+  }
+
+  const TickConsumer_t *consumers[TICK_MAX_CONSUMERS];
+  int consumerCount = tickSchedulerConsumers(consumers, TICK_MAX_CONSUMERS);
+
+  wsOutboxClose(&writer, "],\"missed\":{");
+  for (int c = 0; c < consumerCount; ++c)
+    wsOutboxAppend(&writer, "%s\"%s\":%u", c ? "," : "", consumers[c]->name, consumers[c]->missed);
+
+  wsOutboxClose(&writer, "},\"counters\":{");
+  for (int c = 0; c < counterCount; ++c)
+    wsOutboxAppend(&writer, "%s\"%s\":%u", c ? "," : "", counters[c].name, counters[c].value);
+
+  wsOutboxClose(&writer, writer.truncated ? "},\"truncated\":true}" : "}}");
+
+  if (writer.truncated && !warned)
+  {
+    printf("metrics: push frame truncated at %d bytes\n", writer.length);
+    warned = true;
+  }
+
+  wsOutboxPublishWriter(WS_OUTBOX_METRICS, &writer);
+}
+
+void metricsInit(MetricsConfig_t *info)
+{
+  config = info;
+
+  metricsHandler.callback = &metricsCallback;
+  metricsHandler.path = "/metrics";
+  metricsHandler.request = HTTP_GET;
+  webserverRegister(&metricsHandler);
+
+  if (config->pushMs > 0)
+    taskPlanCreate(TASK_ROLE_TELEMETRY, metricsTask, "metricsTask", NULL);
+}
+
+void metricsTask(void *arg)
+{
+  TickType_t lastWake = xTaskGetTickCount();
+  while (1)
+  {
+    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(config->pushMs));
+    metricsPush();
+  }
+}
@@ -0,0 +1,110 @@
+//
+// Runtime metrics
+//
+// Loop timing is recorded into fixed log2 histograms of CPU cycles. A
+// recording is a cycle counter read, a count-leading-zeros and a few
+// increments, cheap enough to leave on during races. Each loop and counter
+// has exactly one writer, so nothing is locked. Readers may see a sample
+// mid-update, which is fine for metrics.
+//
+// The cycle counter is per core, so timed loops should stay on one core.
+//
+
+#ifndef __metrics_INCLUDED__
+#define __metrics_INCLUDED__
+
+#include <stdint.h>
+#include "soc/cpu.h"
+
+#define METRICS_BUCKETS 32
+#define METRICS_MAX_LOOPS 8
+#define METRICS_MAX_COUNTERS 16
+
+typedef struct
+{
+  volatile uint32_t count;
+  volatile uint32_t max;
+  volatile uint64_t sum;
+  volatile uint32_t buckets[METRICS_BUCKETS];
+} MetricsHistogram_t;
+
+typedef struct
+{
+  const char *name;
+  uint32_t lastStart;
+  uint32_t expected; // nominal period in cycles, 0 when the loop has none
+  MetricsHistogram_t period;
+  MetricsHistogram_t duration;
+  MetricsHistogram_t jitter; // distance of each period from the nominal one
+} MetricsLoop_t;
+
+typedef struct
+{
+  const char *name;
+  volatile uint32_t value;
+} MetricsCounter_t;
+
+typedef struct
+{
+  uint16_t pushMs; // WebSocket telemetry interval, 0 disables the push
+} MetricsConfig_t;
+
+void metricsInit(MetricsConfig_t *info);
+
+// Registration is cheap but not free, do it once at task start
+MetricsLoop_t *metricsLoop(const char *name);
+MetricsCounter_t *metricsCounter(const char *name);
+MetricsLoop_t *metricsFindLoop(const char *name);
+
+// Periodic loops set their rate so period jitter is tracked as well
+void metricsLoopExpect(MetricsLoop_t *loop, uint32_t hz);
+
+uint32_t metricsCyclesToUs(uint32_t cycles);
+
+// Upper bound in cycles of the bucket holding the given fraction of samples
+uint32_t metricsPercentile(const MetricsHistogram_t *histogram, float fraction);
+
+static inline uint32_t metricsCycles()
+{
+  uint32_t ccount;
+  RSR(CCOUNT, ccount);
+  return ccount;
+}
+
+static inline void metricsRecord(MetricsHistogram_t *histogram, uint32_t cycles)
+{
+  int bucket = 31 - __builtin_clz(cycles | 1);
+  ++histogram->buckets[bucket];
+  ++histogram->count;
+  histogram->sum += cycles;
+
+  if (cycles > histogram->max)
+    histogram->max = cycles;
+}
+
+static inline void metricsLoopBegin(MetricsLoop_t *loop)
+{
+  uint32_t now = metricsCycles();
+  if (loop->lastStart != 0)
+  {
+    uint32_t period = now - loop->lastStart;
+    metricsRecord(&loop->period, period);
+
+    if (loop->expected != 0)
+      metricsRecord(&loop->jitter, period > loop->expected ? period - loop->expected : loop->expected - period);
+  }
+
+  loop->lastStart = now;
+}
+
+static inline void metricsLoopEnd(MetricsLoop_t *loop)
+{
+  metricsRecord(&loop->duration, metricsCycles() - loop->lastStart);
+}
+
+static inline void metricsCount(MetricsCounter_t *counter, uint32_t n)
+{
+  counter->value += n;
+}
+
+#endif
@@ -0,0 +1,329 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+
+#include "pool_alloc.h"
+#include "webserver.h"
+#include "mongoose.h"
+#include "cJSON.h"
+
+typedef struct PoolBlock
+{
+  struct PoolBlock *next;
+} PoolBlock_t;
+
+typedef struct
+{
+  uint8_t *base;
+  uint8_t *end;
+  PoolBlock_t *free;
+  PoolClassStats_t stats;
+} PoolClass_t;
+
+// cJSON nodes are 40 bytes and its strings mostly short, mongoose wants
+// connection structs and send buffers that grow in steps
+static const uint16_t classSizes[POOL_CLASSES] = {32, 48, 128, 256, 512, 1024, 2048};
+
+static PoolAllocConfig_t *config;
+static PoolClass_t classes[POOL_CLASSES];
+static volatile bool ready = false;
+static portMUX_TYPE poolLock = portMUX_INITIALIZER_UNLOCKED;
+
+static volatile uint32_t oversize = 0;
+static volatile uint32_t heapFallbacks = 0;
+static volatile uint32_t heapFailures = 0;
+
+static uint8_t *arena = NULL;
+static uint32_t arenaUsed = 0;
+static uint32_t arenaHighWater = 0;
+static uint32_t arenaOverflows = 0;
+static TaskHandle_t arenaOwner = NULL;
+static SemaphoreHandle_t arenaLock;
+
+static WebRequestHandler_t allocHandler;
+
+uint16_t poolClassSize(int sizeClass)
+{
+  return classSizes[sizeClass];
+}
+
+static void *poolHeapAlloc(size_t size)
+{
+  void *ptr = malloc(size);
+
+  portENTER_CRITICAL(&poolLock);
+  ++heapFallbacks;
+  if (ptr == NULL)
+    ++heapFailures;
+  portEXIT_CRITICAL(&poolLock);
+
+  return ptr;
+}
+
+void *poolMalloc(size_t size)
+{
+  // anything allocated before init, e.g. by static constructors, lives on the heap
+  if (!ready)
+    return malloc(size);
+
+  for (int c = 0; c < POOL_CLASSES; ++c)
+  {
+    if (size > classSizes[c])
+      continue;
+
+    PoolClass_t *pool = &classes[c];
+    PoolBlock_t *block = NULL;
+
+    portENTER_CRITICAL(&poolLock);
+    block = pool->free;
+    if (block != NULL)
+    {
+      pool->free = block->next;
+      ++pool->stats.allocs;
+      if (++pool->stats.inUse > pool->stats.highWater)
+        pool->stats.highWater = pool->stats.inUse;
+    }
+    else
+    {
+      ++pool->stats.exhausted;
+    }
+    portEXIT_CRITICAL(&poolLock);
+
+    return block != NULL ? (void *)block : poolHeapAlloc(size);
+  }
+
+  portENTER_CRITICAL(&poolLock);
+  ++oversize;
+  portEXIT_CRITICAL(&poolLock);
+
+  return poolHeapAlloc(size);
+}
+
+void *poolCalloc(size_t count, size_t size)
+{
+  void *ptr = poolMalloc(count * size);
+  if (ptr != NULL)
+    memset(ptr, 0, count * size);
+
+  return ptr;
+}
+
+static PoolClass_t *poolOwner(void *ptr)
+{
+  for (int c = 0; c < POOL_CLASSES; ++c)
+  {
+    if ((uint8_t *)ptr >= classes[c].base && (uint8_t *)ptr < classes[c].end)
+      return &classes[c];
+  }
+
+  return NULL;
+}
+
+static bool poolInArena(void *ptr)
+{
+  return arena != NULL && (uint8_t *)ptr >= arena && (uint8_t *)ptr < arena + config->arenaSize;
+}
+
+void poolFree(void *ptr)
+{
+  if (ptr == NULL)
+    return;
+
+  PoolClass_t *pool = ready ? poolOwner(ptr) : NULL;
+  if (pool == NULL)
+  {
+    free(ptr);
+    return;
+  }
+
+  PoolBlock_t *block = (PoolBlock_t *)ptr;
+
+  portENTER_CRITICAL(&poolLock);
+  block->next = pool->free;
+  pool->free = block;
+  --pool->stats.inUse;
+  portEXIT_CRITICAL(&poolLock);
+}
+
+void *poolRealloc(void *ptr, size_t size)
+{
+  if (ptr == NULL)
+    return poolMalloc(size);
+
+  if (size == 0)
+  {
+    poolFree(ptr);
+    return NULL;
+  }
+
+  PoolClass_t *pool = ready ? poolOwner(ptr) : NULL;
+  if (pool == NULL)
+    return realloc(ptr, size);
+
+  // mongoose grows its buffers in small steps, most of them still fit
+  if (size <= pool->stats.size)
+    return ptr;
+
+  void *next = poolMalloc(size);
+  if (next == NULL)
+    return NULL;
+
+  memcpy(next, ptr, pool->stats.size);
+  poolFree(ptr);
+  return next;
+}
+
+static void *poolJsonMalloc(size_t size)
+{
+  if (arenaOwner == NULL || arenaOwner != xTaskGetCurrentTaskHandle())
+    return poolMalloc(size);
+
+  uint32_t start = (arenaUsed + 3) & ~3;
+  if (start + size > config->arenaSize)
+  {
+    // a big response still works, it just goes the slow way
+    ++arenaOverflows;
+    return poolMalloc(size);
+  }
+
+  arenaUsed = start + size;
+  if (arenaUsed > arenaHighWater)
+    arenaHighWater = arenaUsed;
+
+  return arena + start;
+}
+
+static void poolJsonFree(void *ptr)
+{
+  // arena memory goes back in one piece when the request ends
+  if (!poolInArena(ptr))
+    poolFree(ptr);
+}
+
+void poolArenaBegin()
+{
+  if (arena == NULL)
+    return;
+
+  xSemaphoreTake(arenaLock, portMAX_DELAY);
+  arenaUsed = 0;
+  arenaOwner = xTaskGetCurrentTaskHandle();
+}
+
+void poolArenaEnd()
+{
+  if (arena == NULL)
+    return;
+
+  arenaOwner = NULL;
+  arenaUsed = 0;
+  xSemaphoreGive(arenaLock);
+}
+
+void poolAllocStats(PoolStats_t *stats)
+{
+  portENTER_CRITICAL(&poolLock);
+  for (int c = 0; c < POOL_CLASSES; ++c)
+    stats->classes[c] = classes[c].stats;
+
+  stats->oversize = oversize;
+  stats->heapFallbacks = heapFallbacks;
+  stats->heapFailures = heapFailures;
+  portEXIT_CRITICAL(&poolLock);
+
+  stats->arenaHighWater = arenaHighWater;
+  stats->arenaOverflows = arenaOverflows;
+  stats->heapFree = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  stats->heapLargest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+}
+
+void allocCallback(struct mg_connection *nc, struct http_message *hm)
+{
+  PoolStats_t stats;
+  poolAllocStats(&stats);
+
+  mg_send_head(nc, 200, -1, "Content-Type: text/plain; version=0.0.4");
+
+  for (int c = 0; c < POOL_CLASSES; ++c)
+  {
+    PoolClassStats_t *pool = &stats.classes[c];
+    mg_printf_http_chunk(nc, "laptimer_pool_blocks{size=\"%u\"} %u\n", pool->size, pool->blocks);
+    mg_printf_http_chunk(nc, "laptimer_pool_in_use{size=\"%u\"} %u\n", pool->size, pool->inUse);
+    mg_printf_http_chunk(nc, "laptimer_pool_high_water{size=\"%u\"} %u\n", pool->size, pool->highWater);
+    mg_printf_http_chunk(nc, "laptimer_pool_allocs_total{size=\"%u\"} %u\n", pool->size, pool->allocs);
+    mg_printf_http_chunk(nc, "laptimer_pool_exhausted_total{size=\"%u\"} %u\n", pool->size, pool->exhausted);
+  }
+
+  mg_printf_http_chunk(nc, "laptimer_pool_oversize_total %u\n", stats.oversize);
+  mg_printf_http_chunk(nc, "laptimer_pool_heap_fallbacks_total %u\n", stats.heapFallbacks);
+  mg_printf_http_chunk(nc, "laptimer_pool_heap_failures_total %u\n", stats.heapFailures);
+  mg_printf_http_chunk(nc, "laptimer_pool_arena_high_water_bytes %u\n", stats.arenaHighWater);
+  mg_printf_http_chunk(nc, "laptimer_pool_arena_overflows_total %u\n", stats.arenaOverflows);
+  mg_printf_http_chunk(nc, "laptimer_heap_free_bytes %u\n", stats.heapFree);
+  mg_printf_http_chunk(nc, "laptimer_heap_largest_free_bytes %u\n", stats.heapLargest);
+
+  // share of free heap unusable for one allocation of the same total size
+  mg_printf_http_chunk(
+      nc, "laptimer_heap_fragmentation_percent %.1f\n",
+      stats.heapFree ? 100.0f - 100.0f * stats.heapLargest / stats.heapFree : 0.0f);
+
+  mg_send_http_chunk(nc, "", 0);
+}
+
+void poolAllocInit(PoolAllocConfig_t *info)
+{
+  config = info;
+  uint32_t total = 0;
+
+  for (int c = 0; c < POOL_CLASSES; ++c)
+  {
+    PoolClass_t *pool = &classes[c];
+    uint32_t bytes = (uint32_t)classSizes[c] * config->blocks[c];
+
+    memset(pool, 0, sizeof(PoolClass_t));
+    pool->stats.size = classSizes[c];
+    pool->stats.blocks = config->blocks[c];
+
+    if (bytes == 0)
+      continue;
+
+    pool->base = heap_caps_malloc(bytes, MALLOC_CAP_8BIT);
+    assert(pool->base != NULL);
+    pool->end = pool->base + bytes;
+
+    for (int b = config->blocks[c] - 1; b >= 0; --b)
+    {
+      PoolBlock_t *block = (PoolBlock_t *)(pool->base + b * classSizes[c]);
+      block->next = pool->free;
+      pool->free = block;
+    }
+
+    total += bytes;
+  }
+
+  if (config->arenaSize > 0)
+  {
+    arena = heap_caps_malloc(config->arenaSize, MALLOC_CAP_8BIT);
+    assert(arena != NULL);
+    arenaLock = xSemaphoreCreateMutex();
+  }
+
+  ready = true;
+
+  cJSON_Hooks hooks = {
+      .malloc_fn = &poolJsonMalloc,
+      .free_fn = &poolJsonFree};
+  cJSON_InitHooks(&hooks);
+
+  allocHandler.callback = &allocCallback;
+  allocHandler.path = "/alloc";
+  allocHandler.request = HTTP_GET;
+  webserverRegister(&allocHandler);
+
+  printf("pool-alloc: %u bytes in %d classes, %u byte arena\n", total, POOL_CLASSES, config->arenaSize);
+}
@@ -0,0 +1,65 @@
+//
+// Pool allocator
+//
+// cJSON and mongoose allocate and free small blocks all day long. Serving
+// them from the general heap leaves it too fragmented for a large
+// allocation after a race day. Instead they get fixed-size blocks from one
+// region per size class, carved out once at boot. A request that doesn't
+// fit a class, or finds its class empty, falls back to the heap and is
+// counted.
+//
+// A request handler can also open an arena: until it closes, the task's
+// cJSON allocations bump a pointer in one buffer and frees are ignored.
+// Closing the arena drops everything at once, leaks included.
+//
+
+#ifndef __pool_alloc_INCLUDED__
+#define __pool_alloc_INCLUDED__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "pool_hooks.h"
+
+#define POOL_CLASSES 7
+
+typedef struct
+{
+  uint16_t blocks[POOL_CLASSES]; // per class, see poolClassSize
+  uint16_t arenaSize;            // bytes in the request arena
+} PoolAllocConfig_t;
+
+typedef struct
+{
+  uint16_t size;
+  uint16_t blocks;
+  uint16_t inUse;
+  uint16_t highWater;
+  uint32_t allocs;
+  uint32_t exhausted; // allocations that found the class empty
+} PoolClassStats_t;
+
+typedef struct
+{
+  PoolClassStats_t classes[POOL_CLASSES];
+  uint32_t oversize;    // allocations larger than the largest class
+  uint32_t heapFallbacks;
+  uint32_t heapFailures; // the heap could not help either
+  uint32_t arenaHighWater;
+  uint32_t arenaOverflows;
+  uint32_t heapFree;
+  uint32_t heapLargest;
+} PoolStats_t;
+
+void poolAllocInit(PoolAllocConfig_t *info);
+
+uint16_t poolClassSize(int sizeClass);
+void poolAllocStats(PoolStats_t *stats);
+
+// Route the calling task's cJSON allocations into the request arena until poolArenaEnd
+void poolArenaBegin();
+void poolArenaEnd();
+
+#endif
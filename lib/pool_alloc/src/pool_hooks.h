@@ -0,0 +1,22 @@
+//
+// Allocator hooks
+//
+// Force included from platformio.ini so mongoose, built with MG_MALLOC and
+// friends pointing here, sees real prototypes.
+//
+
+#ifndef __pool_hooks_INCLUDED__
+#define __pool_hooks_INCLUDED__
+
+#ifndef __ASSEMBLER__
+
+#include <stddef.h>
+
+void *poolMalloc(size_t size);
+void *poolCalloc(size_t count, size_t size);
+void *poolRealloc(void *ptr, size_t size);
+void poolFree(void *ptr);
+
+#endif
+
+#endif
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "freertos/FreeRTOS.h"
+#include "driver/spi_master.h"
+#include "rssi_adc.h"
+
+static void internalInit(const RssiAdcConfig_t *config, adc_bits_width_t width)
+{
+  adc1_config_width(width);
+}
+
+static void internalConfigure(const uint8_t *channels, uint8_t count, adc_atten_t attenuation)
+{
+  for (int c = 0; c < count; ++c)
+    adc1_config_channel_atten(channels[c], attenuation);
+}
+
+static void internalRead(const uint8_t *channels, uint8_t count, uint32_t mask, uint16_t *raw)
+{
+  for (int c = count - 1; c >= 0; --c)
+  {
+    if (mask & (1 << c))
+      raw[c] = adc1_get_raw(channels[c]);
+  }
+}
+
+static uint32_t internalBurstUs(const RssiAdcConfig_t *config, uint8_t count)
+{
+  return 0;
+}
+
+static spi_device_handle_t mcp3208;
+static spi_transaction_t mcp3208Trans[MCP3208_CHANNEL_COUNT];
+
+static void mcp3208Init(const RssiAdcConfig_t *config, adc_bits_width_t width)
+{
+  spi_bus_config_t buscfg = {
+      .mosi_io_num = config->spiOutputPin,
+      .miso_io_num = config->spiInputPin,
+      .sclk_io_num = config->spiClockPin,
+      .quadwp_io_num = -1,
+      .quadhd_io_num = -1};
+
+  // HSPI belongs to the RX5808 bus, frames fit in the transaction so no DMA
+  esp_err_t ret = spi_bus_initialize(VSPI_HOST, &buscfg, 0);
+  assert(ret == ESP_OK);
+
+  spi_device_interface_config_t devcfg = {
+      .clock_speed_hz = config->spiClockSpeed,
+      .mode = 0,
+      .spics_io_num = config->spiSelectPin,
+      .queue_size = 1,
+  };
+
+  ret = spi_bus_add_device(VSPI_HOST, &devcfg, &mcp3208);
+  assert(ret == ESP_OK);
+
+  for (int c = 0; c < MCP3208_CHANNEL_COUNT; ++c)
+  {
+    spi_transaction_t *t = &mcp3208Trans[c];
+    memset(t, 0, sizeof(*t));
+    t->flags = SPI_TRANS_USE_TXDATA | SPI_TRANS_USE_RXDATA;
+    t->length = MCP3208_FRAME_BYTES * 8;
+  }
+
+  printf("rssi-adc: mcp3208 at %u Hz\n", config->spiClockSpeed);
+}
+
+static void mcp3208Configure(const uint8_t *channels, uint8_t count, adc_atten_t attenuation)
+{
+  // the input range is set by VREF, attenuation does not apply
+  for (int c = 0; c < count; ++c)
+  {
+    assert(channels[c] < MCP3208_CHANNEL_COUNT);
+    mcp3208Frame(channels[c], mcp3208Trans[c].tx_data);
+  }
+}
+
+static void mcp3208Read(const uint8_t *channels, uint8_t count, uint32_t mask, uint16_t *raw)
+{
+  // chip select has to rise between conversions, so each channel is its own
+  // transaction. Polled with the bus held, a queued one costs an interrupt
+  // and a task switch, more than the 24 clocks of the conversion itself.
+  spi_device_acquire_bus(mcp3208, portMAX_DELAY);
+  for (int c = 0; c < count; ++c)
+  {
+    if (!(mask & (1 << c)))
+      continue;
+
+    spi_device_polling_transmit(mcp3208, &mcp3208Trans[c]);
+    raw[c] = mcp3208Result(mcp3208Trans[c].rx_data);
+  }
+  spi_device_release_bus(mcp3208);
+}
+
+static uint32_t mcp3208BurstUs(const RssiAdcConfig_t *config, uint8_t count)
+{
+  uint32_t clockHz = config->spiClockSpeed ? config->spiClockSpeed : 1;
+  uint32_t conversionUs = (MCP3208_FRAME_BYTES * 8 * 1000000 + clockHz - 1) / clockHz;
+  return count * (conversionUs + MCP3208_TRANSACTION_US);
+}
+
+static const RssiAdcBackend_t backends[] = {
+    [RSSI_ADC_INTERNAL] = {"adc1", internalInit, internalConfigure, internalRead, internalBurstUs},
+    [RSSI_ADC_MCP3208] = {"mcp3208", mcp3208Init, mcp3208Configure, mcp3208Read, mcp3208BurstUs},
+};
+
+const RssiAdcBackend_t *rssiAdcBackend(uint8_t type)
+{
+  assert(type < sizeof(backends) / sizeof(backends[0]));
+  return &backends[type];
+}
+
+bool rssiAdcValid(const RssiAdcConfig_t *config, uint8_t count, uint32_t updateHz)
+{
+  if (config->type >= sizeof(backends) / sizeof(backends[0]))
+  {
+    printf("rssi-adc: no backend %u\n", config->type);
+    return false;
+  }
+
+  if (config->type == RSSI_ADC_MCP3208 && (config->spiClockSpeed == 0 || config->spiClockSpeed > MCP3208_MAX_CLOCK_HZ))
+  {
+    printf("rssi-adc: mcp3208 clock %u Hz, rated up to %u Hz at 3.3V\n", config->spiClockSpeed, MCP3208_MAX_CLOCK_HZ);
+    return false;
+  }
+
+  // every channel can be hot at once, idle division does not lower the worst case
+  uint32_t burstUs = backends[config->type].burstUs(config, count);
+  uint32_t budgetUs = updateHz ? (uint32_t)(RSSI_ADC_BUDGET * 1000000 / updateHz) : 0;
+  if (burstUs > budgetUs && burstUs > 0)
+  {
+    printf(
+        "rssi-adc: %s reads %u channels in %u us, a %u Hz tick leaves %u us\n",
+        backends[config->type].name, count, burstUs, updateHz, budgetUs);
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,76 @@
+//
+// RSSI ADC backends
+//
+// Where the rssi reader gets its raw counts from. The internal ADC1 only has
+// a few pins left next to the RX5808 bus, so an MCP3208 class converter on
+// its own SPI bus can read all eight channels instead. Every backend hands
+// back 12 bit counts for all channels in one call per sample tick. The
+// backend is picked once at init, channels and attenuation follow config.
+//
+// The MCP3208 is rated for a 2MHz clock at 5V and 1MHz at 2.7V, so on the
+// 3.3V rail it is held to MCP3208_MAX_CLOCK_HZ. A conversion takes 24 clocks,
+// and each channel is its own polled transaction with MCP3208_TRANSACTION_US
+// of driver time on top, about 32us a channel at the top clock. The burst
+// may take RSSI_ADC_BUDGET of a sample tick, so at 10kHz only one channel
+// fits; eight channels need the sample rate at or below about 1.9kHz.
+//
+
+#ifndef __rssi_adc_INCLUDED__
+#define __rssi_adc_INCLUDED__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "driver/adc.h"
+
+#define RSSI_ADC_INTERNAL 0
+#define RSSI_ADC_MCP3208 1
+
+#define MCP3208_CHANNEL_COUNT 8
+#define MCP3208_FRAME_BYTES 3
+#define MCP3208_MAX_CLOCK_HZ 1200000
+#define MCP3208_TRANSACTION_US 12
+
+#define RSSI_ADC_BUDGET 0.5f // share of a sample tick the read burst may take
+
+typedef struct
+{
+  uint8_t type;
+
+  // MCP3208 wiring, it needs MISO so it cannot share the write only RX5808 bus
+  uint8_t spiClockPin;
+  uint8_t spiOutputPin;
+  uint8_t spiInputPin;
+  uint8_t spiSelectPin;
+  uint32_t spiClockSpeed; // at most MCP3208_MAX_CLOCK_HZ
+} RssiAdcConfig_t;
+
+typedef struct
+{
+  const char *name;
+  void (*init)(const RssiAdcConfig_t *config, adc_bits_width_t width);
+  void (*configure)(const uint8_t *channels, uint8_t count, adc_atten_t attenuation);
+  // reads the channels[0..count) whose bit is set in mask into raw, the burst starts and ends inside the call
+  void (*read)(const uint8_t *channels, uint8_t count, uint32_t mask, uint16_t *raw);
+  // worst case time to read count channels, 0 where the backend sets no limit
+  uint32_t (*burstUs)(const RssiAdcConfig_t *config, uint8_t count);
+} RssiAdcBackend_t;
+
+const RssiAdcBackend_t *rssiAdcBackend(uint8_t type);
+
+// False, saying why, when the converter cannot read count channels every sample tick
+bool rssiAdcValid(const RssiAdcConfig_t *config, uint8_t count, uint32_t updateHz);
+
+// MCP3208 single ended conversion frame, the result lands in the last 12 bits received
+static inline void mcp3208Frame(uint8_t channel, uint8_t *tx)
+{
+  tx[0] = 0x06 | ((channel >> 2) & 0x01);
+  tx[1] = (channel & 0x03) << 6;
+  tx[2] = 0;
+}
+
+static inline uint16_t mcp3208Result(const uint8_t *rx)
+{
+  return ((rx[1] & 0x0f) << 8) | rx[2];
+}
+
+#endif
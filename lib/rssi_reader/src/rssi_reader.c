@@ -9,31 +9,53 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <math.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "freertos/semphr.h"
+#include "esp_timer.h"
 #include "rssi_reader.h"
-#include "filters.h"
+#include "rssi_signal.h"
 #include "timers.h"
+#include "config_snapshot.h"
+#include "tick_scheduler.h"
+#include "metrics.h"
+#include "trace_capture.h"
+#include "task_plan.h"
+#include "bench.h"
 
-static RssiReaderConfig_t *config;
+static ConfigSnapshot_t configSnapshot;
+static RssiReaderConfig_t configSlots[CONFIG_SNAPSHOT_SLOTS];
 
 RssiReading_t readings[MAX_RSSI_CHANNEL_COUNT];
 
-float lpf_alpha = 0.025f;
-float lpf2_alpha = 0.025f;
+static RssiSignal_t signal;
+static const RssiAdcBackend_t *adc;
 
-static QueueHandle_t rssiReadLock = NULL;
+static volatile uint32_t hotReadings = 0xffffffff;
+static MetricsCounter_t *samplesRead;
+static MetricsCounter_t *samplesSkipped;
 
 void rssiReadTask(void *args);
+static void rssiBenchRegister(const RssiReaderConfig_t *info);
 
-void rssiConfigPrint(RssiReaderConfig_t *config)
+void rssiConfigPrint(const RssiReaderConfig_t *config)
 {
   printf("rssi-reader-config:\n");
   printf(" channelCount=%u\n", config->channelCount);
+  printf(" adc=%s\n", rssiAdcBackend(config->adc.type)->name);
   printf(" updateHz=%u\n", config->updateHz);
   printf(" lpfCutoffHz=%u\n", config->lpfCutoffHz);
+  printf(" lpf2CutoffHz=%u\n", config->lpf2CutoffHz);
+  printf(" filter=%u\n", config->filter);
+  printf(" firTaps=%u\n", config->firTaps);
+  printf(" euroBeta=%f\n", config->euroBeta);
+  printf(" idleDivider=%u\n", config->idleDivider);
+  printf(" outputCount=%u\n", config->outputCount);
+  printf(" fusion=%u\n", config->fusion);
 }
 
 RssiReading_t *rssiReadings()
@@ -41,48 +63,141 @@ RssiReading_t *rssiReadings()
   return readings;
 }
 
+uint8_t rssiReadingCount(const RssiReaderConfig_t *config)
+{
+  return config->outputCount ? config->outputCount : config->channelCount;
+}
+
+void rssiSetHot(uint32_t readingMask)
+{
+  hotReadings = readingMask;
+}
+
+bool rssiConfigValid(const RssiReaderConfig_t *config)
+{
+  return rssiSignalValid(config) && rssiAdcValid(&config->adc, config->channelCount, config->updateHz);
+}
+
 void rssiInit(RssiReaderConfig_t *info)
 {
-  config = info;
-  rssiConfigPrint(config);
+  configSnapshotInit(&configSnapshot, configSlots, sizeof(RssiReaderConfig_t), info);
+  rssiConfigPrint(info);
+  assert(rssiConfigValid(info));
 
-  memset(readings, 0, sizeof(float) * MAX_RSSI_CHANNEL_COUNT);
+  memset(readings, 0, sizeof(readings));
+  rssiSignalInit(&signal);
 
-  lpf_alpha = lpfAlpha(config->lpfCutoffHz, config->updateHz);
-  lpf2_alpha = lpfAlpha(config->lpf2CutoffHz, config->updateHz);
+  samplesRead = metricsCounter("rssi_samples_read");
+  samplesSkipped = metricsCounter("rssi_samples_skipped");
 
-  adc1_config_width(config->bitWidth);
+  adc = rssiAdcBackend(info->adc.type);
+  adc->init(&info->adc, info->bitWidth);
 
-  for (int c = 0; c < config->channelCount; ++c)
-  {
-    adc1_config_channel_atten(config->channels[c], config->attenuation);
-  }
+  rssiBenchRegister(info);
+  taskPlanCreate(TASK_ROLE_SAMPLING, rssiReadTask, "rssiReadTask", NULL);
+}
+
+const RssiReaderConfig_t *rssiConfigAcquire()
+{
+  return configSnapshotAcquire(&configSnapshot, NULL);
+}
+
+void rssiConfigRelease(const RssiReaderConfig_t *snapshot)
+{
+  configSnapshotRelease(&configSnapshot, snapshot);
+}
+
+void rssiConfigUpdate(const RssiReaderConfig_t *next)
+{
+  configSnapshotPublish(&configSnapshot, next);
+}
+
+// Runs on the read task whenever a new snapshot is seen
+static void rssiApplyConfig(TickConsumer_t *ticks, const RssiReaderConfig_t *next, const RssiReaderConfig_t *prev)
+{
+  rssiSignalApply(&signal, next, prev);
+  adc->configure(next->channels, next->channelCount, next->attenuation);
 
-  rssiReadLock = xSemaphoreCreateBinary();
+  if (prev != NULL && prev->updateHz != next->updateHz)
+    tickSchedulerSetRate(ticks, next->updateHz);
 
-  timerInit(TIMER_1, TIMER_GROUP_1, rssiReadLock, true, 1.0f / config->updateHz);
-  xTaskCreate(rssiReadTask, "rssiReadTask", 1024 * 3, NULL, 10, NULL);
+  rssiConfigPrint(next);
+}
+
+// One filter step per mode, run on the spare last channel so live state is untouched
+static RssiReaderConfig_t benchConfigs[3];
+
+static void rssiBenchFilter(void *arg, uint32_t i)
+{
+  const RssiReaderConfig_t *config = arg;
+  int c = MAX_RSSI_CHANNEL_COUNT - 1;
+  signal.filtered[c] = rssiSignalFilter(&signal, config, c, 1800 + (i & 0xff), 1);
+}
+
+static void rssiBenchRegister(const RssiReaderConfig_t *info)
+{
+  if (info->channelCount >= MAX_RSSI_CHANNEL_COUNT)
+    return;
+
+  const char *names[] = {"rssi_filter_cascade", "rssi_filter_one_euro", "rssi_filter_fir"};
+  for (int f = 0; f < 3; ++f)
+  {
+    benchConfigs[f] = *info;
+    benchConfigs[f].filter = f;
+    benchRegister(names[f], rssiBenchFilter, &benchConfigs[f], BENCH_IRQ_OFF);
+  }
 }
 
 void rssiReadTask(void *arg)
 {
+  RssiReaderConfig_t applied;
+  uint32_t appliedVersion = 0;
+
+  const RssiReaderConfig_t *initial = configSnapshotAcquire(&configSnapshot, NULL);
+  TickConsumer_t *ticks = tickSchedulerAdd("rssi", initial->updateHz);
+  configSnapshotRelease(&configSnapshot, initial);
+
+  MetricsLoop_t *loop = metricsLoop("rssi");
+  uint16_t span = traceCaptureName("rssi");
+
   while (1)
   {
-    if (xSemaphoreTake(rssiReadLock, portMAX_DELAY) == pdFALSE)
+    tickSchedulerWait(ticks);
+    metricsLoopBegin(loop);
+    traceCaptureBegin(span);
+
+    uint32_t version = 0;
+    const RssiReaderConfig_t *config = configSnapshotAcquire(&configSnapshot, &version);
+
+    if (version != appliedVersion)
     {
-      continue;
+      rssiApplyConfig(ticks, config, appliedVersion ? &applied : NULL);
+      metricsLoopExpect(loop, config->updateHz);
+      traceCaptureRate(span, config->updateHz);
+      memcpy(&applied, config, sizeof(applied));
+      appliedVersion = version;
     }
 
     uint32_t timestamp = millis();
 
-    for (int c = config->channelCount - 1; c >= 0; --c)
-    {
-      readings[c].timestamp = timestamp;
-      readings[c].raw = adc1_get_raw(config->channels[c]);
-      readings[c].normalized = (readings[c].raw / 4095.0f - 0.5f) / 0.5f;
-      readings[c].filtered = lowPassFilter(readings[c].filtered, readings[c].normalized, lpf_alpha);
-      readings[c].filtered = lowPassFilter(readings[c].filtered, readings[c].filtered, lpf2_alpha);
-      ++readings[c].sampleCount;
-    }
+    uint32_t mask = rssiSignalSchedule(&signal, config, hotReadings);
+
+    uint16_t raw[MAX_RSSI_CHANNEL_COUNT];
+    uint32_t sampleUs = (uint32_t)esp_timer_get_time();
+    adc->read(config->channels, config->channelCount, mask, raw);
+
+    int read = __builtin_popcount(mask);
+    metricsCount(samplesRead, read);
+    metricsCount(samplesSkipped, config->channelCount - read);
+
+    rssiSignalUpdate(&signal, config, mask, raw, sampleUs);
+    rssiSignalFuse(&signal, config, readings, (uint32_t)esp_timer_get_time());
+
+    for (int o = rssiReadingCount(config) - 1; o >= 0; --o)
+      readings[o].timestamp = timestamp;
+
+    configSnapshotRelease(&configSnapshot, config);
+    traceCaptureEnd(span);
+    metricsLoopEnd(loop);
   }
 }
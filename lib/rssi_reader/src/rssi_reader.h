@@ -11,9 +11,23 @@
 
 #include "driver/gpio.h"
 #include "driver/adc.h"
+#include "rssi_adc.h"
 
 #define MAX_RSSI_CHANNEL_COUNT 8
 
+// How channels feeding the same reading are combined
+#define RSSI_FUSE_MAX 0      // strongest antenna wins
+#define RSSI_FUSE_WEIGHTED 1 // weighted mean, for antennas of known quality
+#define RSSI_FUSE_SNR 2      // antenna furthest above its own noise floor wins
+
+// Filter applied to each channel, every mode reports its group delay so passes can be back dated
+#define RSSI_FILTER_CASCADE 0  // two one-pole stages at lpfCutoffHz and lpf2CutoffHz
+#define RSSI_FILTER_ONE_EURO 1 // one pole opening up with slope, lpfCutoffHz when steady
+#define RSSI_FILTER_FIR 2      // moving average over firTaps samples, constant delay
+
+#define RSSI_FIR_MAX_TAPS 256
+#define RSSI_MAX_IDLE_DIVIDER 16
+
 typedef struct
 {
   uint32_t updateHz;
@@ -23,7 +37,23 @@ typedef struct
   uint16_t lpfCutoffHz;
   uint16_t lpf2CutoffHz;
   uint16_t calibrationSec;
-  uint8_t channels[MAX_RSSI_CHANNEL_COUNT];
+  uint8_t channels[MAX_RSSI_CHANNEL_COUNT]; // adc1_channel_t, or converter inputs with an external ADC
+  RssiAdcConfig_t adc;
+
+  uint8_t filter;
+  uint16_t firTaps;
+  float euroBeta; // cutoff gained per unit of normalized slope per second
+
+  // Adaptive sampling: readings not marked hot are read every idleDivider ticks,
+  // staggered across channels, 0 or 1 reads every channel every tick
+  uint8_t idleDivider;
+
+  // Antenna diversity: with outputCount set, channel c feeds reading outputs[c]
+  // and channels sharing a reading are fused every sample. 0 maps channel c to reading c.
+  uint8_t outputCount;
+  uint8_t fusion;
+  uint8_t outputs[MAX_RSSI_CHANNEL_COUNT];
+  float weights[MAX_RSSI_CHANNEL_COUNT];
 } RssiReaderConfig_t;
 
 typedef struct
@@ -33,12 +63,33 @@ typedef struct
   float filtered;
   uint32_t sampleCount;
   uint32_t timestamp;
+  // microsecond stamps of the ADC read and of the filtered value landing, for lap tracing
+  uint32_t sampleUs;
+  uint32_t filteredUs;
+  uint32_t delayUs; // group delay of filtered, the signal it shows arrived this long ago
   uint16_t bias;
+  uint8_t source; // channel the fused value came from, the heaviest one when weighted
 } RssiReading_t;
 
-void rssiConfigPrint(RssiReaderConfig_t *config);
+void rssiConfigPrint(const RssiReaderConfig_t *config);
+
+// False, saying why, for a channel mapping or converter rate that cannot work
+bool rssiConfigValid(const RssiReaderConfig_t *config);
 
 RssiReading_t *rssiReadings();
+
+// Readings produced per sample, one per pilot
+uint8_t rssiReadingCount(const RssiReaderConfig_t *config);
+
+// Bit n set samples reading n at the full rate, for pilots near or in the gate
+void rssiSetHot(uint32_t readingMask);
 void rssiInit(RssiReaderConfig_t *info);
 
+// Pin the current config for one batch of work, release when the batch is done
+const RssiReaderConfig_t *rssiConfigAcquire();
+void rssiConfigRelease(const RssiReaderConfig_t *snapshot);
+
+// Takes effect on the next sample tick, the read task keeps running
+void rssiConfigUpdate(const RssiReaderConfig_t *next);
+
 #endif
\ No newline at end of file
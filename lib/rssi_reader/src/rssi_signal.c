@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "rssi_signal.h"
+#include "filters.h"
+
+// the noise floor follows drops quickly and rises slowly, so a pass barely moves it
+#define RSSI_FLOOR_FALL 0.01f
+#define RSSI_FLOOR_RISE 0.0001f
+
+#define RSSI_EURO_SLOPE_HZ 1.0f
+
+void rssiSignalInit(RssiSignal_t *signal)
+{
+  memset(signal, 0, sizeof(*signal));
+  signal->firTaps = 1;
+
+  for (int c = 0; c < MAX_RSSI_CHANNEL_COUNT; ++c)
+    signal->floor[c] = 1.0f;
+}
+
+bool rssiSignalValid(const RssiReaderConfig_t *config)
+{
+  if (config->channelCount > MAX_RSSI_CHANNEL_COUNT || config->outputCount > MAX_RSSI_CHANNEL_COUNT)
+  {
+    printf("rssi: %d channels into %d readings, at most %d\n", config->channelCount, config->outputCount, MAX_RSSI_CHANNEL_COUNT);
+    return false;
+  }
+
+  for (int c = 0; c < config->channelCount && config->outputCount; ++c)
+  {
+    if (config->outputs[c] >= config->outputCount)
+    {
+      printf("rssi: channel %d feeds reading %d of %d\n", c, config->outputs[c], config->outputCount);
+      return false;
+    }
+  }
+
+  if (config->outputCount && config->fusion == RSSI_FUSE_WEIGHTED)
+  {
+    // a reading with no weight behind it would sit at zero however strong its antennas are
+    float total[MAX_RSSI_CHANNEL_COUNT] = {0};
+    for (int c = 0; c < config->channelCount; ++c)
+    {
+      float w = config->weights[c];
+      if (!isfinite(w) || w < 0)
+      {
+        printf("rssi: channel %d weight %f\n", c, w);
+        return false;
+      }
+      total[config->outputs[c]] += w;
+    }
+
+    for (int o = 0; o < config->outputCount; ++o)
+    {
+      if (!(total[o] > 0))
+      {
+        printf("rssi: reading %d has no weighted channel\n", o);
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+void rssiSignalApply(RssiSignal_t *signal, const RssiReaderConfig_t *next, const RssiReaderConfig_t *prev)
+{
+  signal->lpfAlpha = lpfAlpha(next->lpfCutoffHz, next->updateHz);
+  signal->lpf2Alpha = lpfAlpha(next->lpf2CutoffHz, next->updateHz);
+
+  signal->sampleHz = next->updateHz;
+  signal->cascadeDelayUs = (uint32_t)(((1.0f - signal->lpfAlpha) / signal->lpfAlpha + (1.0f - signal->lpf2Alpha) / signal->lpf2Alpha) * 1e6f / signal->sampleHz);
+
+  signal->euroMinHz = next->lpfCutoffHz ? next->lpfCutoffHz : 1;
+  signal->euroBeta = next->euroBeta;
+  signal->euroSlopeAlpha = 1.0f / (1.0f + signal->sampleHz / (2.0f * (float)M_PI * RSSI_EURO_SLOPE_HZ));
+
+  for (int k = 1; k <= RSSI_MAX_IDLE_DIVIDER; ++k)
+  {
+    signal->lpfSteps[k] = 1.0f - powf(1.0f - signal->lpfAlpha, k);
+    signal->lpf2Steps[k] = 1.0f - powf(1.0f - signal->lpf2Alpha, k);
+    signal->euroSlopeSteps[k] = 1.0f - powf(1.0f - signal->euroSlopeAlpha, k);
+  }
+
+  uint16_t taps = next->firTaps;
+  taps = taps < 1 ? 1 : taps > RSSI_FIR_MAX_TAPS ? RSSI_FIR_MAX_TAPS : taps;
+
+  if (prev == NULL || taps != signal->firTaps || prev->filter != next->filter || prev->channelCount != next->channelCount)
+  {
+    // a fresh window starts empty, the average ramps up over the first taps samples
+    memset(signal->firRing, 0, sizeof(signal->firRing));
+    memset(signal->firSum, 0, sizeof(signal->firSum));
+    signal->firHead = 0;
+    signal->firTaps = taps;
+  }
+
+  uint32_t delayUs = 0;
+  if (next->filter == RSSI_FILTER_CASCADE)
+    delayUs = signal->cascadeDelayUs;
+  else if (next->filter == RSSI_FILTER_FIR)
+    delayUs = (uint32_t)((signal->firTaps - 1) * 0.5e6f / signal->sampleHz);
+  else
+    delayUs = (uint32_t)(1e6f / (2.0f * (float)M_PI * signal->euroMinHz));
+
+  for (int c = 0; c < MAX_RSSI_CHANNEL_COUNT; ++c)
+    signal->delayUs[c] = delayUs;
+}
+
+uint32_t rssiSignalSchedule(RssiSignal_t *signal, const RssiReaderConfig_t *config, uint32_t hotReadings)
+{
+  uint32_t mask = 0;
+  int divider = config->idleDivider < 1 ? 1 : config->idleDivider > RSSI_MAX_IDLE_DIVIDER ? RSSI_MAX_IDLE_DIVIDER : config->idleDivider;
+  ++signal->idleTicks;
+
+  for (int c = 0; c < config->channelCount; ++c)
+  {
+    int reading = config->outputCount ? config->outputs[c] : c;
+    if ((hotReadings & (1 << reading)) || (signal->idleTicks + c) % divider == 0 || signal->steps[c] + 1 >= divider)
+      mask |= 1 << c;
+  }
+
+  return mask;
+}
+
+float rssiSignalFilter(RssiSignal_t *signal, const RssiReaderConfig_t *config, int c, uint16_t raw, int steps)
+{
+  float normalized = (raw / 4095.0f - 0.5f) / 0.5f;
+
+  switch (config->filter)
+  {
+  case RSSI_FILTER_ONE_EURO:
+  {
+    // the cutoff rises with the slope, so a pass edge is followed closely and a flat signal is smoothed hard
+    float rateHz = signal->sampleHz / steps;
+    float slope = (normalized - signal->prev[c]) * rateHz;
+    signal->prev[c] = normalized;
+    signal->slope[c] = lowPassFilter(signal->slope[c], slope, signal->euroSlopeSteps[steps]);
+
+    float cutoffHz = signal->euroMinHz + signal->euroBeta * fabsf(signal->slope[c]);
+    float samples = rateHz / (2.0f * (float)M_PI * cutoffHz);
+    signal->delayUs[c] = (uint32_t)(samples * 1e6f / rateHz);
+    return lowPassFilter(signal->filtered[c], normalized, 1.0f / (1.0f + samples));
+  }
+
+  case RSSI_FILTER_FIR:
+  {
+    uint16_t *slot = &signal->firRing[c][signal->firHead];
+    signal->firSum[c] += raw - *slot;
+    *slot = raw;
+    return ((float)signal->firSum[c] / (signal->firTaps * 4095.0f) - 0.5f) / 0.5f;
+  }
+
+  default:
+    signal->stage[c] = lowPassFilter(signal->stage[c], normalized, signal->lpfSteps[steps]);
+    return lowPassFilter(signal->filtered[c], signal->stage[c], signal->lpf2Steps[steps]);
+  }
+}
+
+void rssiSignalUpdate(RssiSignal_t *signal, const RssiReaderConfig_t *config, uint32_t mask, const uint16_t *raw, uint32_t sampleUs)
+{
+  for (int c = config->channelCount - 1; c >= 0; --c)
+  {
+    bool sampled = mask & (1 << c);
+    ++signal->steps[c];
+
+    if (sampled)
+    {
+      signal->sampleUs[c] = sampleUs;
+      signal->raw[c] = raw[c];
+    }
+    else if (config->filter != RSSI_FILTER_FIR)
+    {
+      continue;
+    }
+
+    // the moving average holds the last reading through skipped ticks, its window is in ticks
+    int steps = config->filter == RSSI_FILTER_FIR ? 1 : signal->steps[c];
+    float filtered = rssiSignalFilter(signal, config, c, (uint16_t)signal->raw[c], steps);
+    signal->filtered[c] = filtered;
+    signal->steps[c] = 0;
+
+    float floor = signal->floor[c];
+    signal->floor[c] = floor + (filtered - floor) * (filtered < floor ? RSSI_FLOOR_FALL : RSSI_FLOOR_RISE);
+  }
+
+  signal->firHead = signal->firHead + 1 < signal->firTaps ? signal->firHead + 1 : 0;
+}
+
+void rssiSignalFuse(const RssiSignal_t *signal, const RssiReaderConfig_t *config, RssiReading_t *readings, uint32_t fusedUs)
+{
+  int outputCount = config->outputCount ? config->outputCount : config->channelCount;
+  float best[MAX_RSSI_CHANNEL_COUNT];
+  float value[MAX_RSSI_CHANNEL_COUNT];
+  float weight[MAX_RSSI_CHANNEL_COUNT];
+  uint8_t source[MAX_RSSI_CHANNEL_COUNT];
+
+  if (config->outputCount == 0)
+  {
+    for (int c = 0; c < config->channelCount; ++c)
+    {
+      value[c] = signal->filtered[c];
+      source[c] = c;
+    }
+  }
+  else if (config->fusion == RSSI_FUSE_WEIGHTED)
+  {
+    for (int o = 0; o < outputCount; ++o)
+    {
+      value[o] = 0;
+      weight[o] = 0;
+      best[o] = -1;
+      source[o] = 0;
+    }
+
+    for (int c = 0; c < config->channelCount; ++c)
+    {
+      int o = config->outputs[c];
+      float w = config->weights[c];
+      bool take = w > best[o];
+
+      value[o] += w * signal->filtered[c];
+      weight[o] += w;
+      best[o] = take ? w : best[o];
+      source[o] = take ? c : source[o];
+    }
+
+    for (int o = 0; o < outputCount; ++o)
+      value[o] = weight[o] > 0 ? value[o] / weight[o] : 0;
+  }
+  else
+  {
+    // max and snr only differ in what they rank by
+    float bias = config->fusion == RSSI_FUSE_SNR ? 1.0f : 0.0f;
+
+    for (int o = 0; o < outputCount; ++o)
+    {
+      best[o] = -4.0f;
+      value[o] = 0;
+      source[o] = 0;
+    }
+
+    for (int c = 0; c < config->channelCount; ++c)
+    {
+      int o = config->outputs[c];
+      float rank = signal->filtered[c] - bias * signal->floor[c];
+      bool take = rank > best[o];
+
+      best[o] = take ? rank : best[o];
+      value[o] = take ? signal->filtered[c] : value[o];
+      source[o] = take ? c : source[o];
+    }
+  }
+
+  for (int o = 0; o < outputCount; ++o)
+  {
+    RssiReading_t *reading = &readings[o];
+    int c = source[o];
+
+    reading->raw = signal->raw[c];
+    reading->normalized = (signal->raw[c] / 4095.0f - 0.5f) / 0.5f;
+    reading->filtered = value[o];
+    reading->source = c;
+    reading->sampleUs = signal->sampleUs[c];
+    reading->filteredUs = fusedUs;
+    reading->delayUs = signal->delayUs[c];
+    ++reading->sampleCount;
+  }
+}
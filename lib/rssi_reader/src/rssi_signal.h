@@ -0,0 +1,78 @@
+//
+// RSSI signal path
+//
+// What happens to raw counts between the converter and the lap detector:
+// which channels are read on a tick when idle ones are divided down, the
+// filter of each channel with its group delay, the noise floor, and the
+// fusion of channels that feed the same reading. Plain C with no platform
+// calls, sample stamps are passed in, so recorded or synthetic traces replay
+// through it on a PC exactly as the read task runs them.
+//
+
+#ifndef __rssi_signal_INCLUDED__
+#define __rssi_signal_INCLUDED__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "rssi_reader.h"
+
+typedef struct
+{
+  // per channel state, laid out as plain arrays so the fusion loops stay tight
+  float raw[MAX_RSSI_CHANNEL_COUNT];
+  float stage[MAX_RSSI_CHANNEL_COUNT];
+  float filtered[MAX_RSSI_CHANNEL_COUNT];
+  float slope[MAX_RSSI_CHANNEL_COUNT];
+  float prev[MAX_RSSI_CHANNEL_COUNT];
+  float floor[MAX_RSSI_CHANNEL_COUNT];
+  uint32_t delayUs[MAX_RSSI_CHANNEL_COUNT];
+  uint32_t sampleUs[MAX_RSSI_CHANNEL_COUNT];
+  uint8_t steps[MAX_RSSI_CHANNEL_COUNT]; // ticks since the channel was last filtered
+
+  // the moving average keeps raw counts so the running sum never drifts
+  uint16_t firRing[MAX_RSSI_CHANNEL_COUNT][RSSI_FIR_MAX_TAPS];
+  uint32_t firSum[MAX_RSSI_CHANNEL_COUNT];
+  uint16_t firHead;
+  uint16_t firTaps;
+
+  float sampleHz;
+  float lpfAlpha;
+  float lpf2Alpha;
+  uint32_t cascadeDelayUs; // the sum of each stage's (1 - a) / a samples
+
+  // one euro filter state shared by all channels
+  float euroSlopeAlpha;
+  float euroMinHz;
+  float euroBeta;
+
+  // a one-pole step over k ticks at once is 1 - (1 - a)^k, so a channel read
+  // less often keeps the same response in time
+  float lpfSteps[RSSI_MAX_IDLE_DIVIDER + 1];
+  float lpf2Steps[RSSI_MAX_IDLE_DIVIDER + 1];
+  float euroSlopeSteps[RSSI_MAX_IDLE_DIVIDER + 1];
+
+  uint32_t idleTicks;
+} RssiSignal_t;
+
+void rssiSignalInit(RssiSignal_t *signal);
+
+// False, saying why, for a channel mapping or fusion weights that cannot work
+bool rssiSignalValid(const RssiReaderConfig_t *config);
+
+// Recomputes the filter constants for next, prev is the config it replaces or NULL at start
+void rssiSignalApply(RssiSignal_t *signal, const RssiReaderConfig_t *next, const RssiReaderConfig_t *prev);
+
+// Channels to read this tick, bit c for channel c. Channels of hot readings are
+// always read, idle ones take turns so each tick reads about the same number.
+uint32_t rssiSignalSchedule(RssiSignal_t *signal, const RssiReaderConfig_t *config, uint32_t hotReadings);
+
+// Filters the channels in mask from raw, sampled at sampleUs, and steps every other one a tick on
+void rssiSignalUpdate(RssiSignal_t *signal, const RssiReaderConfig_t *config, uint32_t mask, const uint16_t *raw, uint32_t sampleUs);
+
+// Filters one raw sample of channel c taken steps ticks after the last one, keeping its group delay current
+float rssiSignalFilter(RssiSignal_t *signal, const RssiReaderConfig_t *config, int c, uint16_t raw, int steps);
+
+// Combines the channels of each reading into readings, stamped fusedUs
+void rssiSignalFuse(const RssiSignal_t *signal, const RssiReaderConfig_t *config, RssiReading_t *readings, uint32_t fusedUs);
+
+#endif
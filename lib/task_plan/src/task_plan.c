@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "sdkconfig.h"
+
+#include "task_plan.h"
+#include "metrics.h"
+
+#define TASK_PLAN_BENCH_PORT 9
+
+static TaskPlanConfig_t *config = NULL;
+
+static const char *roleNames[TASK_ROLE_COUNT] = {
+    "sampling",
+    "detection",
+    "display",
+    "network",
+    "telemetry",
+    "storage"};
+
+static volatile bool flooding = false;
+static volatile uint32_t floodSent = 0;
+
+void taskPlanBenchTask(void *arg);
+void taskPlanFloodTask(void *arg);
+
+static bool taskPlanTiming(int role)
+{
+  return role == TASK_ROLE_SAMPLING || role == TASK_ROLE_DETECTION;
+}
+
+// Hard errors assert, a plan that runs but gives up isolation only warns
+static void taskPlanCheck()
+{
+  const TaskPlacement_t *sampling = &config->roles[TASK_ROLE_SAMPLING];
+  const TaskPlacement_t *detection = &config->roles[TASK_ROLE_DETECTION];
+
+  for (int r = 0; r < TASK_ROLE_COUNT; ++r)
+  {
+    const TaskPlacement_t *placement = &config->roles[r];
+    printf("task-plan: %-9s core %u priority %2u stack %u\n", roleNames[r], placement->core, placement->priority, placement->stackSize);
+
+    assert(placement->core < portNUM_PROCESSORS);
+    assert(placement->priority > tskIDLE_PRIORITY && placement->priority < configMAX_PRIORITIES);
+    assert(placement->stackSize >= configMINIMAL_STACK_SIZE);
+
+    if (!taskPlanTiming(r) && placement->core == sampling->core && placement->priority >= detection->priority)
+      printf("task-plan: warning, %s can preempt detection on core %u\n", roleNames[r], placement->core);
+  }
+
+  // sampling hands readings to detection, it must never wait behind it
+  assert(sampling->priority > detection->priority);
+
+  if (sampling->core != detection->core)
+    printf("task-plan: warning, sampling and detection on different cores\n");
+
+  if (sampling->core == TASK_PLAN_RADIO_CORE || detection->core == TASK_PLAN_RADIO_CORE)
+    printf("task-plan: warning, timing tasks share core %u with WiFi\n", TASK_PLAN_RADIO_CORE);
+
+#if CONFIG_TCPIP_TASK_AFFINITY != TASK_PLAN_RADIO_CORE
+  printf("task-plan: warning, lwIP is not pinned to core %u and may run next to sampling\n", TASK_PLAN_RADIO_CORE);
+#endif
+}
+
+void taskPlanInit(TaskPlanConfig_t *info)
+{
+  config = info;
+  taskPlanCheck();
+
+  if (config->benchSec > 0)
+    taskPlanCreate(TASK_ROLE_TELEMETRY, taskPlanBenchTask, "taskPlanBench", NULL);
+}
+
+const TaskPlacement_t *taskPlanPlacement(int role)
+{
+  assert(config != NULL && role < TASK_ROLE_COUNT);
+  return &config->roles[role];
+}
+
+TaskHandle_t taskPlanCreate(int role, TaskFunction_t task, const char *name, void *arg)
+{
+  const TaskPlacement_t *placement = taskPlanPlacement(role);
+  TaskHandle_t handle = NULL;
+
+  BaseType_t created = xTaskCreatePinnedToCore(task, name, placement->stackSize, arg, placement->priority, &handle, placement->core);
+  assert(created == pdPASS);
+
+  return handle;
+}
+
+static void taskPlanBenchPhase(MetricsLoop_t *loop, const char *phase)
+{
+  MetricsHistogram_t before;
+  memcpy(&before, (const void *)&loop->jitter, sizeof(before));
+
+  vTaskDelay(pdMS_TO_TICKS(config->benchSec * 1000));
+
+  MetricsHistogram_t window;
+  memset(&window, 0, sizeof(window));
+  window.count = loop->jitter.count - before.count;
+  for (int b = 0; b < METRICS_BUCKETS; ++b)
+  {
+    window.buckets[b] = loop->jitter.buckets[b] - before.buckets[b];
+    if (window.buckets[b] != 0)
+      window.max = (2u << b) - 1;
+  }
+
+  printf(
+      "task-plan: bench %-6s samples %u jitter p50 %u us p99 %u us p999 %u us max < %u us\n",
+      phase,
+      window.count,
+      metricsCyclesToUs(metricsPercentile(&window, 0.5f)),
+      metricsCyclesToUs(metricsPercentile(&window, 0.99f)),
+      metricsCyclesToUs(metricsPercentile(&window, 0.999f)),
+      metricsCyclesToUs(window.max));
+}
+
+void taskPlanFloodTask(void *arg)
+{
+  int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  int broadcast = 1;
+  setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(TASK_PLAN_BENCH_PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+
+  static char payload[1024];
+  uint32_t failed = 0;
+
+  while (flooding)
+  {
+    if (sendto(sock, payload, sizeof(payload), 0, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+      // out of buffers, give the stack a tick to drain
+      ++failed;
+      vTaskDelay(1);
+    }
+    else
+    {
+      ++floodSent;
+    }
+  }
+
+  close(sock);
+  printf("task-plan: bench flood sent %u frames, %u refused\n", floodSent, failed);
+  vTaskDelete(NULL);
+}
+
+void taskPlanBenchTask(void *arg)
+{
+  MetricsLoop_t *loop = NULL;
+  while ((loop = metricsFindLoop("rssi")) == NULL || loop->expected == 0)
+    vTaskDelay(pdMS_TO_TICKS(100));
+
+  taskPlanBenchPhase(loop, "quiet");
+
+  floodSent = 0;
+  flooding = true;
+  taskPlanCreate(TASK_ROLE_NETWORK, taskPlanFloodTask, "taskPlanFlood", NULL);
+
+  // with no network up every send fails, and the phase would only time a quiet radio again
+  for (int i = 0; i < 10 && floodSent == 0; ++i)
+    vTaskDelay(pdMS_TO_TICKS(100));
+
+  if (floodSent == 0)
+    printf("task-plan: bench wifi skipped, no frame could be sent, is WiFi up?\n");
+  else
+    taskPlanBenchPhase(loop, "wifi");
+  flooding = false;
+
+  vTaskDelete(NULL);
+}
@@ -0,0 +1,51 @@
+//
+// Task placement plan
+//
+// Every task this project starts is created through the plan, which pins it
+// to a core at a fixed priority. Sampling and detection share one core with
+// nothing else of ours on it; WiFi, lwIP, the web server, display and
+// storage live on the other. The plan is checked once at startup.
+//
+// With benchSec set, a bench task measures the jitter of the sampling loop
+// for that long on a quiet radio, then again while flooding UDP broadcast
+// frames, and prints both. The flood phase is skipped, saying so, when no
+// frame gets out because no network is up.
+//
+
+#ifndef __task_plan_INCLUDED__
+#define __task_plan_INCLUDED__
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define TASK_ROLE_SAMPLING 0
+#define TASK_ROLE_DETECTION 1
+#define TASK_ROLE_DISPLAY 2
+#define TASK_ROLE_NETWORK 3
+#define TASK_ROLE_TELEMETRY 4
+#define TASK_ROLE_STORAGE 5
+#define TASK_ROLE_COUNT 6
+
+// Core the IDF runs WiFi on, see CONFIG_ESP32_WIFI_TASK_PINNED_TO_CORE_*
+#define TASK_PLAN_RADIO_CORE 0
+
+typedef struct
+{
+  uint8_t core;
+  uint8_t priority;
+  uint16_t stackSize;
+} TaskPlacement_t;
+
+typedef struct
+{
+  TaskPlacement_t roles[TASK_ROLE_COUNT];
+  uint16_t benchSec; // 0 disables the jitter bench
+} TaskPlanConfig_t;
+
+void taskPlanInit(TaskPlanConfig_t *info);
+
+const TaskPlacement_t *taskPlanPlacement(int role);
+TaskHandle_t taskPlanCreate(int role, TaskFunction_t task, const char *name, void *arg);
+
+#endif
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_ipc.h"
+#include "driver/timer.h"
+#include "soc/timer_group_struct.h"
+
+#include "tick_scheduler.h"
+#include "trace_capture.h"
+
+// 80 MHz APB / 80 = 1 us per timer count
+#define TICK_TIMER_DIVIDER 80
+#define TICK_TIMER_HZ (TIMER_BASE_CLK / TICK_TIMER_DIVIDER)
+
+static TickSchedulerConfig_t *config;
+
+static TickConsumer_t consumers[TICK_MAX_CONSUMERS];
+static volatile int consumerCount = 0;
+static volatile uint32_t ticks = 0;
+static portMUX_TYPE consumerLock = portMUX_INITIALIZER_UNLOCKED;
+static uint16_t traceIsr;
+
+static void IRAM_ATTR tickSchedulerIsr(void *arg)
+{
+  traceCaptureIsrEnter(traceIsr);
+  timg_dev_t *hw = config->timerGroup == TIMER_GROUP_0 ? &TIMERG0 : &TIMERG1;
+
+  if (config->timerIndex == TIMER_0)
+    hw->int_clr_timers.t0 = 1;
+  else
+    hw->int_clr_timers.t1 = 1;
+
+  hw->hw_timer[config->timerIndex].config.alarm_en = TIMER_ALARM_EN;
+
+  ++ticks;
+
+  BaseType_t woken = pdFALSE;
+
+  portENTER_CRITICAL_ISR(&consumerLock);
+  for (int c = 0; c < consumerCount; ++c)
+  {
+    TickConsumer_t *consumer = &consumers[c];
+    if (--consumer->countdown != 0)
+      continue;
+
+    consumer->countdown = consumer->divisor;
+    ++consumer->notified;
+    vTaskNotifyGiveFromISR(consumer->task, &woken);
+  }
+  portEXIT_CRITICAL_ISR(&consumerLock);
+  traceCaptureIsrExit(traceIsr);
+
+  if (woken == pdTRUE)
+    portYIELD_FROM_ISR();
+}
+
+// Interrupts are serviced by the core that allocates them
+static void tickSchedulerAttach(void *arg)
+{
+  timer_isr_register(config->timerGroup, config->timerIndex, tickSchedulerIsr, NULL, ESP_INTR_FLAG_IRAM, NULL);
+}
+
+void tickSchedulerInit(TickSchedulerConfig_t *info)
+{
+  config = info;
+  memset(consumers, 0, sizeof(consumers));
+  traceIsr = traceCaptureName("tick");
+  traceCaptureRate(traceIsr, config->baseHz);
+
+  timer_config_t timerConfig = {
+      .alarm_en = TIMER_ALARM_EN,
+      .counter_en = TIMER_PAUSE,
+      .intr_type = TIMER_INTR_LEVEL,
+      .counter_dir = TIMER_COUNT_UP,
+      .auto_reload = TIMER_AUTORELOAD_EN,
+      .divider = TICK_TIMER_DIVIDER};
+
+  timer_init(config->timerGroup, config->timerIndex, &timerConfig);
+  timer_set_counter_value(config->timerGroup, config->timerIndex, 0);
+  timer_set_alarm_value(config->timerGroup, config->timerIndex, TICK_TIMER_HZ / config->baseHz);
+  timer_enable_intr(config->timerGroup, config->timerIndex);
+  if (config->core == xPortGetCoreID())
+    tickSchedulerAttach(NULL);
+  else
+    esp_ipc_call_blocking(config->core, &tickSchedulerAttach, NULL);
+
+  timer_start(config->timerGroup, config->timerIndex);
+
+  printf("tick-scheduler: %u Hz on timer %u:%u, core %u\n", config->baseHz, config->timerGroup, config->timerIndex, config->core);
+}
+
+static uint32_t tickSchedulerDivisor(uint32_t hz)
+{
+  uint32_t divisor = hz ? config->baseHz / hz : 1;
+  return divisor ? divisor : 1;
+}
+
+TickConsumer_t *tickSchedulerAdd(const char *name, uint32_t hz)
+{
+  portENTER_CRITICAL(&consumerLock);
+  assert(consumerCount < TICK_MAX_CONSUMERS);
+
+  TickConsumer_t *consumer = &consumers[consumerCount];
+  memset(consumer, 0, sizeof(TickConsumer_t));
+  consumer->name = name;
+  consumer->task = xTaskGetCurrentTaskHandle();
+  consumer->divisor = tickSchedulerDivisor(hz);
+
+  // line up with the tick every other consumer counts from
+  consumer->countdown = consumer->divisor - ticks % consumer->divisor;
+
+  ++consumerCount;
+  portEXIT_CRITICAL(&consumerLock);
+
+  printf("tick-scheduler: %s every %u ticks\n", name, consumer->divisor);
+  return consumer;
+}
+
+void tickSchedulerSetRate(TickConsumer_t *consumer, uint32_t hz)
+{
+  uint32_t divisor = tickSchedulerDivisor(hz);
+
+  portENTER_CRITICAL(&consumerLock);
+  consumer->divisor = divisor;
+  consumer->countdown = divisor - ticks % divisor;
+  portEXIT_CRITICAL(&consumerLock);
+}
+
+uint32_t tickSchedulerWait(TickConsumer_t *consumer)
+{
+  uint32_t elapsed = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+  ++consumer->wakes;
+  if (elapsed > 1)
+  {
+    // ran late, the ticks in between were folded into this wake
+    ++consumer->coalesced;
+    consumer->missed += elapsed - 1;
+  }
+
+  return elapsed;
+}
+
+uint32_t tickSchedulerBaseHz()
+{
+  return config->baseHz;
+}
+
+uint32_t tickSchedulerTicks()
+{
+  return ticks;
+}
+
+int tickSchedulerConsumers(const TickConsumer_t **out, int maxConsumers)
+{
+  int count = consumerCount < maxConsumers ? consumerCount : maxConsumers;
+  for (int c = 0; c < count; ++c)
+    out[c] = &consumers[c];
+
+  return count;
+}
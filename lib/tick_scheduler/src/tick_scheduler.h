@@ -0,0 +1,58 @@
+//
+// Tick scheduler
+//
+// One hardware timer drives all periodic work. Each consumer runs every
+// Nth base tick and is woken by a direct task notification. All consumers
+// count from the same tick, so a consumer at 1 kHz always wakes on the same
+// tick as a 10 kHz consumer. Ticks that arrive while a consumer is still
+// busy are coalesced into its next wake and counted, never silently lost.
+//
+
+#ifndef __tick_scheduler_INCLUDED__
+#define __tick_scheduler_INCLUDED__
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/timer.h"
+
+#define TICK_MAX_CONSUMERS 8
+
+typedef struct
+{
+  uint32_t baseHz;
+  timer_group_t timerGroup;
+  timer_idx_t timerIndex;
+  uint8_t core; // the interrupt is allocated here, keep it next to the consumers
+} TickSchedulerConfig_t;
+
+typedef struct
+{
+  const char *name;
+  TaskHandle_t task;
+  volatile uint32_t divisor;
+  uint32_t countdown;
+
+  // written by the ISR
+  volatile uint32_t notified;
+
+  // written by the consumer
+  uint32_t wakes;
+  uint32_t missed;
+  uint32_t coalesced;
+} TickConsumer_t;
+
+void tickSchedulerInit(TickSchedulerConfig_t *info);
+
+// Registers the calling task, rates are rounded to a whole divisor of the base rate
+TickConsumer_t *tickSchedulerAdd(const char *name, uint32_t hz);
+void tickSchedulerSetRate(TickConsumer_t *consumer, uint32_t hz);
+
+// Blocks until the consumer's next tick, returns how many of its ticks passed since the last wait
+uint32_t tickSchedulerWait(TickConsumer_t *consumer);
+
+uint32_t tickSchedulerBaseHz();
+uint32_t tickSchedulerTicks();
+int tickSchedulerConsumers(const TickConsumer_t **consumers, int maxConsumers);
+
+#endif
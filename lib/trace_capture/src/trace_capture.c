@@ -0,0 +1,352 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_ipc.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#include "trace_capture.h"
+#include "metrics.h"
+#include "webserver.h"
+#include "mongoose.h"
+
+#define TRACE_NONE 0xff
+#define TRACE_SPAN_PID 2
+#define TRACE_MAX_TASKS 24
+#define TRACE_CHUNK 2048
+
+typedef struct
+{
+  uint32_t cycles;
+  void *task;
+  uint16_t id;
+  volatile uint8_t type; // written last, TRACE_NONE until the slot is complete
+  uint8_t core;
+} TraceEvent_t;
+
+typedef struct
+{
+  uint32_t cycles;
+  int64_t us;
+} TraceAnchor_t;
+
+typedef struct
+{
+  struct mg_connection *nc;
+  mg_event_handler_t handler;
+  uint32_t cursor;
+  uint32_t count;
+  int taskCount;
+  TaskStatus_t tasks[TRACE_MAX_TASKS];
+} TraceStream_t;
+
+static TraceCaptureConfig_t *config;
+
+static TraceEvent_t *events = NULL;
+static volatile uint32_t head = 0;
+static volatile bool recording = false;
+static uint8_t classes = 0;
+
+static TraceAnchor_t anchors[portNUM_PROCESSORS];
+static int64_t startUs = 0;
+static esp_timer_handle_t stopTimer;
+
+static const char *names[TRACE_MAX_NAMES];
+static uint16_t nameEvery[TRACE_MAX_NAMES];
+static uint32_t nameSeen[TRACE_MAX_NAMES];
+static bool nameKept[TRACE_MAX_NAMES];
+static int nameCount = 0;
+
+static TraceStream_t stream;
+static char line[160];
+
+static WebRequestHandler_t traceHandler;
+
+uint16_t traceCaptureName(const char *name)
+{
+  assert(nameCount < TRACE_MAX_NAMES);
+  names[nameCount] = name;
+  nameEvery[nameCount] = 1;
+  nameKept[nameCount] = true;
+  return nameCount++;
+}
+
+void traceCaptureRate(uint16_t id, uint32_t hz)
+{
+  uint32_t every = config->pairHz != 0 && hz > config->pairHz ? hz / config->pairHz : 1;
+  nameEvery[id] = every > UINT16_MAX ? UINT16_MAX : every;
+}
+
+static void IRAM_ATTR traceCaptureWrite(uint8_t type, uint16_t id, void *task)
+{
+  uint32_t slot = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+  if (slot >= config->events)
+  {
+    recording = false;
+    return;
+  }
+
+  TraceEvent_t *event = &events[slot];
+  event->cycles = metricsCycles();
+  event->task = task;
+  event->id = id;
+  event->core = xPortGetCoreID();
+  __atomic_store_n(&event->type, type, __ATOMIC_RELEASE);
+}
+
+void IRAM_ATTR traceCaptureTaskSwitch(int type, void *task)
+{
+  if (recording && (classes & TRACE_CLASS_TASK))
+    traceCaptureWrite(type, 0, task);
+}
+
+void IRAM_ATTR traceCaptureRecord(uint8_t type, uint16_t id)
+{
+  if (!recording)
+    return;
+
+  bool span = type == TRACE_SPAN_BEGIN || type == TRACE_SPAN_END;
+  if (!(classes & (span ? TRACE_CLASS_SPAN : TRACE_CLASS_ISR)))
+    return;
+
+  // the end goes with its begin, so a decimated name never leaves half a pair
+  if (type == TRACE_ISR_ENTER || type == TRACE_SPAN_BEGIN)
+    nameKept[id] = nameSeen[id]++ % nameEvery[id] == 0;
+  if (!nameKept[id])
+    return;
+
+  // ISRs interrupt whatever task is running, they get a lane of their own
+  traceCaptureWrite(type, id, span ? xTaskGetCurrentTaskHandle() : NULL);
+}
+
+static void traceCaptureAnchor(void *arg)
+{
+  TraceAnchor_t *anchor = &anchors[xPortGetCoreID()];
+  anchor->us = esp_timer_get_time();
+  anchor->cycles = metricsCycles();
+}
+
+static void traceCaptureStopCallback(void *arg)
+{
+  recording = false;
+}
+
+bool traceCaptureStart(uint32_t ms, uint8_t mask)
+{
+  if (recording || stream.nc != NULL)
+    return false;
+
+  if (ms == 0 || ms > config->maxMs)
+    ms = config->maxMs;
+  classes = mask & TRACE_CLASS_ALL ? mask & TRACE_CLASS_ALL : config->classes;
+
+  memset(events, TRACE_NONE, config->events * sizeof(TraceEvent_t));
+  head = 0;
+
+  // each core keeps its own cycle counter, pin both to the same microsecond clock
+  traceCaptureAnchor(NULL);
+  for (int core = 0; core < portNUM_PROCESSORS; ++core)
+  {
+    if (core != xPortGetCoreID())
+      esp_ipc_call_blocking(core, &traceCaptureAnchor, NULL);
+  }
+
+  startUs = esp_timer_get_time();
+  recording = true;
+  esp_timer_start_once(stopTimer, ms * 1000);
+
+  printf("trace-capture: recording %u ms, classes 0x%02x\n", ms, classes);
+  return true;
+}
+
+void traceCaptureStop()
+{
+  esp_timer_stop(stopTimer);
+  recording = false;
+}
+
+bool traceCaptureRecording()
+{
+  return recording;
+}
+
+uint32_t traceCaptureCount()
+{
+  return head < config->events ? head : config->events;
+}
+
+static const char *traceCaptureTaskName(TraceStream_t *s, void *task)
+{
+  for (int t = 0; t < s->taskCount; ++t)
+  {
+    if (s->tasks[t].xHandle == task)
+      return s->tasks[t].pcTaskName;
+  }
+
+  return NULL;
+}
+
+static int traceCaptureFormat(TraceStream_t *s, TraceEvent_t *event)
+{
+  TraceAnchor_t *anchor = &anchors[event->core];
+  double ts = (double)(anchor->us - startUs) + (double)(uint32_t)(event->cycles - anchor->cycles) / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+
+  // the metadata always goes first, so every event follows a comma
+  const char *sep = ",";
+
+  switch (event->type)
+  {
+  case TRACE_TASK_IN:
+  case TRACE_TASK_OUT:
+  {
+    const char *name = traceCaptureTaskName(s, event->task);
+    return snprintf(line, sizeof(line), "%s\n{\"ph\":\"%s\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"name\":\"%s\"}",
+                    sep, event->type == TRACE_TASK_IN ? "B" : "E", event->core, (uint32_t)event->task, ts, name ? name : "task");
+  }
+  case TRACE_ISR_ENTER:
+  case TRACE_ISR_EXIT:
+    return snprintf(line, sizeof(line), "%s\n{\"ph\":\"%s\",\"pid\":%u,\"tid\":0,\"ts\":%.3f,\"name\":\"%s\"}",
+                    sep, event->type == TRACE_ISR_ENTER ? "B" : "E", event->core, ts, names[event->id]);
+  default:
+    // spans go on their own process, a task may be switched out mid span
+    return snprintf(line, sizeof(line), "%s\n{\"ph\":\"%s\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"name\":\"%s\",\"args\":{\"core\":%u}}",
+                    sep, event->type == TRACE_SPAN_BEGIN ? "B" : "E", TRACE_SPAN_PID, (uint32_t)event->task, ts, names[event->id], event->core);
+  }
+}
+
+static void traceCaptureMetadata(TraceStream_t *s)
+{
+  struct mg_connection *nc = s->nc;
+
+  mg_printf(nc, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  mg_printf(nc, "\n{\"ph\":\"M\",\"pid\":%u,\"name\":\"process_name\",\"args\":{\"name\":\"spans\"}}", TRACE_SPAN_PID);
+
+  for (int core = 0; core < portNUM_PROCESSORS; ++core)
+  {
+    mg_printf(nc, ",\n{\"ph\":\"M\",\"pid\":%u,\"name\":\"process_name\",\"args\":{\"name\":\"core %u\"}}", core, core);
+    mg_printf(nc, ",\n{\"ph\":\"M\",\"pid\":%u,\"tid\":0,\"name\":\"thread_name\",\"args\":{\"name\":\"ISR\"}}", core);
+  }
+
+  for (int t = 0; t < s->taskCount; ++t)
+  {
+    for (int pid = 0; pid <= TRACE_SPAN_PID; ++pid)
+    {
+      mg_printf(nc, ",\n{\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}",
+                pid, (uint32_t)s->tasks[t].xHandle, s->tasks[t].pcTaskName);
+    }
+  }
+}
+
+static void traceCaptureEndStream(TraceStream_t *s)
+{
+  s->nc->handler = s->handler;
+  s->nc = NULL;
+}
+
+// Top up the send buffer a chunk at a time, the rest follows on MG_EV_SEND
+static void traceCapturePump(TraceStream_t *s)
+{
+  struct mg_connection *nc = s->nc;
+
+  while (s->cursor < s->count && nc->send_mbuf.len < TRACE_CHUNK)
+  {
+    TraceEvent_t *event = &events[s->cursor++];
+    if (event->type == TRACE_NONE)
+      continue;
+
+    int len = traceCaptureFormat(s, event);
+    mg_send(nc, line, len);
+  }
+
+  if (s->cursor >= s->count)
+  {
+    mg_printf(nc, "\n]}\n");
+    nc->flags |= MG_F_SEND_AND_CLOSE;
+    traceCaptureEndStream(s);
+  }
+}
+
+static void traceCaptureStreamHandler(struct mg_connection *nc, int ev, void *ev_data MG_UD_ARG(void *user_data))
+{
+  mg_event_handler_t handler = stream.handler;
+
+  if (stream.nc == nc)
+  {
+    if (ev == MG_EV_SEND)
+      traceCapturePump(&stream);
+    else if (ev == MG_EV_CLOSE)
+      traceCaptureEndStream(&stream);
+  }
+
+  handler(nc, ev, ev_data MG_UD_ARG(user_data));
+}
+
+void traceCallback(struct mg_connection *nc, struct http_message *hm)
+{
+  char value[12];
+
+  if (mg_get_http_var(&hm->query_string, "start", value, sizeof(value)) > 0)
+  {
+    uint32_t ms = strtoul(value, NULL, 10);
+    uint8_t mask = 0;
+    if (mg_get_http_var(&hm->query_string, "classes", value, sizeof(value)) > 0)
+      mask = strtoul(value, NULL, 0);
+
+    bool started = traceCaptureStart(ms, mask);
+    mg_send_head(nc, started ? 200 : 409, -1, "Content-Type: text/plain");
+    mg_printf_http_chunk(nc, started ? "recording\n" : "busy\n");
+    mg_send_http_chunk(nc, "", 0);
+    return;
+  }
+
+  if (recording || stream.nc != NULL)
+  {
+    mg_send_head(nc, 409, -1, "Content-Type: text/plain");
+    mg_printf_http_chunk(nc, "%s, %u events\n", recording ? "recording" : "busy", traceCaptureCount());
+    mg_send_http_chunk(nc, "", 0);
+    return;
+  }
+
+  stream.nc = nc;
+  stream.cursor = 0;
+  stream.count = traceCaptureCount();
+  stream.taskCount = uxTaskGetSystemState(stream.tasks, TRACE_MAX_TASKS, NULL);
+
+  // no length up front, the capture is rendered as it goes and the connection closes at the end
+  mg_printf(nc, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n");
+  mg_printf(nc, "Content-Disposition: attachment; filename=\"trace.json\"\r\nConnection: close\r\n\r\n");
+  traceCaptureMetadata(&stream);
+
+  stream.handler = nc->handler;
+  nc->handler = traceCaptureStreamHandler;
+  traceCapturePump(&stream);
+}
+
+void traceCaptureInit(TraceCaptureConfig_t *info)
+{
+  config = info;
+
+  events = heap_caps_malloc(config->events * sizeof(TraceEvent_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  assert(events != NULL);
+  head = 0;
+  memset(&stream, 0, sizeof(stream));
+
+  esp_timer_create_args_t timerArgs = {
+      .callback = &traceCaptureStopCallback,
+      .arg = NULL,
+      .dispatch_method = ESP_TIMER_TASK,
+      .name = "trace"};
+  esp_timer_create(&timerArgs, &stopTimer);
+
+  traceHandler.callback = &traceCallback;
+  traceHandler.path = "/trace";
+  traceHandler.request = HTTP_GET;
+  webserverRegister(&traceHandler);
+
+  printf("trace-capture: %u events, %u bytes, %u ms max\n", config->events, config->events * sizeof(TraceEvent_t), config->maxMs);
+}
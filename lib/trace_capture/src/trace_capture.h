@@ -0,0 +1,85 @@
+//
+// Scheduling trace capture
+//
+// Records task switches, ISR entry/exit and user spans into a RAM ring
+// allocated once at boot. Recording is armed on demand from /trace?start=ms
+// and stops when the time is up or the ring is full, after which /trace
+// streams the capture as Chrome trace event JSON (chrome://tracing or
+// Perfetto). Each core is a process, each task a thread.
+//
+// An event is a cycle counter read and an atomic slot claim. The cycle
+// counters of the two cores are anchored to esp_timer when the capture
+// starts, so both cores land on one timeline.
+//
+// A 10 kHz tick fills a few thousand slots in well under 100 ms, so the
+// ring only lasts as long as the event rate allows. Each capture records a
+// mask of event classes, task switches are the costliest and off by
+// default. Names that run at a known rate are decimated to about pairHz
+// begin/end pairs a second, a kept begin always keeps its end.
+//
+
+#ifndef __trace_capture_INCLUDED__
+#define __trace_capture_INCLUDED__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TRACE_TASK_IN 0
+#define TRACE_TASK_OUT 1
+#define TRACE_ISR_ENTER 2
+#define TRACE_ISR_EXIT 3
+#define TRACE_SPAN_BEGIN 4
+#define TRACE_SPAN_END 5
+
+#define TRACE_CLASS_TASK 0x01
+#define TRACE_CLASS_ISR 0x02
+#define TRACE_CLASS_SPAN 0x04
+#define TRACE_CLASS_ALL 0x07
+
+#define TRACE_MAX_NAMES 16
+
+typedef struct
+{
+  uint32_t events;   // ring size, 12 bytes each
+  uint16_t maxMs;    // longest capture, the cycle counter wraps after ~17 s
+  uint8_t classes;   // TRACE_CLASS_* recorded unless /trace?classes= picks others
+  uint16_t pairHz;   // begin/end pairs kept a second for each rated name, 0 keeps all
+} TraceCaptureConfig_t;
+
+void traceCaptureInit(TraceCaptureConfig_t *info);
+
+// Register a span or ISR name once, the id goes into every event
+uint16_t traceCaptureName(const char *name);
+
+// The name runs hz times a second, only one begin in hz / pairHz is kept
+void traceCaptureRate(uint16_t id, uint32_t hz);
+
+// A mask of 0 records the configured default classes
+bool traceCaptureStart(uint32_t ms, uint8_t mask);
+void traceCaptureStop();
+bool traceCaptureRecording();
+uint32_t traceCaptureCount();
+
+void traceCaptureRecord(uint8_t type, uint16_t id);
+
+static inline void traceCaptureIsrEnter(uint16_t id)
+{
+  traceCaptureRecord(TRACE_ISR_ENTER, id);
+}
+
+static inline void traceCaptureIsrExit(uint16_t id)
+{
+  traceCaptureRecord(TRACE_ISR_EXIT, id);
+}
+
+static inline void traceCaptureBegin(uint16_t id)
+{
+  traceCaptureRecord(TRACE_SPAN_BEGIN, id);
+}
+
+static inline void traceCaptureEnd(uint16_t id)
+{
+  traceCaptureRecord(TRACE_SPAN_END, id);
+}
+
+#endif
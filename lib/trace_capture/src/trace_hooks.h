@@ -0,0 +1,21 @@
+//
+// FreeRTOS trace hooks
+//
+// Force included into every translation unit by platformio.ini so the
+// kernel picks these up before its own empty defaults. Only tasks.c expands
+// them, where pxCurrentTCB is in scope.
+//
+
+#ifndef __trace_hooks_INCLUDED__
+#define __trace_hooks_INCLUDED__
+
+#ifndef __ASSEMBLER__
+
+void traceCaptureTaskSwitch(int type, void *task);
+
+#define traceTASK_SWITCHED_IN() traceCaptureTaskSwitch(0, pxCurrentTCB[xPortGetCoreID()])
+#define traceTASK_SWITCHED_OUT() traceCaptureTaskSwitch(1, pxCurrentTCB[xPortGetCoreID()])
+
+#endif
+
+#endif
@@ -12,20 +12,49 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "driver/spi_master.h"
 
 #include "rx_channels.h"
 #include "rx_controller.h"
 
 #include "rx_5808.h"
+#include "bench.h"
 
-static RxControllerConfig_t *config;
+// Pins and bus speed are fixed once the SPI bus is up, so keep a private copy
+static RxControllerConfig_t rxConfig;
+static const RxControllerConfig_t *config = &rxConfig;
 
 static spi_device_handle_t devHandle[MAX_RX_COUNT];
+static uint8_t tunedBand[MAX_RX_COUNT];
+static uint8_t tunedChannel[MAX_RX_COUNT];
 
-void rxInit(RxControllerConfig_t *info)
+// the web, Chorus and bench paths all retune, a retune is its register writes and tuned state together
+static SemaphoreHandle_t rxLock;
+
+uint16_t getChannelData(uint16_t frequency);
+static void rxWriteChannel(uint8_t deviceId, uint16_t data);
+
+static void rxBenchChannelData(void *arg, uint32_t i)
 {
-  config = info;
+  volatile uint16_t data = getChannelData(5658 + (i & 0xff));
+  (void)data;
+}
+
+// retunes receiver 0 to what it is already on, so a run does not disturb timing;
+// the register writes only, rxSetState also logs every call. Under the lock,
+// a retune landing mid run is never undone with the channel read before it
+static void rxBenchSetState(void *arg, uint32_t i)
+{
+  xSemaphoreTake(rxLock, portMAX_DELAY);
+  rxWriteChannel(0, channelTable[(tunedChannel[0] - 1) + (8 * tunedBand[0])]);
+  xSemaphoreGive(rxLock);
+}
+
+void rxInit(const RxControllerConfig_t *info)
+{
+  memcpy(&rxConfig, info, sizeof(rxConfig));
+  rxLock = xSemaphoreCreateMutex();
 
   esp_err_t ret;
 
@@ -60,7 +89,14 @@ void rxInit(RxControllerConfig_t *info)
 
     ret = spi_bus_add_device(HSPI_HOST, &devcfg, &devHandle[i]);
     assert(ret == ESP_OK);
+
+    tunedBand[i] = 0;
+    tunedChannel[i] = 1;
   }
+
+  benchRegister("rx_channel_data", rxBenchChannelData, NULL, BENCH_IRQ_OFF);
+  if (config->rxCount > 0)
+    benchRegister("rx_set_state", rxBenchSetState, NULL, 0);
 }
 
 void rxProcessTransaction(spi_transaction_t *t)
@@ -99,17 +135,9 @@ uint16_t getChannelData(uint16_t frequency)
   return channelData;
 }
 
-void rxSetState(uint8_t deviceId, uint8_t band, uint8_t channel)
+// The two register writes that retune a receiver, nothing else; the caller holds rxLock
+static void rxWriteChannel(uint8_t deviceId, uint16_t data)
 {
-  assert(deviceId >= (uint8_t)0);
-  assert(deviceId < MAX_RX_COUNT);
-  assert(deviceId < config->rxCount);
-
-
-  int index = (channel - 1) + (8 * band);
-  uint16_t freq = channelFreqTable[index];
-  uint16_t data = channelTable[index];
-
   rx5808_request_t ra = {
       .address = 1,
       .readWrite = 0,
@@ -122,11 +150,29 @@ void rxSetState(uint8_t deviceId, uint8_t band, uint8_t channel)
 
   rxTransmit(devHandle[deviceId], (uint8_t *)&ra, sizeof(rx5808_request_t));
   rxTransmit(devHandle[deviceId], (uint8_t *)&rd, sizeof(rx5808_request_t));
+}
+
+void rxSetState(uint8_t deviceId, uint8_t band, uint8_t channel)
+{
+  assert(deviceId >= (uint8_t)0);
+  assert(deviceId < MAX_RX_COUNT);
+  assert(deviceId < config->rxCount);
+
+
+  int index = (channel - 1) + (8 * band);
+  uint16_t freq = channelFreqTable[index];
+  uint16_t data = channelTable[index];
+
+  xSemaphoreTake(rxLock, portMAX_DELAY);
+  rxWriteChannel(deviceId, data);
+  tunedBand[deviceId] = band;
+  tunedChannel[deviceId] = channel;
+  xSemaphoreGive(rxLock);
 
   printf("rx[%u]->[b:%u, c:%u, f:%u, d:%x]\n", deviceId, band, channel, freq, data);
 }
 
-const char rxGetBandShortName(int band)
+char rxGetBandShortName(int band)
 {
   return bandShortNameTable[band];
 }
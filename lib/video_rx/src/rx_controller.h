@@ -28,8 +28,8 @@ typedef struct
   RxDeviceConfig_t devices[MAX_RX_COUNT];
 } RxControllerConfig_t;
 
-void rxInit(RxControllerConfig_t *info);
+void rxInit(const RxControllerConfig_t *info);
 void rxSetState(uint8_t deviceId, uint8_t band, uint8_t channel);
-const char rxGetBandShortName(int band);
+char rxGetBandShortName(int band);
 int rxGetFrequency(int band, int channel);
 #endif
\ No newline at end of file
@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include "rom/crc.h"
+
+#include "web_assets.h"
+#include "webserver.h"
+#include "mongoose.h"
+
+typedef struct
+{
+  char path[WEB_ASSETS_PATH_LEN];
+  uint32_t size;
+  char etag[20];
+  const char *mimeType;
+} WebAsset_t;
+
+typedef struct
+{
+  struct mg_connection *nc;
+  FILE *file;
+  uint32_t remaining;
+  mg_event_handler_t handler;
+} WebAssetStream_t;
+
+static WebAssetsConfig_t *config;
+
+static WebAsset_t assets[WEB_ASSETS_MAX_FILES];
+static int assetCount = 0;
+
+static WebAssetStream_t streams[WEB_ASSETS_MAX_STREAMS];
+static char chunk[1024];
+
+static WebRequestHandler_t assetsHandler;
+
+static const char *webAssetsMimeType(const char *path)
+{
+  const char *ext = strrchr(path, '.');
+  if (ext == NULL)
+    return "application/octet-stream";
+
+  if (strcmp(ext, ".html") == 0)
+    return "text/html";
+  if (strcmp(ext, ".js") == 0)
+    return "application/javascript";
+  if (strcmp(ext, ".css") == 0)
+    return "text/css";
+  if (strcmp(ext, ".json") == 0)
+    return "application/json";
+  if (strcmp(ext, ".svg") == 0)
+    return "image/svg+xml";
+  if (strcmp(ext, ".png") == 0)
+    return "image/png";
+  if (strcmp(ext, ".ico") == 0)
+    return "image/x-icon";
+
+  return "application/octet-stream";
+}
+
+static void webAssetsFilePath(char *out, size_t len, const char *path)
+{
+  snprintf(out, len, "%s/%s%s.gz", config->mount, config->dir, path);
+}
+
+// Reads each file once at boot so requests never have to hash anything
+static void webAssetsIndex(const char *name)
+{
+  size_t dirLen = strlen(config->dir);
+  size_t nameLen = strlen(name);
+
+  if (strncmp(name, config->dir, dirLen) != 0 || name[dirLen] != '/')
+    return;
+
+  if (nameLen < 3 || strcmp(name + nameLen - 3, ".gz") != 0)
+    return;
+
+  if (assetCount >= WEB_ASSETS_MAX_FILES)
+  {
+    printf("web-assets: index full, skipping %s\n", name);
+    return;
+  }
+
+  WebAsset_t *asset = &assets[assetCount];
+  int pathLen = nameLen - dirLen - 3;
+  if (pathLen >= WEB_ASSETS_PATH_LEN)
+    return;
+
+  memcpy(asset->path, name + dirLen, pathLen);
+  asset->path[pathLen] = 0;
+
+  char filePath[80];
+  webAssetsFilePath(filePath, sizeof(filePath), asset->path);
+
+  FILE *file = fopen(filePath, "rb");
+  if (file == NULL)
+    return;
+
+  uint32_t crc = 0;
+  uint32_t size = 0;
+  size_t read = 0;
+  while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+  {
+    crc = crc32_le(crc, (const uint8_t *)chunk, read);
+    size += read;
+  }
+  fclose(file);
+
+  asset->size = size;
+  asset->mimeType = webAssetsMimeType(asset->path);
+  sprintf(asset->etag, "\"%08x-%x\"", crc, size);
+  ++assetCount;
+
+  printf("web-assets: %s %u %s\n", asset->path, size, asset->etag);
+}
+
+static WebAsset_t *webAssetsFind(const struct mg_str *uri)
+{
+  size_t prefixLen = strlen(config->urlPrefix);
+  const char *path = uri->p + prefixLen;
+  size_t pathLen = uri->len - prefixLen;
+
+  if (pathLen == 0 || (pathLen == 1 && path[0] == '/'))
+  {
+    path = "/index.html";
+    pathLen = strlen(path);
+  }
+
+  for (int a = 0; a < assetCount; ++a)
+  {
+    if (strlen(assets[a].path) == pathLen && strncmp(assets[a].path, path, pathLen) == 0)
+      return &assets[a];
+  }
+
+  return NULL;
+}
+
+static WebAssetStream_t *webAssetsFindStream(struct mg_connection *nc)
+{
+  for (int s = 0; s < WEB_ASSETS_MAX_STREAMS; ++s)
+  {
+    if (streams[s].nc == nc)
+      return &streams[s];
+  }
+
+  return NULL;
+}
+
+static void webAssetsEndStream(WebAssetStream_t *stream)
+{
+  fclose(stream->file);
+  stream->nc->handler = stream->handler;
+  stream->nc = NULL;
+  stream->file = NULL;
+}
+
+// Top up the send buffer to one chunk, the rest follows on MG_EV_SEND
+static void webAssetsPump(WebAssetStream_t *stream)
+{
+  struct mg_connection *nc = stream->nc;
+  while (stream->remaining > 0 && nc->send_mbuf.len < config->chunkSize)
+  {
+    size_t want = stream->remaining < config->chunkSize ? stream->remaining : config->chunkSize;
+    if (want > sizeof(chunk))
+      want = sizeof(chunk);
+
+    size_t read = fread(chunk, 1, want, stream->file);
+    if (read == 0)
+    {
+      nc->flags |= MG_F_SEND_AND_CLOSE;
+      stream->remaining = 0;
+      break;
+    }
+
+    mg_send(nc, chunk, read);
+    stream->remaining -= read;
+  }
+
+  if (stream->remaining == 0)
+    webAssetsEndStream(stream);
+}
+
+static void webAssetsStreamHandler(struct mg_connection *nc, int ev, void *ev_data MG_UD_ARG(void *user_data))
+{
+  WebAssetStream_t *stream = webAssetsFindStream(nc);
+  if (stream == NULL)
+    return;
+
+  // the stream may finish and hand the connection back below, so keep the original handler
+  mg_event_handler_t handler = stream->handler;
+
+  if (ev == MG_EV_SEND)
+    webAssetsPump(stream);
+  else if (ev == MG_EV_CLOSE)
+    webAssetsEndStream(stream);
+
+  handler(nc, ev, ev_data MG_UD_ARG(user_data));
+}
+
+static void webAssetsSendHeaders(struct mg_connection *nc, int status, WebAsset_t *asset)
+{
+  const char *html = strcmp(asset->mimeType, "text/html") == 0 ? "no-cache" : NULL;
+
+  mg_printf(nc, "HTTP/1.1 %d %s\r\n", status, status == 304 ? "Not Modified" : "OK");
+  mg_printf(nc, "ETag: %s\r\n", asset->etag);
+  mg_printf(nc, "Vary: Accept-Encoding\r\n");
+
+  // html always revalidates so a new build is picked up, everything else is cached outright
+  if (html != NULL)
+    mg_printf(nc, "Cache-Control: %s\r\n", html);
+  else
+    mg_printf(nc, "Cache-Control: public, max-age=%u\r\n", config->maxAgeSec);
+
+  if (status == 304)
+  {
+    mg_printf(nc, "Content-Length: 0\r\n\r\n");
+    return;
+  }
+
+  mg_printf(nc, "Content-Type: %s\r\n", asset->mimeType);
+  mg_printf(nc, "Content-Encoding: gzip\r\n");
+  mg_printf(nc, "Content-Length: %u\r\n\r\n", asset->size);
+}
+
+void webAssetsCallback(struct mg_connection *nc, struct http_message *hm)
+{
+  WebAsset_t *asset = webAssetsFind(&hm->uri);
+  if (asset == NULL)
+  {
+    mg_http_send_error(nc, 404, NULL);
+    return;
+  }
+
+  struct mg_str *match = mg_get_http_header(hm, "If-None-Match");
+  if (match != NULL && mg_vcmp(match, asset->etag) == 0)
+  {
+    webAssetsSendHeaders(nc, 304, asset);
+    return;
+  }
+
+  struct mg_str *encoding = mg_get_http_header(hm, "Accept-Encoding");
+  if (encoding == NULL || mg_strstr(*encoding, mg_mk_str("gzip")) == NULL)
+  {
+    mg_http_send_error(nc, 406, "gzip required");
+    return;
+  }
+
+  WebAssetStream_t *stream = webAssetsFindStream(NULL);
+  if (stream == NULL)
+  {
+    mg_http_send_error(nc, 503, NULL);
+    return;
+  }
+
+  char filePath[80];
+  webAssetsFilePath(filePath, sizeof(filePath), asset->path);
+
+  stream->file = fopen(filePath, "rb");
+  if (stream->file == NULL)
+  {
+    mg_http_send_error(nc, 404, NULL);
+    return;
+  }
+
+  webAssetsSendHeaders(nc, 200, asset);
+
+  stream->nc = nc;
+  stream->remaining = asset->size;
+  stream->handler = nc->handler;
+  nc->handler = webAssetsStreamHandler;
+
+  webAssetsPump(stream);
+}
+
+void webAssetsInit(WebAssetsConfig_t *info)
+{
+  config = info;
+
+  memset(assets, 0, sizeof(assets));
+  memset(streams, 0, sizeof(streams));
+  assetCount = 0;
+
+  DIR *dir = opendir(config->mount);
+  if (dir != NULL)
+  {
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+      webAssetsIndex(entry->d_name);
+
+    closedir(dir);
+  }
+
+  printf("web-assets: %d files under %s\n", assetCount, config->urlPrefix);
+
+  assetsHandler.callback = &webAssetsCallback;
+  assetsHandler.path = config->urlPrefix;
+  assetsHandler.request = HTTP_GET;
+  webserverRegister(&assetsHandler);
+}
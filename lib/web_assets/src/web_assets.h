@@ -0,0 +1,30 @@
+//
+// Static web assets
+//
+// Serves the race UI from flash. Files are stored gzip compressed by the
+// build (tools/compress_assets.py) and indexed once at boot, so a
+// revalidation is answered with 304 from the index without touching the
+// file, and full responses are streamed a chunk at a time.
+//
+
+#ifndef __web_assets_INCLUDED__
+#define __web_assets_INCLUDED__
+
+#include <stdint.h>
+
+#define WEB_ASSETS_MAX_FILES 32
+#define WEB_ASSETS_MAX_STREAMS 4
+#define WEB_ASSETS_PATH_LEN 32
+
+typedef struct
+{
+  const char *mount;     // flashFS mount point, e.g. /spiffs
+  const char *dir;       // directory inside the mount holding the .gz files
+  const char *urlPrefix; // url the assets are served under
+  uint32_t maxAgeSec;    // Cache-Control max-age for everything but html
+  uint16_t chunkSize;
+} WebAssetsConfig_t;
+
+void webAssetsInit(WebAssetsConfig_t *info);
+
+#endif
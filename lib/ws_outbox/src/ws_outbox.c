@@ -0,0 +1,418 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "ws_outbox.h"
+#include "webserver.h"
+#include "task_plan.h"
+
+typedef struct
+{
+  uint32_t seq;
+  uint16_t len;
+  bool sent;
+  uint32_t originUs;
+  uint32_t readyUs;
+  char data[WS_OUTBOX_FRAME_SIZE];
+} WsOutboxFrame_t;
+
+typedef struct
+{
+  struct mg_connection *nc;
+  uint32_t id;
+  uint32_t sweep;
+  uint32_t lapCursor;
+  uint32_t telemetrySeq[WS_OUTBOX_CLASSES - WS_OUTBOX_TELEMETRY];
+  uint32_t lapsSent;
+  uint32_t telemetrySent;
+  uint32_t telemetryDropped;
+  uint32_t bufferedBytes;
+} WsOutboxClient_t;
+
+static WsOutboxConfig_t *config;
+
+// frames are written by publishers and copied out by the mongoose thread under
+// frameLock, which is held for one frame's memcpy and never across a send
+static SemaphoreHandle_t frameLock;
+static WsOutboxFrame_t lapFrames[WS_OUTBOX_LAP_FRAMES];
+static WsOutboxFrame_t telemetryFrames[WS_OUTBOX_CLASSES - WS_OUTBOX_TELEMETRY];
+static volatile uint32_t lapHead = 0;
+static volatile uint32_t telemetryPublished = 0; // of every class, tells the sweep there is news
+
+// json is serialized here before it is copied in, under a lock only publishers take
+static SemaphoreHandle_t stageLock;
+static char stage[WS_OUTBOX_FRAME_SIZE];
+
+// the frame being sent, copied out of its slot, owned by the mongoose thread
+static WsOutboxFrame_t sending;
+
+// client state is owned by the mongoose thread
+static WsOutboxClient_t clients[WS_OUTBOX_MAX_CLIENTS];
+static uint32_t lastSweep = 0;
+static uint32_t nextClientId = 1;
+static uint32_t evictions = 0;
+static volatile bool backlog = false;
+
+static struct mg_mgr *volatile manager = NULL;
+static TaskHandle_t outboxTask = NULL;
+static WsOutboxClock_t traceClock = NULL;
+static WsOutboxSentHook_t traceSent = NULL;
+static WebSocketDataHandler_t subscribeHandler;
+
+void wsOutboxTask(void *arg);
+
+static WsOutboxClient_t *wsOutboxFindClient(struct mg_connection *nc, bool create)
+{
+  WsOutboxClient_t *slot = NULL;
+  for (int c = 0; c < WS_OUTBOX_MAX_CLIENTS; ++c)
+  {
+    if (clients[c].nc == nc)
+      return &clients[c];
+
+    if (slot == NULL && clients[c].nc == NULL)
+      slot = &clients[c];
+  }
+
+  if (!create || slot == NULL)
+    return NULL;
+
+  memset(slot, 0, sizeof(WsOutboxClient_t));
+  slot->nc = nc;
+  slot->id = nextClientId++;
+  slot->sweep = lastSweep;
+  slot->lapCursor = lapHead;
+  for (int t = 0; t < WS_OUTBOX_CLASSES - WS_OUTBOX_TELEMETRY; ++t)
+    slot->telemetrySeq[t] = telemetryFrames[t].seq;
+  return slot;
+}
+
+static void wsOutboxSubscribe(struct mg_connection *nc, cJSON *data)
+{
+  wsOutboxAttach(nc->mgr);
+  wsOutboxFindClient(nc, true);
+}
+
+void wsOutboxInit(WsOutboxConfig_t *info)
+{
+  config = info;
+
+  memset(clients, 0, sizeof(clients));
+  memset(lapFrames, 0, sizeof(lapFrames));
+  memset(telemetryFrames, 0, sizeof(telemetryFrames));
+
+  frameLock = xSemaphoreCreateMutex();
+  stageLock = xSemaphoreCreateMutex();
+
+  subscribeHandler.callback = &wsOutboxSubscribe;
+  subscribeHandler.command = "subscribe";
+  webserverWSRegister(&subscribeHandler);
+
+  outboxTask = taskPlanCreate(TASK_ROLE_NETWORK, wsOutboxTask, "wsOutboxTask", NULL);
+}
+
+void wsOutboxAttach(struct mg_mgr *mgr)
+{
+  manager = mgr;
+}
+
+void wsOutboxSetTrace(WsOutboxClock_t clock, WsOutboxSentHook_t sent)
+{
+  traceClock = clock;
+  traceSent = sent;
+}
+
+static WsOutboxFrame_t *wsOutboxBeginFrame(uint8_t frameClass)
+{
+  xSemaphoreTake(frameLock, portMAX_DELAY);
+
+  if (frameClass == WS_OUTBOX_LAP)
+    return &lapFrames[lapHead % WS_OUTBOX_LAP_FRAMES];
+
+  return &telemetryFrames[frameClass - WS_OUTBOX_TELEMETRY];
+}
+
+static void wsOutboxEndFrame(uint8_t frameClass, WsOutboxFrame_t *frame)
+{
+  if (frameClass == WS_OUTBOX_LAP)
+  {
+    frame->seq = lapHead++;
+  }
+  else
+  {
+    ++frame->seq;
+    ++telemetryPublished;
+  }
+
+  xSemaphoreGive(frameLock);
+
+  if (outboxTask != NULL)
+    xTaskNotifyGive(outboxTask);
+}
+
+static void wsOutboxStore(uint8_t frameClass, const char *data, size_t len, uint32_t originUs, uint32_t readyUs)
+{
+  WsOutboxFrame_t *frame = wsOutboxBeginFrame(frameClass);
+  memcpy(frame->data, data, len);
+  frame->len = len;
+  frame->sent = false;
+  frame->originUs = originUs;
+  frame->readyUs = readyUs;
+  wsOutboxEndFrame(frameClass, frame);
+}
+
+bool wsOutboxPublish(uint8_t frameClass, const char *data, size_t len)
+{
+  if (len > WS_OUTBOX_FRAME_SIZE || frameClass >= WS_OUTBOX_CLASSES)
+    return false;
+
+  wsOutboxStore(frameClass, data, len, 0, 0);
+  return true;
+}
+
+bool wsOutboxPublishJsonTraced(uint8_t frameClass, cJSON *json, uint32_t originUs, uint32_t *readyUs)
+{
+  if (frameClass >= WS_OUTBOX_CLASSES)
+    return false;
+
+  xSemaphoreTake(stageLock, portMAX_DELAY);
+
+  if (!cJSON_PrintPreallocated(json, stage, WS_OUTBOX_FRAME_SIZE, false))
+  {
+    xSemaphoreGive(stageLock);
+    printf("ws-outbox: frame too large\n");
+    return false;
+  }
+
+  bool traced = traceClock != NULL && originUs != 0;
+  uint32_t ready = traced ? traceClock() : 0;
+  wsOutboxStore(frameClass, stage, strlen(stage), traced ? originUs : 0, ready);
+  xSemaphoreGive(stageLock);
+
+  if (readyUs != NULL)
+    *readyUs = ready;
+  return true;
+}
+
+bool wsOutboxPublishJson(uint8_t frameClass, cJSON *json)
+{
+  return wsOutboxPublishJsonTraced(frameClass, json, 0, NULL);
+}
+
+void wsOutboxWriterInit(WsOutboxWriter_t *writer, int reserve)
+{
+  writer->data[0] = 0;
+  writer->length = 0;
+  writer->reserve = reserve;
+  writer->truncated = false;
+}
+
+static bool wsOutboxWrite(WsOutboxWriter_t *writer, int limit, const char *format, va_list args)
+{
+  int space = limit - writer->length;
+  int n = space > 0 ? vsnprintf(writer->data + writer->length, space, format, args) : -1;
+
+  if (n < 0 || n >= space)
+  {
+    // undo the partial write, the frame ends at the last whole field
+    writer->data[writer->length] = 0;
+    writer->truncated = true;
+    return false;
+  }
+
+  writer->length += n;
+  return true;
+}
+
+bool wsOutboxAppend(WsOutboxWriter_t *writer, const char *format, ...)
+{
+  if (writer->truncated)
+    return false;
+
+  va_list args;
+  va_start(args, format);
+  bool ok = wsOutboxWrite(writer, WS_OUTBOX_FRAME_SIZE - writer->reserve, format, args);
+  va_end(args);
+  return ok;
+}
+
+bool wsOutboxClose(WsOutboxWriter_t *writer, const char *format, ...)
+{
+  // a failed close would leave broken json, keep the flag for the caller to see
+  bool truncated = writer->truncated;
+
+  va_list args;
+  va_start(args, format);
+  bool ok = wsOutboxWrite(writer, WS_OUTBOX_FRAME_SIZE, format, args);
+  va_end(args);
+
+  writer->truncated |= truncated;
+  return ok;
+}
+
+bool wsOutboxPublishWriter(uint8_t frameClass, const WsOutboxWriter_t *writer)
+{
+  if (writer->length == 0)
+    return false;
+
+  return wsOutboxPublish(frameClass, writer->data, writer->length);
+}
+
+// Under frameLock, takes the copy to send; true the first time the frame goes to any client
+static bool wsOutboxCopy(WsOutboxFrame_t *frame)
+{
+  bool first = !frame->sent;
+  memcpy(&sending, frame, offsetof(WsOutboxFrame_t, data) + frame->len);
+  frame->sent = true;
+  return first;
+}
+
+// Sends the copy with frameLock released, a slow socket only holds up the mongoose thread
+static void wsOutboxSend(struct mg_connection *nc, bool first)
+{
+  mg_send_websocket_frame(nc, WEBSOCKET_OP_TEXT, sending.data, sending.len);
+
+  if (first && sending.originUs != 0 && traceSent != NULL)
+    traceSent(sending.originUs, sending.readyUs);
+}
+
+static void wsOutboxReclaim(uint32_t sweep)
+{
+  for (int c = 0; c < WS_OUTBOX_MAX_CLIENTS; ++c)
+  {
+    // not seen during the previous sweep, the connection is gone
+    if (clients[c].nc != NULL && clients[c].sweep < lastSweep)
+      clients[c].nc = NULL;
+  }
+
+  lastSweep = sweep;
+}
+
+static void wsOutboxFlush(struct mg_connection *nc, WsOutboxClient_t *client)
+{
+  while (client->lapCursor != lapHead && nc->send_mbuf.len < config->sendHighWater)
+  {
+    xSemaphoreTake(frameLock, portMAX_DELAY);
+    uint32_t behind = lapHead - client->lapCursor;
+    bool first = behind <= WS_OUTBOX_LAP_FRAMES && wsOutboxCopy(&lapFrames[client->lapCursor % WS_OUTBOX_LAP_FRAMES]);
+    xSemaphoreGive(frameLock);
+
+    if (behind > WS_OUTBOX_LAP_FRAMES)
+    {
+      // laps are never skipped, a client this far behind has to reconnect and resync
+      printf("ws-outbox: evicting client %u, %u laps behind\n", client->id, behind);
+      nc->flags |= MG_F_SEND_AND_CLOSE;
+      client->nc = NULL;
+      ++evictions;
+      return;
+    }
+
+    wsOutboxSend(nc, first);
+    ++client->lapCursor;
+    ++client->lapsSent;
+  }
+
+  // telemetry waits behind laps, then every class gets its newest frame in turn
+  bool behind = client->lapCursor != lapHead;
+  for (int t = 0; t < WS_OUTBOX_CLASSES - WS_OUTBOX_TELEMETRY; ++t)
+  {
+    WsOutboxFrame_t *frame = &telemetryFrames[t];
+    if (client->telemetrySeq[t] == frame->seq)
+      continue;
+
+    if (client->lapCursor != lapHead || nc->send_mbuf.len >= config->sendHighWater)
+    {
+      behind = true;
+      continue;
+    }
+
+    xSemaphoreTake(frameLock, portMAX_DELAY);
+    uint32_t telemetrySeq = frame->seq;
+    bool first = wsOutboxCopy(frame);
+    xSemaphoreGive(frameLock);
+
+    client->telemetryDropped += telemetrySeq - client->telemetrySeq[t] - 1;
+    wsOutboxSend(nc, first);
+    client->telemetrySeq[t] = telemetrySeq;
+    ++client->telemetrySent;
+  }
+
+  if (behind)
+    backlog = true;
+
+  client->bufferedBytes = nc->send_mbuf.len;
+}
+
+// Runs on the mongoose thread once per connection for every mg_broadcast
+static void wsOutboxSweep(struct mg_connection *nc, int ev, void *ev_data MG_UD_ARG(void *user_data))
+{
+  uint32_t sweep = *(uint32_t *)ev_data;
+  if (sweep != lastSweep)
+    wsOutboxReclaim(sweep);
+
+  if ((nc->flags & MG_F_IS_WEBSOCKET) == 0 || (nc->flags & (MG_F_CLOSE_IMMEDIATELY | MG_F_SEND_AND_CLOSE)) != 0)
+    return;
+
+  WsOutboxClient_t *client = wsOutboxFindClient(nc, true);
+  if (client == NULL)
+    return;
+
+  client->sweep = sweep;
+  wsOutboxFlush(nc, client);
+}
+
+void wsOutboxTask(void *arg)
+{
+  uint32_t sweep = 0;
+  uint32_t sentHead = 0;
+  uint32_t sentTelemetry = 0;
+
+  while (1)
+  {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(config->retryMs));
+
+    struct mg_mgr *mgr = manager;
+    if (mgr == NULL)
+      continue;
+
+    if (!backlog && sentHead == lapHead && sentTelemetry == telemetryPublished)
+      continue;
+
+    backlog = false;
+    sentHead = lapHead;
+    sentTelemetry = telemetryPublished;
+
+    ++sweep;
+    mg_broadcast(mgr, wsOutboxSweep, &sweep, sizeof(sweep));
+  }
+}
+
+int wsOutboxClientStats(WsOutboxClientStats_t *stats, int maxStats)
+{
+  int count = 0;
+  for (int c = 0; c < WS_OUTBOX_MAX_CLIENTS && count < maxStats; ++c)
+  {
+    WsOutboxClient_t *client = &clients[c];
+    if (client->nc == NULL)
+      continue;
+
+    WsOutboxClientStats_t *s = &stats[count++];
+    s->id = client->id;
+    s->lapDepth = lapHead - client->lapCursor;
+    s->lapsSent = client->lapsSent;
+    s->telemetrySent = client->telemetrySent;
+    s->telemetryDropped = client->telemetryDropped;
+    s->bufferedBytes = client->bufferedBytes;
+  }
+
+  return count;
+}
+
+uint32_t wsOutboxEvictions()
+{
+  return evictions;
+}
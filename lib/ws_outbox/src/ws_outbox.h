@@ -0,0 +1,83 @@
+//
+// WebSocket outbox
+//
+// Timing tasks publish frames here instead of writing to sockets. The
+// mongoose thread fans them out to each client at that client's pace:
+// lap frames are queued and never skipped, telemetry frames are coalesced
+// per class so a slow client only ever sees the newest one of each kind,
+// and one kind never hides another.
+//
+
+#ifndef __ws_outbox_INCLUDED__
+#define __ws_outbox_INCLUDED__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mongoose.h"
+#include "cJSON.h"
+
+#define WS_OUTBOX_MAX_CLIENTS 8
+#define WS_OUTBOX_LAP_FRAMES 32
+#define WS_OUTBOX_FRAME_SIZE 512
+
+#define WS_OUTBOX_LAP 0
+#define WS_OUTBOX_TELEMETRY 1 // first telemetry class, each has its own coalescing slot
+#define WS_OUTBOX_METRICS 1
+#define WS_OUTBOX_QUALITY 2
+#define WS_OUTBOX_CLASSES 3
+
+typedef struct
+{
+  uint16_t retryMs;       // how often clients that are behind get another flush
+  uint32_t sendHighWater; // bytes queued in mongoose before a client counts as behind
+} WsOutboxConfig_t;
+
+// Builds a text frame without overrunning it. An append that does not fit
+// is dropped whole and ends the frame at the last complete field; reserve
+// bytes stay free for the brackets written with wsOutboxClose.
+typedef struct
+{
+  char data[WS_OUTBOX_FRAME_SIZE];
+  int length;
+  int reserve;
+  bool truncated;
+} WsOutboxWriter_t;
+
+// Optional latency tracing of published frames
+typedef uint32_t (*WsOutboxClock_t)();
+typedef void (*WsOutboxSentHook_t)(uint32_t originUs, uint32_t readyUs);
+
+typedef struct
+{
+  uint32_t id;
+  uint32_t lapDepth;
+  uint32_t lapsSent;
+  uint32_t telemetrySent;
+  uint32_t telemetryDropped;
+  uint32_t bufferedBytes;
+} WsOutboxClientStats_t;
+
+void wsOutboxInit(WsOutboxConfig_t *info);
+
+// Called by the web server once its manager exists
+void wsOutboxAttach(struct mg_mgr *mgr);
+
+// Safe from any task, never touches a socket
+bool wsOutboxPublish(uint8_t frameClass, const char *data, size_t len);
+bool wsOutboxPublishJson(uint8_t frameClass, cJSON *json);
+
+void wsOutboxWriterInit(WsOutboxWriter_t *writer, int reserve);
+bool wsOutboxAppend(WsOutboxWriter_t *writer, const char *format, ...);
+bool wsOutboxClose(WsOutboxWriter_t *writer, const char *format, ...);
+bool wsOutboxPublishWriter(uint8_t frameClass, const WsOutboxWriter_t *writer);
+
+// originUs is when the event began, readyUs receives when the frame was serialized.
+// The sent hook fires the first time the frame is handed to a client socket.
+bool wsOutboxPublishJsonTraced(uint8_t frameClass, cJSON *json, uint32_t originUs, uint32_t *readyUs);
+void wsOutboxSetTrace(WsOutboxClock_t clock, WsOutboxSentHook_t sent);
+
+// Only from the mongoose thread
+int wsOutboxClientStats(WsOutboxClientStats_t *stats, int maxStats);
+uint32_t wsOutboxEvictions();
+
+#endif
@@ -1,15 +1,42 @@
 //
 #include "wifi_controller.h"
 #include "webserver.h"
+#include "ws_outbox.h"
 #include "lap_timer.h"
 #include "udp_send.h"
 #include "display_controller.h"
 #include "flashFS.h"
+#include "web_assets.h"
+#include "metrics.h"
+#include "trace_capture.h"
+#include "pool_alloc.h"
+#include "config_store.h"
+#include "chorus_controller.h"
+#include "bench.h"
 
 static LapTimerConfig_t config;
 static WifiConfig_t wifiConfig;
-//static ChorusControllerConfig_t chorusConfig;
+static ChorusControllerConfig_t chorusConfig = {
+    .udpPort = 9000,
+    .uart = -1,
+    .uartTxPin = -1,
+    .uartRxPin = -1,
+    .baudRate = 115200};
 static WebServerConfig_t webConfig;
+static WsOutboxConfig_t wsOutboxConfig;
+static WebAssetsConfig_t webAssetsConfig;
+static MetricsConfig_t metricsConfig;
+static TraceCaptureConfig_t traceConfig;
+static BenchConfig_t benchConfig = {
+    .iterations = 1000,
+    .warmup = 50};
+static PoolAllocConfig_t poolConfig = {
+    .blocks = {128, 128, 32, 16, 16, 6, 2},
+    .arenaSize = 4096};
+static ConfigStoreConfig_t storeConfig = {
+    .ns = "timer",
+    .debounceMs = 2000,
+    .maxDelayMs = 10000};
 static RxControllerConfig_t rxConfig;
 static UdpSendConfig_t udpSendConfig;
 static DisplayControllerConfig_t display;
@@ -18,6 +45,9 @@ static DisplayControllerConfig_t display;
 
 void app_main()
 {
+  // before anything allocates through cJSON or mongoose
+  poolAllocInit(&poolConfig);
+
   FlashFSConfig_t files = {
       .partition = "storage",
       .root = "/spiffs",
@@ -25,6 +55,12 @@ void app_main()
 
   flashFSInit(&files);
 
+  webAssetsConfig.mount = files.root;
+  webAssetsConfig.dir = "www";
+  webAssetsConfig.urlPrefix = "/ui";
+  webAssetsConfig.maxAgeSec = 60 * 60 * 24;
+  webAssetsConfig.chunkSize = 1024;
+
   strcpy(wifiConfig.ssid, "practice-timer");
   strcpy(wifiConfig.password, "on-the-tone");
 
@@ -37,6 +73,44 @@ void app_main()
     },
     .minLapTime = 5000,
     .updateHz = 1000,
+    .tasks = {
+      .roles = {
+        [TASK_ROLE_SAMPLING] = {.core = 1, .priority = 12, .stackSize = 1024 * 3},
+        [TASK_ROLE_DETECTION] = {.core = 1, .priority = 11, .stackSize = 1024 * 3},
+        [TASK_ROLE_DISPLAY] = {.core = 0, .priority = 2, .stackSize = 1024 * 3},
+        [TASK_ROLE_NETWORK] = {.core = 0, .priority = 5, .stackSize = 1024 * 3},
+        [TASK_ROLE_TELEMETRY] = {.core = 0, .priority = 3, .stackSize = 1024 * 3},
+        [TASK_ROLE_STORAGE] = {.core = 0, .priority = 4, .stackSize = 1024 * 3}
+      },
+      .benchSec = 0
+    },
+    .udp = {
+      .group = "239.255.76.84",
+      .port = 7684,
+      .node = 0,
+      .rssiHz = 20,
+      .pilotMs = 1000,
+      .heartbeatMs = 500,
+      .reliable = true,
+      .replayLimit = 16,
+      .aggregate = false,
+      .syncMs = 2000
+    },
+    .sectors = {
+      .gateCount = 0
+    },
+    .journal = {
+      .path = "/spiffs/session.jnl",
+      .batch = 16,
+      .commitMs = 200,
+      .queueLength = 32,
+      .compactBytes = 16 * 1024
+    },
+    .scheduler = {
+      .baseHz = 10000,
+      .timerGroup = TIMER_GROUP_0,
+      .timerIndex = TIMER_0
+    },
     .rxController = {
       .rxCount = COUNT,
       .spiClockSpeed = 8000000,
@@ -51,10 +125,17 @@ void app_main()
       .calibrationSec = 1,
       .lpfCutoffHz = 20,
       .lpf2CutoffHz = 50,
+      .filter = RSSI_FILTER_CASCADE,
+      .firTaps = 200,
+      .euroBeta = 20,
+      .idleDivider = 1, // off, every channel every tick. 8 reads pilots away from the gate at 1250 Hz
       .updateHz = 10000,
       .channelCount = COUNT,
       .bitWidth = ADC_WIDTH_12Bit,
       .attenuation = ADC_ATTEN_DB_2_5,
+      .adc = {
+        .type = RSSI_ADC_INTERNAL
+      },
       .channels = {
         ADC1_CHANNEL_0,
         ADC1_CHANNEL_1
@@ -66,14 +147,44 @@ void app_main()
 
   sprintf(&webConfig.port[0], "80");
 
+  wsOutboxConfig.retryMs = 50;
+  wsOutboxConfig.sendHighWater = 2048;
+
+  metricsConfig.pushMs = 1000;
+
+  // every class at full rate is ~90k events/s (10 kHz tick and rssi loop with their task
+  // switches), 4096 events last under 50 ms. ISRs and spans at 100 pairs/s each are
+  // tick + rssi + lapTimer = 600 events/s, so 5 s takes ~3000 of the 4096 slots
+  traceConfig.events = 4096;
+  traceConfig.classes = TRACE_CLASS_ISR | TRACE_CLASS_SPAN;
+  traceConfig.pairHz = 100;
+  traceConfig.maxMs = 5000;
+
 
   display.updateDelay = 250;
+  cfg.displayFrameMs = display.updateDelay;
+
+  // whatever was set last time replaces the defaults above, before any task reads them
+  // a stored mapping that no longer fits the hardware is dropped for the defaults
+  static LapTimerConfig_t stored;
+  configStoreInit(&storeConfig);
+  if (configStoreLoad(LAP_TIMER_CONFIG_KEY, LAP_TIMER_CONFIG_VERSION, &stored, sizeof(stored)) && lapTimerConfigValid(&stored))
+    cfg = stored;
+
+  // before any module starts a task
+  taskPlanInit(&cfg.tasks);
 
   //wifiInit(&wifiConfig);
   //webserverInit(&webConfig);
+  wsOutboxInit(&wsOutboxConfig);
+  webAssetsInit(&webAssetsConfig);
+  metricsInit(&metricsConfig);
+  traceCaptureInit(&traceConfig);
+  benchInit(&benchConfig);
   //udpSendInit(&udpSendConfig);
 
   displayInit(&display);
   //wsClientInit(&wsConfig);
   lapTimerInit(&cfg);
+  chorusControllerInit(&chorusConfig);
 }
\ No newline at end of file
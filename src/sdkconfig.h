@@ -42,6 +42,9 @@
 #define CONFIG_UDP_RECVMBOX_SIZE 6
 #define CONFIG_SPI_FLASH_YIELD_DURING_ERASE 1
 #define CONFIG_FREERTOS_QUEUE_REGISTRY_SIZE 0
+#define CONFIG_FREERTOS_USE_TRACE_FACILITY 1
+#define CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS 1
+#define CONFIG_FREERTOS_RUN_TIME_STATS_USING_ESP_TIMER 1
 #define CONFIG_MBEDTLS_AES_C 1
 #define CONFIG_MBEDTLS_ECP_DP_SECP521R1_ENABLED 1
 #define CONFIG_ESP32_WIFI_SOFTAP_BEACON_MAX_LEN 752
@@ -172,7 +175,7 @@
 #define CONFIG_ESP32_REV_MIN 0
 #define CONFIG_SUPPRESS_SELECT_DEBUG_OUTPUT 1
 #define CONFIG_GATTS_SEND_SERVICE_CHANGE_MODE 0
-#define CONFIG_TCPIP_TASK_AFFINITY_NO_AFFINITY 1
+#define CONFIG_TCPIP_TASK_AFFINITY_CPU0 1
 #define CONFIG_MAKE_WARN_UNDEFINED_VARIABLES 1
 #define CONFIG_FATFS_TIMEOUT_MS 10000
 #define CONFIG_ESP32_WIFI_DYNAMIC_RX_BUFFER_NUM 32
@@ -284,7 +287,7 @@
 #define CONFIG_TCP_MAXRTX 12
 #define CONFIG_BTM_INITIAL_TRACE_LEVEL 2
 #define CONFIG_ESPTOOLPY_AFTER "hard_reset"
-#define CONFIG_TCPIP_TASK_AFFINITY 0x7FFFFFFF
+#define CONFIG_TCPIP_TASK_AFFINITY 0x0
 #define CONFIG_LWIP_SO_REUSE 1
 #define CONFIG_ESP32_XTAL_FREQ_40 1
 #define CONFIG_BTDM_CONTROLLER_MODE_BLE_ONLY 1
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "task_plan.h"
+#include "lap_detect.h"
+#include "lap_proto.h"
+#include "rssi_signal.h"
+
+// Runs the plain C kernels /bench runs on target through the same bench
+// code, under the same names and inputs, so the two reports line up. Cycles
+// are host nanoseconds scaled to the 240 MHz the firmware clocks at; compare
+// host runs with host runs, the target has the final say.
+//
+//   make -C test bench                     every kernel
+//   make -C test bench KERNEL=lap_update_pilot
+
+static BenchConfig_t config = {
+    .iterations = 1000,
+    .warmup = 50};
+
+// the shipped signal settings, one copy per filter mode
+static RssiReaderConfig_t filterConfigs[3];
+static RssiSignal_t filterSignals[3];
+
+TaskHandle_t taskPlanCreate(int role, TaskFunction_t task, const char *name, void *arg)
+{
+  // runs happen on the calling thread through benchRun, the bench task never starts
+  return NULL;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+  return 0;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+  return pdTRUE;
+}
+
+static void benchUpdatePilot(void *arg, uint32_t i)
+{
+  static PilotLapData_t lapData;
+  static const PilotConfig_t pilot = {.threshold = 2048};
+
+  // a slow sawtooth through the threshold, so every state gets its share
+  float rssi = (float)(i & 0x3ff) / 1024.0f;
+  if (lapData.timesCount >= MAX_LAPS - 1)
+    lapData.timesCount = 0;
+  lapDetectUpdate(&pilot, &lapData, rssi, i, 0);
+}
+
+static void benchLapProto(void *arg, uint32_t i)
+{
+  uint8_t packet[64];
+  LapProtoLap_t lap = {
+      .seq = i,
+      .pilot = 0,
+      .lap = 3,
+      .time = 18930,
+      .timestamp = 120000,
+      .detectedUs = 120000412};
+
+  volatile size_t len = lapProtoEncodeLap(packet, sizeof(packet), 0, i, &lap);
+  (void)len;
+}
+
+static void benchFilter(void *arg, uint32_t i)
+{
+  const RssiReaderConfig_t *filterConfig = arg;
+  RssiSignal_t *signal = &filterSignals[filterConfig->filter];
+  int c = MAX_RSSI_CHANNEL_COUNT - 1;
+  signal->filtered[c] = rssiSignalFilter(signal, filterConfig, c, 1800 + (i & 0xff), 1);
+}
+
+static void benchKernelsRegister()
+{
+  benchRegister("lap_update_pilot", benchUpdatePilot, NULL, BENCH_IRQ_OFF);
+  benchRegister("lap_message_proto", benchLapProto, NULL, BENCH_IRQ_OFF);
+
+  const char *names[] = {"rssi_filter_cascade", "rssi_filter_one_euro", "rssi_filter_fir"};
+  for (int f = 0; f < 3; ++f)
+  {
+    filterConfigs[f] = (RssiReaderConfig_t){
+        .updateHz = 10000,
+        .channelCount = 1,
+        .lpfCutoffHz = 20,
+        .lpf2CutoffHz = 50,
+        .filter = f,
+        .firTaps = 200,
+        .euroBeta = 20,
+        .idleDivider = 1,
+    };
+    rssiSignalInit(&filterSignals[f]);
+    rssiSignalApply(&filterSignals[f], &filterConfigs[f], NULL);
+    benchRegister(names[f], benchFilter, &filterConfigs[f], BENCH_IRQ_OFF);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  const char *names[] = {"lap_update_pilot", "lap_message_proto", "rssi_filter_cascade", "rssi_filter_one_euro", "rssi_filter_fir"};
+  const char *only = argc > 1 && argv[1][0] != 0 ? argv[1] : NULL;
+  int ran = 0;
+
+  benchInit(&config);
+  benchKernelsRegister();
+
+  printf(BENCH_COLUMNS);
+  for (int k = 0; k < (int)(sizeof(names) / sizeof(names[0])); ++k)
+  {
+    if (only != NULL && strcmp(names[k], only) != 0)
+      continue;
+
+    BenchResult_t result;
+    char line[128];
+    benchRun(names[k], &result);
+    benchFormat(line, sizeof(line), &result, xPortGetCoreID());
+    fputs(line, stdout);
+    ++ran;
+  }
+
+  if (ran == 0)
+    printf("bench: no kernel %s\n", only);
+  return ran == 0;
+}
@@ -0,0 +1,40 @@
+//
+// Synthetic RSSI traces
+//
+// Labelled passes for the signal path tests: a receiver sits at its floor
+// away from the gate and rises to a peak at the moment the pilot crosses,
+// as a gaussian in time, with uniform noise on top. The pass time is the
+// label a detector is scored against. The noise comes from a seeded LCG so
+// every run replays the same trace.
+//
+
+#ifndef __rssi_trace_INCLUDED__
+#define __rssi_trace_INCLUDED__
+
+#include <stdint.h>
+#include <math.h>
+
+typedef struct
+{
+  uint32_t seed;
+  float floor;   // counts away from the gate
+  float peak;    // counts added at the gate
+  float widthMs; // gaussian sigma of a pass
+  float noise;   // peak to peak counts of the noise
+} RssiTrace_t;
+
+static inline float rssiTraceNoise(RssiTrace_t *trace)
+{
+  trace->seed = trace->seed * 1664525 + 1013904223;
+  return ((trace->seed >> 8) / (float)(1 << 24) - 0.5f) * trace->noise;
+}
+
+// Count at tMs for a pass at passMs
+static inline uint16_t rssiTraceSample(RssiTrace_t *trace, float tMs, float passMs)
+{
+  float d = (tMs - passMs) / trace->widthMs;
+  float counts = trace->floor + trace->peak * expf(-0.5f * d * d) + rssiTraceNoise(trace);
+  return counts < 0 ? 0 : counts > 4095 ? 4095 : (uint16_t)counts;
+}
+
+#endif
@@ -0,0 +1,20 @@
+//
+// Host stand-in for cJSON
+//
+// Only the allocator hooks, the tests that link it keep the ones installed.
+//
+
+#ifndef __cJSON_INCLUDED__
+#define __cJSON_INCLUDED__
+
+#include <stddef.h>
+
+typedef struct cJSON_Hooks
+{
+  void *(*malloc_fn)(size_t size);
+  void (*free_fn)(void *ptr);
+} cJSON_Hooks;
+
+void cJSON_InitHooks(cJSON_Hooks *hooks);
+
+#endif
@@ -0,0 +1,19 @@
+//
+// Host stand-in for the display controller
+//
+// A 128x64 panel that draws nowhere, the renderer tests watch its spans.
+//
+
+#ifndef __display_controller_INCLUDED__
+#define __display_controller_INCLUDED__
+
+#include <stdint.h>
+
+#define DISPLAY_WIDTH 128
+#define DISPLAY_HEIGHT 64
+
+void displayClear();
+void displayDraw(int x, int y, uint8_t color);
+void displayUpdate();
+
+#endif
@@ -0,0 +1,35 @@
+//
+// Host stand-in for the ADC1 driver
+//
+// The types and calls the rssi backends use. The tests that link them define
+// the calls, so they decide what the converter reads.
+//
+
+#ifndef __adc_INCLUDED__
+#define __adc_INCLUDED__
+
+#include "esp_err.h"
+
+typedef enum
+{
+  ADC_WIDTH_BIT_9,
+  ADC_WIDTH_BIT_10,
+  ADC_WIDTH_BIT_11,
+  ADC_WIDTH_BIT_12,
+} adc_bits_width_t;
+
+typedef enum
+{
+  ADC_ATTEN_DB_0,
+  ADC_ATTEN_DB_2_5,
+  ADC_ATTEN_DB_6,
+  ADC_ATTEN_DB_11,
+} adc_atten_t;
+
+typedef int adc1_channel_t;
+
+esp_err_t adc1_config_width(adc_bits_width_t width);
+esp_err_t adc1_config_channel_atten(adc1_channel_t channel, adc_atten_t atten);
+int adc1_get_raw(adc1_channel_t channel);
+
+#endif
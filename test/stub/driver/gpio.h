@@ -0,0 +1,12 @@
+//
+// Host stand-in for the GPIO driver
+//
+// Only the pin number type, for configs that name pins.
+//
+
+#ifndef __gpio_INCLUDED__
+#define __gpio_INCLUDED__
+
+typedef int gpio_num_t;
+
+#endif
@@ -0,0 +1,68 @@
+//
+// Host stand-in for the SPI master driver
+//
+// Transactions keep the small tx_data and rx_data frames of the real driver.
+// The tests that link them define the calls and play the device on the bus.
+//
+
+#ifndef __spi_master_INCLUDED__
+#define __spi_master_INCLUDED__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#define HSPI_HOST 1
+#define VSPI_HOST 2
+
+#define SPI_TRANS_USE_RXDATA (1 << 2)
+#define SPI_TRANS_USE_TXDATA (1 << 3)
+
+typedef int spi_host_device_t;
+typedef struct spi_device_t *spi_device_handle_t;
+
+typedef struct
+{
+  int mosi_io_num;
+  int miso_io_num;
+  int sclk_io_num;
+  int quadwp_io_num;
+  int quadhd_io_num;
+  int max_transfer_sz;
+} spi_bus_config_t;
+
+typedef struct
+{
+  uint8_t mode;
+  int clock_speed_hz;
+  int spics_io_num;
+  uint32_t flags;
+  int queue_size;
+} spi_device_interface_config_t;
+
+typedef struct
+{
+  uint32_t flags;
+  size_t length; // in bits
+  size_t rxlength;
+  void *user;
+  union
+  {
+    const void *tx_buffer;
+    uint8_t tx_data[4];
+  };
+  union
+  {
+    void *rx_buffer;
+    uint8_t rx_data[4];
+  };
+} spi_transaction_t;
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t *config, int dma);
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t *config, spi_device_handle_t *handle);
+esp_err_t spi_device_acquire_bus(spi_device_handle_t device, TickType_t wait);
+esp_err_t spi_device_polling_transmit(spi_device_handle_t device, spi_transaction_t *trans);
+void spi_device_release_bus(spi_device_handle_t device);
+
+#endif
@@ -0,0 +1,54 @@
+//
+// Host stand-in for the ESP-IDF UART driver
+//
+// The config the driver takes and the calls made on a port. The tests that
+// link it define the calls and play the other end of the line.
+//
+
+#ifndef __uart_INCLUDED__
+#define __uart_INCLUDED__
+
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/queue.h"
+
+typedef int uart_port_t;
+
+typedef enum
+{
+  UART_DATA_8_BITS = 3,
+} uart_word_length_t;
+
+typedef enum
+{
+  UART_PARITY_DISABLE = 0,
+} uart_parity_t;
+
+typedef enum
+{
+  UART_STOP_BITS_1 = 1,
+} uart_stop_bits_t;
+
+typedef enum
+{
+  UART_HW_FLOWCTRL_DISABLE = 0,
+} uart_hw_flowcontrol_t;
+
+#define UART_PIN_NO_CHANGE (-1)
+
+typedef struct
+{
+  int baud_rate;
+  uart_word_length_t data_bits;
+  uart_parity_t parity;
+  uart_stop_bits_t stop_bits;
+  uart_hw_flowcontrol_t flow_ctrl;
+} uart_config_t;
+
+esp_err_t uart_param_config(uart_port_t uart, const uart_config_t *config);
+esp_err_t uart_set_pin(uart_port_t uart, int txPin, int rxPin, int rtsPin, int ctsPin);
+esp_err_t uart_driver_install(uart_port_t uart, int rxSize, int txSize, int queueSize, QueueHandle_t *queue, int flags);
+int uart_read_bytes(uart_port_t uart, uint8_t *buffer, uint32_t length, TickType_t wait);
+int uart_write_bytes(uart_port_t uart, const char *data, size_t length);
+
+#endif
@@ -0,0 +1,13 @@
+//
+// Host stand-in for esp_err.h
+//
+
+#ifndef __esp_err_INCLUDED__
+#define __esp_err_INCLUDED__
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+#endif
@@ -0,0 +1,19 @@
+//
+// Host stand-in for esp_heap_caps.h
+//
+// The tests that link it define the calls, so they see every region handed out.
+//
+
+#ifndef __esp_heap_caps_INCLUDED__
+#define __esp_heap_caps_INCLUDED__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+
+void *heap_caps_malloc(size_t size, uint32_t caps);
+size_t heap_caps_get_free_size(uint32_t caps);
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+
+#endif
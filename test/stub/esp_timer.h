@@ -0,0 +1,15 @@
+//
+// Host stand-in for esp_timer.h
+//
+// A monotonic microsecond clock from the host, enough for code that only
+// takes differences of it.
+//
+
+#ifndef __esp_timer_INCLUDED__
+#define __esp_timer_INCLUDED__
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time();
+
+#endif
@@ -0,0 +1,24 @@
+//
+// Host stand-in for the mu-core filters
+//
+// The one-pole low pass in the form the rssi signal path works its group
+// delay out from: alpha = 1 / (1 + rate / (2 pi cutoff)), a delay of
+// (1 - alpha) / alpha samples.
+//
+
+#ifndef __filters_INCLUDED__
+#define __filters_INCLUDED__
+
+#include <math.h>
+
+static inline float lowPassFilter(float prev, float input, float alpha)
+{
+  return prev + alpha * (input - prev);
+}
+
+static inline float lpfAlpha(float cutoffHz, float sampleHz)
+{
+  return 1.0f / (1.0f + sampleHz / (2.0f * (float)M_PI * cutoffHz));
+}
+
+#endif
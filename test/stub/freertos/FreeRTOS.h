@@ -0,0 +1,37 @@
+//
+// Host stand-in for FreeRTOS.h
+//
+// The tick type and the forever timeout, for code that only passes them on,
+// and critical sections and interrupt masks that are no-ops on a single
+// threaded host, which counts as core 0 at the sdkconfig clock.
+//
+
+#ifndef __FreeRTOS_INCLUDED__
+#define __FreeRTOS_INCLUDED__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define portMAX_DELAY ((TickType_t)0xffffffff)
+
+typedef struct
+{
+  uint32_t owner;
+  uint32_t count;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0, 0}
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+#define portDISABLE_INTERRUPTS()
+#define portENABLE_INTERRUPTS()
+#define xPortGetCoreID() 0
+
+#define CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ 240
+
+#endif
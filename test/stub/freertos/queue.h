@@ -0,0 +1,18 @@
+//
+// Host stand-in for FreeRTOS queues
+//
+// The tests that link it define the calls and decide what a receive hands over.
+//
+
+#ifndef __queue_INCLUDED__
+#define __queue_INCLUDED__
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(uint32_t length, uint32_t itemSize);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait);
+
+#endif
@@ -0,0 +1,18 @@
+//
+// Host stand-in for FreeRTOS semaphores
+//
+// The tests that link it define the calls and decide when a take succeeds.
+//
+
+#ifndef __semphr_INCLUDED__
+#define __semphr_INCLUDED__
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+#endif
@@ -0,0 +1,20 @@
+//
+// Host stand-in for FreeRTOS tasks
+//
+// Task handles, entry points and notifications only, the tests that link
+// it say which task is running and what a notify does.
+//
+
+#ifndef __task_INCLUDED__
+#define __task_INCLUDED__
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+TaskHandle_t xTaskGetCurrentTaskHandle();
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+
+#endif
@@ -0,0 +1,33 @@
+//
+// Host stand-in for lap_timer.h
+//
+// The head of the lap timer config and the calls the Chorus controller
+// makes, pilots and their laps come from lap_detect.h. The tests that link
+// it define the calls and hold the config.
+//
+
+#ifndef __lap_timer_INCLUDED__
+#define __lap_timer_INCLUDED__
+
+#include <stdint.h>
+#include "lap_detect.h"
+#include "rssi_reader.h"
+#include "rx_controller.h"
+
+typedef struct
+{
+  uint32_t updateHz;
+  uint8_t pilotCount;
+  uint16_t minLapTime;
+  uint16_t displayFrameMs;
+
+  PilotConfig_t pilots[MAX_RX_COUNT];
+} LapTimerConfig_t;
+
+const LapTimerConfig_t *lapTimerConfigAcquire();
+void lapTimerConfigRelease(const LapTimerConfig_t *snapshot);
+void lapTimerUpdatePilotConfig(const PilotConfig_t *pilot);
+void lapTimerUpdateMinLapTime(uint16_t ms);
+const PilotLapData_t *lapTimerPilotLapData(int pilot);
+
+#endif
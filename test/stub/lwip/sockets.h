@@ -0,0 +1,14 @@
+//
+// Host stand-in for lwip/sockets.h
+//
+// lwIP follows the BSD socket API, the host's own sockets stand in for it.
+//
+
+#ifndef __sockets_INCLUDED__
+#define __sockets_INCLUDED__
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#endif
@@ -0,0 +1,55 @@
+//
+// Host stand-in for mongoose
+//
+// The HTTP reply calls the handlers use. Every reply lands in stubHttp, the
+// chunks appended in order, so a test reads back what a client would see.
+// Built without MG_ENABLE_CALLBACK_USERDATA, as the firmware is.
+//
+
+#ifndef __mongoose_INCLUDED__
+#define __mongoose_INCLUDED__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define STUB_HTTP_SIZE 16384
+
+#define MG_EV_POLL 0
+#define MG_EV_CLOSE 5
+#define MG_UD_ARG(x)
+
+struct mg_connection;
+typedef void (*mg_event_handler_t)(struct mg_connection *nc, int ev, void *ev_data MG_UD_ARG(void *user_data));
+
+struct mg_connection
+{
+  mg_event_handler_t handler;
+  void *user_data;
+};
+
+struct mg_str
+{
+  const char *p;
+  size_t len;
+};
+
+struct http_message
+{
+  struct mg_str uri;
+  struct mg_str query_string;
+  struct mg_str body;
+};
+
+extern char stubHttp[STUB_HTTP_SIZE];
+extern int stubHttpLength;
+extern int stubHttpStatus;
+
+void stubHttpReset();
+
+void mg_send_head(struct mg_connection *nc, int status, int64_t length, const char *headers);
+void mg_printf_http_chunk(struct mg_connection *nc, const char *fmt, ...);
+void mg_send_http_chunk(struct mg_connection *nc, const char *buf, size_t len);
+void mg_send(struct mg_connection *nc, const void *buf, int len);
+int mg_get_http_var(const struct mg_str *buf, const char *name, char *dst, size_t dst_len);
+
+#endif
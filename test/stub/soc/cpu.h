@@ -0,0 +1,17 @@
+//
+// Host stand-in for the Xtensa cpu header
+//
+// RSR(CCOUNT) reads a cycle count from the host clock at 240MHz, so loop
+// timing code builds and counts in the same units.
+//
+
+#ifndef __cpu_INCLUDED__
+#define __cpu_INCLUDED__
+
+#include <stdint.h>
+
+uint32_t cpuCycleCount();
+
+#define RSR(reg, at) ((at) = cpuCycleCount())
+
+#endif
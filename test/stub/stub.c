@@ -0,0 +1,103 @@
+#include <time.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "display_controller.h"
+#include "soc/cpu.h"
+#include "webserver.h"
+
+int64_t esp_timer_get_time()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// From nanoseconds, so a kernel of a few dozen cycles still shows up
+uint32_t cpuCycleCount()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)(((uint64_t)now.tv_sec * 1000000000 + now.tv_nsec) * 240 / 1000);
+}
+
+void displayClear()
+{
+}
+
+void displayDraw(int x, int y, uint8_t color)
+{
+}
+
+void displayUpdate()
+{
+}
+
+void webserverRegister(WebRequestHandler_t *handler)
+{
+}
+
+char stubHttp[STUB_HTTP_SIZE];
+int stubHttpLength;
+int stubHttpStatus;
+
+void stubHttpReset()
+{
+  stubHttp[0] = 0;
+  stubHttpLength = 0;
+  stubHttpStatus = 0;
+}
+
+void mg_send_head(struct mg_connection *nc, int status, int64_t length, const char *headers)
+{
+  stubHttpStatus = status;
+}
+
+void mg_printf_http_chunk(struct mg_connection *nc, const char *fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(stubHttp + stubHttpLength, STUB_HTTP_SIZE - stubHttpLength, fmt, args);
+  va_end(args);
+  stubHttpLength += n < STUB_HTTP_SIZE - stubHttpLength ? n : STUB_HTTP_SIZE - 1 - stubHttpLength;
+}
+
+void mg_send_http_chunk(struct mg_connection *nc, const char *buf, size_t len)
+{
+  if (len > (size_t)(STUB_HTTP_SIZE - 1 - stubHttpLength))
+    len = STUB_HTTP_SIZE - 1 - stubHttpLength;
+  memcpy(stubHttp + stubHttpLength, buf, len);
+  stubHttpLength += len;
+  stubHttp[stubHttpLength] = 0;
+}
+
+void mg_send(struct mg_connection *nc, const void *buf, int len)
+{
+  mg_send_http_chunk(nc, buf, len);
+}
+
+// Value of name in a query string, -1 when it is missing or does not fit
+int mg_get_http_var(const struct mg_str *buf, const char *name, char *dst, size_t dst_len)
+{
+  size_t nameLen = strlen(name);
+  const char *end = buf->p + buf->len;
+
+  for (const char *at = buf->p; at != NULL && at + nameLen < end; at = memchr(at, '&', end - at))
+  {
+    at += *at == '&';
+    if (strncmp(at, name, nameLen) != 0 || at[nameLen] != '=')
+      continue;
+
+    const char *value = at + nameLen + 1;
+    const char *valueEnd = memchr(value, '&', end - value);
+    size_t len = (valueEnd ? valueEnd : end) - value;
+    if (len >= dst_len)
+      return -1;
+    memcpy(dst, value, len);
+    dst[len] = 0;
+    return len;
+  }
+  return -1;
+}
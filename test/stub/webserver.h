@@ -0,0 +1,24 @@
+//
+// Host stand-in for the mu-core webserver
+//
+// Handlers register and are dropped, tests call the callbacks themselves.
+//
+
+#ifndef __webserver_INCLUDED__
+#define __webserver_INCLUDED__
+
+#include "mongoose.h"
+
+#define HTTP_GET 0
+#define HTTP_POST 1
+
+typedef struct
+{
+  const char *path;
+  int request;
+  void (*callback)(struct mg_connection *nc, struct http_message *hm);
+} WebRequestHandler_t;
+
+void webserverRegister(WebRequestHandler_t *handler);
+
+#endif
@@ -0,0 +1,29 @@
+//
+// Host test harness
+//
+// Just enough to check the plain C libraries on a PC: a check macro that
+// counts failures and a main epilogue that turns them into an exit code.
+// Build and run everything with make -C test.
+//
+
+#ifndef __test_INCLUDED__
+#define __test_INCLUDED__
+
+#include <stdio.h>
+
+static int testFailures = 0;
+
+#define CHECK(cond)                                                  \
+  do                                                                 \
+  {                                                                  \
+    if (!(cond))                                                     \
+    {                                                                \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      ++testFailures;                                                \
+    }                                                                \
+  } while (0)
+
+#define TEST_RESULT()                                                      \
+  (printf("%s: %s\n", __FILE__, testFailures ? "FAILED" : "ok"), testFailures != 0)
+
+#endif
@@ -0,0 +1,306 @@
+#include <string.h>
+#include <setjmp.h>
+#include <stdint.h>
+
+#include "test.h"
+#include "chorus_controller.h"
+#include "lap_timer.h"
+#include "task_plan.h"
+#include "freertos/semphr.h"
+#include "driver/uart.h"
+#include "rx_channels.h"
+
+// Replays Chorus sessions against the controller: the race software's lines
+// come in on the UART, the replies and lap reports are read back off it. The
+// lap timer behind it is a config and lap data held here.
+//
+// The tasks run one at a time until they would block. Every state change and
+// every line sent has to happen under the controller's locks, taken state
+// first, so commands from the UDP and the UART task cannot interleave.
+
+#define TASKS 4
+#define LAP_QUEUE 16
+
+// in the order chorusControllerInit creates them
+#define SEND_LOCK 1
+#define STATE_LOCK 2
+
+typedef struct
+{
+  const char *name;
+  TaskFunction_t task;
+} TestTask_t;
+
+static LapTimerConfig_t timer = {
+    .updateHz = 10000,
+    .pilotCount = 2,
+    .minLapTime = 3000,
+    .pilots = {{.id = 0, .band = 0, .channel = 1, .threshold = 800}, {.id = 1, .band = 2, .channel = 5, .threshold = 900}},
+};
+static PilotLapData_t lapData[MAX_RX_COUNT];
+static RssiReading_t readings[MAX_RSSI_CHANNEL_COUNT];
+static int acquired;
+
+static TestTask_t tasks[TASKS];
+static int taskCount;
+static jmp_buf blocked;
+
+static bool held[3];
+static int mutexCount;
+static int lockErrors; // a lock taken twice, out of order or given back unheld
+static int unlocked;   // state touched or a line sent without the locks
+
+static const char *uartIn;
+static char uartOut[512];
+static int uartOutLength;
+
+static LapEvent_t queued[LAP_QUEUE];
+static int queueHead, queueLength;
+
+const LapTimerConfig_t *lapTimerConfigAcquire()
+{
+  ++acquired;
+  return &timer;
+}
+
+void lapTimerConfigRelease(const LapTimerConfig_t *snapshot)
+{
+  --acquired;
+}
+
+void lapTimerUpdatePilotConfig(const PilotConfig_t *pilot)
+{
+  unlocked += !held[STATE_LOCK];
+  timer.pilots[pilot->id] = *pilot;
+}
+
+void lapTimerUpdateMinLapTime(uint16_t ms)
+{
+  unlocked += !held[STATE_LOCK];
+  timer.minLapTime = ms;
+}
+
+const PilotLapData_t *lapTimerPilotLapData(int pilot)
+{
+  unlocked += !held[STATE_LOCK];
+  return &lapData[pilot];
+}
+
+RssiReading_t *rssiReadings()
+{
+  return readings;
+}
+
+int rxGetFrequency(int band, int channel)
+{
+  return channelFreqTable[(channel - 1) + 8 * band];
+}
+
+TaskHandle_t taskPlanCreate(int role, TaskFunction_t task, const char *name, void *arg)
+{
+  tasks[taskCount].name = name;
+  tasks[taskCount].task = task;
+  return (TaskHandle_t)(intptr_t)++taskCount;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+  return (SemaphoreHandle_t)(intptr_t)++mutexCount;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait)
+{
+  int m = (intptr_t)semaphore;
+  lockErrors += held[m] || (m == STATE_LOCK && held[SEND_LOCK]);
+  held[m] = true;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+  int m = (intptr_t)semaphore;
+  lockErrors += !held[m];
+  held[m] = false;
+  return pdTRUE;
+}
+
+QueueHandle_t xQueueCreate(uint32_t length, uint32_t itemSize)
+{
+  return queued;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+  if (queueLength == LAP_QUEUE)
+    return pdFALSE;
+  memcpy(&queued[(queueHead + queueLength++) % LAP_QUEUE], item, sizeof(LapEvent_t));
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait)
+{
+  // an empty queue blocks the lap task, which ends its run
+  if (queueLength == 0)
+    longjmp(blocked, 1);
+  memcpy(item, &queued[queueHead], sizeof(LapEvent_t));
+  queueHead = (queueHead + 1) % LAP_QUEUE;
+  --queueLength;
+  return pdTRUE;
+}
+
+esp_err_t uart_param_config(uart_port_t uart, const uart_config_t *config)
+{
+  return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t uart, int txPin, int rxPin, int rtsPin, int ctsPin)
+{
+  return ESP_OK;
+}
+
+esp_err_t uart_driver_install(uart_port_t uart, int rxSize, int txSize, int queueSize, QueueHandle_t *queue, int flags)
+{
+  return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t uart, uint8_t *buffer, uint32_t length, TickType_t wait)
+{
+  // nothing may stay locked while the task waits for the next byte
+  lockErrors += held[SEND_LOCK] || held[STATE_LOCK];
+  if (*uartIn == 0)
+    longjmp(blocked, 1);
+  *buffer = *uartIn++;
+  return 1;
+}
+
+int uart_write_bytes(uart_port_t uart, const char *data, size_t length)
+{
+  unlocked += !held[SEND_LOCK] || !held[STATE_LOCK];
+  memcpy(uartOut + uartOutLength, data, length);
+  uartOutLength += length;
+  uartOut[uartOutLength] = 0;
+  return length;
+}
+
+// Runs a task until it blocks
+static void runTask(const char *name)
+{
+  for (int t = 0; t < taskCount; ++t)
+  {
+    if (strcmp(tasks[t].name, name) == 0 && setjmp(blocked) == 0)
+      tasks[t].task(NULL);
+  }
+}
+
+// Feeds the race software's lines to the UART task, returns what went back
+static const char *session(const char *lines)
+{
+  uartIn = lines;
+  uartOutLength = 0;
+  uartOut[0] = 0;
+  runTask("chorusUartTask");
+  return uartOut;
+}
+
+static const char *lapReports(const LapEvent_t *events, int count)
+{
+  for (int e = 0; e < count; ++e)
+    chorusControllerLap(&events[e]);
+
+  uartOutLength = 0;
+  uartOut[0] = 0;
+  runTask("chorusLapTask");
+  return uartOut;
+}
+
+static void testEnumerate()
+{
+  // two pilots take nodes 0 and 1 and pass 2 down the chain
+  CHECK(strcmp(session("N0\n"), "N2\n") == 0);
+
+  CHECK(strcmp(session("R*a\n"),
+               "S0B0\nS0C0\nS0F161A\nS0T0320\nS0M03\nS0R0\n"
+               "S1B2\nS1C4\nS1F16B1\nS1T0384\nS1M03\nS1R0\n") == 0);
+
+  CHECK(strcmp(session("R*#\n"), "S0#0004\nS1#0004\n") == 0);
+}
+
+static void testSetters()
+{
+  // each setter answers with the value now in effect
+  CHECK(strcmp(session("R1B3\n"), "S1B3\n") == 0);
+  CHECK(timer.pilots[1].band == 3 && timer.pilots[1].channel == 5);
+
+  CHECK(strcmp(session("R0C7\n"), "S0C7\n") == 0);
+  CHECK(timer.pilots[0].channel == 8);
+
+  // 5800 MHz is F4, a frequency no channel is on changes nothing
+  CHECK(strcmp(session("R0F16A8\n"), "S0F16A8\n") == 0);
+  CHECK(timer.pilots[0].band == 4 && timer.pilots[0].channel == 4);
+  CHECK(strcmp(session("R0F1000\n"), "S0F16A8\n") == 0);
+
+  // out of range band and channel are ignored
+  CHECK(strcmp(session("R1B9\nR1C8\n"), "S1B3\nS1C4\n") == 0);
+
+  CHECK(strcmp(session("R1T0400\n"), "S1T0400\n") == 0);
+  CHECK(timer.pilots[1].threshold == 0x400);
+
+  CHECK(strcmp(session("R*M05\n"), "S0M05\nS1M05\n") == 0);
+  CHECK(timer.minLapTime == 5000);
+
+  readings[1].filtered = 0.5f;
+  CHECK(strcmp(session("R1r\n"), "S1r0BFF\n") == 0);
+
+  // other nodes in the chain and lines that are not commands get no answer
+  CHECK(strcmp(session("R7B1\nhello\nR\n"), "") == 0);
+}
+
+static void testRace()
+{
+  // pilot 0 already has laps, the race counts from the crossing it stands at
+  lapData[0].timesCount = 3;
+  lapData[1].timesCount = 0;
+  CHECK(strcmp(session("R*R1\n"), "S0R1\nS1R1\n") == 0);
+
+  const LapEvent_t laps[] = {
+      {.pilot = 0, .lap = 2, .time = 17000},  // before the race
+      {.pilot = 0, .lap = 3, .time = 18930},
+      {.pilot = 1, .lap = 1, .time = 20000},
+      {.pilot = 9, .lap = 1, .time = 20000},  // no such pilot
+  };
+  CHECK(strcmp(lapReports(laps, 4), "S0L01000049F2\nS1L0100004E20\n") == 0);
+
+  // once the race stops laps are no longer reported
+  CHECK(strcmp(session("R*R0\n"), "S0R0\nS1R0\n") == 0);
+  CHECK(strcmp(lapReports(&laps[2], 1), "") == 0);
+}
+
+static void testRenumber()
+{
+  // a chain rebuilt mid session moves our pilots and their laps to the new ids
+  CHECK(strcmp(session("N4\n"), "N6\n") == 0);
+  CHECK(strcmp(session("R*R1\n"), "S4R1\nS5R1\n") == 0);
+
+  const LapEvent_t lap = {.pilot = 1, .lap = 2, .time = 21000};
+  CHECK(strcmp(lapReports(&lap, 1), "S5L0200005208\n") == 0);
+
+  CHECK(strcmp(session("R0B1\n"), "") == 0);
+  CHECK(strcmp(session("R5B1\n"), "S5B1\n") == 0);
+}
+
+int main()
+{
+  ChorusControllerConfig_t config = {.udpPort = 0, .uart = 1, .uartTxPin = 17, .uartRxPin = 16, .baudRate = 115200};
+  chorusControllerInit(&config);
+  CHECK(taskCount == 2 && mutexCount == 2);
+
+  testEnumerate();
+  testSetters();
+  testRace();
+  testRenumber();
+
+  CHECK(lockErrors == 0);
+  CHECK(unlocked == 0);
+  CHECK(acquired == 0);
+  return TEST_RESULT();
+}
@@ -0,0 +1,92 @@
+#include <string.h>
+
+#include "test.h"
+#include "chorus_proto.h"
+
+static ChorusLineBuffer_t buffer;
+static ChorusCommand_t command;
+
+static int feed(const char *bytes)
+{
+  int lines = 0;
+  for (; *bytes != 0; ++bytes)
+    lines += chorusLineFeed(&buffer, *bytes);
+  return lines;
+}
+
+static void testLineFeed()
+{
+  memset(&buffer, 0, sizeof(buffer));
+
+  CHECK(feed("R1B3") == 0);
+  CHECK(feed("\r\n") == 1);
+  CHECK(strcmp(buffer.line, "R1B3") == 0);
+
+  // blank lines are not commands
+  CHECK(feed("\n\r\n") == 0);
+
+  // an overlong line is dropped whole, the next one comes through
+  char longLine[CHORUS_LINE_MAX + 8];
+  memset(longLine, 'A', sizeof(longLine) - 1);
+  longLine[sizeof(longLine) - 1] = 0;
+  CHECK(feed(longLine) == 0);
+  CHECK(feed("\n") == 0);
+  CHECK(feed("R*a\n") == 1);
+  CHECK(strcmp(buffer.line, "R*a") == 0);
+}
+
+static void testParse()
+{
+  CHECK(chorusParse("R1F16A8", &command));
+  CHECK(command.node == 1 && command.command == CHORUS_FREQUENCY && command.hasValue && command.value == 0x16a8);
+
+  CHECK(chorusParse("R*M05", &command));
+  CHECK(command.node == CHORUS_ALL_NODES && command.command == CHORUS_MIN_LAP && command.value == 5);
+
+  CHECK(chorusParse("RFt0320", &command));
+  CHECK(command.node == 15 && command.command == 't' && command.value == 0x320);
+
+  CHECK(chorusParse("R1r", &command));
+  CHECK(command.node == 1 && command.command == CHORUS_RSSI && !command.hasValue && command.value == 0);
+
+  CHECK(chorusParse("N3", &command));
+  CHECK(command.node == CHORUS_ALL_NODES && command.command == CHORUS_ENUMERATE && command.value == 3);
+
+  // the largest value still fits, the controller clamps what it cannot hold
+  CHECK(chorusParse("R*MFFFFFFFF", &command));
+  CHECK(command.value == 0xffffffff);
+
+  CHECK(!chorusParse("", &command));
+  CHECK(!chorusParse("R", &command));
+  CHECK(!chorusParse("R1", &command));
+  CHECK(!chorusParse("RxB3", &command));
+  CHECK(!chorusParse("R1B3x", &command));
+  CHECK(!chorusParse("S1B3", &command));
+}
+
+static void testFormat()
+{
+  char out[CHORUS_LINE_MAX];
+
+  CHECK(chorusFormat(out, 1, CHORUS_BAND, 3) == 5 && strcmp(out, "S1B3\n") == 0);
+  CHECK(chorusFormat(out, 1, CHORUS_FREQUENCY, 5800) == 8 && strcmp(out, "S1F16A8\n") == 0);
+  CHECK(chorusFormat(out, 0, CHORUS_MIN_LAP, 5) == 6 && strcmp(out, "S0M05\n") == 0);
+  CHECK(chorusFormat(out, 0, CHORUS_VERSION, CHORUS_API_VERSION) == 8 && strcmp(out, "S0#0004\n") == 0);
+  CHECK(chorusFormat(out, 0x1a, CHORUS_RACE, 1) == 5 && strcmp(out, "SAR1\n") == 0);
+
+  CHECK(chorusFormatLap(out, 1, 3, 18930) == 14 && strcmp(out, "S1L03000049F2\n") == 0);
+  CHECK(chorusFormatEnumerate(out, 4) == 3 && strcmp(out, "N4\n") == 0);
+
+  // a formatted reply parses back as a line of the stream
+  memset(&buffer, 0, sizeof(buffer));
+  chorusFormat(out, 2, CHORUS_THRESHOLD, 800);
+  CHECK(feed(out) == 1 && strcmp(buffer.line, "S2T0320") == 0);
+}
+
+int main()
+{
+  testLineFeed();
+  testParse();
+  testFormat();
+  return TEST_RESULT();
+}
@@ -0,0 +1,252 @@
+#include <string.h>
+#include <stdbool.h>
+
+#include "test.h"
+#include "display_renderer.h"
+
+extern const uint8_t font5x7[];
+
+// What the panel shows, kept up to date from the spans the renderer flushes
+static uint8_t panel[RENDER_PAGES][RENDER_WIDTH];
+static uint8_t expected[RENDER_HEIGHT][RENDER_WIDTH];
+static RendererConfig_t config;
+
+static void panelFlushSpan(int page, int x0, int x1, const uint8_t *columns)
+{
+  memcpy(&panel[page][x0], columns, x1 - x0 + 1);
+}
+
+static int panelPixel(int x, int y)
+{
+  return (panel[y >> 3][x] >> (y & 7)) & 1;
+}
+
+// The reference draws one pixel at a time, the slow way the renderer must agree with
+static void expectPixel(int x, int y, int color)
+{
+  if (x >= 0 && x < RENDER_WIDTH && y >= 0 && y < RENDER_HEIGHT)
+    expected[y][x] = color;
+}
+
+static void expectRect(int x, int y, int w, int h, int color)
+{
+  for (int row = y; row < y + h; ++row)
+    for (int col = x; col < x + w; ++col)
+      expectPixel(col, row, color);
+}
+
+static void expectGlyph(int x, int y, const uint8_t *glyph, int width, int color)
+{
+  for (int col = 0; col < width; ++col)
+    for (int b = 0; b < 8; ++b)
+      if ((glyph[col] >> b) & 1)
+        expectPixel(x + col, y + b, color);
+}
+
+// Pixels that differ between the panel and the reference
+static int panelDiff()
+{
+  int diff = 0;
+  for (int y = 0; y < RENDER_HEIGHT; ++y)
+    for (int x = 0; x < RENDER_WIDTH; ++x)
+      diff += panelPixel(x, y) != expected[y][x];
+  return diff;
+}
+
+// Reference bitmap of rows of '#' and '.' at (x, y), everything outside it is expected clear
+static void expectBitmap(int x, int y, const char *rows[], int h)
+{
+  memset(expected, 0, sizeof(expected));
+  for (int row = 0; row < h; ++row)
+    for (int col = 0; rows[row][col] != 0; ++col)
+      expectPixel(x + col, y + row, rows[row][col] == '#');
+}
+
+static void frameBegin()
+{
+  rendererBeginFrame();
+  memset(expected, 0, sizeof(expected));
+}
+
+static void testFillRect()
+{
+  // every width and offset across a word boundary, and heights across page boundaries
+  for (int x = 0; x < 8; ++x)
+  {
+    for (int w = 1; w < 14; ++w)
+    {
+      frameBegin();
+      rendererFillRect(x, 5, w, 12, 1);
+      expectRect(x, 5, w, 12, 1);
+      rendererFillRect(x + 1, 9, w / 2, 3, 0);
+      expectRect(x + 1, 9, w / 2, 3, 0);
+      rendererEndFrame();
+      CHECK(panelDiff() == 0);
+    }
+  }
+
+  // clipped on every edge, the parts off the frame are simply not drawn
+  frameBegin();
+  rendererFillRect(-2, -3, 5, 6, 1);
+  rendererFillRect(125, 60, 10, 10, 1);
+  rendererFillRect(-5, 30, RENDER_WIDTH + 10, 2, 1);
+  rendererFillRect(40, -10, 3, 5, 1);
+  rendererFillRect(200, 10, 5, 5, 1);
+  rendererFillRect(10, 10, 0, 5, 1);
+  rendererFillRect(10, 10, 5, -1, 1);
+  expectRect(0, 0, 3, 3, 1);
+  expectRect(125, 60, 3, 4, 1);
+  expectRect(0, 30, RENDER_WIDTH, 2, 1);
+  rendererEndFrame();
+  CHECK(panelDiff() == 0);
+
+  const char *corner[] = {
+      "###.",
+      "###.",
+      "###.",
+      "....",
+  };
+  expectBitmap(0, 0, corner, 4);
+  expectRect(125, 60, 3, 4, 1);
+  expectRect(0, 30, RENDER_WIDTH, 2, 1);
+  CHECK(panelDiff() == 0);
+
+  // an empty frame clears what the last one drew
+  frameBegin();
+  rendererEndFrame();
+  CHECK(panelDiff() == 0);
+}
+
+static void testBlitGlyph()
+{
+  static const uint8_t box[] = {0x7F, 0x41, 0x41, 0x7F};
+
+  // above the frame: only the glyph's bottom rows land on page 0
+  frameBegin();
+  rendererBlitGlyph(2, -3, box, 4, 1);
+  rendererEndFrame();
+
+  const char *top[] = {
+      "..#..#",
+      "..#..#",
+      "..#..#",
+      "..####",
+      "......",
+  };
+  expectBitmap(0, 0, top, 5);
+  CHECK(panelDiff() == 0);
+
+  // straddling two pages, hanging off the left, the right and the bottom
+  for (int y = -7; y < RENDER_HEIGHT; ++y)
+  {
+    frameBegin();
+    rendererBlitGlyph(-2, y, box, 4, 1);
+    rendererBlitGlyph(RENDER_WIDTH - 2, y, box, 4, 1);
+    rendererBlitGlyph(60, y, box, 4, 1);
+    expectGlyph(-2, y, box, 4, 1);
+    expectGlyph(RENDER_WIDTH - 2, y, box, 4, 1);
+    expectGlyph(60, y, box, 4, 1);
+    rendererEndFrame();
+    CHECK(panelDiff() == 0);
+  }
+
+  // entirely off the frame
+  frameBegin();
+  rendererBlitGlyph(10, -8, box, 4, 1);
+  rendererBlitGlyph(10, RENDER_HEIGHT, box, 4, 1);
+  rendererBlitGlyph(-4, 10, box, 4, 1);
+  rendererEndFrame();
+  CHECK(panelDiff() == 0);
+
+  // color 0 punches the glyph out of a filled area
+  frameBegin();
+  rendererFillRect(0, 0, 8, 16, 1);
+  rendererBlitGlyph(1, 3, box, 4, 0);
+  expectRect(0, 0, 8, 16, 1);
+  expectGlyph(1, 3, box, 4, 0);
+  rendererEndFrame();
+  CHECK(panelDiff() == 0);
+}
+
+static void expectText(int x, int y, const char *text, int color)
+{
+  for (; *text; ++text, x += 6)
+    expectGlyph(x, y, &font5x7[(*text - ' ') * 5], 5, color);
+}
+
+static void testDrawLapTime()
+{
+  // lap number white on a black box one pixel larger than the text, then m:ss.cc
+  frameBegin();
+  int end = rendererDrawLapTime(10, 20, 12, 61234);
+  expectRect(10, 19, 2 * 6 + 1, 9, 1);
+  expectText(11, 20, "12", 0);
+  expectText(10 + 13 + 2, 20, "1:01.23", 1);
+  rendererEndFrame();
+  CHECK(panelDiff() == 0);
+  CHECK(end == 10 + 13 + 2 + 7 * 6);
+
+  // under a minute the minutes go, and the box clips at the top of the frame
+  frameBegin();
+  end = rendererDrawLapTime(0, 0, 3, 9870);
+  expectRect(0, -1, 7, 9, 1);
+  expectText(1, 0, "3", 0);
+  expectText(9, 0, "9.87", 1);
+  rendererEndFrame();
+  CHECK(panelDiff() == 0);
+  CHECK(end == 9 + 4 * 6);
+
+  // the digit 1 in the box, as it should look on the panel
+  const char *one[] = {
+      "#######",
+      "###.###",
+      "##..###",
+      "###.###",
+      "###.###",
+      "###.###",
+      "###.###",
+      "##...##",
+      "#######",
+  };
+  frameBegin();
+  rendererDrawLapTime(0, 1, 1, 0);
+  rendererEndFrame();
+  expectBitmap(0, 0, one, 9);
+  expectText(9, 1, "0.00", 1);
+  CHECK(panelDiff() == 0);
+}
+
+static void testDirtySpans()
+{
+  // a frame that matches the last one flushes nothing
+  frameBegin();
+  rendererFillRect(20, 20, 4, 4, 1);
+  rendererEndFrame();
+  uint32_t unchanged = rendererStats()->unchangedFrames;
+
+  rendererBeginFrame();
+  rendererFillRect(20, 20, 4, 4, 1);
+  rendererEndFrame();
+  CHECK(rendererStats()->unchangedFrames == unchanged + 1);
+  CHECK(rendererStats()->dirtyBytes == 0);
+
+  // one changed column is one dirty byte
+  rendererBeginFrame();
+  rendererFillRect(20, 20, 4, 4, 1);
+  rendererDraw(100, 1, 1);
+  rendererEndFrame();
+  CHECK(rendererStats()->dirtyBytes == 1);
+}
+
+int main()
+{
+  config.flushSpan = panelFlushSpan;
+  config.present = NULL;
+  rendererInit(&config);
+
+  testFillRect();
+  testBlitGlyph();
+  testDrawLapTime();
+  testDirtySpans();
+  return TEST_RESULT();
+}
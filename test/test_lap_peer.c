@@ -0,0 +1,123 @@
+#include <string.h>
+
+#include "test.h"
+#include "lap_peer.h"
+
+// One remote node seen from the aggregator: its clock runs fast by a few
+// ppm from an offset, and restarts from zero when the node reboots.
+
+#define DRIFT 20e-6
+#define DELAY_US 1500
+#define TURNAROUND_US 80
+
+static LapPeer_t peer;
+
+static int64_t bootLocalUs; // our time when the node's clock read startUs
+static int64_t startUs;
+static uint32_t head;
+static uint32_t boot;
+
+static int64_t nodeClock(int64_t localUs)
+{
+  return startUs + (int64_t)((localUs - bootLocalUs) * (1.0 + DRIFT));
+}
+
+static void sync(int64_t nowUs)
+{
+  LapProtoSync_t sync = {.origin = nowUs};
+  sync.receive = nodeClock(nowUs + DELAY_US);
+  sync.transmit = sync.receive + TURNAROUND_US;
+  lapPeerSync(&peer, &sync, nowUs + 2 * DELAY_US + TURNAROUND_US);
+}
+
+static bool heartbeat(int64_t nowUs)
+{
+  LapProtoHeartbeat_t beat = {.head = head, .oldest = 1, .uptime = (nowUs - bootLocalUs) / 1000, .boot = boot};
+  return lapPeerHeartbeat(&peer, &beat, nowUs);
+}
+
+// a lap detected at nowUs, heard DELAY_US later
+static int lap(int64_t nowUs, LapProtoLap_t *out)
+{
+  LapProtoLap_t lap = {.seq = ++head, .lap = head, .time = 20000, .detectedUs = (uint32_t)nodeClock(nowUs)};
+  *out = lap;
+  return lapPeerLap(&peer, &lap, nowUs + DELAY_US);
+}
+
+static void checkMapped(const LapProtoLap_t *lap, int64_t detectedUs)
+{
+  int64_t localUs;
+  uint32_t time;
+  CHECK(lapPeerLocal(&peer, lap, detectedUs + DELAY_US, &localUs, &time));
+
+  int64_t error = localUs > detectedUs ? localUs - detectedUs : detectedUs - localUs;
+  CHECK(error <= peer.clock.errorUs + 2);
+  CHECK(time < 20000 && time > 19990);
+}
+
+static int64_t runSynced(int64_t nowUs, int seconds)
+{
+  for (int s = 0; s < seconds * 10; ++s, nowUs += 100000)
+  {
+    sync(nowUs);
+    if (s % 2 == 0)
+      CHECK(!heartbeat(nowUs));
+  }
+  return nowUs;
+}
+
+static void testReboot()
+{
+  lapPeerInit(&peer, 200);
+  bootLocalUs = 0;
+  startUs = 0;
+  head = 0;
+  boot = 1;
+
+  // hours in, the node clock reads far from ours
+  int64_t now = 3600000000ll;
+  startUs = 600000000ll;
+  CHECK(!heartbeat(now));
+  now = runSynced(now, 2);
+
+  LapProtoLap_t seen;
+  for (int l = 0; l < 20; ++l, now += 1000000)
+  {
+    CHECK(lap(now, &seen) == LAP_RELIABLE_NEW);
+    checkMapped(&seen, now);
+  }
+  now = runSynced(now, 1);
+
+  // down for three seconds, back with the last five laps replayed under seqs 1 to 5
+  now += 3000000;
+  bootLocalUs = now;
+  startUs = 0;
+  head = 5;
+  boot = 6;
+
+  CHECK(heartbeat(now));
+  CHECK(peer.rx.reboots == 1 && !peer.clock.synced);
+
+  // new laps are not duplicates, and are not mapped with the old clock fit
+  CHECK(lap(now + 100000, &seen) == LAP_RELIABLE_NEW);
+  int64_t localUs;
+  uint32_t time;
+  CHECK(!lapPeerLocal(&peer, &seen, now + 100000, &localUs, &time));
+
+  now = runSynced(now + 200000, 2);
+  for (int l = 0; l < 20; ++l, now += 1000000)
+  {
+    CHECK(lap(now, &seen) == LAP_RELIABLE_NEW);
+    checkMapped(&seen, now);
+  }
+
+  CHECK(lap(now, &seen) == LAP_RELIABLE_NEW);
+  CHECK(lapPeerLap(&peer, &seen, now + 5000) == LAP_RELIABLE_DUPLICATE);
+  CHECK(peer.rx.lost == 0 && peer.rx.reboots == 1);
+}
+
+int main()
+{
+  testReboot();
+  return TEST_RESULT();
+}
@@ -0,0 +1,135 @@
+#include <string.h>
+
+#include "test.h"
+#include "lap_proto.h"
+
+static uint8_t buf[LAP_PROTO_MAX_PACKET];
+static LapProtoPacket_t packet;
+
+static void testLap()
+{
+  LapProtoLap_t lap = {.seq = 70000, .pilot = 3, .lap = 12, .time = 41234, .timestamp = 0x89abcdef, .detectedUs = 0xfedcba98};
+  size_t len = lapProtoEncodeLap(buf, sizeof(buf), 5, 0x01020304, &lap);
+
+  CHECK(len == LAP_PROTO_HEADER_SIZE + 20);
+  CHECK(buf[0] == 'L' && buf[1] == 'T' && buf[3] == LAP_PROTO_LAP);
+  // little endian on the wire whatever the host is
+  CHECK(buf[8] == 0x04 && buf[11] == 0x01);
+
+  CHECK(lapProtoDecode(buf, len, &packet) == LAP_PROTO_OK);
+  CHECK(packet.header.node == 5 && packet.header.seq == 0x01020304 && packet.header.flags == 0);
+  CHECK(packet.lap.seq == 70000 && packet.lap.pilot == 3 && packet.lap.lap == 12);
+  CHECK(packet.lap.time == 41234 && packet.lap.timestamp == 0x89abcdef && packet.lap.detectedUs == 0xfedcba98);
+
+  lapProtoSetFlags(buf, LAP_PROTO_FLAG_RETRANSMIT);
+  CHECK(lapProtoDecode(buf, len, &packet) == LAP_PROTO_OK);
+  CHECK(packet.header.flags == LAP_PROTO_FLAG_RETRANSMIT);
+
+  // a sender from before detectedUs
+  buf[6] = 16;
+  CHECK(lapProtoDecode(buf, LAP_PROTO_HEADER_SIZE + 16, &packet) == LAP_PROTO_OK);
+  CHECK(packet.lap.time == 41234 && packet.lap.detectedUs == 0);
+
+  CHECK(lapProtoEncodeLap(buf, len - 1, 5, 1, &lap) == 0);
+}
+
+static void testPilot()
+{
+  LapProtoPilot_t pilot = {.pilot = 7, .band = 4, .channel = 8, .state = 2, .threshold = 2900, .laps = 300, .lastLap = 65432};
+  size_t len = lapProtoEncodePilot(buf, sizeof(buf), 1, 2, &pilot);
+
+  CHECK(lapProtoDecode(buf, len, &packet) == LAP_PROTO_OK);
+  CHECK(packet.header.type == LAP_PROTO_PILOT);
+  CHECK(packet.pilot.pilot == 7 && packet.pilot.band == 4 && packet.pilot.channel == 8 && packet.pilot.state == 2);
+  CHECK(packet.pilot.threshold == 2900 && packet.pilot.laps == 300 && packet.pilot.lastLap == 65432);
+}
+
+static void testRssi()
+{
+  LapProtoRssi_t rssi = {.timestamp = 123456, .count = 3, .decimation = 40};
+  rssi.filtered[0] = lapProtoScaleRssi(0.5f);
+  rssi.filtered[1] = lapProtoScaleRssi(-2.0f);
+  rssi.filtered[2] = lapProtoScaleRssi(1.0f);
+
+  size_t len = lapProtoEncodeRssi(buf, sizeof(buf), 1, 2, &rssi);
+  CHECK(len == LAP_PROTO_HEADER_SIZE + 8 + 3 * 2);
+
+  CHECK(lapProtoDecode(buf, len, &packet) == LAP_PROTO_OK);
+  CHECK(packet.rssi.timestamp == 123456 && packet.rssi.count == 3 && packet.rssi.decimation == 40);
+  CHECK(packet.rssi.filtered[0] == 16383);
+  CHECK(packet.rssi.filtered[1] == -32767);
+  CHECK(lapProtoUnscaleRssi(packet.rssi.filtered[2]) == 1.0f);
+
+  // a count the payload does not carry
+  buf[LAP_PROTO_HEADER_SIZE + 4] = 4;
+  CHECK(lapProtoDecode(buf, len, &packet) == LAP_PROTO_ERR_LENGTH);
+
+  rssi.count = LAP_PROTO_MAX_RSSI + 4;
+  len = lapProtoEncodeRssi(buf, sizeof(buf), 1, 2, &rssi);
+  CHECK(len == LAP_PROTO_HEADER_SIZE + 8 + LAP_PROTO_MAX_RSSI * 2);
+  CHECK(lapProtoDecode(buf, len, &packet) == LAP_PROTO_OK && packet.rssi.count == LAP_PROTO_MAX_RSSI);
+}
+
+static void testControl()
+{
+  LapProtoHeartbeat_t heartbeat = {.head = 100, .oldest = 37, .uptime = 987654, .boot = 21};
+  size_t len = lapProtoEncodeHeartbeat(buf, sizeof(buf), 1, 2, &heartbeat);
+  CHECK(lapProtoDecode(buf, len, &packet) == LAP_PROTO_OK);
+  CHECK(packet.heartbeat.head == 100 && packet.heartbeat.oldest == 37 && packet.heartbeat.uptime == 987654);
+  CHECK(packet.heartbeat.boot == 21);
+
+  // a sender from before boot
+  buf[6] = 12;
+  CHECK(lapProtoDecode(buf, LAP_PROTO_HEADER_SIZE + 12, &packet) == LAP_PROTO_OK);
+  CHECK(packet.heartbeat.uptime == 987654 && packet.heartbeat.boot == 0);
+
+  LapProtoNack_t nack = {.from = 41, .count = 3};
+  len = lapProtoEncodeNack(buf, sizeof(buf), 1, 2, &nack);
+  CHECK(lapProtoDecode(buf, len, &packet) == LAP_PROTO_OK);
+  CHECK(packet.header.type == LAP_PROTO_NACK && packet.nack.from == 41 && packet.nack.count == 3);
+
+  LapProtoSync_t sync = {.origin = 0x0102030405060708ull, .receive = 1ull << 40, .transmit = (1ull << 40) + 17};
+  len = lapProtoEncodeSync(buf, sizeof(buf), LAP_PROTO_SYNC_REPLY, 1, 2, &sync);
+  CHECK(lapProtoDecode(buf, len, &packet) == LAP_PROTO_OK);
+  CHECK(packet.header.type == LAP_PROTO_SYNC_REPLY);
+  CHECK(packet.sync.origin == sync.origin && packet.sync.receive == sync.receive && packet.sync.transmit == sync.transmit);
+}
+
+static void testMalformed()
+{
+  LapProtoHeartbeat_t heartbeat = {.head = 1, .oldest = 1, .uptime = 1};
+  size_t len = lapProtoEncodeHeartbeat(buf, sizeof(buf), 1, 2, &heartbeat);
+
+  CHECK(lapProtoDecode(buf, LAP_PROTO_HEADER_SIZE - 1, &packet) == LAP_PROTO_ERR_SHORT);
+  CHECK(lapProtoDecode(buf, len - 1, &packet) == LAP_PROTO_ERR_SHORT);
+
+  // fields appended by a newer sender are skipped
+  buf[6] += 4;
+  CHECK(lapProtoDecode(buf, len + 4, &packet) == LAP_PROTO_OK);
+  buf[6] -= 4;
+
+  buf[6] = 8;
+  CHECK(lapProtoDecode(buf, len, &packet) == LAP_PROTO_ERR_LENGTH);
+  buf[6] = 16;
+
+  buf[3] = 99;
+  CHECK(lapProtoDecode(buf, len, &packet) == LAP_PROTO_ERR_TYPE);
+  buf[3] = LAP_PROTO_HEARTBEAT;
+
+  buf[2] = LAP_PROTO_VERSION + 1;
+  CHECK(lapProtoDecode(buf, len, &packet) == LAP_PROTO_ERR_VERSION);
+  buf[2] = LAP_PROTO_VERSION;
+
+  buf[1] = 'X';
+  CHECK(lapProtoDecode(buf, len, &packet) == LAP_PROTO_ERR_MAGIC);
+}
+
+int main()
+{
+  testLap();
+  testPilot();
+  testRssi();
+  testControl();
+  testMalformed();
+  return TEST_RESULT();
+}
@@ -0,0 +1,264 @@
+#include <string.h>
+
+#include "test.h"
+#include "lap_proto.h"
+#include "lap_reliable.h"
+
+// A node and a receiver joined by a loopback that loses, duplicates and
+// reorders packets, every packet going through the wire encoding.
+
+#define NODE_LOG 48      // laps the node can replay
+#define LINK_SLOTS 64    // packets in flight
+#define MAX_SEQ 1024
+#define HEARTBEAT_MS 200
+#define NACK_MS 50
+
+typedef struct
+{
+  uint8_t data[LAP_PROTO_MAX_PACKET];
+  size_t len;
+  uint32_t dueMs;
+  bool toNode;
+} LinkPacket_t;
+
+static LinkPacket_t wire[LINK_SLOTS];
+static uint32_t seed = 12345;
+static int lossPercent = 0;
+
+// the node, laps are numbered per boot in lap, seqs restart each boot
+static uint32_t head = 0;
+static uint32_t boot = 1;
+static uint32_t bootMs = 0;
+static uint32_t packetSeq = 0;
+static uint32_t lapOfSeq[MAX_SEQ];
+static uint32_t lapCount = 0;
+
+// the receiver
+static LapReliableRx_t rx;
+static uint8_t delivered[MAX_SEQ * 2]; // by lap
+static uint32_t deliveredCount = 0;
+
+static uint32_t testRandom()
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) & 0x7fff;
+}
+
+static void linkSend(const uint8_t *data, size_t len, uint32_t nowMs, bool toNode)
+{
+  if ((int)(testRandom() % 100) < lossPercent)
+    return;
+
+  // some arrive twice
+  int copies = testRandom() % 10 == 0 ? 2 : 1;
+  for (int c = 0; c < copies; ++c)
+  {
+    for (int s = 0; s < LINK_SLOTS; ++s)
+    {
+      if (wire[s].len == 0)
+      {
+        memcpy(wire[s].data, data, len);
+        wire[s].len = len;
+        wire[s].dueMs = nowMs + 1 + testRandom() % 30; // reorders
+        wire[s].toNode = toNode;
+        break;
+      }
+    }
+  }
+}
+
+static void nodeSendLap(uint32_t seq, uint32_t nowMs, uint8_t flags)
+{
+  uint8_t buf[LAP_PROTO_MAX_PACKET];
+  LapProtoLap_t lap = {.seq = seq, .lap = lapOfSeq[seq] & 0xffff, .timestamp = lapOfSeq[seq]};
+  size_t len = lapProtoEncodeLap(buf, sizeof(buf), 1, ++packetSeq, &lap);
+  lapProtoSetFlags(buf, flags);
+  linkSend(buf, len, nowMs, false);
+}
+
+static uint32_t nodeOldest()
+{
+  return head > NODE_LOG ? head - NODE_LOG + 1 : 1;
+}
+
+static void nodeLap(uint32_t nowMs)
+{
+  lapOfSeq[++head] = ++lapCount;
+  nodeSendLap(head, nowMs, 0);
+}
+
+static void nodeHeartbeat(uint32_t nowMs)
+{
+  uint8_t buf[LAP_PROTO_MAX_PACKET];
+  LapProtoHeartbeat_t heartbeat = {.head = head, .oldest = nodeOldest(), .uptime = nowMs - bootMs, .boot = boot};
+  linkSend(buf, lapProtoEncodeHeartbeat(buf, sizeof(buf), 1, ++packetSeq, &heartbeat), nowMs, false);
+}
+
+// restarts the node, its journal gives back the last replayed laps under new seqs
+static void nodeReboot(uint32_t nowMs, uint32_t replayed)
+{
+  uint32_t from = lapCount - replayed;
+  for (uint32_t l = 0; l < replayed; ++l)
+    lapOfSeq[l + 1] = from + l + 1;
+
+  head = replayed;
+  boot = head + 1;
+  bootMs = nowMs;
+}
+
+static void nodeReceive(const LapProtoPacket_t *packet, uint32_t nowMs)
+{
+  if (packet->header.type != LAP_PROTO_NACK)
+    return;
+
+  for (uint32_t seq = packet->nack.from; seq < packet->nack.from + packet->nack.count && seq <= head; ++seq)
+  {
+    if (seq >= nodeOldest())
+      nodeSendLap(seq, nowMs, LAP_PROTO_FLAG_RETRANSMIT);
+  }
+}
+
+static void receiverReceive(const LapProtoPacket_t *packet, uint32_t nowMs)
+{
+  if (packet->header.type == LAP_PROTO_HEARTBEAT)
+  {
+    const LapProtoHeartbeat_t *heartbeat = &packet->heartbeat;
+    lapReliableOnHeartbeat(&rx, heartbeat->head, heartbeat->oldest, heartbeat->uptime, heartbeat->boot, nowMs);
+  }
+  else if (packet->header.type == LAP_PROTO_LAP && lapReliableOnLap(&rx, packet->lap.seq, nowMs) == LAP_RELIABLE_NEW)
+  {
+    CHECK(packet->lap.timestamp < sizeof(delivered));
+    ++delivered[packet->lap.timestamp];
+    ++deliveredCount;
+  }
+}
+
+static void step(uint32_t nowMs)
+{
+  for (int s = 0; s < LINK_SLOTS; ++s)
+  {
+    if (wire[s].len == 0 || wire[s].dueMs > nowMs)
+      continue;
+
+    LapProtoPacket_t packet;
+    CHECK(lapProtoDecode(wire[s].data, wire[s].len, &packet) == LAP_PROTO_OK);
+    wire[s].len = 0;
+
+    if (wire[s].toNode)
+      nodeReceive(&packet, nowMs);
+    else
+      receiverReceive(&packet, nowMs);
+  }
+
+  if ((nowMs - bootMs) % HEARTBEAT_MS == 0)
+    nodeHeartbeat(nowMs);
+
+  uint32_t from;
+  uint16_t count;
+  if (lapReliableNack(&rx, nowMs, &from, &count))
+  {
+    uint8_t buf[LAP_PROTO_MAX_PACKET];
+    LapProtoNack_t nack = {.from = from, .count = count};
+    linkSend(buf, lapProtoEncodeNack(buf, sizeof(buf), 1, 0, &nack), nowMs, true);
+  }
+}
+
+// laps every lapMs for durationMs, then a quiet second to settle
+static uint32_t run(uint32_t nowMs, uint32_t durationMs, uint32_t lapMs)
+{
+  for (uint32_t end = nowMs + durationMs; nowMs < end; ++nowMs)
+  {
+    if (nowMs % lapMs == 0)
+      nodeLap(nowMs);
+    step(nowMs);
+  }
+
+  for (uint32_t end = nowMs + 1000; nowMs < end; ++nowMs)
+    step(nowMs);
+
+  return nowMs;
+}
+
+static void reset(int loss)
+{
+  memset(wire, 0, sizeof(wire));
+  memset(delivered, 0, sizeof(delivered));
+  deliveredCount = 0;
+  head = lapCount = packetSeq = 0;
+  boot = 1;
+  bootMs = 0;
+  lossPercent = loss;
+  lapReliableInit(&rx, NACK_MS);
+}
+
+static void checkExactlyOnce(uint32_t fromLap)
+{
+  for (uint32_t l = fromLap; l <= lapCount; ++l)
+  {
+    if (delivered[l] != 1)
+      printf("lap %u delivered %u times\n", l, delivered[l]);
+    CHECK(delivered[l] == 1);
+  }
+}
+
+static void testLossy()
+{
+  reset(25);
+
+  // joins on the first heartbeat, laps before it are not owed
+  uint32_t now = 1;
+  step(now);
+  now = run(HEARTBEAT_MS, 20000, 37);
+
+  CHECK(rx.started);
+  checkExactlyOnce(1);
+  CHECK(deliveredCount == lapCount);
+  CHECK(rx.duplicates > 0 && rx.nacks > 0 && rx.lost == 0 && rx.reboots == 0);
+  printf("lossy: %u laps, %u nacks, %u duplicates\n", lapCount, rx.nacks, rx.duplicates);
+}
+
+static void testReboot()
+{
+  reset(25);
+
+  uint32_t now = run(HEARTBEAT_MS, 10000, 41);
+  checkExactlyOnce(1);
+  uint32_t before = lapCount;
+
+  // seqs start over below what the receiver delivered
+  nodeReboot(now, 10);
+  now = run(now, 10000, 43);
+
+  CHECK(rx.reboots == 1);
+  CHECK(lapCount > before + 100);
+  checkExactlyOnce(1);
+  CHECK(deliveredCount == lapCount);
+}
+
+static void testRebootUnseen()
+{
+  // an older sender that does not say where its boot began
+  reset(0);
+
+  uint32_t now = run(HEARTBEAT_MS, 3000, 50);
+  uint32_t before = lapCount;
+
+  // a long session before the restart, replayed seqs run past what was delivered
+  nodeReboot(now, 0);
+  boot = 0;
+  now = run(now + 1, 3000, 50);
+
+  CHECK(rx.reboots == 1);
+  CHECK(rx.lost == 0);
+  // laps between boot and the first heartbeat are lost without boot, the rest arrive once
+  for (uint32_t l = before + HEARTBEAT_MS / 50 + 1; l <= lapCount; ++l)
+    CHECK(delivered[l] == 1);
+}
+
+int main()
+{
+  testLossy();
+  testReboot();
+  testRebootUnseen();
+  return TEST_RESULT();
+}
@@ -0,0 +1,141 @@
+#include <string.h>
+#include <stdio.h>
+
+#include "test.h"
+#include "lap_trace.h"
+#include "mongoose.h"
+
+void latencyCallback(struct mg_connection *nc, struct http_message *hm);
+
+// The simulated clock, moved by hand between stages
+static uint32_t simUs;
+
+static uint32_t simClock()
+{
+  return simUs;
+}
+
+static uint32_t histogramBuckets(const MetricsHistogram_t *histogram)
+{
+  uint32_t count = 0;
+  for (int b = 0; b < METRICS_BUCKETS; ++b)
+    count += histogram->buckets[b];
+  return count;
+}
+
+// Value of one exposition line, -1 when it is missing
+static long long exposed(const char *series)
+{
+  const char *line = strstr(stubHttp, series);
+  long long value = -1;
+  if (line == NULL || sscanf(line + strlen(series), " %lld", &value) != 1)
+    return -1;
+  return value;
+}
+
+// Runs one lap through the pipeline the way the lap timer and the outbox do
+static void tracedLap(uint32_t filterUs, uint32_t detectUs, uint32_t serializeUs, uint32_t sendUs)
+{
+  LapTrace_t trace;
+  trace.us[LAP_STAGE_SAMPLED] = lapTraceNow();
+  simUs += filterUs;
+  trace.us[LAP_STAGE_FILTERED] = lapTraceNow();
+  simUs += detectUs;
+  trace.us[LAP_STAGE_DETECTED] = lapTraceNow();
+  simUs += serializeUs;
+  trace.us[LAP_STAGE_SERIALIZED] = lapTraceNow();
+  lapTraceRecord(&trace, LAP_STAGE_SAMPLED, LAP_STAGE_SERIALIZED);
+
+  simUs += sendUs;
+  lapTraceSent(trace.us[LAP_STAGE_SAMPLED], trace.us[LAP_STAGE_SERIALIZED]);
+}
+
+static void testStages()
+{
+  lapTraceInit();
+  lapTraceSetClock(simClock);
+
+  simUs = 5000;
+  CHECK(lapTraceNow() == 5000);
+
+  tracedLap(100, 900, 40, 3000);
+  tracedLap(120, 1100, 60, 1000);
+
+  // each stage holds the time spent reaching it, the total runs from the sample to the send
+  const MetricsHistogram_t *filtered = lapTraceStage(LAP_STAGE_FILTERED);
+  CHECK(filtered->count == 2 && filtered->sum == 220 && filtered->max == 120);
+  CHECK(lapTraceStage(LAP_STAGE_DETECTED)->sum == 2000);
+  CHECK(lapTraceStage(LAP_STAGE_SERIALIZED)->sum == 100);
+  CHECK(lapTraceStage(LAP_STAGE_SENT)->sum == 4000 && lapTraceStage(LAP_STAGE_SENT)->max == 3000);
+  CHECK(lapTraceTotal()->count == 2 && lapTraceTotal()->sum == 4040 + 2280);
+  CHECK(lapTraceStage(LAP_STAGE_SAMPLED)->count == 0);
+
+  // log2 buckets: 100 and 120 both sit in [64, 128)
+  CHECK(filtered->buckets[6] == 2);
+  CHECK(lapTraceStage(LAP_STAGE_DETECTED)->buckets[9] == 1 && lapTraceStage(LAP_STAGE_DETECTED)->buckets[10] == 1);
+
+  for (int s = LAP_STAGE_FILTERED; s < LAP_STAGE_COUNT; ++s)
+    CHECK(histogramBuckets(lapTraceStage(s)) == lapTraceStage(s)->count);
+
+  // a partial record only touches the stages asked for
+  LapTrace_t partial = {.us = {0, 0, 7000, 7300, 0}};
+  lapTraceRecord(&partial, LAP_STAGE_DETECTED, LAP_STAGE_SERIALIZED);
+  CHECK(lapTraceStage(LAP_STAGE_DETECTED)->count == 2);
+  CHECK(lapTraceStage(LAP_STAGE_SERIALIZED)->count == 3 && lapTraceStage(LAP_STAGE_SERIALIZED)->max == 300);
+}
+
+static void testWrap()
+{
+  lapTraceInit();
+
+  // the microsecond clock wraps every 71 minutes, a lap across it still measures right
+  simUs = 0xffffff00;
+  tracedLap(0x80, 0x100, 0x20, 0x40);
+  CHECK(simUs == 0xe0);
+  CHECK(lapTraceStage(LAP_STAGE_DETECTED)->max == 0x100);
+  CHECK(lapTraceStage(LAP_STAGE_SERIALIZED)->max == 0x20);
+  CHECK(lapTraceTotal()->max == 0x1e0);
+}
+
+static void testExposition()
+{
+  lapTraceInit();
+  simUs = 1000;
+  tracedLap(10, 1500, 30, 200);
+  tracedLap(10, 2500, 30, 200000);
+
+  struct mg_connection nc;
+  stubHttpReset();
+  latencyCallback(&nc, NULL);
+
+  CHECK(stubHttpStatus == 200);
+  CHECK(strstr(stubHttp, "# TYPE laptimer_lap_latency_us histogram\n") == stubHttp);
+
+  // the sample is the reference point and has no series of its own
+  CHECK(strstr(stubHttp, "stage=\"sampled\"") == NULL);
+
+  CHECK(exposed("laptimer_lap_latency_us_count{stage=\"detected\"}") == 2);
+  CHECK(exposed("laptimer_lap_latency_us_sum{stage=\"detected\"}") == 4000);
+  CHECK(exposed("laptimer_lap_latency_us_max{stage=\"sent\"}") == 200000);
+  CHECK(exposed("laptimer_lap_latency_us_sum{stage=\"total\"}") == 1740 + 202540);
+
+  // buckets are cumulative up to +Inf, which matches the count
+  CHECK(exposed("laptimer_lap_latency_us_bucket{stage=\"detected\",le=\"1023\"}") == 0);
+  CHECK(exposed("laptimer_lap_latency_us_bucket{stage=\"detected\",le=\"2047\"}") == 1);
+  CHECK(exposed("laptimer_lap_latency_us_bucket{stage=\"detected\",le=\"4095\"}") == 2);
+  CHECK(exposed("laptimer_lap_latency_us_bucket{stage=\"total\",le=\"+Inf\"}") == 2);
+
+  // every finite bucket is there for every stage, so the series set does not change between scrapes
+  int buckets = 0;
+  for (const char *at = stubHttp; (at = strstr(at, "_bucket{")) != NULL; ++at)
+    ++buckets;
+  CHECK(buckets == LAP_STAGE_COUNT * METRICS_BUCKETS); // four stages and the total
+}
+
+int main()
+{
+  testStages();
+  testWrap();
+  testExposition();
+  return TEST_RESULT();
+}
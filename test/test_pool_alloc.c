@@ -0,0 +1,319 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "test.h"
+#include "pool_alloc.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "cJSON.h"
+
+// Soaks the pools with a seeded mix of allocs, reallocs and frees across
+// every class, the heap fallback and the arena. Each live allocation is
+// filled with its own tag, so a block handed to two owners shows up as a
+// clobbered tag, and the class stats are checked against the live set.
+
+#define SOAK_OPS 400000
+#define SOAK_SLOTS 96
+#define REGIONS (POOL_CLASSES + 1)
+
+typedef struct
+{
+  uint8_t *ptr;
+  size_t size;
+  uint8_t tag;
+} SoakSlot_t;
+
+static PoolAllocConfig_t config = {
+    .blocks = {8, 8, 6, 4, 4, 3, 2},
+    .arenaSize = 1024,
+};
+
+// where init carved out each class and then the arena, in that order
+static uint8_t *regions[REGIONS];
+static size_t regionSizes[REGIONS];
+static int regionCount;
+
+static cJSON_Hooks jsonHooks;
+static TaskHandle_t currentTask = (TaskHandle_t)1;
+static uint32_t seed = 1;
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+  void *ptr = malloc(size);
+  if (regionCount < REGIONS)
+  {
+    regions[regionCount] = ptr;
+    regionSizes[regionCount++] = size;
+  }
+  return ptr;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+  return 0;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+  return 0;
+}
+
+void cJSON_InitHooks(cJSON_Hooks *hooks)
+{
+  jsonHooks = *hooks;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+  return currentTask;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+  return (SemaphoreHandle_t)1;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait)
+{
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+  return pdTRUE;
+}
+
+static uint32_t soakRandom(uint32_t range)
+{
+  seed = seed * 1664525 + 1013904223;
+  return (seed >> 8) % range;
+}
+
+// Class that owns ptr, -1 for heap memory
+static int soakClass(const uint8_t *ptr)
+{
+  for (int c = 0; c < POOL_CLASSES; ++c)
+  {
+    if (ptr >= regions[c] && ptr < regions[c] + regionSizes[c])
+      return c;
+  }
+  return -1;
+}
+
+static void soakFill(SoakSlot_t *slot)
+{
+  memset(slot->ptr, slot->tag, slot->size);
+}
+
+static bool soakIntact(const SoakSlot_t *slot, size_t size)
+{
+  for (size_t i = 0; i < size; ++i)
+  {
+    if (slot->ptr[i] != slot->tag)
+      return false;
+  }
+  return true;
+}
+
+// Mostly small sizes the way cJSON and mongoose ask, now and then one past the largest class
+static size_t soakSize()
+{
+  if (soakRandom(40) == 0)
+    return poolClassSize(POOL_CLASSES - 1) + 1 + soakRandom(1000);
+
+  int c = soakRandom(POOL_CLASSES);
+  size_t low = c ? poolClassSize(c - 1) + 1 : 1;
+  return low + soakRandom(poolClassSize(c) - low + 1);
+}
+
+// Live blocks per class must match the stats, and no block may have two owners
+static int soakCheck(const SoakSlot_t *slots)
+{
+  int wrong = 0;
+  int live[POOL_CLASSES] = {0};
+  PoolStats_t stats;
+  poolAllocStats(&stats);
+
+  for (int s = 0; s < SOAK_SLOTS; ++s)
+  {
+    if (slots[s].ptr == NULL)
+      continue;
+
+    int c = soakClass(slots[s].ptr);
+    if (c < 0)
+      continue;
+
+    ++live[c];
+    wrong += (slots[s].ptr - regions[c]) % poolClassSize(c) != 0;
+    for (int t = s + 1; t < SOAK_SLOTS; ++t)
+      wrong += slots[t].ptr == slots[s].ptr;
+  }
+
+  for (int c = 0; c < POOL_CLASSES; ++c)
+  {
+    wrong += stats.classes[c].inUse != live[c];
+    wrong += stats.classes[c].highWater > stats.classes[c].blocks;
+  }
+  return wrong;
+}
+
+static void testSoak()
+{
+  static SoakSlot_t slots[SOAK_SLOTS];
+  int clobbered = 0;
+  int inconsistent = 0;
+  int unzeroed = 0;
+
+  for (uint32_t op = 0; op < SOAK_OPS; ++op)
+  {
+    SoakSlot_t *slot = &slots[soakRandom(SOAK_SLOTS)];
+
+    if (slot->ptr == NULL)
+    {
+      size_t size = soakSize();
+      bool zeroed = soakRandom(4) == 0;
+      slot->ptr = zeroed ? poolCalloc(1, size) : poolMalloc(size);
+      slot->size = size;
+      slot->tag = 1 + op % 255;
+
+      if (zeroed)
+      {
+        for (size_t i = 0; i < size; ++i)
+          unzeroed += slot->ptr[i] != 0;
+      }
+      soakFill(slot);
+    }
+    else if (soakRandom(2) == 0)
+    {
+      // grow or shrink, the prefix both sizes share has to survive the move
+      size_t size = soakSize();
+      size_t kept = size < slot->size ? size : slot->size;
+      clobbered += !soakIntact(slot, slot->size);
+      slot->ptr = poolRealloc(slot->ptr, size);
+      slot->size = size;
+      clobbered += !soakIntact(slot, kept);
+      soakFill(slot);
+    }
+    else
+    {
+      clobbered += !soakIntact(slot, slot->size);
+      poolFree(slot->ptr);
+      slot->ptr = NULL;
+    }
+
+    if (op % 1000 == 0)
+      inconsistent += soakCheck(slots);
+  }
+
+  for (int s = 0; s < SOAK_SLOTS; ++s)
+  {
+    clobbered += slots[s].ptr != NULL && !soakIntact(&slots[s], slots[s].size);
+    poolFree(slots[s].ptr);
+    slots[s].ptr = NULL;
+  }
+
+  CHECK(clobbered == 0);
+  CHECK(inconsistent == 0);
+  CHECK(unzeroed == 0);
+
+  // everything went back, and the soak ran every class dry more than once
+  PoolStats_t stats;
+  poolAllocStats(&stats);
+  for (int c = 0; c < POOL_CLASSES; ++c)
+  {
+    CHECK(stats.classes[c].inUse == 0);
+    CHECK(stats.classes[c].highWater == config.blocks[c]);
+    CHECK(stats.classes[c].exhausted > 0);
+  }
+  CHECK(stats.oversize > 0 && stats.heapFallbacks > stats.oversize);
+  CHECK(stats.heapFailures == 0);
+}
+
+static void testDrain()
+{
+  // after the soak every free list still holds every block of its class, once
+  PoolStats_t before, after;
+  poolAllocStats(&before);
+
+  for (int c = 0; c < POOL_CLASSES; ++c)
+  {
+    uint8_t *blocks[32];
+    int owned = 0;
+    for (int b = 0; b < config.blocks[c]; ++b)
+    {
+      blocks[b] = poolMalloc(poolClassSize(c));
+      owned += soakClass(blocks[b]) == c;
+    }
+    CHECK(owned == config.blocks[c]);
+
+    for (int b = 0; b < config.blocks[c]; ++b)
+      for (int d = b + 1; d < config.blocks[c]; ++d)
+        CHECK(blocks[b] != blocks[d]);
+
+    // one more finds the class empty and falls back to the heap
+    void *extra = poolMalloc(poolClassSize(c));
+    CHECK(soakClass(extra) == -1);
+    poolFree(extra);
+
+    for (int b = 0; b < config.blocks[c]; ++b)
+      poolFree(blocks[b]);
+  }
+
+  poolAllocStats(&after);
+  for (int c = 0; c < POOL_CLASSES; ++c)
+  {
+    CHECK(after.classes[c].inUse == 0);
+    CHECK(after.classes[c].exhausted == before.classes[c].exhausted + 1);
+  }
+}
+
+static void testArena()
+{
+  uint8_t *arena = regions[POOL_CLASSES];
+  CHECK(regionCount == REGIONS && regionSizes[POOL_CLASSES] == config.arenaSize);
+
+  // inside a request the owner's cJSON blocks come from the arena and frees are ignored
+  poolArenaBegin();
+  uint8_t *a = jsonHooks.malloc_fn(40);
+  uint8_t *b = jsonHooks.malloc_fn(13);
+  uint8_t *c = jsonHooks.malloc_fn(40);
+  CHECK(a == arena && b == arena + 40 && c == arena + 56);
+  jsonHooks.free_fn(b);
+  CHECK(jsonHooks.malloc_fn(8) == arena + 96);
+
+  // another task's cJSON goes to the pools as usual
+  currentTask = (TaskHandle_t)2;
+  uint8_t *other = jsonHooks.malloc_fn(40);
+  CHECK(soakClass(other) == 1);
+  jsonHooks.free_fn(other);
+  currentTask = (TaskHandle_t)1;
+
+  // past the end of the arena the request falls back to the pools
+  uint8_t *big = jsonHooks.malloc_fn(config.arenaSize);
+  CHECK(soakClass(big) == 5);
+  jsonHooks.free_fn(big);
+  poolArenaEnd();
+
+  // the next request starts from the top again
+  poolArenaBegin();
+  CHECK(jsonHooks.malloc_fn(40) == arena);
+  poolArenaEnd();
+
+  PoolStats_t stats;
+  poolAllocStats(&stats);
+  CHECK(stats.arenaHighWater == 104 && stats.arenaOverflows == 1);
+  for (int k = 0; k < POOL_CLASSES; ++k)
+    CHECK(stats.classes[k].inUse == 0);
+}
+
+int main()
+{
+  poolAllocInit(&config);
+  CHECK(regionCount == REGIONS);
+
+  testSoak();
+  testDrain();
+  testArena();
+  return TEST_RESULT();
+}
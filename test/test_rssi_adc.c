@@ -0,0 +1,216 @@
+#include <string.h>
+
+#include "test.h"
+#include "driver/spi_master.h"
+#include "rssi_adc.h"
+
+// A simulated MCP3208 on the bus: it reads the frame clock by clock the way
+// the datasheet draws it and answers with the count held for the channel
+static uint16_t converterCounts[MCP3208_CHANNEL_COUNT];
+static int busHeld;
+static int transactions;
+static int badFrames;
+static int lastChannel;
+
+static int frameBit(const uint8_t *frame, int clock)
+{
+  return (frame[clock >> 3] >> (7 - (clock & 7))) & 1;
+}
+
+static void frameSetBit(uint8_t *frame, int clock, int bit)
+{
+  if (bit)
+    frame[clock >> 3] |= 0x80 >> (clock & 7);
+  else
+    frame[clock >> 3] &= ~(0x80 >> (clock & 7));
+}
+
+esp_err_t spi_device_polling_transmit(spi_device_handle_t device, spi_transaction_t *trans)
+{
+  int clocks = trans->length;
+  ++transactions;
+  if (!busHeld || clocks != MCP3208_FRAME_BYTES * 8)
+  {
+    ++badFrames;
+    return ESP_FAIL;
+  }
+
+  // the output floats high until the null bit
+  memset(trans->rx_data, 0xff, sizeof(trans->rx_data));
+
+  int clock = 0;
+  while (clock < clocks && !frameBit(trans->tx_data, clock))
+    ++clock;
+
+  // start, single ended, D2 D1 D0, a clock to sample, the null bit, then B11..B0
+  if (clock + 1 + 1 + 3 + 1 + 1 + 12 > clocks || !frameBit(trans->tx_data, clock + 1))
+  {
+    ++badFrames;
+    return ESP_FAIL;
+  }
+
+  int channel = 0;
+  for (int b = 0; b < 3; ++b)
+    channel = (channel << 1) | frameBit(trans->tx_data, clock + 2 + b);
+  lastChannel = channel;
+
+  clock += 6;
+  frameSetBit(trans->rx_data, clock++, 0);
+  for (int b = 11; b >= 0; --b)
+    frameSetBit(trans->rx_data, clock++, (converterCounts[channel] >> b) & 1);
+
+  // the last clock of the frame is B0, nothing is left for the LSB first tail
+  if (clock != clocks)
+    ++badFrames;
+  return ESP_OK;
+}
+
+esp_err_t spi_device_acquire_bus(spi_device_handle_t device, TickType_t wait)
+{
+  ++busHeld;
+  return ESP_OK;
+}
+
+void spi_device_release_bus(spi_device_handle_t device)
+{
+  --busHeld;
+}
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t *config, int dma)
+{
+  return ESP_OK;
+}
+
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t *config, spi_device_handle_t *handle)
+{
+  *handle = NULL;
+  return ESP_OK;
+}
+
+esp_err_t adc1_config_width(adc_bits_width_t width)
+{
+  return ESP_OK;
+}
+
+esp_err_t adc1_config_channel_atten(adc1_channel_t channel, adc_atten_t atten)
+{
+  return ESP_OK;
+}
+
+int adc1_get_raw(adc1_channel_t channel)
+{
+  return 0;
+}
+
+static void testFrame()
+{
+  uint8_t tx[MCP3208_FRAME_BYTES];
+  uint8_t rx[MCP3208_FRAME_BYTES + 1];
+
+  // start and single ended bits, then the channel split across the first two bytes
+  for (uint8_t channel = 0; channel < MCP3208_CHANNEL_COUNT; ++channel)
+  {
+    mcp3208Frame(channel, tx);
+    CHECK((tx[0] & 0xf8) == 0 && (tx[0] & 0x06) == 0x06);
+    CHECK((tx[0] & 0x01) == channel >> 2);
+    CHECK(tx[1] >> 6 == (channel & 0x03));
+    CHECK((tx[1] & 0x3f) == 0 && tx[2] == 0);
+
+    spi_transaction_t t = {.length = MCP3208_FRAME_BYTES * 8};
+    memcpy(t.tx_data, tx, sizeof(tx));
+    converterCounts[channel] = 0xa5a ^ channel;
+    ++busHeld;
+    CHECK(spi_device_polling_transmit(NULL, &t) == ESP_OK);
+    --busHeld;
+    CHECK(lastChannel == channel);
+    CHECK(mcp3208Result(t.rx_data) == (0xa5a ^ channel));
+  }
+
+  // the top nibble of the middle byte is the floating output, never part of the count
+  rx[0] = 0xff;
+  rx[1] = 0xf0 | 0x0c;
+  rx[2] = 0x34;
+  CHECK(mcp3208Result(rx) == 0xc34);
+  rx[1] = 0xef;
+  rx[2] = 0xff;
+  CHECK(mcp3208Result(rx) == 0xfff);
+  rx[1] = 0xe0;
+  rx[2] = 0x00;
+  CHECK(mcp3208Result(rx) == 0);
+  CHECK(badFrames == 0);
+}
+
+static void testRead()
+{
+  RssiAdcConfig_t config = {.type = RSSI_ADC_MCP3208, .spiClockSpeed = MCP3208_MAX_CLOCK_HZ};
+  const RssiAdcBackend_t *backend = rssiAdcBackend(RSSI_ADC_MCP3208);
+  const uint8_t channels[] = {7, 0, 3, 4};
+  uint16_t raw[4];
+
+  backend->init(&config, ADC_WIDTH_BIT_12);
+  backend->configure(channels, 4, ADC_ATTEN_DB_11);
+  for (int c = 0; c < MCP3208_CHANNEL_COUNT; ++c)
+    converterCounts[c] = 0x100 * c + 0x0f;
+
+  // every channel lands in its own slot, with the bus held for the whole burst
+  transactions = 0;
+  memset(raw, 0, sizeof(raw));
+  backend->read(channels, 4, 0x0f, raw);
+  CHECK(transactions == 4 && busHeld == 0);
+  for (int c = 0; c < 4; ++c)
+    CHECK(raw[c] == 0x100 * channels[c] + 0x0f);
+
+  // channels out of the mask are not converted and keep their last count
+  transactions = 0;
+  converterCounts[0] = 0xfff;
+  converterCounts[3] = 0x001;
+  raw[1] = raw[2] = 0x555;
+  backend->read(channels, 4, 0x09, raw);
+  CHECK(transactions == 2 && busHeld == 0);
+  CHECK(raw[0] == 0x70f && raw[1] == 0x555 && raw[2] == 0x555 && raw[3] == 0x40f);
+  CHECK(badFrames == 0);
+}
+
+static void testBudget()
+{
+  RssiAdcConfig_t config = {.type = RSSI_ADC_MCP3208, .spiClockSpeed = MCP3208_MAX_CLOCK_HZ};
+  const RssiAdcBackend_t *backend = rssiAdcBackend(RSSI_ADC_MCP3208);
+
+  // 24 clocks at 1.2MHz is 20us, plus the driver time of each transaction
+  CHECK(backend->burstUs(&config, 1) == 20 + MCP3208_TRANSACTION_US);
+  CHECK(backend->burstUs(&config, 8) == 8 * (20 + MCP3208_TRANSACTION_US));
+
+  // half of a 10kHz tick is 50us, one channel fits and two do not
+  CHECK(rssiAdcValid(&config, 1, 10000));
+  CHECK(!rssiAdcValid(&config, 2, 10000));
+
+  // eight channels take 256us, so a 512us tick is the fastest that fits
+  CHECK(rssiAdcValid(&config, 8, 1953));
+  CHECK(!rssiAdcValid(&config, 8, 1954));
+
+  // a slower clock rounds a conversion up to the next microsecond
+  config.spiClockSpeed = 1000000;
+  CHECK(backend->burstUs(&config, 1) == 24 + MCP3208_TRANSACTION_US);
+  config.spiClockSpeed = 700000;
+  CHECK(backend->burstUs(&config, 1) == 35 + MCP3208_TRANSACTION_US);
+
+  // the clock has to be set and within the 3.3V rating
+  config.spiClockSpeed = 0;
+  CHECK(!rssiAdcValid(&config, 1, 100));
+  config.spiClockSpeed = MCP3208_MAX_CLOCK_HZ + 1;
+  CHECK(!rssiAdcValid(&config, 1, 100));
+
+  // the internal ADC sets no budget, an unknown backend is refused
+  RssiAdcConfig_t internal = {.type = RSSI_ADC_INTERNAL};
+  CHECK(rssiAdcValid(&internal, 8, 10000));
+  internal.type = RSSI_ADC_MCP3208 + 1;
+  CHECK(!rssiAdcValid(&internal, 1, 100));
+}
+
+int main()
+{
+  testFrame();
+  testRead();
+  testBudget();
+  return TEST_RESULT();
+}
@@ -0,0 +1,181 @@
+#include <string.h>
+#include <math.h>
+
+#include "test.h"
+#include "rssi_trace.h"
+#include "rssi_signal.h"
+
+// Scores the filter modes against each other on labelled passes. The lap
+// timer dates a pass where the filtered signal crosses the threshold, back
+// dated by the delay the filter reports at that sample, so the label is
+// where the clean antenna signal crosses it. Lag is how late the filtered
+// crossing is, bias what is left of it after back dating.
+
+#define UPDATE_HZ 10000
+#define PASSES 24
+#define PASS_MS 400.0f
+#define THRESHOLD 0.5f // of the way from floor to peak
+
+typedef struct
+{
+  float lagMs;
+  float delayMs;
+  float biasMs;
+  float biasSdMs;
+  int missed;
+} FilterScore_t;
+
+static RssiSignal_t signal;
+
+static RssiReaderConfig_t filterConfig(uint8_t filter)
+{
+  // the shipped settings
+  RssiReaderConfig_t config = {
+      .updateHz = UPDATE_HZ,
+      .channelCount = 1,
+      .lpfCutoffHz = 20,
+      .lpf2CutoffHz = 50,
+      .filter = filter,
+      .firTaps = 200,
+      .euroBeta = 20,
+      .idleDivider = 1,
+  };
+  return config;
+}
+
+static float normalize(float counts)
+{
+  return (counts / 4095.0f - 0.5f) / 0.5f;
+}
+
+static FilterScore_t scoreFilter(uint8_t filter, float widthMs)
+{
+  RssiReaderConfig_t config = filterConfig(filter);
+  RssiTrace_t trace = {.seed = 1, .floor = 1200, .peak = 2000, .widthMs = widthMs, .noise = 300};
+  float threshold = normalize(trace.floor + THRESHOLD * trace.peak);
+
+  // the clean signal crosses where the gaussian reaches THRESHOLD of its peak
+  float labelMs = PASS_MS - widthMs * sqrtf(-2.0f * logf(THRESHOLD));
+
+  FilterScore_t score = {0};
+  float biasSq = 0;
+  int scored = 0;
+
+  for (int pass = 0; pass < PASSES; ++pass)
+  {
+    trace.seed = 1 + pass;
+    rssiSignalInit(&signal);
+    rssiSignalApply(&signal, &config, NULL);
+
+    bool crossed = false;
+    uint16_t raw[1];
+    for (uint32_t tick = 0; tick < 2 * PASS_MS * UPDATE_HZ / 1000 && !crossed; ++tick)
+    {
+      float tMs = tick * 1000.0f / UPDATE_HZ;
+      raw[0] = rssiTraceSample(&trace, tMs, PASS_MS);
+      rssiSignalUpdate(&signal, &config, 1, raw, 0);
+
+      // past the settling of every filter, the floor starts well under the threshold
+      float filtered = signal.filtered[0];
+      if (tMs > 100 && filtered >= threshold)
+      {
+        float lagMs = tMs - labelMs;
+        float delayMs = signal.delayUs[0] / 1000.0f;
+        score.lagMs += lagMs;
+        score.delayMs += delayMs;
+        score.biasMs += lagMs - delayMs;
+        biasSq += (lagMs - delayMs) * (lagMs - delayMs);
+        crossed = true;
+      }
+    }
+
+    scored += crossed;
+    score.missed += !crossed;
+  }
+
+  if (scored)
+  {
+    score.lagMs /= scored;
+    score.delayMs /= scored;
+    score.biasMs /= scored;
+    score.biasSdMs = sqrtf(fmaxf(biasSq / scored - score.biasMs * score.biasMs, 0));
+  }
+
+  return score;
+}
+
+// Standard deviation of the filtered floor with no pass, in normalized units
+static float filterNoise(uint8_t filter)
+{
+  RssiReaderConfig_t config = filterConfig(filter);
+  RssiTrace_t trace = {.seed = 99, .floor = 1200, .peak = 0, .widthMs = 1, .noise = 300};
+  float sum = 0, sq = 0;
+  int count = 0;
+
+  rssiSignalInit(&signal);
+  rssiSignalApply(&signal, &config, NULL);
+
+  uint16_t raw[1];
+  for (uint32_t tick = 0; tick < UPDATE_HZ; ++tick)
+  {
+    raw[0] = rssiTraceSample(&trace, 0, 0);
+    rssiSignalUpdate(&signal, &config, 1, raw, 0);
+    if (tick >= UPDATE_HZ / 10)
+    {
+      sum += signal.filtered[0];
+      sq += signal.filtered[0] * signal.filtered[0];
+      ++count;
+    }
+  }
+
+  float mean = sum / count;
+  return sqrtf(fmaxf(sq / count - mean * mean, 0));
+}
+
+int main()
+{
+  const char *names[] = {"cascade", "one_euro", "fir"};
+  const float widths[] = {15, 40, 100};
+  FilterScore_t scores[3][3];
+  float noise[3];
+
+  // uniform noise of 300 counts peak to peak, normalized
+  float rawNoise = 300 / sqrtf(12) / 2047.5f;
+
+  printf("%-9s %8s %8s %8s %8s %8s %8s\n", "filter", "width_ms", "lag_ms", "delay_ms", "bias_ms", "bias_sd", "noise");
+  for (int f = 0; f < 3; ++f)
+  {
+    noise[f] = filterNoise(f);
+    for (int w = 0; w < 3; ++w)
+    {
+      FilterScore_t *s = &scores[f][w];
+      *s = scoreFilter(f, widths[w]);
+      printf("%-9s %8.0f %8.2f %8.2f %8.2f %8.2f %8.4f\n", names[f], widths[w], s->lagMs, s->delayMs, s->biasMs, s->biasSdMs, noise[f]);
+
+      // every pass is found, and back dating takes out all but a millisecond or so of the lag
+      CHECK(s->missed == 0);
+      CHECK(fabsf(s->biasMs) < 1.5f);
+      CHECK(s->biasSdMs < 1.0f);
+    }
+
+    // each mode keeps the floor well clear of the raw noise
+    CHECK(noise[f] < rawNoise / 5);
+  }
+
+  for (int w = 0; w < 3; ++w)
+  {
+    // the one euro filter opens up on the pass edge, it crosses in well under half the cascade's lag
+    CHECK(scores[RSSI_FILTER_ONE_EURO][w].lagMs < scores[RSSI_FILTER_CASCADE][w].lagMs / 2);
+
+    // the moving average delays every pass the same (taps - 1) / 2 samples
+    CHECK(fabsf(scores[RSSI_FILTER_FIR][w].delayMs - 199 * 0.5f * 1000 / UPDATE_HZ) < 0.01f);
+
+    // the cascade reports the sum of its two stages' delays
+    CHECK(fabsf(scores[RSSI_FILTER_CASCADE][w].delayMs - scores[RSSI_FILTER_CASCADE][0].delayMs) < 0.01f);
+  }
+
+  // the price of the lower lag is a noisier floor than the cascade's
+  CHECK(noise[RSSI_FILTER_ONE_EURO] > noise[RSSI_FILTER_CASCADE]);
+
+  return TEST_RESULT();
+}
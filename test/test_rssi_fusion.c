@@ -0,0 +1,235 @@
+#include <string.h>
+#include <math.h>
+
+#include "test.h"
+#include "rssi_trace.h"
+#include "rssi_signal.h"
+
+#define UPDATE_HZ 10000
+#define TRACE_MS 2000
+
+static RssiSignal_t signal;
+static RssiReading_t readings[MAX_RSSI_CHANNEL_COUNT];
+
+// Two pilots with two receivers each, channel c feeding reading c / 2
+static RssiReaderConfig_t diversityConfig(uint8_t fusion)
+{
+  RssiReaderConfig_t config = {
+      .updateHz = UPDATE_HZ,
+      .channelCount = 4,
+      .lpfCutoffHz = 20,
+      .lpf2CutoffHz = 50,
+      .filter = RSSI_FILTER_CASCADE,
+      .idleDivider = 1,
+      .outputCount = 2,
+      .fusion = fusion,
+      .outputs = {0, 0, 1, 1},
+      .weights = {1, 1, 1, 1},
+  };
+  return config;
+}
+
+// Replays one tick of the trace through the signal path the way the read task does
+static void replayTick(const RssiReaderConfig_t *config, const uint16_t *raw, uint32_t tick)
+{
+  uint32_t sampleUs = tick * (1000000 / UPDATE_HZ);
+  uint32_t mask = rssiSignalSchedule(&signal, config, 0xffffffff);
+  rssiSignalUpdate(&signal, config, mask, raw, sampleUs);
+  rssiSignalFuse(&signal, config, readings, sampleUs + 20);
+}
+
+static void replayStart(const RssiReaderConfig_t *config)
+{
+  rssiSignalInit(&signal);
+  rssiSignalApply(&signal, config, NULL);
+  memset(readings, 0, sizeof(readings));
+}
+
+static void testMax()
+{
+  RssiReaderConfig_t config = diversityConfig(RSSI_FUSE_MAX);
+  RssiTrace_t traces[4] = {
+      {.seed = 1, .floor = 1200, .peak = 2200, .widthMs = 40, .noise = 300},
+      {.seed = 2, .floor = 1200, .peak = 900, .widthMs = 40, .noise = 300}, // blocked by the pilot's body
+      {.seed = 3, .floor = 1100, .peak = 1500, .widthMs = 60, .noise = 300},
+      {.seed = 4, .floor = 1300, .peak = 2000, .widthMs = 60, .noise = 300},
+  };
+  const float passMs[4] = {500, 500, 1200, 1250};
+
+  replayStart(&config);
+  int wrong = 0;
+  int switches = 0;
+  uint8_t lastSource = 0xff;
+  float peak[2] = {-2, -2};
+  uint32_t peakSource[2] = {0, 0};
+
+  for (uint32_t tick = 0; tick < TRACE_MS * UPDATE_HZ / 1000; ++tick)
+  {
+    uint16_t raw[4];
+    for (int c = 0; c < 4; ++c)
+      raw[c] = rssiTraceSample(&traces[c], tick * 1000.0f / UPDATE_HZ, passMs[c]);
+    replayTick(&config, raw, tick);
+
+    // each reading is the strongest of its own channels and carries that channel's stamps
+    for (int o = 0; o < 2; ++o)
+    {
+      int a = 2 * o, b = 2 * o + 1;
+      int strongest = signal.filtered[b] > signal.filtered[a] ? b : a;
+      wrong += readings[o].filtered != signal.filtered[strongest];
+      wrong += readings[o].source != strongest;
+      wrong += readings[o].raw != signal.raw[strongest];
+      wrong += readings[o].delayUs != signal.delayUs[strongest];
+      wrong += readings[o].sampleUs != tick * (1000000 / UPDATE_HZ);
+
+      if (readings[o].filtered > peak[o])
+      {
+        peak[o] = readings[o].filtered;
+        peakSource[o] = readings[o].source;
+      }
+    }
+
+    switches += lastSource != 0xff && readings[1].source != lastSource;
+    lastSource = readings[1].source;
+  }
+
+  CHECK(wrong == 0);
+  CHECK(readings[0].sampleCount == TRACE_MS * UPDATE_HZ / 1000);
+
+  // the clear antenna carries each pass, the second pilot's floor swaps in between
+  CHECK(peakSource[0] == 0);
+  CHECK(peakSource[1] == 3);
+  CHECK(switches > 0);
+}
+
+static void testWeighted()
+{
+  RssiReaderConfig_t config = diversityConfig(RSSI_FUSE_WEIGHTED);
+  config.weights[0] = 3;
+  config.weights[1] = 1;
+  config.weights[2] = 0;
+  config.weights[3] = 2;
+  RssiTrace_t trace = {.seed = 7, .floor = 1200, .peak = 2000, .widthMs = 50, .noise = 400};
+
+  replayStart(&config);
+  float error = 0;
+  int wrong = 0;
+
+  for (uint32_t tick = 0; tick < TRACE_MS * UPDATE_HZ / 1000; ++tick)
+  {
+    float tMs = tick * 1000.0f / UPDATE_HZ;
+    uint16_t raw[4] = {
+        rssiTraceSample(&trace, tMs, 700),
+        rssiTraceSample(&trace, tMs, 720),
+        rssiTraceSample(&trace, tMs, 1400),
+        rssiTraceSample(&trace, tMs, 1380),
+    };
+    replayTick(&config, raw, tick);
+
+    // a zero weight drops the channel, the heaviest channel names the source
+    float a = (3 * signal.filtered[0] + signal.filtered[1]) / 4;
+    float b = signal.filtered[3];
+    error = fmaxf(error, fabsf(readings[0].filtered - a));
+    error = fmaxf(error, fabsf(readings[1].filtered - b));
+    wrong += readings[0].source != 0 || readings[1].source != 3;
+  }
+
+  CHECK(error < 1e-6f);
+  CHECK(wrong == 0);
+}
+
+static void testSnr()
+{
+  // channel 0 sits on a strong interferer, channel 1 sees the pass below it
+  RssiReaderConfig_t config = diversityConfig(RSSI_FUSE_SNR);
+  config.channelCount = 2;
+  config.outputCount = 1;
+  RssiReaderConfig_t maxConfig = config;
+  maxConfig.fusion = RSSI_FUSE_MAX;
+
+  RssiTrace_t jammed = {.seed = 11, .floor = 2600, .peak = 0, .widthMs = 1, .noise = 200};
+  RssiTrace_t clear = {.seed = 12, .floor = 1200, .peak = 1200, .widthMs = 40, .noise = 200};
+  const float passMs = 1500;
+
+  float peakMs[2] = {0, 0};
+  float peak[2] = {-2, -2};
+  uint8_t peakSource[2] = {0xff, 0xff};
+  RssiReaderConfig_t *configs[2] = {&config, &maxConfig};
+
+  for (int run = 0; run < 2; ++run)
+  {
+    replayStart(configs[run]);
+    jammed.seed = 11;
+    clear.seed = 12;
+
+    for (uint32_t tick = 0; tick < TRACE_MS * UPDATE_HZ / 1000; ++tick)
+    {
+      float tMs = tick * 1000.0f / UPDATE_HZ;
+      uint16_t raw[2] = {rssiTraceSample(&jammed, tMs, 0), rssiTraceSample(&clear, tMs, passMs)};
+      replayTick(configs[run], raw, tick);
+
+      // past the first second both floors have settled, the pass is what stands out
+      if (tMs > 1000 && readings[0].filtered - signal.floor[readings[0].source] > peak[run])
+      {
+        peak[run] = readings[0].filtered - signal.floor[readings[0].source];
+        peakMs[run] = tMs;
+        peakSource[run] = readings[0].source;
+      }
+    }
+  }
+
+  // ranked above its floor the pass comes through, back dated by the filter delay
+  CHECK(peakSource[0] == 1);
+  CHECK(fabsf(peakMs[0] - readings[0].delayUs / 1000.0f - passMs) < 10);
+
+  // ranked by level the interferer hides it
+  CHECK(peakSource[1] == 0);
+}
+
+static void testValid()
+{
+  RssiReaderConfig_t config = diversityConfig(RSSI_FUSE_WEIGHTED);
+  CHECK(rssiSignalValid(&config));
+
+  config.outputs[2] = 2;
+  CHECK(!rssiSignalValid(&config));
+  config.outputs[2] = 1;
+
+  // one weight off still leaves the reading a channel
+  config.weights[1] = 0;
+  CHECK(rssiSignalValid(&config));
+
+  // a reading whose weights are all zero would never rise
+  config.weights[0] = 0;
+  CHECK(!rssiSignalValid(&config));
+
+  // negative weights pull the mean the wrong way, and NaN poisons it
+  config.weights[0] = 2;
+  config.weights[1] = -1;
+  CHECK(!rssiSignalValid(&config));
+  config.weights[1] = NAN;
+  CHECK(!rssiSignalValid(&config));
+  config.weights[1] = INFINITY;
+  CHECK(!rssiSignalValid(&config));
+
+  // weights only matter when they are used
+  config.fusion = RSSI_FUSE_MAX;
+  CHECK(rssiSignalValid(&config));
+  memset(config.weights, 0, sizeof(config.weights));
+  CHECK(rssiSignalValid(&config));
+  config.fusion = RSSI_FUSE_WEIGHTED;
+  CHECK(!rssiSignalValid(&config));
+  config.outputCount = 0;
+  CHECK(rssiSignalValid(&config));
+
+  config.channelCount = MAX_RSSI_CHANNEL_COUNT + 1;
+  CHECK(!rssiSignalValid(&config));
+}
+
+int main()
+{
+  testMax();
+  testWeighted();
+  testSnr();
+  testValid();
+  return TEST_RESULT();
+}
@@ -0,0 +1,154 @@
+#include <string.h>
+#include <math.h>
+
+#include "test.h"
+#include "rssi_trace.h"
+#include "rssi_signal.h"
+
+// Replays the same race with idle channels read every tick and every N
+// ticks, marking pilots hot the way the lap timer does, and compares the
+// pass timestamps and the conversions each run took.
+
+#define UPDATE_HZ 10000
+#define PILOTS 4
+#define RACE_MS 30000
+#define LAP_MS 6000
+#define MAX_PASSES (RACE_MS / LAP_MS + 1)
+
+// as the lap timer has them
+#define THRESHOLD (2600 / 4095.0f)
+#define APPROACH_FRACTION 0.6f
+#define DROP_FRACTION 0.75f
+
+typedef struct
+{
+  int passes[PILOTS];
+  float passUs[PILOTS][MAX_PASSES];
+  uint32_t reads;
+  uint32_t skipped;
+} IdleRun_t;
+
+static RssiSignal_t signal;
+static RssiReading_t readings[MAX_RSSI_CHANNEL_COUNT];
+
+static float passMs(int pilot, int lap)
+{
+  // pilots staggered around the lap so passes rarely overlap
+  return 1000 + lap * LAP_MS + pilot * (LAP_MS / PILOTS) + (lap * 37 % 200);
+}
+
+static void replayRace(uint8_t idleDivider, IdleRun_t *run)
+{
+  RssiReaderConfig_t config = {
+      .updateHz = UPDATE_HZ,
+      .channelCount = PILOTS,
+      .lpfCutoffHz = 20,
+      .lpf2CutoffHz = 50,
+      .filter = RSSI_FILTER_CASCADE,
+      .idleDivider = idleDivider,
+  };
+  RssiTrace_t traces[PILOTS];
+  bool high[PILOTS] = {false};
+  uint32_t hot = 0xffffffff;
+
+  memset(run, 0, sizeof(*run));
+  for (int p = 0; p < PILOTS; ++p)
+    traces[p] = (RssiTrace_t){.seed = 100 + p, .floor = 1200, .peak = 2600, .widthMs = 30 + 10 * p, .noise = 300};
+
+  rssiSignalInit(&signal);
+  rssiSignalApply(&signal, &config, NULL);
+
+  for (uint32_t tick = 0; tick < RACE_MS * (UPDATE_HZ / 1000); ++tick)
+  {
+    float tMs = tick * 1000.0f / UPDATE_HZ;
+    uint32_t tickUs = tick * (1000000 / UPDATE_HZ);
+
+    // every run sees the same trace, a channel that is skipped still draws its sample
+    uint16_t raw[PILOTS];
+    for (int p = 0; p < PILOTS; ++p)
+    {
+      int lap = (int)((tMs - passMs(p, 0) + LAP_MS / 2) / LAP_MS);
+      raw[p] = rssiTraceSample(&traces[p], tMs, passMs(p, lap < 0 ? 0 : lap));
+    }
+
+    uint32_t mask = rssiSignalSchedule(&signal, &config, hot);
+    run->reads += __builtin_popcount(mask);
+    run->skipped += PILOTS - __builtin_popcount(mask);
+    rssiSignalUpdate(&signal, &config, mask, raw, tickUs);
+    rssiSignalFuse(&signal, &config, readings, tickUs);
+
+    // the lap timer's detector: a crossing back dated by the filter delay, rearmed below three quarters
+    hot = 0;
+    for (int p = 0; p < PILOTS; ++p)
+    {
+      float rssi = readings[p].filtered;
+      if (!high[p] && tMs > 500 && rssi >= THRESHOLD)
+      {
+        high[p] = true;
+        if (run->passes[p] < MAX_PASSES)
+          run->passUs[p][run->passes[p]] = (float)tickUs - readings[p].delayUs;
+        ++run->passes[p];
+      }
+      else if (high[p] && rssi < THRESHOLD * DROP_FRACTION)
+      {
+        high[p] = false;
+      }
+
+      if (high[p] || rssi >= THRESHOLD * APPROACH_FRACTION)
+        hot |= 1 << p;
+    }
+  }
+}
+
+int main()
+{
+  static IdleRun_t runs[5];
+  const uint8_t dividers[] = {1, 2, 4, 8, 16};
+  IdleRun_t *full = &runs[0];
+
+  printf("%-8s %8s %8s %8s %8s %8s\n", "divider", "passes", "read_pct", "mean_us", "max_us", "worst_bias");
+  for (int d = 0; d < 5; ++d)
+  {
+    IdleRun_t *run = &runs[d];
+    replayRace(dividers[d], run);
+
+    // every pass lands in both runs, compare it with the full rate one and with the label
+    int passes = 0;
+    int mismatched = 0;
+    float sumUs = 0, maxUs = 0, worstBiasUs = 0;
+    for (int p = 0; p < PILOTS; ++p)
+    {
+      mismatched += run->passes[p] != full->passes[p];
+      for (int i = 0; i < run->passes[p] && i < full->passes[p] && i < MAX_PASSES; ++i)
+      {
+        float diffUs = fabsf(run->passUs[p][i] - full->passUs[p][i]);
+        sumUs += diffUs;
+        maxUs = fmaxf(maxUs, diffUs);
+        ++passes;
+
+        // the detector dates the threshold crossing, the clean trace crosses it ahead of the peak
+        float crossHeight = (THRESHOLD * 0.5f + 0.5f) * 4095 - 1200;
+        float aheadMs = (30 + 10 * p) * sqrtf(-2.0f * logf(crossHeight / 2600));
+        float biasUs = run->passUs[p][i] - (passMs(p, i) - aheadMs) * 1000;
+        worstBiasUs = fmaxf(worstBiasUs, fabsf(biasUs));
+      }
+    }
+
+    float readPct = 100.0f * run->reads / (run->reads + run->skipped);
+    printf("%-8u %8d %8.1f %8.0f %8.0f %8.0f\n", dividers[d], passes, readPct, sumUs / passes, maxUs, worstBiasUs);
+
+    // the same laps are found at every divider, each within a couple of milliseconds of the label
+    CHECK(mismatched == 0);
+    CHECK(passes == PILOTS * RACE_MS / LAP_MS);
+    CHECK(worstBiasUs < 2000);
+
+    // hot pilots run at the full rate, so the crossing moves by well under a millisecond
+    CHECK(sumUs / passes < 500);
+    CHECK(maxUs < 1000);
+
+    // an idle pilot costs a read every divider ticks
+    CHECK(readPct < 100.0f / dividers[d] + 10);
+  }
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,50 @@
+#
+# Compresses the race UI in web/ into data/www/*.gz before each build.
+# `pio run -t uploadfs` then writes data/ to the SPIFFS partition, and
+# web_assets serves the files with Content-Encoding: gzip.
+#
+# SPIFFS object names are limited to 32 characters, including the
+# www/ prefix and .gz suffix.
+#
+
+import gzip
+import os
+
+Import("env")
+
+SPIFFS_NAME_LEN = 32
+
+project_dir = env.subst("$PROJECT_DIR")
+source_dir = os.path.join(project_dir, "web")
+target_dir = os.path.join(project_dir, "data", "www")
+
+
+def compress_assets():
+    if not os.path.isdir(source_dir):
+        return
+
+    for root, _, files in os.walk(source_dir):
+        for name in files:
+            source = os.path.join(root, name)
+            relative = os.path.relpath(source, source_dir).replace(os.sep, "/")
+            target = os.path.join(target_dir, relative + ".gz")
+
+            if len("www/" + relative + ".gz") >= SPIFFS_NAME_LEN:
+                print("compress_assets: name too long for spiffs: %s" % relative)
+                env.Exit(1)
+
+            if os.path.exists(target) and os.path.getmtime(target) >= os.path.getmtime(source):
+                continue
+
+            os.makedirs(os.path.dirname(target), exist_ok=True)
+            with open(source, "rb") as src:
+                data = src.read()
+
+            # mtime=0 keeps the output, and so the device side ETag, stable between builds
+            with open(target, "wb") as dst:
+                dst.write(gzip.compress(data, compresslevel=9, mtime=0))
+
+            print("compress_assets: %s %d -> %d" % (relative, len(data), os.path.getsize(target)))
+
+
+compress_assets()